@@ -71,6 +71,8 @@ extern "C"
 
 	AMALGAM_EXPORT void SetSBFDataStoreEnabled(bool enable_SBF_datastore);
 	AMALGAM_EXPORT bool IsSBFDataStoreEnabled();
+	AMALGAM_EXPORT void SetSBFDataStoreReducedPrecision(bool reduced_precision);
+	AMALGAM_EXPORT bool IsSBFDataStoreReducedPrecision();
 	AMALGAM_EXPORT size_t GetMaxNumThreads();
 	AMALGAM_EXPORT void SetMaxNumThreads(size_t max_num_threads);
 }
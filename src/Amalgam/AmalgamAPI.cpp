@@ -419,6 +419,16 @@ extern "C"
 		return _enable_SBF_datastore;
 	}
 
+	void SetSBFDataStoreReducedPrecision(bool reduced_precision)
+	{
+		_enable_SBF_datastore_reduced_precision = reduced_precision;
+	}
+
+	bool IsSBFDataStoreReducedPrecision()
+	{
+		return _enable_SBF_datastore_reduced_precision;
+	}
+
 	size_t GetMaxNumThreads()
 	{
 	#if defined(MULTITHREAD_SUPPORT) || defined(_OPENMP)
@@ -109,6 +109,7 @@ PLATFORM_MAIN_CONSOLE
 			<< "--debug-minimal: when specified, begins in debugging mode with minimal output while stepping." << std::endl
 			<< "--debug-sources: when specified, prepends all node comments with the source of the node when applicable." << std::endl
 			<< "--nosbfds: disables the sbfds acceleration, which is generally preferred in the heuristics." << std::endl
+			<< "--sbfds-reduced-precision: keeps sbfds number values as floats to reduce memory, computing returned distances from the exact values." << std::endl
 			<< "--trace: uses commands via stdio to act as if it were being called as a library." << std::endl
 			<< "--tracefile [file]: like trace, but pulls the data from the file specified." << std::endl
 			<< "--version: prints the current version." << std::endl;
@@ -172,6 +173,8 @@ PLATFORM_MAIN_CONSOLE
 			debug_sources = true;
 		else if(args[i] == "--nosbfds")
 			_enable_SBF_datastore = false;
+		else if(args[i] == "--sbfds-reduced-precision")
+			_enable_SBF_datastore_reduced_precision = true;
 		else if(args[i] == "--trace")
 			run_trace = true;
 		else if(args[i] == "--tracefile" && i + 1 < args.size())
@@ -276,7 +279,7 @@ PLATFORM_MAIN_CONSOLE
 		// the entity should have one reference left, which is the entity's code itself
 		if(entity->evaluableNodeManager.GetNumberOfNodesReferenced() > 1)
 		{
-			auto &temp_used_nodes = entity->evaluableNodeManager.GetNodesReferenced();
+			auto temp_used_nodes = entity->evaluableNodeManager.GetNodesReferenced();
 			std::cerr << "Error: memory leak." << std::endl;
 
 			if(Platform_IsDebuggerPresent())
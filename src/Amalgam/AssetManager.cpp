@@ -1,6 +1,7 @@
 //project headers:
 #include "BinaryPacking.h"
 #include "AssetManager.h"
+#include "EntityQueryManager.h"
 #include "EvaluableNode.h"
 #include "FilenameEscapeProcessor.h"
 #include "FileSupportCSV.h"
@@ -243,6 +244,8 @@ Entity *AssetManager::LoadEntityFromResourcePath(std::string &resource_path, std
 	//load contained entities
 	if(load_contained_entities)
 	{
+		std::string query_caches_filename = resource_base_path + "." + FILE_EXTENSION_AMLG_QUERY_CACHES;
+
 		//iterate over all files in directory
 		resource_base_path.append("/");
 		std::vector<std::string> file_names;
@@ -267,6 +270,12 @@ Entity *AssetManager::LoadEntityFromResourcePath(std::string &resource_path, std
 
 			new_entity->AddContainedEntity(contained_entity, entity_name);
 		}
+
+		//if a snapshot of the query caches was stored, use it to build them faster
+		BinaryData query_caches_snapshot;
+		if(new_entity->GetContainedEntities().size() > 0 && std::filesystem::exists(query_caches_filename)
+				&& LoadFileToBuffer<BinaryData>(query_caches_filename, query_caches_snapshot))
+			EntityQueryManager::ReadQueryCachesSnapshot(new_entity, query_caches_snapshot);
 	}
 
 	return new_entity;
@@ -293,6 +302,18 @@ bool AssetManager::StoreEntityToResourcePath(Entity *entity, std::string &resour
 	//don't reescape the path here, since it has already been done
 	StoreResourcePath(&en_assoc, metadata_filename, metadata_base_path, metadata_extension, &entity->evaluableNodeManager, false, sort_keys);
 
+	//store a snapshot of the query caches, removing any previous one that would no longer match
+	if(store_contained_entities)
+	{
+		std::string query_caches_filename = resource_base_path + "." + FILE_EXTENSION_AMLG_QUERY_CACHES;
+		BinaryData query_caches_snapshot;
+		EntityQueryManager::WriteQueryCachesSnapshot(entity, query_caches_snapshot);
+		if(query_caches_snapshot.size() > 0)
+			StoreFileFromBuffer<BinaryData>(query_caches_filename, query_caches_snapshot);
+		else
+			std::filesystem::remove(query_caches_filename);
+	}
+
 	//store contained entities
 	if(store_contained_entities && entity->GetContainedEntities().size() > 0)
 	{
@@ -453,6 +474,7 @@ void AssetManager::DestroyPersistentEntity(Entity *entity)
 			//delete files
 			std::filesystem::remove(total_filepath + "." + defaultEntityExtension);
 			std::filesystem::remove(total_filepath + "." + FILE_EXTENSION_AMLG_METADATA);
+			std::filesystem::remove(total_filepath + "." + FILE_EXTENSION_AMLG_QUERY_CACHES);
 
 			//remove directory and all contents if it exists (command will fail if it doesn't exist)
 			std::filesystem::remove_all(total_filepath);
@@ -10,6 +10,7 @@
 #include <vector>
 
 const std::string FILE_EXTENSION_AMLG_METADATA("mdam");
+const std::string FILE_EXTENSION_AMLG_QUERY_CACHES("qcam");
 const std::string FILE_EXTENSION_AMALGAM("amlg");
 const std::string FILE_EXTENSION_JSON("json");
 const std::string FILE_EXTENSION_YAML("yaml");
@@ -0,0 +1,322 @@
+#pragma once
+
+//project headers:
+#include "InstructionSets.h"
+#include "PlatformSpecific.h"
+
+//system headers:
+#include <cstddef>
+#include <cstdint>
+
+//vectorized kernels for set operations over arrays of 64-bit buckets of bits, as used by BitArrayIntegerSet
+//operations that change buckets also count the bits set in the result as they go, so that
+// the number of elements is known without a separate pass over the buckets
+//the kernels dispatch on the instruction set level detected by InstructionSets
+class BitBucketKernels
+{
+public:
+	//returns the number of bits set in the first num_buckets buckets
+	static inline size_t CountBits(const uint64_t *buckets, size_t num_buckets)
+	{
+		size_t start = 0;
+		size_t count = 0;
+
+	#ifdef INSTRUCTION_SETS_X86_64
+		if(InstructionSets::HasAvx512PopCount())
+			start = CountBitsAvx512(buckets, num_buckets, count);
+		else if(InstructionSets::GetInstructionSetLevel() >= InstructionSets::ISL_AVX2)
+			start = CountBitsAvx2(buckets, num_buckets, count);
+	#endif
+
+		for(size_t i = start; i < num_buckets; i++)
+			count += __popcnt64(buckets[i]);
+
+		return count;
+	}
+
+	//sets dest[i] |= src[i] for the first num_buckets buckets
+	//returns the number of bits set in the resulting buckets
+	static inline size_t UnionAndCount(uint64_t *dest, const uint64_t *src, size_t num_buckets)
+	{
+		return Apply<BO_UNION, true>(dest, src, num_buckets);
+	}
+
+	//sets dest[i] &= src[i] for the first num_buckets buckets
+	//returns the number of bits set in the resulting buckets
+	static inline size_t IntersectAndCount(uint64_t *dest, const uint64_t *src, size_t num_buckets)
+	{
+		return Apply<BO_INTERSECT, true>(dest, src, num_buckets);
+	}
+
+	//sets dest[i] &= ~src[i] for the first num_buckets buckets
+	static inline void Erase(uint64_t *dest, const uint64_t *src, size_t num_buckets)
+	{
+		Apply<BO_ERASE, false>(dest, src, num_buckets);
+	}
+
+	//sets dest[i] = ~src[i] for the first num_buckets buckets, where dest may be the same as src
+	//returns the number of bits set in the resulting buckets
+	static inline size_t NotAndCount(uint64_t *dest, const uint64_t *src, size_t num_buckets)
+	{
+		return Apply<BO_NOT, true>(dest, src, num_buckets);
+	}
+
+	//returns the index of the first bucket from start_bucket up to but not including end_bucket that has any bits set,
+	// or end_bucket if there are none, skipping over empty 512-bit regions at a time
+	static inline size_t FindNonzeroBucket(const uint64_t *buckets, size_t start_bucket, size_t end_bucket)
+	{
+		size_t bucket = start_bucket;
+
+	#ifdef INSTRUCTION_SETS_X86_64
+		auto level = InstructionSets::GetInstructionSetLevel();
+		if(level == InstructionSets::ISL_AVX512)
+			bucket = SkipEmptyRegionsAvx512(buckets, start_bucket, end_bucket);
+		else if(level == InstructionSets::ISL_AVX2)
+			bucket = SkipEmptyRegionsAvx2(buckets, start_bucket, end_bucket);
+	#endif
+
+		//find the bucket within the region
+		while(bucket < end_bucket && buckets[bucket] == 0)
+			bucket++;
+
+		return bucket;
+	}
+
+protected:
+
+	//operations that combine buckets
+	enum BitOperation
+	{
+		BO_UNION,
+		BO_INTERSECT,
+		BO_ERASE,
+		BO_NOT
+	};
+
+	//number of buckets in a 512-bit region
+	static constexpr size_t numBucketsPerRegion = 8;
+
+	template<BitOperation operation>
+	static constexpr uint64_t ApplyScalar(uint64_t dest, uint64_t src)
+	{
+		if constexpr(operation == BO_UNION)
+			return dest | src;
+		else if constexpr(operation == BO_INTERSECT)
+			return dest & src;
+		else if constexpr(operation == BO_ERASE)
+			return dest & ~src;
+		else
+			return ~src;
+	}
+
+	//applies operation to the first num_buckets buckets, returning the number of bits set in the result if count is true
+	template<BitOperation operation, bool count>
+	static inline size_t Apply(uint64_t *dest, const uint64_t *src, size_t num_buckets)
+	{
+		size_t start = 0;
+		size_t num_bits = 0;
+
+	#ifdef INSTRUCTION_SETS_X86_64
+		if(InstructionSets::HasAvx512PopCount())
+			start = ApplyAvx512<operation, count>(dest, src, num_buckets, num_bits);
+		else if(InstructionSets::GetInstructionSetLevel() >= InstructionSets::ISL_AVX2)
+			start = ApplyAvx2<operation, count>(dest, src, num_buckets, num_bits);
+	#endif
+
+		//compute any remaining that don't fill a vector
+		for(size_t i = start; i < num_buckets; i++)
+		{
+			uint64_t result = ApplyScalar<operation>(dest[i], src[i]);
+			dest[i] = result;
+			if constexpr(count)
+				num_bits += __popcnt64(result);
+		}
+
+		return num_bits;
+	}
+
+#ifdef INSTRUCTION_SETS_X86_64
+	//returns the number of bits set in each 64-bit lane of values
+	//uses a lookup table of the bit counts of each 4-bit value, then sums the bytes of each lane
+	INSTRUCTION_SET_TARGET("avx2")
+	static inline __m256i PopCountLanesAvx2(__m256i values)
+	{
+		const __m256i lookup = _mm256_setr_epi8(
+			0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+			0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+		const __m256i low_mask = _mm256_set1_epi8(0x0F);
+
+		__m256i low_nibbles = _mm256_and_si256(values, low_mask);
+		__m256i high_nibbles = _mm256_and_si256(_mm256_srli_epi16(values, 4), low_mask);
+		__m256i byte_counts = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, low_nibbles),
+			_mm256_shuffle_epi8(lookup, high_nibbles));
+		return _mm256_sad_epu8(byte_counts, _mm256_setzero_si256());
+	}
+
+	//returns the sum of the 64-bit lanes of values
+	INSTRUCTION_SET_TARGET("avx2")
+	static inline size_t SumLanesAvx2(__m256i values)
+	{
+		__m128i sum = _mm_add_epi64(_mm256_castsi256_si128(values), _mm256_extracti128_si256(values, 1));
+		return static_cast<size_t>(_mm_cvtsi128_si64(sum)) + static_cast<size_t>(_mm_extract_epi64(sum, 1));
+	}
+
+	//returns the sum of the 64-bit lanes of values
+	INSTRUCTION_SET_TARGET("avx512f")
+	static inline size_t SumLanesAvx512(__m512i values)
+	{
+		uint64_t lanes[8];
+		_mm512_storeu_si512(lanes, values);
+
+		size_t sum = 0;
+		for(auto lane : lanes)
+			sum += lane;
+		return sum;
+	}
+
+	//AVX2 implementation of CountBits, processes 4 buckets at a time, accumulating into count
+	//returns the number of buckets processed
+	INSTRUCTION_SET_TARGET("avx2")
+	static size_t CountBitsAvx2(const uint64_t *buckets, size_t num_buckets, size_t &count)
+	{
+		__m256i counts = _mm256_setzero_si256();
+
+		size_t i = 0;
+		for(; i + 4 <= num_buckets; i += 4)
+		{
+			__m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(buckets + i));
+			counts = _mm256_add_epi64(counts, PopCountLanesAvx2(values));
+		}
+
+		count += SumLanesAvx2(counts);
+		return i;
+	}
+
+	//AVX-512 implementation of CountBits, processes 8 buckets at a time, accumulating into count
+	//returns the number of buckets processed
+	INSTRUCTION_SET_TARGET("avx512f,avx512vpopcntdq")
+	static size_t CountBitsAvx512(const uint64_t *buckets, size_t num_buckets, size_t &count)
+	{
+		__m512i counts = _mm512_setzero_si512();
+
+		size_t i = 0;
+		for(; i + 8 <= num_buckets; i += 8)
+		{
+			__m512i values = _mm512_loadu_si512(buckets + i);
+			counts = _mm512_add_epi64(counts, _mm512_popcnt_epi64(values));
+		}
+
+		count += SumLanesAvx512(counts);
+		return i;
+	}
+
+	//AVX2 implementation of Apply, processes 4 buckets at a time, accumulating into num_bits if count is true
+	//returns the number of buckets processed
+	template<BitOperation operation, bool count>
+	INSTRUCTION_SET_TARGET("avx2")
+	static size_t ApplyAvx2(uint64_t *dest, const uint64_t *src, size_t num_buckets, size_t &num_bits)
+	{
+		const __m256i all_ones = _mm256_set1_epi64x(-1);
+		__m256i counts = _mm256_setzero_si256();
+
+		size_t i = 0;
+		for(; i + 4 <= num_buckets; i += 4)
+		{
+			__m256i src_values = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+			__m256i result;
+			if constexpr(operation == BO_NOT)
+			{
+				result = _mm256_xor_si256(src_values, all_ones);
+			}
+			else
+			{
+				__m256i dest_values = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dest + i));
+				if constexpr(operation == BO_UNION)
+					result = _mm256_or_si256(dest_values, src_values);
+				else if constexpr(operation == BO_INTERSECT)
+					result = _mm256_and_si256(dest_values, src_values);
+				else
+					result = _mm256_andnot_si256(src_values, dest_values);
+			}
+
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(dest + i), result);
+			if constexpr(count)
+				counts = _mm256_add_epi64(counts, PopCountLanesAvx2(result));
+		}
+
+		if constexpr(count)
+			num_bits += SumLanesAvx2(counts);
+		return i;
+	}
+
+	//AVX-512 implementation of Apply, processes 8 buckets at a time, accumulating into num_bits if count is true
+	//returns the number of buckets processed
+	template<BitOperation operation, bool count>
+	INSTRUCTION_SET_TARGET("avx512f,avx512vpopcntdq")
+	static size_t ApplyAvx512(uint64_t *dest, const uint64_t *src, size_t num_buckets, size_t &num_bits)
+	{
+		const __m512i all_ones = _mm512_set1_epi64(-1);
+		__m512i counts = _mm512_setzero_si512();
+
+		size_t i = 0;
+		for(; i + 8 <= num_buckets; i += 8)
+		{
+			__m512i src_values = _mm512_loadu_si512(src + i);
+			__m512i result;
+			if constexpr(operation == BO_NOT)
+			{
+				result = _mm512_xor_si512(src_values, all_ones);
+			}
+			else
+			{
+				__m512i dest_values = _mm512_loadu_si512(dest + i);
+				if constexpr(operation == BO_UNION)
+					result = _mm512_or_si512(dest_values, src_values);
+				else if constexpr(operation == BO_INTERSECT)
+					result = _mm512_and_si512(dest_values, src_values);
+				else //complement explicitly rather than with _mm512_andnot_si512, which some compilers warn leaves values uninitialized
+					result = _mm512_and_si512(dest_values, _mm512_xor_si512(src_values, all_ones));
+			}
+
+			_mm512_storeu_si512(dest + i, result);
+			if constexpr(count)
+				counts = _mm512_add_epi64(counts, _mm512_popcnt_epi64(result));
+		}
+
+		if constexpr(count)
+			num_bits += SumLanesAvx512(counts);
+		return i;
+	}
+
+	//AVX2 implementation of skipping empty regions for FindNonzeroBucket
+	//returns the first bucket of the first region that may have bits set, or the first bucket that doesn't fill a region
+	INSTRUCTION_SET_TARGET("avx2")
+	static size_t SkipEmptyRegionsAvx2(const uint64_t *buckets, size_t start_bucket, size_t end_bucket)
+	{
+		size_t i = start_bucket;
+		for(; i + numBucketsPerRegion <= end_bucket; i += numBucketsPerRegion)
+		{
+			__m256i values = _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(buckets + i)),
+				_mm256_loadu_si256(reinterpret_cast<const __m256i *>(buckets + i + 4)));
+			if(!_mm256_testz_si256(values, values))
+				break;
+		}
+		return i;
+	}
+
+	//AVX-512 implementation of skipping empty regions for FindNonzeroBucket
+	//returns the first bucket of the first region that may have bits set, or the first bucket that doesn't fill a region
+	INSTRUCTION_SET_TARGET("avx512f")
+	static size_t SkipEmptyRegionsAvx512(const uint64_t *buckets, size_t start_bucket, size_t end_bucket)
+	{
+		size_t i = start_bucket;
+		for(; i + numBucketsPerRegion <= end_bucket; i += numBucketsPerRegion)
+		{
+			__m512i values = _mm512_loadu_si512(buckets + i);
+			if(_mm512_test_epi64_mask(values, values) != 0)
+				break;
+		}
+		return i;
+	}
+#endif
+};
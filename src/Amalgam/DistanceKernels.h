@@ -0,0 +1,117 @@
+#pragma once
+
+//project headers:
+#include "FastMath.h"
+#include "InstructionSets.h"
+
+//system headers:
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+//vectorized kernels for computing distance terms of many values at once
+//the kernels dispatch on the instruction set level detected by InstructionSets
+class DistanceKernels
+{
+public:
+	//for each of the num_indices indices, accumulates into distances[i] the distance term
+	// weight * |target - values[indices[i]]|^p, where p is 2 if p_is_2 is true, 1 otherwise
+	//any value that is NaN instead accumulates unknown_term
+	static inline void AccumulateNumericDistanceTerms(const double *values, const size_t *indices, size_t num_indices,
+		double target, double weight, bool p_is_2, double unknown_term, double *distances)
+	{
+		size_t start = 0;
+
+	#ifdef INSTRUCTION_SETS_X86_64
+		auto level = InstructionSets::GetInstructionSetLevel();
+		if(level == InstructionSets::ISL_AVX512)
+			start = AccumulateNumericDistanceTermsAvx512(values, indices, num_indices, target, weight, p_is_2, unknown_term, distances);
+		else if(level == InstructionSets::ISL_AVX2)
+			start = AccumulateNumericDistanceTermsAvx2(values, indices, num_indices, target, weight, p_is_2, unknown_term, distances);
+	#endif
+
+		//compute any remaining that don't fill a vector
+		for(size_t i = start; i < num_indices; i++)
+		{
+			double value = values[indices[i]];
+			if(FastIsNaN(value))
+			{
+				distances[i] += unknown_term;
+				continue;
+			}
+
+			double diff = std::abs(target - value);
+			if(p_is_2)
+				diff *= diff;
+			distances[i] += diff * weight;
+		}
+	}
+
+protected:
+
+#ifdef INSTRUCTION_SETS_X86_64
+	//AVX2 implementation of AccumulateNumericDistanceTerms, processes 4 values at a time
+	//returns the number of indices processed
+	INSTRUCTION_SET_TARGET("avx2")
+	static size_t AccumulateNumericDistanceTermsAvx2(const double *values, const size_t *indices, size_t num_indices,
+		double target, double weight, bool p_is_2, double unknown_term, double *distances)
+	{
+		const __m256d target_v = _mm256_set1_pd(target);
+		const __m256d weight_v = _mm256_set1_pd(weight);
+		const __m256d unknown_v = _mm256_set1_pd(unknown_term);
+		const __m256d sign_mask = _mm256_set1_pd(-0.0);
+
+		size_t i = 0;
+		for(; i + 4 <= num_indices; i += 4)
+		{
+			__m256i index_v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(indices + i));
+			__m256d value_v = _mm256_i64gather_pd(values, index_v, sizeof(double));
+
+			__m256d diff = _mm256_andnot_pd(sign_mask, _mm256_sub_pd(target_v, value_v));
+			if(p_is_2)
+				diff = _mm256_mul_pd(diff, diff);
+			__m256d term = _mm256_mul_pd(diff, weight_v);
+
+			//replace terms for NaN values with the unknown term
+			__m256d nan_mask = _mm256_cmp_pd(value_v, value_v, _CMP_UNORD_Q);
+			term = _mm256_blendv_pd(term, unknown_v, nan_mask);
+
+			_mm256_storeu_pd(distances + i, _mm256_add_pd(_mm256_loadu_pd(distances + i), term));
+		}
+
+		return i;
+	}
+
+	//AVX-512 implementation of AccumulateNumericDistanceTerms, processes 8 values at a time
+	//returns the number of indices processed
+	INSTRUCTION_SET_TARGET("avx512f")
+	static size_t AccumulateNumericDistanceTermsAvx512(const double *values, const size_t *indices, size_t num_indices,
+		double target, double weight, bool p_is_2, double unknown_term, double *distances)
+	{
+		const __m512d target_v = _mm512_set1_pd(target);
+		const __m512d weight_v = _mm512_set1_pd(weight);
+		const __m512d unknown_v = _mm512_set1_pd(unknown_term);
+
+		size_t i = 0;
+		for(; i + 8 <= num_indices; i += 8)
+		{
+			__m512i index_v = _mm512_loadu_si512(indices + i);
+			//gather with an explicit zeroed source so that no lane is left uninitialized
+			__m512d value_v = _mm512_mask_i64gather_pd(_mm512_setzero_pd(), static_cast<__mmask8>(0xFF), index_v, values, sizeof(double));
+
+			__m512d diff = _mm512_abs_pd(_mm512_sub_pd(target_v, value_v));
+			if(p_is_2)
+				diff = _mm512_mul_pd(diff, diff);
+			__m512d term = _mm512_mul_pd(diff, weight_v);
+
+			//replace terms for NaN values with the unknown term
+			__mmask8 nan_mask = _mm512_cmp_pd_mask(value_v, value_v, _CMP_UNORD_Q);
+			term = _mm512_mask_blend_pd(nan_mask, term, unknown_v);
+
+			_mm512_storeu_pd(distances + i, _mm512_add_pd(_mm512_loadu_pd(distances + i), term));
+		}
+
+		return i;
+	}
+#endif
+};
@@ -68,6 +68,34 @@ public:
 			defaultPrecision = ExactApproxValuePair::APPROX;
 	}
 
+	//returns true if other has the same parameters as this, such that distances computed with either would be the same
+	// only compares the parameters that are specified rather than the terms that are computed from them
+	inline bool HasSameParameters(GeneralizedDistance &other)
+	{
+		//nan is used to denote values that are not specified, so treat nans as equal
+		auto same_value = [](double a, double b) { return a == b || (FastIsNaN(a) && FastIsNaN(b)); };
+
+		if(!same_value(pValue, other.pValue) || highAccuracy != other.highAccuracy
+				|| recomputeAccurateDistances != other.recomputeAccurateDistances
+				|| featureParams.size() != other.featureParams.size())
+			return false;
+
+		for(size_t i = 0; i < featureParams.size(); i++)
+		{
+			auto &fp = featureParams[i];
+			auto &other_fp = other.featureParams[i];
+			if(fp.featureType != other_fp.featureType
+					|| !same_value(fp.weight, other_fp.weight)
+					|| !same_value(fp.typeAttributes.maxCyclicDifference, other_fp.typeAttributes.maxCyclicDifference)
+					|| !same_value(fp.deviation, other_fp.deviation)
+					|| !same_value(fp.unknownToUnknownDifference, other_fp.unknownToUnknownDifference)
+					|| !same_value(fp.knownToUnknownDifference, other_fp.knownToUnknownDifference))
+				return false;
+		}
+
+		return true;
+	}
+
 	//computes and sets unknownToUnknownDistanceTerm and knownToUnknownDistanceTerm based on
 	// unknownToUnknownDifference and knownToUnknownDifference respectively
 	inline void ComputeAndStoreUncertaintyDistanceTerms(size_t index)
@@ -0,0 +1,104 @@
+#pragma once
+
+//system headers:
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64)
+	#define INSTRUCTION_SETS_X86_64
+	#include <immintrin.h>
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+	#endif
+#endif
+
+//allows a single function to be compiled for a specific instruction set regardless of the flags
+// used for the rest of the binary; on MSVC intrinsics are always available so no attribute is needed
+#if defined(__GNUC__) || defined(__clang__)
+	#define INSTRUCTION_SET_TARGET(instruction_set) __attribute__((target(instruction_set)))
+#else
+	#define INSTRUCTION_SET_TARGET(instruction_set)
+#endif
+
+//runtime detection of the vector instruction sets supported by the host
+//the instruction set is detected once, so the same binary can use the widest available
+// vector instructions on each host and fall back to scalar code otherwise
+class InstructionSets
+{
+public:
+	//levels of instruction set support, ordered from least to most capable
+	enum InstructionSetLevel
+	{
+		ISL_SCALAR,
+		ISL_AVX2,
+		ISL_AVX512
+	};
+
+	//returns the most capable instruction set level supported by the host
+	static inline InstructionSetLevel GetInstructionSetLevel()
+	{
+		static const InstructionSetLevel level = DetectInstructionSetLevel();
+		return level;
+	}
+
+	//returns true if the host supports AVX-512 population counts of 64-bit lanes, which
+	// not all hosts at ISL_AVX512 do
+	static inline bool HasAvx512PopCount()
+	{
+		static const bool has_avx512_popcount = DetectAvx512PopCount();
+		return has_avx512_popcount;
+	}
+
+protected:
+
+	static inline InstructionSetLevel DetectInstructionSetLevel()
+	{
+	#ifdef INSTRUCTION_SETS_X86_64
+		#if defined(__GNUC__) || defined(__clang__)
+			__builtin_cpu_init();
+			if(__builtin_cpu_supports("avx512f"))
+				return ISL_AVX512;
+			if(__builtin_cpu_supports("avx2"))
+				return ISL_AVX2;
+		#elif defined(_MSC_VER)
+			int cpu_info[4];
+			__cpuid(cpu_info, 1);
+			//make sure the OS saves the extended registers before checking features
+			bool os_uses_xsave = (cpu_info[2] & (1 << 27)) != 0;
+			if(!os_uses_xsave)
+				return ISL_SCALAR;
+
+			uint64_t xcr0 = _xgetbv(0);
+			bool os_saves_ymm = (xcr0 & 0x6) == 0x6;
+			bool os_saves_zmm = (xcr0 & 0xE6) == 0xE6;
+
+			__cpuidex(cpu_info, 7, 0);
+			bool has_avx2 = (cpu_info[1] & (1 << 5)) != 0;
+			bool has_avx512f = (cpu_info[1] & (1 << 16)) != 0;
+
+			if(has_avx512f && os_saves_zmm)
+				return ISL_AVX512;
+			if(has_avx2 && os_saves_ymm)
+				return ISL_AVX2;
+		#endif
+	#endif
+		return ISL_SCALAR;
+	}
+
+	static inline bool DetectAvx512PopCount()
+	{
+		if(GetInstructionSetLevel() != ISL_AVX512)
+			return false;
+
+		bool has_avx512_popcount = false;
+	#ifdef INSTRUCTION_SETS_X86_64
+		#if defined(__GNUC__) || defined(__clang__)
+			has_avx512_popcount = __builtin_cpu_supports("avx512vpopcntdq");
+		#elif defined(_MSC_VER)
+			int cpu_info[4];
+			__cpuidex(cpu_info, 7, 0);
+			has_avx512_popcount = (cpu_info[2] & (1 << 14)) != 0;
+		#endif
+	#endif
+		return has_avx512_popcount;
+	}
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 //project headers:
+#include "BitBucketKernels.h"
 #include "FastMath.h"
 #include "PlatformSpecific.h"
 #include "RandomStream.h"
@@ -9,6 +10,7 @@
 #include <algorithm>
 #include <climits>
 #include <cstdint>
+#include <iterator>
 #include <vector>
 
 //container for holding sparse integers that maximizes efficiency of interoperating
@@ -28,6 +30,15 @@ public:
 			insert(element);
 	}
 
+	SortedIntegerSet(const SortedIntegerSet &other)
+		: integers(other.integers)
+	{	}
+
+	//moves the integers from other so containers of SortedIntegerSet can relocate them without copying
+	SortedIntegerSet(SortedIntegerSet &&other) noexcept
+		: integers(std::move(other.integers))
+	{	}
+
 	//defined to keep compatibility with stl containers
 	using value_type = size_t;
 
@@ -39,6 +50,12 @@ public:
 		integers = other.integers;
 	}
 
+	//move assignment operator
+	inline void operator =(SortedIntegerSet &&other) noexcept
+	{
+		integers = std::move(other.integers);
+	}
+
 	//std begin (must be lowercase)
 	__forceinline auto begin()
 	{
@@ -209,6 +226,9 @@ public:
 				++other_iter;
 			}
 		}
+
+		//cut off anything erased at the end
+		integers.resize(dest_index);
 	}
 
 	//removes all elements contained by other, intended for calling in a batch
@@ -398,6 +418,7 @@ public:
 		numElements = other.numElements;
 		curMaxNumIndices = other.curMaxNumIndices;
 		bitBucket = other.bitBucket;
+		InvalidateRankDirectory();
 	}
 
 	//std begin (must be lowercase)
@@ -420,19 +441,25 @@ public:
 		return Iterator(this, bucket, bit);
 	}
 
-	//iterates over all of the integers as efficiently as possible, passing them into func
+	//iterates over all of the integers from from_index up to but not including up_to_index as efficiently as possible,
+	// passing them into func
 	template<typename IntegerFunction>
-	inline void IterateOver(IntegerFunction func, size_t up_to_index = std::numeric_limits<size_t>::max())
+	inline void IterateOver(IntegerFunction func, size_t up_to_index = std::numeric_limits<size_t>::max(), size_t from_index = 0)
 	{
+		size_t num_indices = size();
+		if(num_indices == 0)
+			return;
+
 		size_t end_integer = GetEndInteger();
 		size_t num_buckets = (end_integer + 63) / 64;
-		size_t num_indices = size();
 		size_t end_index = std::min(up_to_index, end_integer);
+		if(from_index >= end_index)
+			return;
 
 		//if dense, loop over, assuming likely to hit
 		if(num_indices / num_buckets > 32)
 		{
-			for(size_t index = 0; index < end_index; index++)
+			for(size_t index = from_index; index < end_index; index++)
 			{
 				if(ContainsWithoutMaximumIndexCheck(index))
 					func(index);
@@ -440,7 +467,9 @@ public:
 		}
 		else //use the iterator, which is more efficient when sparse
 		{
-			auto iter = begin();
+			Iterator iter(this, from_index / numBitsPerBucket, from_index % numBitsPerBucket);
+			if(!ContainsWithoutMaximumIndexCheck(from_index))
+				++iter;
 			size_t index = *iter;
 			while(index < end_index)
 			{
@@ -506,12 +535,17 @@ public:
 		}
 
 		//empty bucket, skip until find non-empty or run out of buckets
-		do
+		bucket++;
+		if(bucket == bitBucket.size())
+			return;
+
+		//check the next bucket before skipping over larger empty regions
+		if(bitBucket[bucket] == 0)
 		{
-			bucket++;
+			bucket = BitBucketKernels::FindNonzeroBucket(bitBucket.data(), bucket + 1, bitBucket.size());
 			if(bucket == bitBucket.size())
 				return;
-		} while(bitBucket[bucket] == 0);
+		}
 
 		//if made it here, then there is nonzero value in bitBucket[bucket]
 		bit = Platform_FindFirstBitSet(bitBucket[bucket]);
@@ -528,44 +562,56 @@ public:
 	}
 
 	//returns the nth id in the set by sorted order
+	//for larger sets, builds rankDirectory on the first call so that subsequent calls take O(log n)
 	size_t GetNthElement(size_t n)
 	{
 		//if asking for something too big, just return last element (size)
-		if(n > numElements)
+		if(n >= numElements)
 			return GetEndInteger();
 
-		//fast forward using poopulation count to find the bucket
-		size_t iteration = 0;
 		size_t bucket = 0;
-		for(; bucket < bitBucket.size(); bucket++)
+		if(bitBucket.size() >= minNumBucketsForRankDirectory)
 		{
-			size_t bucket_count = __popcnt64(bitBucket[bucket]);
-			//look for where the count exceeds n because the bit hasn't been found yet (e.g., bit 0 is found by the first count of 1)
-			if(iteration + bucket_count > n)
-				break;
+			if(rankDirectory.empty())
+				BuildRankDirectory();
 
-			iteration += bucket_count;
+			//descend the Fenwick tree to find the block containing the nth element,
+			// leaving n as the index of the element within the block
+			size_t num_blocks = rankDirectory.size() - 1;
+			size_t step = 1;
+			while(step * 2 <= num_blocks)
+				step *= 2;
+
+			size_t block = 0;
+			for(; step > 0; step /= 2)
+			{
+				if(block + step <= num_blocks && rankDirectory[block + step] <= n)
+				{
+					block += step;
+					n -= rankDirectory[block];
+				}
+			}
+
+			bucket = block * numBucketsPerRankBlock;
 		}
 
-		//start iterating from the bucket where the bit was found
-		// want to enter the loop at least once, even if iteration == n and have increments at the end,
-		// so a for loop doesn't quite work and neither does a do-while, hence the while(true)
-		size_t bit = 0;
-		while(true)
+		//fast forward using population count to find the bucket
+		for(; bucket < bitBucket.size(); bucket++)
 		{
-			//find next bit
-			while((bitBucket[bucket] & (1ULL << bit)) == 0)
-				bit++;
-
-			if(iteration == n)
+			size_t bucket_count = __popcnt64(bitBucket[bucket]);
+			//look for where the count exceeds n because the bit hasn't been found yet (e.g., bit 0 is found by the first count of 1)
+			if(bucket_count > n)
 				break;
 
-			//move on to subsequent iteration and bit
-			iteration++;
-			bit++;
+			n -= bucket_count;
 		}
 
-		return GetIndexFromBucketAndBit(bucket, bit);
+		//clear the n lowest bits set, leaving the nth as the lowest
+		uint64_t bucket_bits = bitBucket[bucket];
+		for(; n > 0; n--)
+			bucket_bits &= bucket_bits - 1;
+
+		return GetIndexFromBucketAndBit(bucket, Platform_FindFirstBitSet(bucket_bits));
 	}
 
 	//does not uniformly get an element, first selects a bucket at random, then selects an element in the bucket at random
@@ -609,6 +655,7 @@ public:
 		bitBucket.clear();
 		curMaxNumIndices = 0;
 		numElements = 0;
+		InvalidateRankDirectory();
 	}
 
 	//returns the number of elements that exist in the hash set
@@ -626,6 +673,7 @@ public:
 		size_t total_num_buckets = GetBucket(num_ids - 1) + 1;
 		bitBucket.resize(total_num_buckets, fill_value ? 0xFFFFFFFFFFFFFFFFULL : 0);
 		curMaxNumIndices = total_num_buckets * numBitsPerBucket;
+		InvalidateRankDirectory();
 	}
 
 	//reserves space such that num_ids ranging from 0..num_ids-1 could then be directly placed into the hash
@@ -720,6 +768,7 @@ public:
 			//set bit to 1
 			bucket |= mask;
 			numElements++;
+			UpdateRankDirectory(GetBucket(id), true);
 		}
 	}
 
@@ -740,6 +789,7 @@ public:
 			return;
 
 		ReserveNumIntegers(sis.GetEndInteger());
+		InvalidateRankDirectory();
 
 		//if there are elements, need to check if overwriting for keeping numElements updated
 		if(numElements > 0)
@@ -806,6 +856,7 @@ public:
 		//set bit to 0
 		bucket &= ~mask;
 		numElements--;
+		UpdateRankDirectory(GetBucket(id), false);
 
 		TrimBack();
 	}
@@ -820,9 +871,8 @@ public:
 
 		size_t max_bucket = GetBucket(max_index - 1);
 
-		//perform intersection
-		for(size_t i = 0; i <= max_bucket; i++)
-			bitBucket[i] &= ~(other.bitBucket[i]);
+		InvalidateRankDirectory();
+		BitBucketKernels::Erase(bitBucket.data(), other.bitBucket.data(), max_bucket + 1);
 
 		TrimBack();
 	}
@@ -831,6 +881,7 @@ public:
 	template <typename Collection>
 	__forceinline void EraseInBatch(Collection &collection)
 	{
+		InvalidateRankDirectory();
 		for(const size_t id : collection)
 		{
 			if(id >= curMaxNumIndices)
@@ -883,6 +934,7 @@ public:
 		//set bit to 0
 		bucket &= ~mask;
 		numElements--;
+		UpdateRankDirectory(GetBucket(id), false);
 
 		TrimBack();
 
@@ -908,6 +960,7 @@ public:
 			//set bit to 0
 			bucket_from &= ~mask_from;
 			numElements--;
+			UpdateRankDirectory(GetBucket(id_from), false);
 		}
 
 		insert(id_to);
@@ -918,10 +971,8 @@ public:
 	// must be called if a Batch operation is used
 	__forceinline void UpdateNumElements()
 	{
-		//update num elements
-		numElements = 0;
-		for(const auto &bucket : bitBucket)
-			numElements += __popcnt64(bucket);
+		numElements = BitBucketKernels::CountBits(bitBucket.data(), bitBucket.size());
+		InvalidateRankDirectory();
 	}
 
 	//trims off trailing empty buckets
@@ -944,12 +995,12 @@ public:
 
 		//make sure it can hold all of the other
 		ReserveNumIntegers(other.curMaxNumIndices);
+		InvalidateRankDirectory();
 
-		//perform union
-		for(size_t i = 0; i < other.bitBucket.size(); i++)
-			bitBucket[i] |= other.bitBucket[i];
-
-		UpdateNumElements();
+		//perform union, counting the elements as it goes
+		size_t num_other_buckets = other.bitBucket.size();
+		numElements = BitBucketKernels::UnionAndCount(bitBucket.data(), other.bitBucket.data(), num_other_buckets);
+		numElements += BitBucketKernels::CountBits(bitBucket.data() + num_other_buckets, bitBucket.size() - num_other_buckets);
 	}
 
 	//Sets this to the BitArrayIntegerSet to the set that contains only elements that it and another jointly contain
@@ -964,17 +1015,17 @@ public:
 
 		size_t this_bucket_end = bitBucket.size();
 		size_t other_bucket_end = other.bitBucket.size();
+		InvalidateRankDirectory();
 
-		//perform intersection on overlap
-		for(size_t i = 0; i < this_bucket_end && i < other_bucket_end; i++)
-			bitBucket[i] &= other.bitBucket[i];
+		//perform intersection on overlap, counting the elements as it goes
+		numElements = BitBucketKernels::IntersectAndCount(bitBucket.data(), other.bitBucket.data(),
+			std::min(this_bucket_end, other_bucket_end));
 
 		//clear buckets after the other
 		for(size_t i = other_bucket_end; i < this_bucket_end; i++)
 			bitBucket[i] = 0;
 
 		TrimBack();
-		UpdateNumElements();
 	}
 
 	//Sets this to the BitArrayIntegerSet to the set that contains only elements that it and sis jointly contain
@@ -1072,22 +1123,20 @@ public:
 
 		resize(up_to_id);
 
-		//flip buckets up to the last bucket
+		//flip buckets up to the last bucket, counting the elements as it goes
 		size_t num_buckets = bitBucket.size();
-		for(size_t i = 0; i < num_buckets; i++)
-			bitBucket[i] = ~bitBucket[i];
+		size_t last_bucket = num_buckets - 1;
+		numElements = BitBucketKernels::NotAndCount(bitBucket.data(), bitBucket.data(), last_bucket);
 
-		//clear any remaining bits in the last bucket
+		//flip the last bucket, clearing any remaining bits
+		uint64_t last_bucket_value = ~bitBucket[last_bucket];
 		size_t up_to_bit = GetBit(up_to_id);
 		if(up_to_bit > 0)
-		{
-			size_t last_bucket_bitmask = (0xFFFFFFFFFFFFFFFFULL >> (numBitsPerBucket - up_to_bit));
-			size_t last_bucket = num_buckets - 1;
-			bitBucket[last_bucket] &= last_bucket_bitmask;
-		}
+			last_bucket_value &= (0xFFFFFFFFFFFFFFFFULL >> (numBitsPerBucket - up_to_bit));
+		bitBucket[last_bucket] = last_bucket_value;
+		numElements += __popcnt64(last_bucket_value);
 
 		TrimBack();
-		UpdateNumElements();
 	}
 
 	//sets elements to the flip of the elements in other up to but not including up_to_id
@@ -1102,15 +1151,15 @@ public:
 
 		resize(up_to_id);
 
-		//flip buckets up to the last other bucket
+		//flip buckets up to the last other bucket, counting the elements as it goes
 		size_t num_other_buckets = other.bitBucket.size();
-		for(size_t i = 0; i < num_other_buckets; i++)
-			bitBucket[i] = ~other.bitBucket[i];
+		numElements = BitBucketKernels::NotAndCount(bitBucket.data(), other.bitBucket.data(), num_other_buckets);
 
 		//fill in any past the other's max
 		size_t num_buckets = bitBucket.size();
 		for(size_t i = num_other_buckets; i < num_buckets; i++)
 			bitBucket[i] = 0xFFFFFFFFFFFFFFFFULL;
+		numElements += numBitsPerBucket * (num_buckets - num_other_buckets);
 
 		//clear any remaining bits in the last bucket
 		size_t up_to_bit = GetBit(up_to_id);
@@ -1118,11 +1167,19 @@ public:
 		{
 			size_t last_bucket_bitmask = (0xFFFFFFFFFFFFFFFFULL >> (numBitsPerBucket - up_to_bit));
 			size_t last_bucket = num_buckets - 1;
+			numElements -= __popcnt64(bitBucket[last_bucket] & ~last_bucket_bitmask);
 			bitBucket[last_bucket] &= last_bucket_bitmask;
 		}
 
 		TrimBack();
-		UpdateNumElements();
+	}
+
+	//returns the buffer of bit buckets, for containers that operate on buckets directly
+	// TrimBack and UpdateNumElements must be called after modifying it
+	inline std::vector<uint64_t> &GetBitBucketVector()
+	{
+		InvalidateRankDirectory();
+		return bitBucket;
 	}
 
 	//bits per bucket given uint64_t
@@ -1147,6 +1204,57 @@ protected:
 		return (bucket * numBitsPerBucket) + bit;
 	}
 
+	//clears rankDirectory so that it is rebuilt the next time it is needed
+	__forceinline void InvalidateRankDirectory()
+	{
+		rankDirectory.clear();
+	}
+
+	//if rankDirectory is built, updates it for a single element inserted into or erased from bucket
+	__forceinline void UpdateRankDirectory(size_t bucket, bool inserted)
+	{
+		if(rankDirectory.empty())
+			return;
+
+		//i & (~i + 1) is the lowest bit set of i, which is the number of blocks the entry covers
+		for(size_t i = bucket / numBucketsPerRankBlock + 1; i < rankDirectory.size(); i += (i & (~i + 1)))
+		{
+			if(inserted)
+				rankDirectory[i]++;
+			else
+				rankDirectory[i]--;
+		}
+	}
+
+	//builds rankDirectory from the current buckets
+	void BuildRankDirectory()
+	{
+		size_t num_buckets = bitBucket.size();
+		size_t num_blocks = (num_buckets + numBucketsPerRankBlock - 1) / numBucketsPerRankBlock;
+		rankDirectory.assign(num_blocks + 1, 0);
+
+		for(size_t block = 0; block < num_blocks; block++)
+		{
+			size_t start_bucket = block * numBucketsPerRankBlock;
+			rankDirectory[block + 1] = BitBucketKernels::CountBits(bitBucket.data() + start_bucket,
+				std::min(numBucketsPerRankBlock, num_buckets - start_bucket));
+		}
+
+		//accumulate each entry into the next entry that covers it, turning the counts into the Fenwick tree
+		for(size_t i = 1; i <= num_blocks; i++)
+		{
+			size_t covering_entry = i + (i & (~i + 1));
+			if(covering_entry <= num_blocks)
+				rankDirectory[covering_entry] += rankDirectory[i];
+		}
+	}
+
+	//number of buckets whose elements are counted together in rankDirectory
+	static constexpr size_t numBucketsPerRankBlock = 8;
+
+	//minimum number of buckets for GetNthElement to use rankDirectory rather than counting from the first bucket
+	static constexpr size_t minNumBucketsForRankDirectory = 64;
+
 	//num elements that exist as inserted in the hash
 	size_t numElements;
 
@@ -1155,197 +1263,1170 @@ protected:
 
 	//buffer of bit buckets
 	std::vector<uint64_t> bitBucket;
+
+	//Fenwick tree over the number of elements in each block of numBucketsPerRankBlock buckets, indexed from 1,
+	// so that both finding the nth element and updating for an insert or erase of one element take O(log n)
+	//empty until GetNthElement builds it; single element inserts and erases keep it updated
+	// and all other modifications clear it
+	//blocks past the end of bitBucket may remain after TrimBack, but they have no elements
+	std::vector<size_t> rankDirectory;
 };
 
-class EfficientIntegerSet
+//container for holding integers in chunks of numIntegersPerChunk consecutive integers, similar to Roaring bitmaps
+// each chunk stores the low bits of its integers as a sorted array when sparse or as a bit array when dense,
+// so that it uses less memory than SortedIntegerSet for large sets and less than BitArrayIntegerSet when
+// there are large ranges without any integers
+class ChunkedIntegerSet
 {
 public:
 	//defined to keep compatibility with stl containers
 	using value_type = size_t;
 
-	EfficientIntegerSet()
-		: isSisContainer(true)
+	ChunkedIntegerSet()
+		: numElements(0)
 	{	}
 
-	//assignment operator, deep copies
-	inline void operator =(const EfficientIntegerSet &other)
-	{
-		isSisContainer = other.isSisContainer;
+	//number of low bits of each integer that are stored within its chunk
+	static constexpr size_t numLowBits = 16;
 
-		if(other.isSisContainer)
-			sisContainer = other.sisContainer;
-		else
-			baisContainer = other.baisContainer;
-	}
+	//number of consecutive integers that share a chunk
+	static constexpr size_t numIntegersPerChunk = (1ULL << numLowBits);
 
-	//assignment operator, deep copies bit buffer
-	inline void operator =(const SortedIntegerSet &other)
-	{
-		baisContainer.clear();
-		isSisContainer = true;
-		sisContainer = other;
-	}
+	//number of BitArrayIntegerSet buckets that cover one chunk
+	static constexpr size_t numBucketsPerChunk = numIntegersPerChunk / BitArrayIntegerSet::numBitsPerBucket;
 
-	//assignment operator, deep copies bit buffer
-	inline void operator =(const BitArrayIntegerSet &other)
-	{
-		sisContainer.clear();
-		isSisContainer = false;
-		baisContainer = other;
-	}
+	//maximum number of elements a chunk stores as a sorted array, beyond which a bit array uses less memory
+	static constexpr size_t maxNumElementsInArrayChunk = numBucketsPerChunk * sizeof(uint64_t) / sizeof(uint16_t);
 
-	//copies the data to other
-	inline void CopyTo(BitArrayIntegerSet &other)
+	//approximate number of bytes each chunk uses in addition to its elements
+	static constexpr size_t numOverheadBytesPerChunk = 64;
+
+	//integers that have the same high bits
+	class Chunk
 	{
-		if(isSisContainer)
+	public:
+		inline Chunk(size_t _key)
+			: key(_key), numElements(0)
+		{	}
+
+		//returns true if the chunk is stored as a bit array
+		__forceinline bool IsBitArray()
 		{
-			other.clear();
-			other.insert(sisContainer);
+			return bits.size() > 0;
 		}
-		else
-			other = baisContainer;
-	}
 
-	struct Iterator
-	{
-		inline Iterator(const Iterator &other)
+		//returns true if the chunk contains low
+		__forceinline bool contains(size_t low)
 		{
-			isSisContainer = other.isSisContainer;
+			if(IsBitArray())
+				return (bits[low / BitArrayIntegerSet::numBitsPerBucket] & (1ULL << (low % BitArrayIntegerSet::numBitsPerBucket))) != 0;
 
-			if(other.isSisContainer)
-				sisIterator = other.sisIterator;
+			return std::binary_search(std::begin(lows), std::end(lows), static_cast<uint16_t>(low));
+		}
+
+		//inserts low, returns true if it was not already in the chunk
+		inline bool insert(size_t low)
+		{
+			if(IsBitArray())
+			{
+				uint64_t &bucket = bits[low / BitArrayIntegerSet::numBitsPerBucket];
+				uint64_t mask = (1ULL << (low % BitArrayIntegerSet::numBitsPerBucket));
+				if(bucket & mask)
+					return false;
+
+				bucket |= mask;
+				numElements++;
+				return true;
+			}
+
+			//fast path for inserting in order
+			if(lows.size() == 0 || lows.back() < low)
+			{
+				lows.push_back(static_cast<uint16_t>(low));
+			}
 			else
-				baisIterator = other.baisIterator;
+			{
+				auto location = std::lower_bound(std::begin(lows), std::end(lows), static_cast<uint16_t>(low));
+				if(*location == low)
+					return false;
+
+				lows.emplace(location, static_cast<uint16_t>(low));
+			}
+
+			numElements++;
+			if(numElements > maxNumElementsInArrayChunk)
+				ConvertToBitArray();
+
+			return true;
 		}
 
-		inline Iterator(SortedIntegerSet::Iterator _iterator)
+		//removes low, returns true if it was in the chunk
+		inline bool erase(size_t low)
 		{
-			sisIterator = _iterator;
-			isSisContainer = true;
+			if(IsBitArray())
+			{
+				uint64_t &bucket = bits[low / BitArrayIntegerSet::numBitsPerBucket];
+				uint64_t mask = (1ULL << (low % BitArrayIntegerSet::numBitsPerBucket));
+				if((bucket & mask) == 0)
+					return false;
+
+				bucket &= ~mask;
+				numElements--;
+
+				//convert back only well below the threshold so it doesn't flip back and forth
+				if(numElements <= maxNumElementsInArrayChunk / 2)
+					ConvertToArray();
+				return true;
+			}
+
+			auto location = std::lower_bound(std::begin(lows), std::end(lows), static_cast<uint16_t>(low));
+			if(location == std::end(lows) || *location != low)
+				return false;
+
+			lows.erase(location);
+			numElements--;
+			return true;
 		}
 
-		inline Iterator(BitArrayIntegerSet::Iterator _iterator)
+		//stores the chunk as a bit array
+		void ConvertToBitArray()
 		{
-			baisIterator = _iterator;
-			isSisContainer = false;
+			bits.assign(numBucketsPerChunk, 0);
+			for(size_t low : lows)
+				bits[low / BitArrayIntegerSet::numBitsPerBucket] |= (1ULL << (low % BitArrayIntegerSet::numBitsPerBucket));
+
+			lows.clear();
+			lows.shrink_to_fit();
 		}
 
-		~Iterator()
-		{	}
+		//stores the chunk as a sorted array
+		void ConvertToArray()
+		{
+			lows.reserve(numElements);
+			for(size_t bucket = 0; bucket < numBucketsPerChunk; bucket++)
+			{
+				uint64_t bucket_bits = bits[bucket];
+				while(bucket_bits != 0)
+				{
+					lows.push_back(static_cast<uint16_t>(bucket * BitArrayIntegerSet::numBitsPerBucket + Platform_FindFirstBitSet(bucket_bits)));
+					//clear lowest bit set
+					bucket_bits &= bucket_bits - 1;
+				}
+			}
 
-		inline Iterator operator =(const Iterator &other)
+			bits.clear();
+			bits.shrink_to_fit();
+		}
+
+		//recounts the elements after bits has been modified directly, converting to a sorted array if sparse enough
+		void UpdateNumElementsOfBitArray()
 		{
-			isSisContainer = other.isSisContainer;
+			numElements = BitBucketKernels::CountBits(bits.data(), bits.size());
 
-			if(other.isSisContainer)
-				sisIterator = other.sisIterator;
-			else
-				baisIterator = other.baisIterator;
+			if(numElements <= maxNumElementsInArrayChunk / 2)
+				ConvertToArray();
+		}
 
-			return *this;
+		//returns the first position at or after position for iterating over the chunk,
+		// numIntegersPerChunk if there is none
+		//for sorted arrays positions are offsets into lows, for bit arrays they are the low bits themselves
+		__forceinline size_t FindPosition(size_t position)
+		{
+			if(!IsBitArray())
+				return (position < lows.size() ? position : numIntegersPerChunk);
+
+			size_t bucket = position / BitArrayIntegerSet::numBitsPerBucket;
+			if(bucket >= numBucketsPerChunk)
+				return numIntegersPerChunk;
+
+			uint64_t bucket_bits = bits[bucket] & (~0ULL << (position % BitArrayIntegerSet::numBitsPerBucket));
+			while(bucket_bits == 0)
+			{
+				bucket++;
+				if(bucket == numBucketsPerChunk)
+					return numIntegersPerChunk;
+				bucket_bits = bits[bucket];
+			}
+
+			return bucket * BitArrayIntegerSet::numBitsPerBucket + Platform_FindFirstBitSet(bucket_bits);
+		}
+
+		//returns the low bits at position
+		__forceinline size_t GetLowAtPosition(size_t position)
+		{
+			if(!IsBitArray())
+				return lows[position];
+			return position;
+		}
+
+		//returns the nth low bits in sorted order, assumes n is less than numElements
+		size_t GetNthLow(size_t n)
+		{
+			if(!IsBitArray())
+				return lows[n];
+
+			size_t bucket = 0;
+			for(; bucket < numBucketsPerChunk; bucket++)
+			{
+				size_t bucket_count = __popcnt64(bits[bucket]);
+				if(n < bucket_count)
+					break;
+				n -= bucket_count;
+			}
+
+			//clear the lowest bits set until the nth is the lowest
+			uint64_t bucket_bits = bits[bucket];
+			for(; n > 0; n--)
+				bucket_bits &= bucket_bits - 1;
+
+			return bucket * BitArrayIntegerSet::numBitsPerBucket + Platform_FindFirstBitSet(bucket_bits);
+		}
+
+		//returns one past the largest low bits in the chunk, assumes the chunk is not empty
+		size_t GetEndLow()
+		{
+			if(!IsBitArray())
+				return static_cast<size_t>(lows.back()) + 1;
+
+			size_t bucket = numBucketsPerChunk - 1;
+			while(bucket > 0 && bits[bucket] == 0)
+				bucket--;
+
+			return bucket * BitArrayIntegerSet::numBitsPerBucket + Platform_FindLastBitSet(bits[bucket]) + 1;
 		}
 
+		//the high bits shared by all integers in the chunk
+		size_t key;
+
+		//number of integers in the chunk
+		size_t numElements;
+
+		//sorted low bits of the integers if the chunk is sparse
+		std::vector<uint16_t> lows;
+
+		//bit array of the low bits of the integers if the chunk is dense, empty otherwise
+		std::vector<uint64_t> bits;
+	};
+
+	struct Iterator
+	{
+		constexpr Iterator()
+			: chunkIndex(0), position(0), container(nullptr)
+		{	}
+
+		constexpr Iterator(ChunkedIntegerSet *_container, size_t _chunk_index, size_t _position)
+			: chunkIndex(_chunk_index), position(_position), container(_container)
+		{	}
+
 		constexpr bool operator ==(const Iterator &other)
 		{
-			if(isSisContainer)
-				return (sisIterator == other.sisIterator);
-			else
-				return (baisIterator == other.baisIterator);
+			return (chunkIndex == other.chunkIndex && position == other.position);
 		}
 
 		constexpr bool operator !=(const Iterator &other)
 		{
-			if(isSisContainer)
-				return (sisIterator != other.sisIterator);
-			else
-				return (baisIterator != other.baisIterator);
+			return (chunkIndex != other.chunkIndex || position != other.position);
 		}
 
 		__forceinline Iterator &operator ++()
 		{
-			if(isSisContainer)
-				++sisIterator;
-			else
-				++baisIterator;
-
+			container->FindNext(chunkIndex, position);
 			return *this;
 		}
 
 		//dereference operator
-		constexpr size_t operator *()
+		__forceinline size_t operator *()
 		{
-			if(isSisContainer)
-				return *sisIterator;
-			else
-				return *baisIterator;
+			auto &chunk = container->chunks[chunkIndex];
+			return (chunk.key << numLowBits) | chunk.GetLowAtPosition(position);
 		}
 
-		SortedIntegerSet::Iterator sisIterator;
-		BitArrayIntegerSet::Iterator baisIterator;
+		//index of the chunk
+		size_t chunkIndex;
 
-		bool isSisContainer;
+		//position within the chunk
+		size_t position;
+
+		//associated set
+		ChunkedIntegerSet *container;
 	};
 
 	//std begin (must be lowercase)
-	__forceinline auto begin()
+	__forceinline Iterator begin()
 	{
-		if(isSisContainer)
-			return Iterator(sisContainer.begin());
-		else
-			return Iterator(baisContainer.begin());
+		if(chunks.size() == 0)
+			return end();
+
+		return Iterator(this, 0, chunks[0].FindPosition(0));
 	}
 
 	//std end (must be lowercase)
-	__forceinline auto end()
+	__forceinline Iterator end()
 	{
-		if(isSisContainer)
-			return Iterator(sisContainer.end());
-		else
-			return Iterator(baisContainer.end());
+		return Iterator(this, chunks.size(), 0);
 	}
 
-	//iterates over all elements in the container, passing in the value to func
-	//this is intended for fast operations performed at volume, where even small bits
-	//of extra logic in the iterator would affect performance
-	template<typename ElementFunc>
-	__forceinline void IterateFunctionOverElements(ElementFunc func)
+	//advances chunk_index and position to the next element, or to end() if there are no more elements
+	__forceinline void FindNext(size_t &chunk_index, size_t &position)
 	{
-		if(isSisContainer)
-		{
-			for(auto element : sisContainer)
-				func(element);
-		}
-		else
-		{
-			for(auto element : baisContainer)
-				func(element);
-		}
-	}
+		position = chunks[chunk_index].FindPosition(position + 1);
+		if(position != numIntegersPerChunk)
+			return;
 
-	//returns the nth id in the set by sorted order
-	inline size_t GetNthElement(size_t n)
-	{
-		if(isSisContainer)
-			return sisContainer.GetNthElement(n);
+		//chunks are never empty, so the next chunk starts at its first position
+		chunk_index++;
+		if(chunk_index < chunks.size())
+			position = chunks[chunk_index].FindPosition(0);
 		else
-			return baisContainer.GetNthElement(n);
+			position = 0;
 	}
 
-	//gets a random element in a performant way
-	// note that if it is a bais container, it will not necessarily obtain elements with uniform probability
-	inline size_t GetRandomElement(RandomStream &random_stream)
+	//iterates over all of the integers from from_index up to but not including up_to_index as efficiently as possible,
+	// passing them into func
+	template<typename IntegerFunction>
+	inline void IterateOver(IntegerFunction func, size_t up_to_index = std::numeric_limits<size_t>::max(), size_t from_index = 0)
 	{
-		if(isSisContainer)
-			return sisContainer.GetRandomElement(random_stream);
-		else
-			return baisContainer.GetRandomElement(random_stream);
+		for(size_t chunk_index = FindChunkIndex(from_index >> numLowBits); chunk_index < chunks.size(); chunk_index++)
+		{
+			auto &chunk = chunks[chunk_index];
+			size_t base = (chunk.key << numLowBits);
+			if(base >= up_to_index)
+				return;
+
+			//only the first chunk can begin before from_index
+			size_t from_low = (from_index > base ? from_index - base : 0);
+
+			if(chunk.IsBitArray())
+			{
+				size_t from_bucket = from_low / BitArrayIntegerSet::numBitsPerBucket;
+				for(size_t bucket = from_bucket; bucket < numBucketsPerChunk; bucket++)
+				{
+					uint64_t bucket_bits = chunk.bits[bucket];
+					if(bucket == from_bucket)
+						bucket_bits &= ~((1ULL << (from_low % BitArrayIntegerSet::numBitsPerBucket)) - 1);
+
+					while(bucket_bits != 0)
+					{
+						size_t index = base + bucket * BitArrayIntegerSet::numBitsPerBucket + Platform_FindFirstBitSet(bucket_bits);
+						if(index >= up_to_index)
+							return;
+
+						func(index);
+						bucket_bits &= bucket_bits - 1;
+					}
+				}
+			}
+			else
+			{
+				auto from_location = std::lower_bound(std::begin(chunk.lows), std::end(chunk.lows), from_low);
+				for(auto low_location = from_location; low_location != std::end(chunk.lows); ++low_location)
+				{
+					size_t index = base + *low_location;
+					if(index >= up_to_index)
+						return;
+
+					func(index);
+				}
+			}
+		}
+	}
+
+	//returns the nth id in the set by sorted order
+	size_t GetNthElement(size_t n)
+	{
+		//if asking for something too big, just return last element (size)
+		if(n >= numElements)
+			return GetEndInteger();
+
+		for(auto &chunk : chunks)
+		{
+			if(n < chunk.numElements)
+				return (chunk.key << numLowBits) | chunk.GetNthLow(n);
+			n -= chunk.numElements;
+		}
+
+		return GetEndInteger();
+	}
+
+	//returns a random integer
+	inline size_t GetRandomElement(RandomStream &random_stream)
+	{
+		return GetNthElement(random_stream.RandSize(numElements));
+	}
+
+	//clears the ChunkedIntegerSet as if it is new
+	__forceinline void clear()
+	{
+		chunks.clear();
+		numElements = 0;
+	}
+
+	//returns the number of elements that exist in the set
+	__forceinline size_t size()
+	{
+		return numElements;
+	}
+
+	//returns the number of chunks that have elements
+	__forceinline size_t GetNumChunks()
+	{
+		return chunks.size();
+	}
+
+	//does not need to do anything, just conforming to the interface
+	constexpr void ReserveNumIntegers(size_t)
+	{	}
+
+	//returns one past the maximum index in the container, 0 if empty
+	__forceinline size_t GetEndInteger()
+	{
+		if(chunks.size() == 0)
+			return 0;
+
+		auto &chunk = chunks.back();
+		return (chunk.key << numLowBits) + chunk.GetEndLow();
+	}
+
+	//returns true if the id exists in the set
+	__forceinline bool contains(size_t id)
+	{
+		size_t chunk_index = FindChunkIndex(id >> numLowBits);
+		if(chunk_index == chunks.size() || chunks[chunk_index].key != (id >> numLowBits))
+			return false;
+
+		return chunks[chunk_index].contains(id & (numIntegersPerChunk - 1));
+	}
+
+	//returns true if the id exists in the set
+	__forceinline bool operator [](size_t id)
+	{
+		return contains(id);
+	}
+
+	//inserts id into the set, does nothing if id already exists
+	inline void insert(size_t id)
+	{
+		if(GetOrCreateChunk(id >> numLowBits).insert(id & (numIntegersPerChunk - 1)))
+			numElements++;
+	}
+
+	//inserts all elements in collection
+	template <typename Collection>
+	__forceinline void insert(Collection &other)
+	{
+		for(const size_t element : other)
+			insert(element);
+	}
+
+	//inserts all elements in collection
+	//functionally identical to insert
+	template <typename Collection>
+	__forceinline void InsertInBatch(Collection &other)
+	{
+		for(const size_t element : other)
+			insert(element);
+	}
+
+	//inserts all elements in collection
+	//assumes that the elements are not in this set and that the elements are sorted
+	template <typename Collection>
+	__forceinline void InsertNewSortedIntegers(Collection &other)
+	{
+		for(const size_t element : other)
+			InsertNewLargestInteger(element);
+	}
+
+	//insert an id is larger than or equal to GetEndInteger()
+	__forceinline void InsertNewLargestInteger(size_t id)
+	{
+		size_t key = (id >> numLowBits);
+		if(chunks.size() == 0 || chunks.back().key != key)
+			chunks.emplace_back(key);
+
+		chunks.back().insert(id & (numIntegersPerChunk - 1));
+		numElements++;
+	}
+
+	//removes id from the set, does nothing if id does not exist
+	__forceinline void erase(size_t id)
+	{
+		EraseAndRetrieve(id);
+	}
+
+	//removes all elements contained by other
+	template<typename Container>
+	__forceinline void erase(Container &other)
+	{
+		EraseInBatch(other);
+	}
+
+	//removes the id and returns true if it was in the set before removal
+	bool EraseAndRetrieve(size_t id)
+	{
+		size_t chunk_index = FindChunkIndex(id >> numLowBits);
+		if(chunk_index == chunks.size() || chunks[chunk_index].key != (id >> numLowBits))
+			return false;
+
+		auto &chunk = chunks[chunk_index];
+		if(!chunk.erase(id & (numIntegersPerChunk - 1)))
+			return false;
+
+		numElements--;
+		if(chunk.numElements == 0)
+			chunks.erase(std::begin(chunks) + chunk_index);
+
+		return true;
+	}
+
+	//removes all elements contained by other
+	template<typename Container>
+	void EraseInBatch(Container &other)
+	{
+		for(const size_t id : other)
+			EraseAndRetrieve(id);
+	}
+
+	//removes all elements contained by other
+	void EraseInBatch(ChunkedIntegerSet &other)
+	{
+		size_t other_chunk_index = 0;
+		for(auto &chunk : chunks)
+		{
+			while(other_chunk_index < other.chunks.size() && other.chunks[other_chunk_index].key < chunk.key)
+				other_chunk_index++;
+			if(other_chunk_index == other.chunks.size())
+				break;
+
+			auto &other_chunk = other.chunks[other_chunk_index];
+			if(other_chunk.key != chunk.key)
+				continue;
+
+			if(chunk.IsBitArray())
+			{
+				if(other_chunk.IsBitArray())
+				{
+					for(size_t bucket = 0; bucket < numBucketsPerChunk; bucket++)
+						chunk.bits[bucket] &= ~other_chunk.bits[bucket];
+				}
+				else
+				{
+					for(size_t low : other_chunk.lows)
+						chunk.bits[low / BitArrayIntegerSet::numBitsPerBucket] &= ~(1ULL << (low % BitArrayIntegerSet::numBitsPerBucket));
+				}
+
+				chunk.UpdateNumElementsOfBitArray();
+			}
+			else
+			{
+				auto new_end = std::remove_if(std::begin(chunk.lows), std::end(chunk.lows),
+					[&other_chunk](uint16_t low) { return other_chunk.contains(low); });
+				chunk.lows.erase(new_end, std::end(chunk.lows));
+				chunk.numElements = chunk.lows.size();
+			}
+		}
+
+		RemoveEmptyChunksAndUpdateNumElements();
+	}
+
+	//removes all elements contained by other
+	void EraseInBatch(BitArrayIntegerSet &other)
+	{
+		auto &other_buckets = other.GetBitBucketVector();
+		for(auto &chunk : chunks)
+		{
+			size_t base_bucket = chunk.key * numBucketsPerChunk;
+			if(base_bucket >= other_buckets.size())
+				break;
+
+			if(chunk.IsBitArray())
+			{
+				size_t num_buckets = std::min(numBucketsPerChunk, other_buckets.size() - base_bucket);
+				for(size_t bucket = 0; bucket < num_buckets; bucket++)
+					chunk.bits[bucket] &= ~other_buckets[base_bucket + bucket];
+
+				chunk.UpdateNumElementsOfBitArray();
+			}
+			else
+			{
+				size_t base = (chunk.key << numLowBits);
+				auto new_end = std::remove_if(std::begin(chunk.lows), std::end(chunk.lows),
+					[&other, base](uint16_t low) { return other.contains(base + low); });
+				chunk.lows.erase(new_end, std::end(chunk.lows));
+				chunk.numElements = chunk.lows.size();
+			}
+		}
+
+		RemoveEmptyChunksAndUpdateNumElements();
+	}
+
+	//does not need to do anything, just conforming to the interface
+	constexpr void UpdateNumElements()
+	{	}
+
+	//sets this to the set that contains all elements of itself or other
+	template<typename Container>
+	__forceinline void Union(Container &other)
+	{
+		insert(other);
+	}
+
+	//sets this to the set that contains all elements of itself or other
+	void Union(ChunkedIntegerSet &other)
+	{
+		size_t chunk_index = 0;
+		for(auto &other_chunk : other.chunks)
+		{
+			while(chunk_index < chunks.size() && chunks[chunk_index].key < other_chunk.key)
+				chunk_index++;
+
+			if(chunk_index == chunks.size() || chunks[chunk_index].key != other_chunk.key)
+			{
+				chunks.insert(std::begin(chunks) + chunk_index, other_chunk);
+				continue;
+			}
+
+			auto &chunk = chunks[chunk_index];
+			if(!chunk.IsBitArray() && !other_chunk.IsBitArray()
+				&& chunk.lows.size() + other_chunk.lows.size() <= maxNumElementsInArrayChunk)
+			{
+				std::vector<uint16_t> merged;
+				merged.reserve(chunk.lows.size() + other_chunk.lows.size());
+				std::set_union(std::begin(chunk.lows), std::end(chunk.lows),
+					std::begin(other_chunk.lows), std::end(other_chunk.lows), std::back_inserter(merged));
+				chunk.lows = std::move(merged);
+				chunk.numElements = chunk.lows.size();
+				continue;
+			}
+
+			if(!chunk.IsBitArray())
+				chunk.ConvertToBitArray();
+
+			if(other_chunk.IsBitArray())
+			{
+				for(size_t bucket = 0; bucket < numBucketsPerChunk; bucket++)
+					chunk.bits[bucket] |= other_chunk.bits[bucket];
+			}
+			else
+			{
+				for(size_t low : other_chunk.lows)
+					chunk.bits[low / BitArrayIntegerSet::numBitsPerBucket] |= (1ULL << (low % BitArrayIntegerSet::numBitsPerBucket));
+			}
+
+			chunk.UpdateNumElementsOfBitArray();
+		}
+
+		RemoveEmptyChunksAndUpdateNumElements();
+	}
+
+	//sets this to the set that contains only elements that it and other jointly contain
+	//other must be iterated in sorted order
+	template<typename Container>
+	void Intersect(Container &other)
+	{
+		ChunkedIntegerSet other_cis;
+		other_cis.InsertNewSortedIntegers(other);
+		Intersect(other_cis);
+	}
+
+	//sets this to the set that contains only elements that it and other jointly contain
+	void Intersect(ChunkedIntegerSet &other)
+	{
+		size_t other_chunk_index = 0;
+		for(auto &chunk : chunks)
+		{
+			while(other_chunk_index < other.chunks.size() && other.chunks[other_chunk_index].key < chunk.key)
+				other_chunk_index++;
+
+			if(other_chunk_index == other.chunks.size() || other.chunks[other_chunk_index].key != chunk.key)
+			{
+				chunk.numElements = 0;
+				continue;
+			}
+
+			auto &other_chunk = other.chunks[other_chunk_index];
+			if(chunk.IsBitArray() && other_chunk.IsBitArray())
+			{
+				for(size_t bucket = 0; bucket < numBucketsPerChunk; bucket++)
+					chunk.bits[bucket] &= other_chunk.bits[bucket];
+
+				chunk.UpdateNumElementsOfBitArray();
+				continue;
+			}
+
+			if(chunk.IsBitArray())
+			{
+				//the intersection is at most the size of the other's sorted array
+				std::vector<uint16_t> intersection;
+				intersection.reserve(other_chunk.lows.size());
+				for(auto low : other_chunk.lows)
+				{
+					if(chunk.contains(low))
+						intersection.push_back(low);
+				}
+
+				chunk.bits.clear();
+				chunk.bits.shrink_to_fit();
+				chunk.lows = std::move(intersection);
+			}
+			else
+			{
+				auto new_end = std::remove_if(std::begin(chunk.lows), std::end(chunk.lows),
+					[&other_chunk](uint16_t low) { return !other_chunk.contains(low); });
+				chunk.lows.erase(new_end, std::end(chunk.lows));
+			}
+
+			chunk.numElements = chunk.lows.size();
+		}
+
+		RemoveEmptyChunksAndUpdateNumElements();
+	}
+
+	//sets this to the set that contains only elements that it and other jointly contain
+	void Intersect(BitArrayIntegerSet &other)
+	{
+		auto &other_buckets = other.GetBitBucketVector();
+		for(auto &chunk : chunks)
+		{
+			size_t base_bucket = chunk.key * numBucketsPerChunk;
+			if(base_bucket >= other_buckets.size())
+			{
+				chunk.numElements = 0;
+				continue;
+			}
+
+			if(chunk.IsBitArray())
+			{
+				size_t num_buckets = std::min(numBucketsPerChunk, other_buckets.size() - base_bucket);
+				for(size_t bucket = 0; bucket < num_buckets; bucket++)
+					chunk.bits[bucket] &= other_buckets[base_bucket + bucket];
+				for(size_t bucket = num_buckets; bucket < numBucketsPerChunk; bucket++)
+					chunk.bits[bucket] = 0;
+
+				chunk.UpdateNumElementsOfBitArray();
+			}
+			else
+			{
+				size_t base = (chunk.key << numLowBits);
+				auto new_end = std::remove_if(std::begin(chunk.lows), std::end(chunk.lows),
+					[&other, base](uint16_t low) { return !other.contains(base + low); });
+				chunk.lows.erase(new_end, std::end(chunk.lows));
+				chunk.numElements = chunk.lows.size();
+			}
+		}
+
+		RemoveEmptyChunksAndUpdateNumElements();
+	}
+
+	//sets other to contain exactly the elements of this set
+	void CopyTo(BitArrayIntegerSet &other)
+	{
+		other.clear();
+		UnionTo(other);
+	}
+
+	//sets other to the set that contains all elements of itself or this set
+	void UnionTo(BitArrayIntegerSet &other)
+	{
+		if(numElements == 0)
+			return;
+
+		other.ReserveNumIntegers(GetEndInteger());
+		auto &other_buckets = other.GetBitBucketVector();
+		for(auto &chunk : chunks)
+		{
+			size_t base_bucket = chunk.key * numBucketsPerChunk;
+			if(chunk.IsBitArray())
+			{
+				size_t num_buckets = std::min(numBucketsPerChunk, other_buckets.size() - base_bucket);
+				for(size_t bucket = 0; bucket < num_buckets; bucket++)
+					other_buckets[base_bucket + bucket] |= chunk.bits[bucket];
+			}
+			else
+			{
+				for(size_t low : chunk.lows)
+					other_buckets[base_bucket + low / BitArrayIntegerSet::numBitsPerBucket] |= (1ULL << (low % BitArrayIntegerSet::numBitsPerBucket));
+			}
+		}
+
+		other.UpdateNumElements();
+	}
+
+	//sets other to the set that contains only elements that it and this set jointly contain
+	void IntersectTo(BitArrayIntegerSet &other)
+	{
+		auto &other_buckets = other.GetBitBucketVector();
+
+		//buckets before cur_bucket have been intersected
+		size_t cur_bucket = 0;
+		for(auto &chunk : chunks)
+		{
+			size_t base_bucket = chunk.key * numBucketsPerChunk;
+			if(base_bucket >= other_buckets.size())
+				break;
+
+			//clear everything between chunks
+			for(; cur_bucket < base_bucket; cur_bucket++)
+				other_buckets[cur_bucket] = 0;
+
+			size_t num_buckets = std::min(numBucketsPerChunk, other_buckets.size() - base_bucket);
+			if(chunk.IsBitArray())
+			{
+				for(size_t bucket = 0; bucket < num_buckets; bucket++)
+					other_buckets[base_bucket + bucket] &= chunk.bits[bucket];
+			}
+			else
+			{
+				//build up the mask of each bucket from the sorted array
+				size_t low_index = 0;
+				for(size_t bucket = 0; bucket < num_buckets; bucket++)
+				{
+					uint64_t mask = 0;
+					for(; low_index < chunk.lows.size()
+						&& chunk.lows[low_index] / BitArrayIntegerSet::numBitsPerBucket == bucket; low_index++)
+						mask |= (1ULL << (chunk.lows[low_index] % BitArrayIntegerSet::numBitsPerBucket));
+
+					other_buckets[base_bucket + bucket] &= mask;
+				}
+			}
+
+			cur_bucket = base_bucket + num_buckets;
+		}
+
+		for(; cur_bucket < other_buckets.size(); cur_bucket++)
+			other_buckets[cur_bucket] = 0;
+
+		other.TrimBack();
+		other.UpdateNumElements();
+	}
+
+	//removes all elements of this set from other
+	void EraseFrom(BitArrayIntegerSet &other)
+	{
+		auto &other_buckets = other.GetBitBucketVector();
+		for(auto &chunk : chunks)
+		{
+			size_t base_bucket = chunk.key * numBucketsPerChunk;
+			if(base_bucket >= other_buckets.size())
+				break;
+
+			size_t num_buckets = std::min(numBucketsPerChunk, other_buckets.size() - base_bucket);
+			if(chunk.IsBitArray())
+			{
+				for(size_t bucket = 0; bucket < num_buckets; bucket++)
+					other_buckets[base_bucket + bucket] &= ~chunk.bits[bucket];
+			}
+			else
+			{
+				for(size_t low : chunk.lows)
+				{
+					size_t bucket = low / BitArrayIntegerSet::numBitsPerBucket;
+					if(bucket >= num_buckets)
+						break;
+					other_buckets[base_bucket + bucket] &= ~(1ULL << (low % BitArrayIntegerSet::numBitsPerBucket));
+				}
+			}
+		}
+
+		other.TrimBack();
+		other.UpdateNumElements();
+	}
+
+protected:
+
+	//returns the index of the first chunk with a key not less than key
+	__forceinline size_t FindChunkIndex(size_t key)
+	{
+		//fast path for the most common case of accessing the most recent chunk
+		if(chunks.size() > 0 && chunks.back().key <= key)
+			return (chunks.back().key == key ? chunks.size() - 1 : chunks.size());
+
+		auto location = std::lower_bound(std::begin(chunks), std::end(chunks), key,
+			[](const Chunk &chunk, size_t k) { return chunk.key < k; });
+		return static_cast<size_t>(location - std::begin(chunks));
+	}
+
+	//returns the chunk for key, creating it if it does not exist
+	__forceinline Chunk &GetOrCreateChunk(size_t key)
+	{
+		size_t chunk_index = FindChunkIndex(key);
+		if(chunk_index == chunks.size() || chunks[chunk_index].key != key)
+			chunks.emplace(std::begin(chunks) + chunk_index, key);
+
+		return chunks[chunk_index];
+	}
+
+	//removes any chunks without elements and recounts the number of elements
+	void RemoveEmptyChunksAndUpdateNumElements()
+	{
+		auto new_end = std::remove_if(std::begin(chunks), std::end(chunks),
+			[](Chunk &chunk) { return chunk.numElements == 0; });
+		chunks.erase(new_end, std::end(chunks));
+
+		numElements = 0;
+		for(auto &chunk : chunks)
+			numElements += chunk.numElements;
+	}
+
+	//number of elements in all chunks
+	size_t numElements;
+
+	//chunks with at least one element, sorted by key
+	std::vector<Chunk> chunks;
+};
+
+class EfficientIntegerSet
+{
+public:
+	//defined to keep compatibility with stl containers
+	using value_type = size_t;
+
+	//which of the containers holds the integers
+	enum class ContainerType : uint8_t
+	{
+		SIS,
+		BAIS,
+		CIS
+	};
+
+	EfficientIntegerSet()
+		: containerType(ContainerType::SIS)
+	{	}
+
+	//assignment operator, deep copies
+	//clears the containers not in use so that stale integers are not picked up when converting later
+	inline void operator =(const EfficientIntegerSet &other)
+	{
+		containerType = other.containerType;
+
+		if(other.containerType == ContainerType::SIS)
+		{
+			baisContainer.clear();
+			cisContainer.clear();
+			sisContainer = other.sisContainer;
+		}
+		else if(other.containerType == ContainerType::CIS)
+		{
+			sisContainer.clear();
+			baisContainer.clear();
+			cisContainer = other.cisContainer;
+		}
+		else
+		{
+			sisContainer.clear();
+			cisContainer.clear();
+			baisContainer = other.baisContainer;
+		}
+	}
+
+	//assignment operator, deep copies bit buffer
+	inline void operator =(const SortedIntegerSet &other)
+	{
+		baisContainer.clear();
+		cisContainer.clear();
+		containerType = ContainerType::SIS;
+		sisContainer = other;
+	}
+
+	//assignment operator, deep copies bit buffer
+	inline void operator =(const BitArrayIntegerSet &other)
+	{
+		sisContainer.clear();
+		cisContainer.clear();
+		containerType = ContainerType::BAIS;
+		baisContainer = other;
+	}
+
+	//copies the data to other
+	inline void CopyTo(BitArrayIntegerSet &other)
+	{
+		if(containerType == ContainerType::SIS)
+		{
+			other.clear();
+			other.insert(sisContainer);
+		}
+		else if(containerType == ContainerType::CIS)
+		{
+			cisContainer.CopyTo(other);
+		}
+		else
+		{
+			other = baisContainer;
+		}
+	}
+
+	struct Iterator
+	{
+		inline Iterator(const Iterator &other)
+		{
+			containerType = other.containerType;
+
+			if(other.containerType == ContainerType::SIS)
+				sisIterator = other.sisIterator;
+			else if(other.containerType == ContainerType::CIS)
+				cisIterator = other.cisIterator;
+			else
+				baisIterator = other.baisIterator;
+		}
+
+		inline Iterator(SortedIntegerSet::Iterator _iterator)
+		{
+			sisIterator = _iterator;
+			containerType = ContainerType::SIS;
+		}
+
+		inline Iterator(BitArrayIntegerSet::Iterator _iterator)
+		{
+			baisIterator = _iterator;
+			containerType = ContainerType::BAIS;
+		}
+
+		inline Iterator(ChunkedIntegerSet::Iterator _iterator)
+		{
+			cisIterator = _iterator;
+			containerType = ContainerType::CIS;
+		}
+
+		~Iterator()
+		{	}
+
+		inline Iterator operator =(const Iterator &other)
+		{
+			containerType = other.containerType;
+
+			if(other.containerType == ContainerType::SIS)
+				sisIterator = other.sisIterator;
+			else if(other.containerType == ContainerType::CIS)
+				cisIterator = other.cisIterator;
+			else
+				baisIterator = other.baisIterator;
+
+			return *this;
+		}
+
+		constexpr bool operator ==(const Iterator &other)
+		{
+			if(containerType == ContainerType::SIS)
+				return (sisIterator == other.sisIterator);
+			else if(containerType == ContainerType::CIS)
+				return (cisIterator == other.cisIterator);
+			else
+				return (baisIterator == other.baisIterator);
+		}
+
+		constexpr bool operator !=(const Iterator &other)
+		{
+			if(containerType == ContainerType::SIS)
+				return (sisIterator != other.sisIterator);
+			else if(containerType == ContainerType::CIS)
+				return (cisIterator != other.cisIterator);
+			else
+				return (baisIterator != other.baisIterator);
+		}
+
+		__forceinline Iterator &operator ++()
+		{
+			if(containerType == ContainerType::SIS)
+				++sisIterator;
+			else if(containerType == ContainerType::CIS)
+				++cisIterator;
+			else
+				++baisIterator;
+
+			return *this;
+		}
+
+		//dereference operator
+		constexpr size_t operator *()
+		{
+			if(containerType == ContainerType::SIS)
+				return *sisIterator;
+			else if(containerType == ContainerType::CIS)
+				return *cisIterator;
+			else
+				return *baisIterator;
+		}
+
+		SortedIntegerSet::Iterator sisIterator;
+		BitArrayIntegerSet::Iterator baisIterator;
+		ChunkedIntegerSet::Iterator cisIterator;
+
+		ContainerType containerType;
+	};
+
+	//std begin (must be lowercase)
+	__forceinline auto begin()
+	{
+		if(containerType == ContainerType::SIS)
+			return Iterator(sisContainer.begin());
+		else if(containerType == ContainerType::CIS)
+			return Iterator(cisContainer.begin());
+		else
+			return Iterator(baisContainer.begin());
+	}
+
+	//std end (must be lowercase)
+	__forceinline auto end()
+	{
+		if(containerType == ContainerType::SIS)
+			return Iterator(sisContainer.end());
+		else if(containerType == ContainerType::CIS)
+			return Iterator(cisContainer.end());
+		else
+			return Iterator(baisContainer.end());
+	}
+
+	//iterates over all elements in the container, passing in the value to func
+	//this is intended for fast operations performed at volume, where even small bits
+	//of extra logic in the iterator would affect performance
+	template<typename ElementFunc>
+	__forceinline void IterateFunctionOverElements(ElementFunc func)
+	{
+		if(containerType == ContainerType::SIS)
+		{
+			for(auto element : sisContainer)
+				func(element);
+		}
+		else if(containerType == ContainerType::CIS)
+		{
+			cisContainer.IterateOver(func);
+		}
+		else
+		{
+			for(auto element : baisContainer)
+				func(element);
+		}
+	}
+
+	//returns the nth id in the set by sorted order
+	inline size_t GetNthElement(size_t n)
+	{
+		if(containerType == ContainerType::SIS)
+			return sisContainer.GetNthElement(n);
+		else if(containerType == ContainerType::CIS)
+			return cisContainer.GetNthElement(n);
+		else
+			return baisContainer.GetNthElement(n);
+	}
+
+	//gets a random element in a performant way
+	// note that if it is a bais container, it will not necessarily obtain elements with uniform probability
+	inline size_t GetRandomElement(RandomStream &random_stream)
+	{
+		if(containerType == ContainerType::SIS)
+			return sisContainer.GetRandomElement(random_stream);
+		else if(containerType == ContainerType::CIS)
+			return cisContainer.GetRandomElement(random_stream);
+		else
+			return baisContainer.GetRandomElement(random_stream);
 	}
 
 	//clears the container as if it is new
 	inline void clear()
 	{
-		if(isSisContainer)
+		if(containerType == ContainerType::SIS)
 			sisContainer.clear();
+		else if(containerType == ContainerType::CIS)
+			cisContainer.clear();
 		else
 			baisContainer.clear();
 	}
@@ -1353,8 +2434,10 @@ public:
 	//returns the number of elements that exist
 	__forceinline size_t size()
 	{
-		if(isSisContainer)
+		if(containerType == ContainerType::SIS)
 			return sisContainer.size();
+		else if(containerType == ContainerType::CIS)
+			return cisContainer.size();
 		else
 			return baisContainer.size();
 	}
@@ -1362,8 +2445,10 @@ public:
 	//reserves the number of elements to be inserted
 	__forceinline void ReserveNumIntegers(size_t num_elements)
 	{
-		if(isSisContainer)
+		if(containerType == ContainerType::SIS)
 			sisContainer.ReserveNumIntegers(num_elements);
+		else if(containerType == ContainerType::CIS)
+			cisContainer.ReserveNumIntegers(num_elements);
 		else
 			baisContainer.ReserveNumIntegers(num_elements);
 	}
@@ -1371,8 +2456,10 @@ public:
 	//returns one past the maximum index in the container, 0 if empty
 	inline size_t GetEndInteger()
 	{
-		if(isSisContainer)
+		if(containerType == ContainerType::SIS)
 			return sisContainer.GetEndInteger();
+		else if(containerType == ContainerType::CIS)
+			return cisContainer.GetEndInteger();
 		else
 			return baisContainer.GetEndInteger();
 	}
@@ -1380,8 +2467,10 @@ public:
 	//returns true if the id exists in the set
 	inline bool contains(size_t id)
 	{
-		if(isSisContainer)
+		if(containerType == ContainerType::SIS)
 			return sisContainer.contains(id);
+		else if(containerType == ContainerType::CIS)
+			return cisContainer.contains(id);
 		else
 			return baisContainer.contains(id);
 	}
@@ -1389,17 +2478,16 @@ public:
 	//returns true if the id exists in the set
 	inline bool operator [](size_t id)
 	{
-		if(isSisContainer)
-			return sisContainer.contains(id);
-		else
-			return baisContainer.contains(id);
+		return contains(id);
 	}
 
 	//sets all up_to_id integers to true/exist
 	void SetAllIds(size_t up_to_id)
 	{
-		if(isSisContainer)
+		if(containerType == ContainerType::SIS)
 			ConvertSisToBais();
+		else if(containerType == ContainerType::CIS)
+			ConvertCisToBais();
 
 		baisContainer.SetAllIds(up_to_id);
 	}
@@ -1407,43 +2495,42 @@ public:
 	//inserts id into set, does nothing if id already exists
 	void insert(size_t id)
 	{
-		if(isSisContainer)
+		if(containerType == ContainerType::SIS)
 		{
 			sisContainer.insert(id);
-			ConvertSisToBaisIfBetter();
+			ConvertSisIfBetter();
+		}
+		else if(containerType == ContainerType::CIS)
+		{
+			cisContainer.insert(id);
+			ConvertCisIfBetter();
 		}
 		else
 		{
 			baisContainer.insert(id);
-			ConvertBaisToSisIfBetter();
+			ConvertBaisIfBetter();
 		}
 	}
 
 	//inserts all elements from other
 	__forceinline void InsertInBatch(EfficientIntegerSet &other)
 	{
-		if(other.isSisContainer)
-		{
-			if(isSisContainer)
-				sisContainer.InsertInBatch(other.sisContainer);
-			else
-				baisContainer.InsertInBatch(other.sisContainer);
-		}
+		if(other.containerType == ContainerType::SIS)
+			InsertInBatch(other.sisContainer);
+		else if(other.containerType == ContainerType::CIS)
+			InsertInBatch(other.cisContainer);
 		else
-		{
-			if(isSisContainer)
-				sisContainer.InsertInBatch(other.baisContainer);
-			else
-				baisContainer.InsertInBatch(other.baisContainer);
-		}
+			InsertInBatch(other.baisContainer);
 	}
 
 	//inserts all elements in collection
 	template <typename Collection>
 	__forceinline void InsertInBatch(Collection &other)
 	{
-		if(isSisContainer)
+		if(containerType == ContainerType::SIS)
 			sisContainer.InsertInBatch(other);
+		else if(containerType == ContainerType::CIS)
+			cisContainer.InsertInBatch(other);
 		else
 			baisContainer.InsertInBatch(other);
 	}
@@ -1452,53 +2539,76 @@ public:
 	// it assumes that the id is larger than GetEndInteger()
 	inline void InsertNewLargestInteger(size_t id)
 	{
-		if(isSisContainer)
+		if(containerType == ContainerType::SIS)
 		{
 			sisContainer.InsertNewLargestInteger(id);
-			ConvertSisToBaisIfBetter();
+			ConvertSisIfBetter();
+		}
+		else if(containerType == ContainerType::CIS)
+		{
+			cisContainer.InsertNewLargestInteger(id);
+			ConvertCisIfBetter();
 		}
 		else
 		{
 			baisContainer.insert(id);
-			ConvertBaisToSisIfBetter();
+			ConvertBaisIfBetter();
 		}
 	}
 
 	//removes id from hash set, does nothing if id does not exist in the hash
 	void erase(size_t id)
 	{
-		if(isSisContainer)
+		if(containerType == ContainerType::SIS)
 		{
 			sisContainer.erase(id);
-			ConvertSisToBaisIfBetter();
+			ConvertSisIfBetter();
+		}
+		else if(containerType == ContainerType::CIS)
+		{
+			cisContainer.erase(id);
+			ConvertCisIfBetter();
 		}
 		else
 		{
 			baisContainer.erase(id);
-			ConvertBaisToSisIfBetter();
+			ConvertBaisIfBetter();
 		}
 	}
 
 	//removes all elements contained by other
 	void erase(EfficientIntegerSet &other)
 	{
-		if(isSisContainer)
+		if(containerType == ContainerType::SIS)
 		{
 			sisContainer.erase(other);
-			ConvertSisToBaisIfBetter();
+			ConvertSisIfBetter();
+		}
+		else if(containerType == ContainerType::CIS)
+		{
+			if(other.containerType == ContainerType::CIS)
+				cisContainer.EraseInBatch(other.cisContainer);
+			else if(other.containerType == ContainerType::BAIS)
+				cisContainer.EraseInBatch(other.baisContainer);
+			else
+				cisContainer.EraseInBatch(other.sisContainer);
+
+			ConvertCisIfBetter();
 		}
 		else
 		{
 			baisContainer.erase(other);
-			ConvertBaisToSisIfBetter();
+			ConvertBaisIfBetter();
 		}
 	}
 
 	//removs all elements of this container from other
 	void EraseTo(BitArrayIntegerSet &other)
 	{
-		if(isSisContainer)
+		if(containerType == ContainerType::SIS)
 			other.erase(sisContainer);
+		else if(containerType == ContainerType::CIS)
+			cisContainer.EraseFrom(other);
 		else
 			other.erase(baisContainer);
 	}
@@ -1507,23 +2617,30 @@ public:
 	template<typename Container>
 	inline void EraseInBatch(Container &other)
 	{
-		if(isSisContainer)
+		if(containerType == ContainerType::SIS)
 		{
 			sisContainer.EraseInBatch(other);
-			ConvertSisToBaisIfBetter();
+			ConvertSisIfBetter();
+		}
+		else if(containerType == ContainerType::CIS)
+		{
+			cisContainer.EraseInBatch(other);
+			ConvertCisIfBetter();
 		}
 		else
 		{
 			baisContainer.EraseInBatch(other);
-			ConvertBaisToSisIfBetter();
+			ConvertBaisIfBetter();
 		}
 	}
 
 	//removes all elements from other in this container, intended for calling in a batch
 	void EraseInBatchFrom(BitArrayIntegerSet &other)
 	{
-		if(isSisContainer)
+		if(containerType == ContainerType::SIS)
 			other.EraseInBatch(sisContainer);
+		else if(containerType == ContainerType::CIS)
+			cisContainer.EraseFrom(other);
 		else
 			other.EraseInBatch(baisContainer);
 	}
@@ -1531,34 +2648,30 @@ public:
 	//removes all elements contained by other, intended for calling in a batch
 	inline void EraseInBatch(EfficientIntegerSet &other)
 	{
-		if(isSisContainer)
-		{
-			if(other.isSisContainer)
-				sisContainer.EraseInBatch(other.sisContainer);
-			else
-				sisContainer.EraseInBatch(other.baisContainer);
-
-			ConvertSisToBaisIfBetter();
-		}
+		if(other.containerType == ContainerType::SIS)
+			EraseInBatch(other.sisContainer);
+		else if(other.containerType == ContainerType::CIS)
+			EraseInBatch(other.cisContainer);
 		else
-		{
-			if(other.isSisContainer)
-				baisContainer.EraseInBatch(other.sisContainer);
-			else
-				baisContainer.EraseInBatch(other.baisContainer);
-
-			ConvertBaisToSisIfBetter();
-		}
+			EraseInBatch(other.baisContainer);
 	}
 
 	//removes the id and returns true if it was in the id before removal
 	inline bool EraseAndRetrieve(size_t id)
 	{
-		if(isSisContainer)
+		if(containerType == ContainerType::SIS)
 		{
 			if(sisContainer.EraseAndRetrieve(id))
 			{
-				ConvertSisToBaisIfBetter();
+				ConvertSisIfBetter();
+				return true;
+			}
+		}
+		else if(containerType == ContainerType::CIS)
+		{
+			if(cisContainer.EraseAndRetrieve(id))
+			{
+				ConvertCisIfBetter();
 				return true;
 			}
 		}
@@ -1566,7 +2679,7 @@ public:
 		{
 			if(baisContainer.EraseAndRetrieve(id))
 			{
-				ConvertBaisToSisIfBetter();
+				ConvertBaisIfBetter();
 				return true;
 			}
 		}
@@ -1577,15 +2690,20 @@ public:
 	//updates the number of elements
 	void UpdateNumElements()
 	{
-		if(isSisContainer)
+		if(containerType == ContainerType::SIS)
 		{
 			sisContainer.UpdateNumElements();
-			ConvertSisToBaisIfBetter();
+			ConvertSisIfBetter();
+		}
+		else if(containerType == ContainerType::CIS)
+		{
+			cisContainer.UpdateNumElements();
+			ConvertCisIfBetter();
 		}
 		else
 		{
 			baisContainer.UpdateNumElements();
-			ConvertBaisToSisIfBetter();
+			ConvertBaisIfBetter();
 		}
 	}
 
@@ -1593,39 +2711,61 @@ public:
 	void Union(EfficientIntegerSet &other)
 	{
 		//see if should convert to bais before merging to speed things up
-		if(isSisContainer)
+		if(containerType != ContainerType::BAIS)
 		{
-			size_t lower_bound_num_elements = std::max(sisContainer.size(), other.size());
-			size_t lower_bound_max_size = std::max(sisContainer.GetEndInteger(), other.GetEndInteger());
+			size_t lower_bound_num_elements = std::max(size(), other.size());
+			size_t lower_bound_max_size = std::max(GetEndInteger(), other.GetEndInteger());
 			if(IsBaisPreferredToSis(lower_bound_num_elements, lower_bound_max_size))
-				ConvertSisToBais();
+			{
+				if(containerType == ContainerType::SIS)
+					ConvertSisToBais();
+				else
+					ConvertCisToBais();
+			}
 		}
 
-		if(isSisContainer)
+		if(containerType == ContainerType::SIS)
 		{
-			if(other.isSisContainer)
+			if(other.containerType == ContainerType::SIS)
 				sisContainer.insert(other.sisContainer);
+			else if(other.containerType == ContainerType::CIS)
+				sisContainer.insert(other.cisContainer);
 			else
 				sisContainer.insert(other.baisContainer);
 
-			ConvertSisToBaisIfBetter();
+			ConvertSisIfBetter();
+		}
+		else if(containerType == ContainerType::CIS)
+		{
+			if(other.containerType == ContainerType::SIS)
+				cisContainer.Union(other.sisContainer);
+			else if(other.containerType == ContainerType::CIS)
+				cisContainer.Union(other.cisContainer);
+			else
+				cisContainer.Union(other.baisContainer);
+
+			ConvertCisIfBetter();
 		}
 		else
 		{
-			if(other.isSisContainer)
+			if(other.containerType == ContainerType::SIS)
 				baisContainer.insert(other.sisContainer);
+			else if(other.containerType == ContainerType::CIS)
+				other.cisContainer.UnionTo(baisContainer);
 			else
 				baisContainer.Union(other.baisContainer);
 
-			ConvertBaisToSisIfBetter();
+			ConvertBaisIfBetter();
 		}
 	}
 
 	//sets other to the set that contains all elements of itself or other
 	inline void UnionTo(BitArrayIntegerSet &other)
 	{
-		if(IsSisContainer())
+		if(containerType == ContainerType::SIS)
 			other.insert(sisContainer);
+		else if(containerType == ContainerType::CIS)
+			cisContainer.UnionTo(other);
 		else
 			other.Union(baisContainer);
 	}
@@ -1634,7 +2774,7 @@ public:
 	void Intersect(EfficientIntegerSet &other)
 	{
 		//see if should convert to sis before merging to speed things up
-		if(!isSisContainer)
+		if(containerType == ContainerType::BAIS)
 		{
 			size_t upper_bound_num_elements = std::min(sisContainer.size(), other.size());
 			size_t upper_bound_max_size = std::min(sisContainer.GetEndInteger(), other.GetEndInteger());
@@ -1642,31 +2782,48 @@ public:
 				ConvertBaisToSis();
 		}
 
-		if(isSisContainer)
+		if(containerType == ContainerType::SIS)
 		{
-			if(other.isSisContainer)
+			if(other.containerType == ContainerType::SIS)
 				sisContainer.Intersect(other.sisContainer);
+			else if(other.containerType == ContainerType::CIS)
+				sisContainer.Intersect(other.cisContainer);
 			else
 				sisContainer.Intersect(other.baisContainer);
 
-			ConvertSisToBaisIfBetter();
+			ConvertSisIfBetter();
+		}
+		else if(containerType == ContainerType::CIS)
+		{
+			if(other.containerType == ContainerType::SIS)
+				cisContainer.Intersect(other.sisContainer);
+			else if(other.containerType == ContainerType::CIS)
+				cisContainer.Intersect(other.cisContainer);
+			else
+				cisContainer.Intersect(other.baisContainer);
+
+			ConvertCisIfBetter();
 		}
 		else
 		{
-			if(other.isSisContainer)
+			if(other.containerType == ContainerType::SIS)
 				baisContainer.Intersect(other.sisContainer);
+			else if(other.containerType == ContainerType::CIS)
+				other.cisContainer.IntersectTo(baisContainer);
 			else
 				baisContainer.Intersect(other.baisContainer);
 
-			ConvertBaisToSisIfBetter();
+			ConvertBaisIfBetter();
 		}
 	}
 
 	//sets other to the set that contains only elements that it and other jointly contain
 	inline void IntersectTo(BitArrayIntegerSet &other)
 	{
-		if(IsSisContainer())
+		if(containerType == ContainerType::SIS)
 			other.Intersect(sisContainer);
+		else if(containerType == ContainerType::CIS)
+			cisContainer.IntersectTo(other);
 		else
 			other.Intersect(baisContainer);
 	}
@@ -1675,19 +2832,27 @@ public:
 	// resetting the size of the container
 	void Not(size_t up_to_id)
 	{
-		if(isSisContainer)
+		if(containerType == ContainerType::SIS)
 		{
 			//if it was a sisContainer, then it was sparse, so convert to baisContainer
 			//set all and remove those from sisContainer
 			baisContainer.SetAllIds(up_to_id);
 			baisContainer.erase(sisContainer);
 			sisContainer.clear();
-			isSisContainer = false;
+			containerType = ContainerType::BAIS;
+		}
+		else if(containerType == ContainerType::CIS)
+		{
+			//cisContainer is sparse as well, so the same applies
+			baisContainer.SetAllIds(up_to_id);
+			cisContainer.EraseFrom(baisContainer);
+			cisContainer.clear();
+			containerType = ContainerType::BAIS;
 		}
 		else
 		{
 			baisContainer.Not(up_to_id);
-			ConvertBaisToSisIfBetter();
+			ConvertBaisIfBetter();
 		}
 	}
 
@@ -1697,19 +2862,24 @@ public:
 	void Not(Container &other, size_t up_to_id)
 	{
 		clear();
-		isSisContainer = false;
+		containerType = ContainerType::BAIS;
 
-		if(other.isSisContainer)
+		if(other.containerType == ContainerType::SIS)
 		{
 			//if it was a sisContainer, then it was sparse, so convert to baisContainer
 			//set all and remove those from sisContainer
 			baisContainer.SetAllIds(up_to_id);
 			baisContainer.erase(other.sisContainer);
 		}
+		else if(other.containerType == ContainerType::CIS)
+		{
+			baisContainer.SetAllIds(up_to_id);
+			other.cisContainer.EraseFrom(baisContainer);
+		}
 		else
 		{
 			baisContainer.Not(other.baisContainer, up_to_id);
-			ConvertBaisToSisIfBetter();
+			ConvertBaisIfBetter();
 		}
 	}
 
@@ -1717,11 +2887,16 @@ public:
 	// up_to_id must be at least as large as the max index of other
 	void NotTo(BitArrayIntegerSet &other, size_t up_to_id)
 	{
-		if(isSisContainer)
+		if(containerType == ContainerType::SIS)
 		{
 			other.SetAllIds(up_to_id);
 			other.erase(sisContainer);
 		}
+		else if(containerType == ContainerType::CIS)
+		{
+			other.SetAllIds(up_to_id);
+			cisContainer.EraseFrom(other);
+		}
 		else
 		{
 			other.Not(baisContainer, up_to_id);
@@ -1732,12 +2907,17 @@ public:
 
 	constexpr bool IsSisContainer()
 	{
-		return isSisContainer;
+		return containerType == ContainerType::SIS;
 	}
 
 	constexpr bool IsBaisContainer()
 	{
-		return !isSisContainer;
+		return containerType == ContainerType::BAIS;
+	}
+
+	constexpr bool IsCisContainer()
+	{
+		return containerType == ContainerType::CIS;
 	}
 
 	constexpr auto &GetSisContainer()
@@ -1750,10 +2930,19 @@ public:
 		return baisContainer;
 	}
 
+	constexpr auto &GetCisContainer()
+	{
+		return cisContainer;
+	}
+
+	//minimum number of elements to consider using cis, since smaller sets use little memory either way
+	// and sis is faster to operate on
+	static constexpr size_t minNumElementsForCis = 4096;
+
 protected:
 
 	//returns true if it would be more efficient to convert from sis to bais
-	//assumes conitainer is already sis
+	//assumes conitainer is already sis or cis
 	inline bool IsBaisPreferredToSis(size_t num_elements, size_t max_element)
 	{
 		//add 1 to round up to make it less likely to flip back and forth between types
@@ -1772,12 +2961,38 @@ protected:
 		return (2 * num_bais_elements_required > num_elements);
 	}
 
+	//returns true if it would be more efficient to store sparse elements in cis than sis
+	//assumes conitainer is already sis or bais
+	inline bool IsCisPreferredToSis(size_t num_elements, size_t max_element)
+	{
+		if(num_elements < minNumElementsForCis)
+			return false;
+
+		//each element can be in a different chunk, but there cannot be more chunks than cover max_element
+		size_t max_num_chunks = std::min(num_elements, (max_element / ChunkedIntegerSet::numIntegersPerChunk) + 1);
+		size_t max_cis_bytes = sizeof(uint16_t) * num_elements + ChunkedIntegerSet::numOverheadBytesPerChunk * max_num_chunks;
+		//require cis to be at most half the memory to make it less likely to flip back and forth between types
+		return (2 * max_cis_bytes <= sizeof(size_t) * num_elements);
+	}
+
+	//returns true if it would be more efficient to store sparse elements in sis than cis
+	//assumes conitainer is already cis
+	inline bool IsSisPreferredToCis(size_t num_elements, size_t num_chunks)
+	{
+		//halve the threshold to make it less likely to flip back and forth between types
+		if(num_elements < minNumElementsForCis / 2)
+			return true;
+
+		size_t max_cis_bytes = sizeof(uint16_t) * num_elements + ChunkedIntegerSet::numOverheadBytesPerChunk * num_chunks;
+		return (max_cis_bytes >= sizeof(size_t) * num_elements);
+	}
+
 	//converts data storage to bais; assumes it is already sis
 	inline void ConvertSisToBais()
 	{
 		baisContainer.InsertInBatch(sisContainer);
 		sisContainer.clear();
-		isSisContainer = false;
+		containerType = ContainerType::BAIS;
 	}
 
 	//converts data storage to sis; assumes it is already bais
@@ -1785,29 +3000,85 @@ protected:
 	{
 		sisContainer.InsertNewSortedIntegers(baisContainer);
 		baisContainer.clear();
-		isSisContainer = true;
+		containerType = ContainerType::SIS;
+	}
+
+	//converts data storage to cis; assumes it is already sis
+	inline void ConvertSisToCis()
+	{
+		cisContainer.InsertNewSortedIntegers(sisContainer);
+		//release the memory, since the point of converting is to use less
+		sisContainer = SortedIntegerSet();
+		containerType = ContainerType::CIS;
+	}
+
+	//converts data storage to sis; assumes it is already cis
+	inline void ConvertCisToSis()
+	{
+		sisContainer.InsertNewSortedIntegers(cisContainer);
+		cisContainer.clear();
+		containerType = ContainerType::SIS;
+	}
+
+	//converts data storage to cis; assumes it is already bais
+	inline void ConvertBaisToCis()
+	{
+		cisContainer.InsertNewSortedIntegers(baisContainer);
+		baisContainer.clear();
+		containerType = ContainerType::CIS;
+	}
+
+	//converts data storage to bais; assumes it is already cis
+	inline void ConvertCisToBais()
+	{
+		cisContainer.CopyTo(baisContainer);
+		cisContainer.clear();
+		containerType = ContainerType::BAIS;
 	}
 
-	//automatically converts Sis to Bais when better
-	//assumes isSisContainer is true
-	__forceinline void ConvertSisToBaisIfBetter()
+	//automatically converts Sis to Bais or Cis when better
+	//assumes containerType is SIS
+	__forceinline void ConvertSisIfBetter()
 	{
-		if(IsBaisPreferredToSis(sisContainer.size(), sisContainer.GetEndInteger()))
+		size_t num_elements = sisContainer.size();
+		size_t max_element = sisContainer.GetEndInteger();
+		if(IsBaisPreferredToSis(num_elements, max_element))
 			ConvertSisToBais();
+		else if(IsCisPreferredToSis(num_elements, max_element))
+			ConvertSisToCis();
+	}
+
+	//automatically converts Bais to Sis or Cis when better
+	//assumes containerType is BAIS
+	__forceinline void ConvertBaisIfBetter()
+	{
+		size_t num_elements = baisContainer.size();
+		size_t max_element = baisContainer.GetEndInteger();
+		if(IsSisPreferredToBais(num_elements, max_element))
+		{
+			if(IsCisPreferredToSis(num_elements, max_element))
+				ConvertBaisToCis();
+			else
+				ConvertBaisToSis();
+		}
 	}
 
-	//automatically converts Bais to Sis when better
-	//assumes isSisContainer is false
-	__forceinline void ConvertBaisToSisIfBetter()
+	//automatically converts Cis to Bais or Sis when better
+	//assumes containerType is CIS
+	__forceinline void ConvertCisIfBetter()
 	{
-		if(IsSisPreferredToBais(baisContainer.size(), baisContainer.GetEndInteger()))
-			ConvertBaisToSis();
+		size_t num_elements = cisContainer.size();
+		if(IsBaisPreferredToSis(num_elements, cisContainer.GetEndInteger()))
+			ConvertCisToBais();
+		else if(IsSisPreferredToCis(num_elements, cisContainer.GetNumChunks()))
+			ConvertCisToSis();
 	}
 
-	//if true, use sisContainer, if false use baisContainer
-	bool isSisContainer;
+	//which container is in use
+	ContainerType containerType;
 
-	//keep both container types
+	//keep all container types
 	SortedIntegerSet sisContainer;
 	BitArrayIntegerSet baisContainer;
+	ChunkedIntegerSet cisContainer;
 };
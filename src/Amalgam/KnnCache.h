@@ -5,6 +5,7 @@
 #include "SeparableBoxFilterDataStore.h"
 
 //system headers:
+#include <algorithm>
 #include <vector>
 
 //caches nearest neighbor results for every entity in the provided data structure
@@ -23,14 +24,150 @@ public:
 		GeneralizedDistance &dist_params, std::vector<StringInternPool::StringID> &position_label_ids)
 	{
 		sbfDataStore = &datastore;
-		relevantIndices = &relevant_indices;
-		distParams = &dist_params;
-		positionLabelIds = &position_label_ids;
+		relevantIndices = relevant_indices;
+		distParams = dist_params;
+		//neighbors are cached for reuse, so find them with the accuracy they are reported with
+		distParams.SetHighAccuracy(distParams.highAccuracy || distParams.recomputeAccurateDistances);
+		positionLabelIds = position_label_ids;
+		sbfDataStore->GetColumnDistanceStates(distParams, positionLabelIds, columnDistanceStates);
+		changedIndices.clear();
 
 		cachedNeighbors.clear();
 		cachedNeighbors.resize(sbfDataStore->GetNumInsertedEntities());
 	}
 
+	//like ResetCache, but if the cache was last used with the same datastore and distance parameters, only clears the cached
+	// neighbors that could have been affected by the entities changed since or by entities that have become or are no longer relevant
+	//top_k is the number of neighbors that will be cached, which bounds how many changed entities are worth repairing
+#ifdef MULTITHREAD_SUPPORT
+	void UpdateCache(SeparableBoxFilterDataStore &datastore, BitArrayIntegerSet &relevant_indices,
+		GeneralizedDistance &dist_params, std::vector<StringInternPool::StringID> &position_label_ids, size_t top_k, bool run_concurrently)
+#else
+	void UpdateCache(SeparableBoxFilterDataStore &datastore, BitArrayIntegerSet &relevant_indices,
+		GeneralizedDistance &dist_params, std::vector<StringInternPool::StringID> &position_label_ids, size_t top_k)
+#endif
+	{
+		if(sbfDataStore != &datastore || positionLabelIds != position_label_ids || !distParams.HasSameParameters(dist_params))
+		{
+			ResetCache(datastore, relevant_indices, dist_params, position_label_ids);
+			return;
+		}
+
+		//if columns have moved or the range of values used for unknown values has changed, distances may differ between any entities
+		auto &column_states = columnDistanceStatesBuffer;
+		sbfDataStore->GetColumnDistanceStates(distParams, positionLabelIds, column_states);
+		if(column_states != columnDistanceStates)
+		{
+			ResetCache(datastore, relevant_indices, dist_params, position_label_ids);
+			return;
+		}
+
+		//entities that have become or are no longer relevant are treated the same as changed entities
+		for(auto index : relevant_indices)
+		{
+			if(!relevantIndices.contains(index))
+				changedIndices.insert(index);
+		}
+		for(auto index : relevantIndices)
+		{
+			if(!relevant_indices.contains(index))
+				changedIndices.insert(index);
+		}
+		relevantIndices = relevant_indices;
+
+		cachedNeighbors.resize(sbfDataStore->GetNumInsertedEntities());
+
+		if(changedIndices.size() == 0)
+			return;
+
+		//every cached neighbor list is checked against each changed entity, so once there are more changed entities than
+		// a small multiple of the neighbors being cached, or than a fraction of the relevant entities, recomputing is cheaper
+		size_t max_changed_entities = std::min((top_k + 1) * maxChangedEntitiesPerNeighborForRepair,
+			relevantIndices.size() / maxChangedEntitiesFractionForRepair);
+		if(changedIndices.size() > max_changed_entities)
+		{
+			for(auto &neighbors : cachedNeighbors)
+				neighbors.clear();
+			changedIndices.clear();
+			return;
+		}
+
+		auto &changed_relevant_indices = changedRelevantIndicesBuffer;
+		changed_relevant_indices.clear();
+		for(auto index : changedIndices)
+		{
+			if(index < cachedNeighbors.size())
+				cachedNeighbors[index].clear();
+
+			if(relevantIndices.contains(index))
+				changed_relevant_indices.push_back(index);
+		}
+
+		size_t end_index = relevantIndices.GetEndInteger();
+
+	#ifdef MULTITHREAD_SUPPORT
+		if(run_concurrently && relevantIndices.size() > 1)
+		{
+			auto enqueue_task_lock = Concurrency::threadPool.BeginEnqueueBatchTask();
+			if(enqueue_task_lock.AreThreadsAvailable())
+			{
+				size_t num_ranges = std::max<size_t>(Concurrency::GetMaxNumThreads(), 1);
+				size_t range_size = (end_index + num_ranges - 1) / num_ranges;
+
+				std::vector<std::future<void>> ranges_completed;
+				ranges_completed.reserve(num_ranges);
+
+				for(size_t start_index = 0; start_index < end_index; start_index += range_size)
+				{
+					size_t range_end_index = std::min(start_index + range_size, end_index);
+					ranges_completed.emplace_back(
+						Concurrency::threadPool.EnqueueBatchTask(
+							[this, start_index, range_end_index, &changed_relevant_indices]
+							{
+								std::vector<double> distances;
+								RepairCachedNeighbors(start_index, range_end_index, changed_relevant_indices, distances);
+							}
+						)
+					);
+				}
+
+				enqueue_task_lock.Unlock();
+				Concurrency::threadPool.CountCurrentThreadAsPaused();
+
+				for(auto &future : ranges_completed)
+					future.wait();
+
+				Concurrency::threadPool.CountCurrentThreadAsResumed();
+
+				changedIndices.clear();
+				return;
+			}
+		}
+		//not running concurrently
+	#endif
+
+		RepairCachedNeighbors(0, end_index, changed_relevant_indices, distancesBuffer);
+		changedIndices.clear();
+	}
+
+	//marks the entity at index as changed, so that any neighbors it could affect are recomputed the next time UpdateCache is called
+	inline void EntityChanged(size_t index)
+	{
+		//if the cache hasn't been populated, there are no neighbors to update
+		if(sbfDataStore == nullptr)
+			return;
+
+		changedIndices.insert(index);
+	}
+
+	//like EntityChanged, but only marks the entity at index as changed if label_id is one of the position labels
+	// changes to other labels can only change which entities are relevant, which UpdateCache accounts for
+	inline void EntityLabelChanged(size_t index, StringInternPool::StringID label_id)
+	{
+		if(std::find(begin(positionLabelIds), end(positionLabelIds), label_id) != end(positionLabelIds))
+			EntityChanged(index);
+	}
+
 	//gets the nearest neighbors to the index and caches them
 	//this may expand k so that at least one non-zero distance is returned - if that is not possible then it will return all entities
 #ifdef MULTITHREAD_SUPPORT
@@ -41,15 +178,15 @@ public:
 	{
 
 	#ifdef MULTITHREAD_SUPPORT
-		if(run_concurrently && relevantIndices->size() > 1)
+		if(run_concurrently && relevantIndices.size() > 1)
 		{
 			auto enqueue_task_lock = Concurrency::threadPool.BeginEnqueueBatchTask();
 			if(enqueue_task_lock.AreThreadsAvailable())
 			{
 				std::vector<std::future<void>> indices_completed;
-				indices_completed.reserve(relevantIndices->size());
+				indices_completed.reserve(relevantIndices.size());
 			
-				for(auto index : *relevantIndices)
+				for(auto index : relevantIndices)
 				{
 					//fill in cache entry if it is not sufficient
 					if(top_k > cachedNeighbors[index].size())
@@ -59,8 +196,8 @@ public:
 								[this, index, top_k]
 								{
 									// could have knn cache constructor take in dist params and just get top_k from there, so don't need to pass it in everywhere
-									sbfDataStore->FindEntitiesNearestToIndexedEntity(distParams, *positionLabelIds, true, index,
-										top_k, *relevantIndices, true, cachedNeighbors[index]);
+									sbfDataStore->FindEntitiesNearestToIndexedEntity(&distParams, positionLabelIds, true, index,
+										top_k, relevantIndices, true, cachedNeighbors[index]);
 								}
 							)
 						);
@@ -81,13 +218,13 @@ public:
 		//not running concurrently
 	#endif
 
-		for(auto index : *relevantIndices)
+		for(auto index : relevantIndices)
 		{
 			//fill in cache entry if it is not sufficient
 			if(top_k > cachedNeighbors[index].size())
 			{
 				cachedNeighbors[index].clear();
-				sbfDataStore->FindEntitiesNearestToIndexedEntity(distParams, *positionLabelIds, false, index, top_k, *relevantIndices, true, cachedNeighbors[index]);
+				sbfDataStore->FindEntitiesNearestToIndexedEntity(&distParams, positionLabelIds, true, index, top_k, relevantIndices, true, cachedNeighbors[index]);
 			}
 		}
 	}
@@ -123,7 +260,7 @@ public:
 
 		//there were not enough results for this search, just do a new search
 		out.clear();
-		sbfDataStore->FindEntitiesNearestToIndexedEntity(distParams, *positionLabelIds, false, index, top_k, *relevantIndices, true, out, additional_holdout_index);
+		sbfDataStore->FindEntitiesNearestToIndexedEntity(&distParams, positionLabelIds, true, index, top_k, relevantIndices, true, out, additional_holdout_index);
 	}
 
 	//like the other GetKnn, but only considers from_indices
@@ -142,22 +279,77 @@ public:
 
 		//there were not enough results for this search, just do a new search
 		out.clear();
-		sbfDataStore->FindEntitiesNearestToIndexedEntity(distParams, *positionLabelIds, false, index, top_k, from_indices, true, out);
+		sbfDataStore->FindEntitiesNearestToIndexedEntity(&distParams, positionLabelIds, true, index, top_k, from_indices, true, out);
 	}
 
 	//returns a pointer to the relevant indices of the cache
 	constexpr BitArrayIntegerSet *GetRelevantEntities()
 	{
-		return relevantIndices;
+		return &relevantIndices;
 	}
 
 	//returns the number of relevant indices in the cache
 	inline size_t GetNumRelevantEntities()
 	{
-		return relevantIndices->size();
+		return relevantIndices.size();
 	}
 
 private:
+	//clears the cached neighbors of the relevant entities from start_index up to but not including end_index
+	// that changedIndices could have affected, where changed_relevant_indices are the changed entities that are still relevant
+	//distances is used as a buffer
+	void RepairCachedNeighbors(size_t start_index, size_t end_index,
+		std::vector<size_t> &changed_relevant_indices, std::vector<double> &distances)
+	{
+		for(size_t index = start_index; index < end_index; index++)
+		{
+			if(!relevantIndices.ContainsWithoutMaximumIndexCheck(index))
+				continue;
+
+			auto &neighbors = cachedNeighbors[index];
+			if(neighbors.size() == 0)
+				continue;
+
+			//if no nonzero distance was found, then the search included every entity and would need to include any new ones
+			if(neighbors.back().distance == 0.0)
+			{
+				neighbors.clear();
+				continue;
+			}
+
+			//if a neighbor changed or is no longer relevant, the neighbors need to be recomputed
+			bool neighbor_changed = std::any_of(begin(neighbors), end(neighbors),
+				[this](auto &drp) { return changedIndices.contains(drp.reference); });
+			if(neighbor_changed)
+			{
+				neighbors.clear();
+				continue;
+			}
+
+			//if any changed entity is now at least as close as the furthest neighbor, it could be one of the neighbors
+			sbfDataStore->FindDistancesFromIndexedEntity(distParams, positionLabelIds, index, changed_relevant_indices, distances);
+			double furthest_neighbor_distance = neighbors.back().distance * (1.0 + distanceTolerance);
+			for(double distance : distances)
+			{
+				if(distance <= furthest_neighbor_distance)
+				{
+					neighbors.clear();
+					break;
+				}
+			}
+		}
+	}
+
+	//if more than one in this many of the relevant entities have changed, UpdateCache recomputes all neighbors
+	static constexpr size_t maxChangedEntitiesFractionForRepair = 16;
+
+	//if more than this many entities per cached neighbor have changed, UpdateCache recomputes all neighbors
+	static constexpr size_t maxChangedEntitiesPerNeighborForRepair = 8;
+
+	//relative amount that a changed entity may be further than the furthest cached neighbor and still invalidate it,
+	// since the search accumulates distances in a different order than computing them directly
+	static constexpr double distanceTolerance = 1e-9;
+
 	//cache of nearest neighbor results.  The index of cache is the entity, and the corresponding vector are its nearest neighbors.
 	std::vector<std::vector<DistanceReferencePair<size_t>>> cachedNeighbors;
 
@@ -165,11 +357,23 @@ private:
 	SeparableBoxFilterDataStore *sbfDataStore;
 
 	//distance parameters for the search
-	GeneralizedDistance *distParams;
+	// searches are made on copies so that every cached neighbor list is computed with the same parameters
+	GeneralizedDistance distParams;
 
 	//position labels
-	std::vector<StringInternPool::StringID> *positionLabelIds;
+	std::vector<StringInternPool::StringID> positionLabelIds;
+
+	//indices of relevant entities used to populate the cache
+	BitArrayIntegerSet relevantIndices;
+
+	//column states of the position labels when the cache was populated
+	std::vector<std::pair<size_t, double>> columnDistanceStates;
+
+	//entities that have changed since the cache was last updated
+	BitArrayIntegerSet changedIndices;
 
-	//pointer to the indices of relevant entities used to populate the cache
-	BitArrayIntegerSet *relevantIndices;
+	//buffers for UpdateCache
+	std::vector<std::pair<size_t, double>> columnDistanceStatesBuffer;
+	std::vector<size_t> changedRelevantIndicesBuffer;
+	std::vector<double> distancesBuffer;
 };
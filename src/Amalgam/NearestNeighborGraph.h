@@ -0,0 +1,484 @@
+#pragma once
+
+//project headers:
+#include "DistanceReferencePair.h"
+#include "GeneralizedDistance.h"
+#include "HashMaps.h"
+#include "IntegerSet.h"
+#include "RandomStream.h"
+#include "StringInternPool.h"
+
+//system headers:
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <vector>
+
+//approximate nearest neighbor index over a set of features, stored as a hierarchical navigable small world graph
+// the graph only stores the links between entity indices, and distances between nodes are computed by a function passed
+// to each method that modifies the graph, so that the values are read from wherever they are already stored
+// links are kept symmetric so that nodes can be removed or reassigned by only visiting their neighbors
+class NearestNeighborGraph
+{
+public:
+	//creates an empty graph for the features of label_ids, where dist_params is the distance of the queries it answers
+	// and is also used to compute the distances between nodes
+	NearestNeighborGraph(std::vector<StringInternPool::StringID> &label_ids, GeneralizedDistance &dist_params)
+		: labelIds(label_ids), distParams(dist_params), nodeDistParams(dist_params), numNodes(0), entryNode(0), topLevel(0),
+		randomStream(std::string("NearestNeighborGraph"))
+	{
+		SetUniversallyNumericFeaturesToNumeric(distParams);
+		SetUniversallyNumericFeaturesToNumeric(nodeDistParams);
+	}
+
+	//returns the number of entities in the graph
+	constexpr size_t GetNumNodes()
+	{
+		return numNodes;
+	}
+
+	//returns true if the graph answers queries over label_ids in the same order with the same distance parameters
+	inline bool IsForQuery(std::vector<StringInternPool::StringID> &label_ids, GeneralizedDistance &dist_params)
+	{
+		if(label_ids != labelIds)
+			return false;
+
+		GeneralizedDistance query_dist_params = dist_params;
+		SetUniversallyNumericFeaturesToNumeric(query_dist_params);
+		return distParams.HasSameParameters(query_dist_params);
+	}
+
+	//returns true if label_id is one of the labels the graph was built for
+	inline bool HasLabel(StringInternPool::StringID label_id)
+	{
+		return std::find(begin(labelIds), end(labelIds), label_id) != end(labelIds);
+	}
+
+	//returns true if entity_index is a node in the graph
+	inline bool IsNode(size_t entity_index)
+	{
+		return (entity_index < links.size() && links[entity_index].size() > 0);
+	}
+
+	//links entity_index into the graph, where node_distance(a, b) returns the distance between the entities at indices a and b
+	// entity_index must not already be a node
+	template<typename NodeDistanceFunction>
+	void InsertNode(size_t entity_index, NodeDistanceFunction node_distance)
+	{
+		if(entity_index >= links.size())
+			links.resize(entity_index + 1);
+
+		size_t node_top_level = GetRandomLevel();
+		links[entity_index].resize(node_top_level + 1);
+		if(node_top_level > 0)
+			GetUpperLevelNodes(node_top_level).insert(entity_index);
+
+		if(numNodes == 0)
+		{
+			entryNode = entity_index;
+			topLevel = node_top_level;
+			numNodes++;
+			return;
+		}
+
+		auto distance_to_node = [&node_distance, entity_index](size_t other) { return node_distance(entity_index, other); };
+
+		size_t closest = entryNode;
+		double closest_distance = distance_to_node(closest);
+		for(size_t level = topLevel; level > node_top_level; level--)
+			FindClosestGreedily(closest, closest_distance, level, distance_to_node);
+
+		std::vector<DistanceReferencePair<size_t>> candidates;
+		std::vector<size_t> selected;
+		for(size_t level = std::min(node_top_level, topLevel) + 1; level-- > 0; )
+		{
+			SearchLevel(closest, closest_distance, level, numConstructionCandidates, distance_to_node, nullptr, candidates);
+			SelectNeighbors(candidates, GetMaxLinks(level), selected, node_distance);
+			for(size_t neighbor : selected)
+				Link(entity_index, neighbor, level, node_distance);
+
+			closest = candidates[0].reference;
+			closest_distance = candidates[0].distance;
+		}
+
+		numNodes++;
+		if(node_top_level > topLevel)
+		{
+			topLevel = node_top_level;
+			entryNode = entity_index;
+		}
+	}
+
+	//removes entity_index from the graph if it is a node and links its former neighbors to each other where they have room
+	template<typename NodeDistanceFunction>
+	void RemoveNode(size_t entity_index, NodeDistanceFunction node_distance)
+	{
+		if(!IsNode(entity_index))
+			return;
+
+		auto former_links = std::move(links[entity_index]);
+		links[entity_index].clear();
+		numNodes--;
+
+		size_t node_top_level = former_links.size() - 1;
+		if(node_top_level > 0)
+			GetUpperLevelNodes(node_top_level).erase(entity_index);
+
+		std::vector<size_t> others;
+		for(size_t level = 0; level < former_links.size(); level++)
+		{
+			auto &former_neighbors = former_links[level];
+			for(size_t neighbor : former_neighbors)
+				Unlink(neighbor, entity_index, level);
+
+			size_t max_links = GetMaxLinks(level);
+			for(size_t neighbor : former_neighbors)
+			{
+				others = former_neighbors;
+				std::sort(begin(others), end(others),
+					[&node_distance, neighbor](size_t a, size_t b) { return node_distance(neighbor, a) < node_distance(neighbor, b); });
+
+				for(size_t other : others)
+				{
+					if(links[neighbor][level].size() >= max_links)
+						break;
+
+					auto &neighbor_links = links[neighbor][level];
+					if(other == neighbor || links[other][level].size() >= max_links
+							|| std::find(begin(neighbor_links), end(neighbor_links), other) != end(neighbor_links))
+						continue;
+
+					neighbor_links.push_back(other);
+					links[other][level].push_back(neighbor);
+				}
+			}
+		}
+
+		if(entryNode == entity_index)
+			ReplaceEntryNode(former_links);
+	}
+
+	//removes the entity at entity_index and moves the node at entity_index_to_reassign to entity_index,
+	// using the same conventions as SeparableBoxFilterDataStore::RemoveEntity
+	//must be called while node_distance can still compute distances for both indices
+	template<typename NodeDistanceFunction>
+	void RemoveEntity(size_t entity_index, size_t entity_index_to_reassign, NodeDistanceFunction node_distance)
+	{
+		RemoveNode(entity_index, node_distance);
+
+		if(entity_index_to_reassign != entity_index && IsNode(entity_index_to_reassign))
+			MoveNode(entity_index_to_reassign, entity_index);
+
+		//trim any trailing indices that aren't nodes
+		while(links.size() > 0 && links.back().size() == 0)
+			links.pop_back();
+	}
+
+	//finds up to top_k nodes in enabled_indices nearest to a point, where distance_to_point(entity_index) returns
+	// the distance from the point to the entity, and places them in distances_out sorted from nearest to farthest
+	// num_candidates is the number of nodes kept while searching the bottom level, larger values increase recall at the cost of more distance computations
+	template<typename DistanceFunction>
+	void FindNearest(DistanceFunction distance_to_point, size_t top_k, size_t num_candidates,
+		BitArrayIntegerSet &enabled_indices, std::vector<DistanceReferencePair<size_t>> &distances_out)
+	{
+		distances_out.clear();
+		if(numNodes == 0 || top_k == 0)
+			return;
+
+		size_t closest = entryNode;
+		double closest_distance = distance_to_point(closest);
+		for(size_t level = topLevel; level > 0; level--)
+			FindClosestGreedily(closest, closest_distance, level, distance_to_point);
+
+		SearchLevel(closest, closest_distance, 0, std::max(num_candidates, top_k), distance_to_point, &enabled_indices, distances_out);
+		if(distances_out.size() > top_k)
+			distances_out.resize(top_k);
+	}
+
+	//labels of the features of the graph, in the order of the queries it answers
+	std::vector<StringInternPool::StringID> labelIds;
+
+	//distance parameters of the queries the graph answers
+	GeneralizedDistance distParams;
+
+	//distance parameters used to compute the distances between nodes, which are distParams
+	// with the differences for unknown values populated from the values when the graph was built
+	GeneralizedDistance nodeDistParams;
+
+protected:
+
+	//maximum number of links per node on each level above the bottom, which has twice as many
+	static constexpr size_t maxLinksPerLevel = 16;
+
+	//number of candidates kept when searching for the links of a new node
+	static constexpr size_t numConstructionCandidates = 64;
+
+	//maximum number of links for a node on level
+	static constexpr size_t GetMaxLinks(size_t level)
+	{
+		return (level == 0 ? 2 * maxLinksPerLevel : maxLinksPerLevel);
+	}
+
+	//searching may specialize a continuous feature to universally numeric when every value is a number,
+	// which doesn't change the distances but may not hold as values change, so sets them back to continuous numeric
+	static inline void SetUniversallyNumericFeaturesToNumeric(GeneralizedDistance &dist_params)
+	{
+		for(auto &feature_params : dist_params.featureParams)
+		{
+			if(feature_params.featureType == FDT_CONTINUOUS_UNIVERSALLY_NUMERIC)
+				feature_params.featureType = FDT_CONTINUOUS_NUMERIC;
+		}
+	}
+
+	//returns the nodes whose top level is level, which must be greater than 0
+	inline FastHashSet<size_t> &GetUpperLevelNodes(size_t level)
+	{
+		if(level > upperLevelNodes.size())
+			upperLevelNodes.resize(level);
+		return upperLevelNodes[level - 1];
+	}
+
+	//randomly chooses the top level for a new node such that each level has exponentially fewer nodes
+	inline size_t GetRandomLevel()
+	{
+		const double level_multiplier = 1.0 / std::log(static_cast<double>(maxLinksPerLevel));
+		double level = -std::log(1.0 - randomStream.RandFull()) * level_multiplier;
+		return std::min(static_cast<size_t>(level), static_cast<size_t>(32));
+	}
+
+	//moves closest along links on level as long as it gets closer, updating closest_distance
+	template<typename DistanceFunction>
+	inline void FindClosestGreedily(size_t &closest, double &closest_distance, size_t level, DistanceFunction &distance_to_point)
+	{
+		bool moved = true;
+		while(moved)
+		{
+			moved = false;
+			auto &neighbors = links[closest][level];
+			for(size_t neighbor : neighbors)
+			{
+				double distance = distance_to_point(neighbor);
+				if(distance < closest_distance)
+				{
+					closest = neighbor;
+					closest_distance = distance;
+					moved = true;
+				}
+			}
+		}
+	}
+
+	//searches level starting at entry keeping the num_candidates closest nodes, and places the closest that are
+	// in accepted_indices, or all nodes if accepted_indices is null, into results sorted from nearest to farthest
+	template<typename DistanceFunction>
+	void SearchLevel(size_t entry, double entry_distance, size_t level, size_t num_candidates,
+		DistanceFunction &distance_to_point, BitArrayIntegerSet *accepted_indices, std::vector<DistanceReferencePair<size_t>> &results)
+	{
+		FastHashSet<size_t> visited;
+		visited.insert(entry);
+
+		//candidates are stored with negated distances so the top is the nearest
+		std::priority_queue<DistanceReferencePair<size_t>> candidates;
+		candidates.emplace(-entry_distance, entry);
+
+		//the top of nearest is the farthest kept
+		std::priority_queue<DistanceReferencePair<size_t>> nearest;
+		if(accepted_indices == nullptr || accepted_indices->contains(entry))
+			nearest.emplace(entry_distance, entry);
+
+		while(!candidates.empty())
+		{
+			auto candidate = candidates.top();
+			if(nearest.size() >= num_candidates && -candidate.distance > nearest.top().distance)
+				break;
+			candidates.pop();
+
+			for(size_t neighbor : links[candidate.reference][level])
+			{
+				if(!visited.insert(neighbor).second)
+					continue;
+
+				double distance = distance_to_point(neighbor);
+				if(nearest.size() >= num_candidates && distance >= nearest.top().distance)
+					continue;
+
+				candidates.emplace(-distance, neighbor);
+				if(accepted_indices == nullptr || accepted_indices->contains(neighbor))
+				{
+					nearest.emplace(distance, neighbor);
+					if(nearest.size() > num_candidates)
+						nearest.pop();
+				}
+			}
+		}
+
+		results.resize(nearest.size());
+		while(!nearest.empty())
+		{
+			results[nearest.size() - 1] = nearest.top();
+			nearest.pop();
+		}
+	}
+
+	//selects up to max_links of the candidates, sorted nearest first, preferring candidates that are closer to the new node
+	// than to any already selected so that links reach in different directions, then filling with the nearest remaining
+	template<typename NodeDistanceFunction>
+	void SelectNeighbors(std::vector<DistanceReferencePair<size_t>> &candidates, size_t max_links, std::vector<size_t> &selected,
+		NodeDistanceFunction &node_distance)
+	{
+		selected.clear();
+		for(auto &candidate : candidates)
+		{
+			if(selected.size() >= max_links)
+				break;
+
+			bool diverse = std::none_of(begin(selected), end(selected),
+				[&node_distance, &candidate](size_t s) { return node_distance(candidate.reference, s) < candidate.distance; });
+			if(diverse)
+				selected.push_back(candidate.reference);
+		}
+
+		for(auto &candidate : candidates)
+		{
+			if(selected.size() >= max_links)
+				break;
+
+			if(std::find(begin(selected), end(selected), candidate.reference) == end(selected))
+				selected.push_back(candidate.reference);
+		}
+	}
+
+	//links a and b on level, pruning the farthest links of either if it has too many
+	template<typename NodeDistanceFunction>
+	void Link(size_t a, size_t b, size_t level, NodeDistanceFunction &node_distance)
+	{
+		links[a][level].push_back(b);
+		links[b][level].push_back(a);
+		PruneLinks(a, level, node_distance);
+		PruneLinks(b, level, node_distance);
+	}
+
+	//removes b from the links of a on level
+	inline void Unlink(size_t a, size_t b, size_t level)
+	{
+		auto &neighbors = links[a][level];
+		auto found = std::find(begin(neighbors), end(neighbors), b);
+		if(found != end(neighbors))
+		{
+			*found = neighbors.back();
+			neighbors.pop_back();
+		}
+	}
+
+	//removes the farthest links of node on level until it has no more than the maximum
+	template<typename NodeDistanceFunction>
+	void PruneLinks(size_t node, size_t level, NodeDistanceFunction &node_distance)
+	{
+		auto &neighbors = links[node][level];
+		if(neighbors.size() <= GetMaxLinks(level))
+			return;
+
+		//only one link is over the maximum after linking, so find the farthest with one distance per neighbor
+		size_t farthest_offset = 0;
+		double farthest_distance = -std::numeric_limits<double>::infinity();
+		for(size_t i = 0; i < neighbors.size(); i++)
+		{
+			double distance = node_distance(node, neighbors[i]);
+			if(distance > farthest_distance)
+			{
+				farthest_distance = distance;
+				farthest_offset = i;
+			}
+		}
+
+		size_t farthest_node = neighbors[farthest_offset];
+		neighbors[farthest_offset] = neighbors.back();
+		neighbors.pop_back();
+		Unlink(farthest_node, node, level);
+	}
+
+	//chooses a new entry node on the highest level that has any nodes after the entry node was removed,
+	// where former_links are the links that the entry node had
+	void ReplaceEntryNode(std::vector<std::vector<size_t>> &former_links)
+	{
+		entryNode = 0;
+		topLevel = 0;
+		if(numNodes == 0)
+			return;
+
+		//drop empty levels from the top
+		while(upperLevelNodes.size() > 0 && upperLevelNodes.back().size() == 0)
+			upperLevelNodes.pop_back();
+
+		if(upperLevelNodes.size() > 0)
+		{
+			topLevel = upperLevelNodes.size();
+			entryNode = *std::begin(upperLevelNodes.back());
+			return;
+		}
+
+		//only the bottom level remains, so any former neighbor will do
+		if(former_links.size() > 0 && former_links[0].size() > 0)
+		{
+			entryNode = former_links[0][0];
+			return;
+		}
+
+		//the entry node had no links on the bottom level, so find any remaining node
+		for(size_t i = 0; i < links.size(); i++)
+		{
+			if(links[i].size() > 0)
+			{
+				entryNode = i;
+				return;
+			}
+		}
+	}
+
+	//moves the node at from to the index to, which must not be a node
+	void MoveNode(size_t from, size_t to)
+	{
+		if(to >= links.size())
+			links.resize(to + 1);
+
+		links[to] = std::move(links[from]);
+		links[from].clear();
+
+		size_t node_top_level = links[to].size() - 1;
+		if(node_top_level > 0)
+		{
+			auto &level_nodes = GetUpperLevelNodes(node_top_level);
+			level_nodes.erase(from);
+			level_nodes.insert(to);
+		}
+
+		for(size_t level = 0; level < links[to].size(); level++)
+		{
+			for(size_t neighbor : links[to][level])
+				std::replace(begin(links[neighbor][level]), end(links[neighbor][level]), from, to);
+		}
+
+		if(entryNode == from)
+			entryNode = to;
+	}
+
+	//for each entity index, the links on each level from 0 through its top level; empty if not a node
+	std::vector<std::vector<std::vector<size_t>>> links;
+
+	//for each level above the bottom, the nodes whose top level is that level, where index 0 is level 1
+	// so that a new entry node can be found without visiting every node
+	std::vector<FastHashSet<size_t>> upperLevelNodes;
+
+	//number of entities that are nodes
+	size_t numNodes;
+
+	//node on the top level where searches begin
+	size_t entryNode;
+
+	//highest level of any node
+	size_t topLevel;
+
+	//used to choose the levels of nodes
+	RandomStream randomStream;
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+//project headers:
+#include "FastMath.h"
+
+//system headers:
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+//sum of values that can be removed as well as added, using Neumaier's compensated summation so that
+// the sum does not drift as values are repeatedly added and removed
+//infinite and nan values are counted rather than summed so that they can be removed again
+class CompensatedSum
+{
+public:
+	inline CompensatedSum()
+		: sum(0.0), compensation(0.0), numNan(0), numPositiveInfinity(0), numNegativeInfinity(0)
+	{	}
+
+	inline void Add(double value)
+	{
+		if(FastIsNaN(value))
+			numNan++;
+		else if(value == std::numeric_limits<double>::infinity())
+			numPositiveInfinity++;
+		else if(value == -std::numeric_limits<double>::infinity())
+			numNegativeInfinity++;
+		else
+			AccumulateFinite(value);
+	}
+
+	//removes value, which must have previously been added
+	inline void Remove(double value)
+	{
+		if(FastIsNaN(value))
+			numNan--;
+		else if(value == std::numeric_limits<double>::infinity())
+			numPositiveInfinity--;
+		else if(value == -std::numeric_limits<double>::infinity())
+			numNegativeInfinity--;
+		else
+			AccumulateFinite(-value);
+	}
+
+	//returns the sum, which is nan or infinite the same as summing all of the values directly would be
+	inline double GetSum()
+	{
+		if(numNan > 0 || (numPositiveInfinity > 0 && numNegativeInfinity > 0))
+			return std::numeric_limits<double>::quiet_NaN();
+		if(numPositiveInfinity > 0)
+			return std::numeric_limits<double>::infinity();
+		if(numNegativeInfinity > 0)
+			return -std::numeric_limits<double>::infinity();
+
+		//if the finite values overflowed, the compensation is no longer meaningful
+		if(!std::isfinite(sum))
+			return sum;
+		return sum + compensation;
+	}
+
+protected:
+	__forceinline void AccumulateFinite(double value)
+	{
+		double new_sum = sum + value;
+		if(std::abs(sum) >= std::abs(value))
+			compensation += (sum - new_sum) + value;
+		else
+			compensation += (value - new_sum) + sum;
+		sum = new_sum;
+	}
+
+	double sum;
+	//accumulated low order bits lost from sum
+	double compensation;
+
+	size_t numNan;
+	size_t numPositiveInfinity;
+	size_t numNegativeInfinity;
+};
+
+//running aggregates of a set of number values, including nans, that are updated as values are added and removed
+class NumberValueSummary
+{
+public:
+	inline NumberValueSummary()
+		: numValues(0)
+	{	}
+
+	inline void Add(double value)
+	{
+		numValues++;
+		sum.Add(value);
+		sumOfSquares.Add(value * value);
+	}
+
+	//removes value, which must have previously been added
+	inline void Remove(double value)
+	{
+		numValues--;
+		sum.Remove(value);
+		sumOfSquares.Remove(value * value);
+	}
+
+	size_t numValues;
+	CompensatedSum sum;
+	CompensatedSum sumOfSquares;
+};
+
+//running aggregates of a set of number values, each with a weight, that are updated as values are added and removed
+//values with a weight of zero are not included, so that zero weights take precedence over infinite or nan values
+class WeightedNumberValueSummary
+{
+public:
+	inline void Add(double value, double weight)
+	{
+		if(weight == 0.0)
+			return;
+
+		weightSum.Add(weight);
+		weightedSum.Add(weight * value);
+		weightedSumOfSquares.Add(weight * value * value);
+	}
+
+	//removes value with weight, which must have previously been added
+	inline void Remove(double value, double weight)
+	{
+		if(weight == 0.0)
+			return;
+
+		weightSum.Remove(weight);
+		weightedSum.Remove(weight * value);
+		weightedSumOfSquares.Remove(weight * value * value);
+	}
+
+	CompensatedSum weightSum;
+	CompensatedSum weightedSum;
+	CompensatedSum weightedSumOfSquares;
+};
@@ -4,11 +4,16 @@
 #include "DistanceReferencePair.h"
 #include "EvaluableNode.h"
 #include "EvaluableNodeTreeFunctions.h"
+#include "FastMath.h"
 #include "HashMaps.h"
 #include "IntegerSet.h"
+#include "NumberValueSummary.h"
+#include "SortedNumberValueBuckets.h"
+#include "StringEditDistanceIndex.h"
 
 //system headers:
 #include <algorithm>
+#include <limits>
 #include <memory>
 #include <vector>
 
@@ -25,6 +30,8 @@ public:
 		longestStringLength = 0;
 		indexWithLargestCode = 0;
 		largestCodeSize = 0;
+		reducedPrecision = false;
+		writeEpoch = 0;
 	}
 
 	//like InsertIndexValue, but used only for building the column data from an empty column
@@ -34,6 +41,8 @@ public:
 	void InsertNextIndexValueExceptNumbers(EvaluableNodeImmediateValueType value_type, EvaluableNodeImmediateValue &value,
 		size_t index, std::vector<DistanceReferencePair<size_t>> &entities_with_number_values)
 	{
+		SetColumnarValue(value_type, value, index);
+
 		if(value_type == ENIVT_NOT_EXIST)
 		{
 			invalidIndices.insert(index);
@@ -46,9 +55,14 @@ public:
 		{
 			numberIndices.insert(index);
 			if(FastIsNaN(value.number))
+			{
 				nanIndices.insert(index);
+				numberValueSummary.Add(value.number);
+			}
 			else
+			{
 				entities_with_number_values.emplace_back(value.number, index);
+			}
 		}
 		else if(value_type == ENIVT_STRING_ID)
 		{
@@ -57,7 +71,11 @@ public:
 			//try to insert the value if not already there, inserting an empty pointer
 			auto [id_entry, inserted] = stringIdValueToIndices.emplace(value.stringID, nullptr);
 			if(inserted)
+			{
 				id_entry->second = std::make_unique<SortedIntegerSet>();
+				if(stringEditDistanceIndex)
+					stringEditDistanceIndex->Insert(value.stringID);
+			}
 
 			auto &ids = id_entry->second;
 
@@ -90,44 +108,244 @@ public:
 		if(index_values.size() == 0)
 			return;
 
-		//count unique values so only need to perform one allocation for the main list
-		size_t num_uniques = 1;
-		double prev_value = index_values[0].distance;
-		for(size_t i = 1; i < index_values.size(); i++)
+		numberIndices.ReserveNumIntegers(index_values.back().reference + 1);
+
+		for(auto &index_value : index_values)
+		{
+			//if don't have the right bucket, then need to create one
+			if(sortedNumberValueBuckets.size() == 0 || sortedNumberValueBuckets.back().value != index_value.distance)
+				sortedNumberValueBuckets.InsertNewLargestValue(index_value.distance);
+
+			sortedNumberValueBuckets.InsertNewLargestIndexInLastBucket(index_value.reference);
+			numberIndices.insert(index_value.reference);
+			numberValueSummary.Add(index_value.distance);
+		}
+	}
+
+	//the sorted number value buckets of a column, which can be stored and used to rebuild the column without sorting its values
+	struct NumberValueBucketsSnapshot
+	{
+		//sum of HashNumberValue over the indices of all of the buckets
+		uint64_t numberValuesHash = 0;
+
+		//value of each bucket in sorted order
+		std::vector<double> bucketValues;
+
+		//number of indices in each bucket
+		std::vector<size_t> bucketSizes;
+
+		//indices of all of the buckets in order of bucket, sorted within each bucket
+		std::vector<size_t> bucketIndices;
+
+		//if not null, the index that each index had when the snapshot was taken, which numberValuesHash was computed with
+		std::shared_ptr<std::vector<size_t>> snapshotIndices;
+	};
+
+	//returns the term for index having the number value in the hash of the number values of a column
+	// the terms are summed so that the hash does not depend on the order the indices are visited in
+	static inline uint64_t HashNumberValue(size_t index, double value)
+	{
+		uint64_t hash = bit_cast<uint64_t, double>(value) ^ (static_cast<uint64_t>(index) * 0x9E3779B97F4A7C15ull);
+		hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ull;
+		hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBull;
+		return hash ^ (hash >> 31);
+	}
+
+	//populates snapshot_out with the buckets of sortedNumberValueBuckets
+	void GetNumberValueBucketsSnapshot(NumberValueBucketsSnapshot &snapshot_out)
+	{
+		snapshot_out = NumberValueBucketsSnapshot();
+		snapshot_out.bucketValues.reserve(sortedNumberValueBuckets.size());
+		snapshot_out.bucketSizes.reserve(sortedNumberValueBuckets.size());
+		snapshot_out.bucketIndices.reserve(sortedNumberValueBuckets.GetNumIndices());
+
+		for(auto &bucket : sortedNumberValueBuckets)
 		{
-			if(prev_value != index_values[i].distance)
+			snapshot_out.bucketValues.push_back(bucket.value);
+			snapshot_out.bucketSizes.push_back(bucket.indices.size());
+			for(auto index : bucket.indices)
 			{
-				num_uniques++;
-				prev_value = index_values[i].distance;
+				snapshot_out.bucketIndices.push_back(index);
+				snapshot_out.numberValuesHash += HashNumberValue(index, bucket.value);
 			}
 		}
+	}
 
-		sortedNumberValueIndexPairs.reserve(num_uniques);
-		numberIndices.ReserveNumIntegers(index_values.back().reference + 1);
+	//sorts index_values, which are assumed to be in order of index, and inserts them via AppendSortedNumberIndicesWithSortedIndices
+	//if snapshot is not nullptr and was taken of the same values, then inserts its buckets instead of sorting
+	void AppendNumberIndices(std::vector<DistanceReferencePair<size_t>> &index_values, NumberValueBucketsSnapshot *snapshot)
+	{
+		if(snapshot != nullptr && snapshot->bucketIndices.size() == index_values.size())
+		{
+			auto snapshot_indices = snapshot->snapshotIndices.get();
+			uint64_t number_values_hash = 0;
+			bool indices_valid = true;
+			for(auto &index_value : index_values)
+			{
+				size_t index = index_value.reference;
+				if(snapshot_indices != nullptr)
+				{
+					if(index >= snapshot_indices->size())
+					{
+						indices_valid = false;
+						break;
+					}
+					index = (*snapshot_indices)[index];
+				}
+				number_values_hash += HashNumberValue(index, index_value.distance);
+			}
 
-		for(auto &index_value : index_values)
+			if(indices_valid && number_values_hash == snapshot->numberValuesHash)
+			{
+				AppendNumberValueBucketsSnapshot(*snapshot);
+				return;
+			}
+		}
+
+		//sort the number values for efficient insertion, but keep the entities in their order
+		std::stable_sort(std::begin(index_values), std::end(index_values));
+		AppendSortedNumberIndicesWithSortedIndices(index_values);
+	}
+
+	//like AppendSortedNumberIndicesWithSortedIndices, but inserts the buckets of snapshot
+	void AppendNumberValueBucketsSnapshot(NumberValueBucketsSnapshot &snapshot)
+	{
+		if(snapshot.bucketIndices.size() == 0)
+			return;
+
+		numberIndices.ReserveNumIntegers(snapshot.bucketIndices.back() + 1);
+
+		size_t bucket_indices_offset = 0;
+		for(size_t bucket_index = 0; bucket_index < snapshot.bucketValues.size(); bucket_index++)
 		{
-			//if don't have the right bucket, then need to create one
-			if(sortedNumberValueIndexPairs.size() == 0 || sortedNumberValueIndexPairs.back().first != index_value.distance)
-				sortedNumberValueIndexPairs.emplace_back(index_value.distance, std::make_unique<SortedIntegerSet>());
+			double value = snapshot.bucketValues[bucket_index];
+			sortedNumberValueBuckets.InsertNewLargestValue(value);
 
-			sortedNumberValueIndexPairs.back().second->InsertNewLargestInteger(index_value.reference);
-			numberIndices.insert(index_value.reference);
+			for(size_t i = 0; i < snapshot.bucketSizes[bucket_index]; i++)
+			{
+				size_t index = snapshot.bucketIndices[bucket_indices_offset++];
+				sortedNumberValueBuckets.InsertNewLargestIndexInLastBucket(index);
+				numberIndices.insert(index);
+				numberValueSummary.Add(value);
+			}
 		}
 	}
 
-	//returns the value type of the given index given the value
+	//returns the value type of the given index
 	__forceinline EvaluableNodeImmediateValueType GetIndexValueType(size_t index)
 	{
-		if(numberIndices.contains(index))
-			return ENIVT_NUMBER;
-		if(stringIdIndices.contains(index))
-			return ENIVT_STRING_ID;
-		if(nullIndices.contains(index))
-			return ENIVT_NULL;
-		if(invalidIndices.contains(index))
+		if(index >= valueTypes.size())
 			return ENIVT_NOT_EXIST;
-		return ENIVT_CODE;
+		return valueTypes[index];
+	}
+
+	//returns the value of the given index, requires a valid index
+	__forceinline EvaluableNodeImmediateValue GetIndexValue(size_t index)
+	{
+		if(!reducedPrecision)
+			return values[index];
+
+		switch(valueTypes[index])
+		{
+		case ENIVT_NUMBER:
+			return EvaluableNodeImmediateValue(GetIndexNumberValue(index));
+
+		case ENIVT_STRING_ID:
+		case ENIVT_CODE:
+			return nonNumberValues.find(index)->second;
+
+		default:
+			return EvaluableNodeImmediateValue(std::numeric_limits<double>::quiet_NaN());
+		}
+	}
+
+	//returns the number value of the given index, NaN if the value is not a number
+	// requires a valid index
+	__forceinline double GetIndexNumberValue(size_t index)
+	{
+		if(valueTypes[index] != ENIVT_NUMBER)
+			return std::numeric_limits<double>::quiet_NaN();
+
+		if(!reducedPrecision)
+			return values[index].number;
+
+		return FindExactNumberValueFromReducedNumberValue(index);
+	}
+
+	//returns the values of every index as doubles, which are only valid for indices that are numbers,
+	// null, or do not exist, the latter two of which are NaN
+	//used to compute numeric distance terms of a column that has no string or code values,
+	// and requires that the column is not using reduced precision
+	__forceinline const double *GetNumberValuesData()
+	{
+		static_assert(sizeof(EvaluableNodeImmediateValue) == sizeof(double), "Values must be laid out as doubles");
+		return reinterpret_cast<const double *>(values.data());
+	}
+
+	//returns the number value of the given index rounded to a float, NaN if the value is not a number
+	// requires a valid index and that the column is using reduced precision
+	__forceinline float GetIndexReducedNumberValue(size_t index)
+	{
+		return reducedNumberValues[index];
+	}
+
+	//switches the columnar values between full and reduced precision
+	//at reduced precision, only the floats and the string and code values are stored by index,
+	// and exact numbers are recovered from sortedNumberValueBuckets
+	void SetReducedPrecision(bool reduced)
+	{
+		if(reduced == reducedPrecision)
+			return;
+
+		if(reduced)
+		{
+			reducedNumberValues.resize(values.size());
+			for(size_t i = 0; i < values.size(); i++)
+			{
+				reducedNumberValues[i] = static_cast<float>(GetIndexNumberValue(i));
+				if(valueTypes[i] == ENIVT_STRING_ID || valueTypes[i] == ENIVT_CODE)
+					nonNumberValues.emplace(i, values[i]);
+			}
+
+			values.clear();
+			values.shrink_to_fit();
+			reducedPrecision = true;
+		}
+		else
+		{
+			values.resize(reducedNumberValues.size());
+			for(size_t i = 0; i < values.size(); i++)
+				values[i] = GetIndexValue(i);
+
+			reducedPrecision = false;
+			reducedNumberValues.clear();
+			reducedNumberValues.shrink_to_fit();
+			nonNumberValues.clear();
+		}
+	}
+
+	//returns true if the value at index is a number, including NaN
+	__forceinline bool IsIndexNumber(size_t index)
+	{
+		return (index < valueTypes.size() && valueTypes[index] == ENIVT_NUMBER);
+	}
+
+	//truncates or extends the columnar storage to num_indices,
+	// filling any new indices as not existing
+	inline void ResizeColumnarStorage(size_t num_indices)
+	{
+		if(reducedPrecision)
+		{
+			//remove any string or code values of truncated indices
+			for(size_t i = num_indices; i < valueTypes.size(); i++)
+				nonNumberValues.erase(i);
+			reducedNumberValues.resize(num_indices, std::numeric_limits<float>::quiet_NaN());
+		}
+		else
+		{
+			values.resize(num_indices, EvaluableNodeImmediateValue(std::numeric_limits<double>::quiet_NaN()));
+		}
+		valueTypes.resize(num_indices, ENIVT_NOT_EXIST);
 	}
 
 	//moves index from being associated with key old_value to key new_value
@@ -154,6 +372,21 @@ public:
 	//deletes everything involving the value at the index
 	void DeleteIndexValue(EvaluableNodeImmediateValue value, size_t index)
 	{
+		if(index < valueTypes.size())
+		{
+			if(reducedPrecision)
+			{
+				if(valueTypes[index] == ENIVT_STRING_ID || valueTypes[index] == ENIVT_CODE)
+					nonNumberValues.erase(index);
+				reducedNumberValues[index] = std::numeric_limits<float>::quiet_NaN();
+			}
+			else
+			{
+				values[index].number = std::numeric_limits<double>::quiet_NaN();
+			}
+			valueTypes[index] = ENIVT_NOT_EXIST;
+		}
+
 		if(invalidIndices.EraseAndRetrieve(index))
 			return;
 
@@ -163,6 +396,8 @@ public:
 
 		if(numberIndices.EraseAndRetrieve(index))
 		{
+			numberValueSummary.Remove(value.number);
+
 			//remove, and if not a nan, then need to also remove the number
 			if(!nanIndices.EraseAndRetrieve(index))
 			{
@@ -172,13 +407,13 @@ public:
 					return;
 
 				//if the bucket has only one entry, we must delete the entire bucket
-				if(sortedNumberValueIndexPairs[value_index].second->size() == 1)
+				if(sortedNumberValueBuckets[value_index].indices.size() == 1)
 				{
-					sortedNumberValueIndexPairs.erase(sortedNumberValueIndexPairs.begin() + value_index);
+					sortedNumberValueBuckets.Erase(value_index);
 				}
 				else //else we can just remove the id from the bucket
 				{
-					sortedNumberValueIndexPairs[value_index].second->erase(index);
+					sortedNumberValueBuckets.EraseIndex(value_index, index);
 				}
 			}
 
@@ -195,7 +430,11 @@ public:
 				
 				//if no more entries have the value, remove it
 				if(entities.size() == 0)
+				{
 					stringIdValueToIndices.erase(id_entry);
+					if(stringEditDistanceIndex)
+						stringEditDistanceIndex->Remove(value.stringID);
+				}
 			}
 
 			//see if need to compute new longest string
@@ -241,6 +480,8 @@ public:
 	//inserts the value at id
 	void InsertIndexValue(EvaluableNodeImmediateValueType value_type, EvaluableNodeImmediateValue &value, size_t index)
 	{
+		SetColumnarValue(value_type, value, index);
+
 		if(value_type == ENIVT_NOT_EXIST)
 		{
 			invalidIndices.insert(index);
@@ -256,6 +497,7 @@ public:
 		if(value_type == ENIVT_NUMBER)
 		{
 			numberIndices.insert(index);
+			numberValueSummary.Add(value.number);
 
 			if(FastIsNaN(value.number))
 			{
@@ -267,14 +509,14 @@ public:
 			auto [value_index, exact_index_found] = FindExactIndexForValue(value.number);
 			if(exact_index_found)
 			{
-				sortedNumberValueIndexPairs[value_index].second->insert(index);
+				sortedNumberValueBuckets.InsertIndex(value_index, index);
 				return;
 			}
 
 			//insert new value in correct position
 			size_t new_value_index = FindUpperBoundIndexForValue(value.number);
-			auto inserted = sortedNumberValueIndexPairs.emplace(sortedNumberValueIndexPairs.begin() + new_value_index, value.number, std::make_unique<SortedIntegerSet>());
-			inserted->second->insert(index);
+			sortedNumberValueBuckets.Insert(new_value_index, value.number);
+			sortedNumberValueBuckets.InsertIndex(new_value_index, index);
 
 			return;
 		}
@@ -286,7 +528,11 @@ public:
 			//try to insert the value if not already there
 			auto [inserted_id_entry, inserted] = stringIdValueToIndices.emplace(value.stringID, nullptr);
 			if(inserted)
+			{
 				inserted_id_entry->second = std::make_unique<SortedIntegerSet>();
+				if(stringEditDistanceIndex)
+					stringEditDistanceIndex->Insert(value.stringID);
+			}
 
 			auto &ids = *(inserted_id_entry->second);
 			
@@ -323,10 +569,10 @@ public:
 
 		case FDT_CONTINUOUS_NUMERIC:
 		case FDT_CONTINUOUS_UNIVERSALLY_NUMERIC:
-			if(sortedNumberValueIndexPairs.size() <= 1)
+			if(sortedNumberValueBuckets.size() <= 1)
 				return 0.0;
 
-			return sortedNumberValueIndexPairs.back().first - sortedNumberValueIndexPairs[0].first;
+			return sortedNumberValueBuckets.back().value - sortedNumberValueBuckets.front().value;
 
 		case FDT_CONTINUOUS_NUMERIC_CYCLIC:
 			//maximum is the other side of the cycle
@@ -371,43 +617,29 @@ public:
 	// .second: true if exact index was found, false otherwise
 	inline std::pair<size_t, bool> FindExactIndexForValue(double value, bool return_index_lower_bound = false)
 	{
-		auto target_iter = std::lower_bound(begin(sortedNumberValueIndexPairs), end(sortedNumberValueIndexPairs), value,
-			[](const auto& value_index_pair, double value)
-			{
-				return value_index_pair.first < value;
-			});
+		size_t target_index = sortedNumberValueBuckets.FindLowerBoundIndex(value);
 
-		if ((target_iter == end(sortedNumberValueIndexPairs)) || (target_iter->first != value)) // not exact match
+		if((target_index == sortedNumberValueBuckets.size()) || (sortedNumberValueBuckets[target_index].value != value)) // not exact match
 		{
-			return std::make_pair(return_index_lower_bound ? std::distance(begin(sortedNumberValueIndexPairs), target_iter) : -1 , false);
+			return std::make_pair(return_index_lower_bound ? target_index : -1 , false);
 		}
 
-		return std::make_pair(std::distance(begin(sortedNumberValueIndexPairs), target_iter), true); // exact match
+		return std::make_pair(target_index, true); // exact match
 	}
 
 	//returns the index of the lower bound of value
 	inline size_t FindLowerBoundIndexForValue(double value)
 	{
-		auto target_iter = std::lower_bound(begin(sortedNumberValueIndexPairs), end(sortedNumberValueIndexPairs), value,
-			[](const auto &value_index_pair, double value)
-			{
-				return value_index_pair.first < value;
-			});
-		return std::distance(begin(sortedNumberValueIndexPairs), target_iter);
+		return sortedNumberValueBuckets.FindLowerBoundIndex(value);
 	}
 
 	//returns the index of the upper bound of value
 	inline size_t FindUpperBoundIndexForValue(double value)
 	{
-		auto target_iter = std::upper_bound(begin(sortedNumberValueIndexPairs), end(sortedNumberValueIndexPairs), value,
-			[](double value, const auto &value_index_pair)
-			{
-				return value < value_index_pair.first;
-			});
-		return std::distance(begin(sortedNumberValueIndexPairs), target_iter);
+		return sortedNumberValueBuckets.FindUpperBoundIndex(value);
 	}
 
-	//given a value, returns the index at which the value should be inserted into the sortedNumberValueIndexPairs
+	//given a value, returns the index at which the value should be inserted into the sortedNumberValueBuckets
 	//returns true for .second when an exact match is found, false otherwise
 	//O(log(n))
 	//cycle_length will take into account whether wrapping around is closer
@@ -422,10 +654,10 @@ public:
 		}
 
 		//if only have one element (or zero), short circuit code below
-		if(sortedNumberValueIndexPairs.size() <= 1)
+		if(sortedNumberValueBuckets.size() <= 1)
 			return std::make_pair(0, false);
 
-		size_t max_valid_index = sortedNumberValueIndexPairs.size() - 1;
+		size_t max_valid_index = sortedNumberValueBuckets.size() - 1;
 		size_t target_index = std::min(max_valid_index, value_index); //value_index is lower bound index since no exact match
 
 		//if not cyclic or cyclic and not at the edge
@@ -435,15 +667,15 @@ public:
 			//need to check index again in case not cyclic
 			// return index with the closer difference
 			if(target_index < max_valid_index
-					&& (std::abs(sortedNumberValueIndexPairs[target_index + 1].first - value) < std::abs(sortedNumberValueIndexPairs[target_index].first - value)))
+					&& (std::abs(sortedNumberValueBuckets[target_index + 1].value - value) < std::abs(sortedNumberValueBuckets[target_index].value - value)))
 				return std::make_pair(target_index + 1, false);
 			else
 				return std::make_pair(target_index, false);
 		}
 		else //cyclic
 		{
-			double dist_to_max_index = std::abs(sortedNumberValueIndexPairs[max_valid_index].first - value);
-			double dist_to_0_index = std::abs(sortedNumberValueIndexPairs[0].first - value);
+			double dist_to_max_index = std::abs(sortedNumberValueBuckets[max_valid_index].value - value);
+			double dist_to_0_index = std::abs(sortedNumberValueBuckets[0].value - value);
 			size_t other_closest_index;
 
 			if(target_index == 0)
@@ -459,7 +691,7 @@ public:
 				other_closest_index = max_valid_index - 1;
 			}
 
-			double dist_to_other_closest_index = std::abs(sortedNumberValueIndexPairs[other_closest_index].first - value);
+			double dist_to_other_closest_index = std::abs(sortedNumberValueBuckets[other_closest_index].value - value);
 			if(dist_to_0_index <= dist_to_other_closest_index && dist_to_0_index <= dist_to_max_index)
 				return std::make_pair(0, false);
 			else if(dist_to_other_closest_index <= dist_to_0_index)
@@ -478,7 +710,7 @@ public:
 		if(value_type == ENIVT_NUMBER)
 		{
 			//there are no ids for this column, so return no results
-			if(sortedNumberValueIndexPairs.size() == 0)
+			if(sortedNumberValueBuckets.size() == 0)
 				return;
 
 			//make a copy because passed by reference, and may need to change value for logic below
@@ -535,19 +767,19 @@ public:
 				if(between_values)
 				{
 					size_t index = value_index;
-					out.InsertInBatch(*sortedNumberValueIndexPairs[index].second);
+					out.InsertInBatch(sortedNumberValueBuckets[index].indices);
 				}
 				else //if not within, populate with all indices not equal to value
 				{
 					//include nans
 					nanIndices.CopyTo(out);
 
-					for(auto &[bucket_val, bucket] : sortedNumberValueIndexPairs)
+					for(auto &[bucket_val, bucket] : sortedNumberValueBuckets)
 					{
 						if(bucket_val == low_number)
 							continue;
 
-						out.InsertInBatch(*bucket);
+						out.InsertInBatch(bucket);
 					}
 				}
 
@@ -555,27 +787,29 @@ public:
 			}
 
 			size_t start_index = (low_number == -std::numeric_limits<double>::infinity()) ? 0 : FindLowerBoundIndexForValue(low_number);
-			size_t end_index = (high_number == std::numeric_limits<double>::infinity()) ? sortedNumberValueIndexPairs.size() : FindUpperBoundIndexForValue(high_number);
+			size_t end_index = (high_number == std::numeric_limits<double>::infinity()) ? sortedNumberValueBuckets.size() : FindUpperBoundIndexForValue(high_number);
+			auto start_iter = sortedNumberValueBuckets.GetIteratorAtIndex(start_index);
+			auto end_iter = sortedNumberValueBuckets.GetIteratorAtIndex(end_index);
 
 			if(between_values)
 			{
 				//insert everything between the two indices
-				for(size_t i = start_index; i < end_index; i++)
-					out.InsertInBatch(*sortedNumberValueIndexPairs[i].second);
+				for(auto iter = start_iter; iter != end_iter; ++iter)
+					out.InsertInBatch(iter->indices);
 
 				//include end_index if value matches
-				if(end_index < sortedNumberValueIndexPairs.size() && sortedNumberValueIndexPairs[end_index].first == high_number)
-					out.InsertInBatch(*sortedNumberValueIndexPairs[end_index].second);
+				if(end_iter != sortedNumberValueBuckets.end() && end_iter->value == high_number)
+					out.InsertInBatch(end_iter->indices);
 			}
 			else //not between_values
 			{
 				//insert everything left of range
-				for(size_t i = 0; i < start_index; i++)
-					out.InsertInBatch(*sortedNumberValueIndexPairs[i].second);
+				for(auto iter = sortedNumberValueBuckets.begin(); iter != start_iter; ++iter)
+					out.InsertInBatch(iter->indices);
 
 				//insert everything right of range
-				for(size_t i = end_index; i < sortedNumberValueIndexPairs.size(); i++)
-					out.InsertInBatch(*sortedNumberValueIndexPairs[i].second);
+				for(auto iter = end_iter; iter != sortedNumberValueBuckets.end(); ++iter)
+					out.InsertInBatch(iter->indices);
 			}
 
 		}
@@ -637,7 +871,7 @@ public:
 
 			auto [value_index, exact_index_found] = FindExactIndexForValue(value.number);
 			if(exact_index_found)
-				out.InsertInBatch(*sortedNumberValueIndexPairs[value_index].second);
+				out.InsertInBatch(sortedNumberValueBuckets[value_index].indices);
 		}
 		else if(value_type == ENIVT_STRING_ID)
 		{
@@ -647,6 +881,83 @@ public:
 		}
 	}
 
+	//returns the number of indices UnionAllIndicesWithValue would insert for value
+	// for ENIVT_CODE, returns the number of indices with code values, since any of them may be equal
+	size_t GetNumIndicesWithValue(EvaluableNodeImmediateValueType value_type, EvaluableNodeImmediateValue &value)
+	{
+		if(value_type == ENIVT_NULL)
+			return nullIndices.size();
+
+		if(value_type == ENIVT_NUMBER)
+		{
+			if(FastIsNaN(value.number))
+				return nanIndices.size();
+
+			auto [value_index, exact_index_found] = FindExactIndexForValue(value.number);
+			if(!exact_index_found)
+				return 0;
+			return sortedNumberValueBuckets[value_index].indices.size();
+		}
+
+		if(value_type == ENIVT_STRING_ID)
+		{
+			auto id_entry = stringIdValueToIndices.find(value.stringID);
+			if(id_entry == end(stringIdValueToIndices))
+				return 0;
+			return id_entry->second->size();
+		}
+
+		if(value_type == ENIVT_CODE)
+			return codeIndices.size();
+
+		return 0;
+	}
+
+	//returns an estimate of the number of indices FindAllIndicesWithinRange would insert
+	//number ranges are counted from the sorted values, while string ranges are assumed to contain half of the strings
+	size_t EstimateNumIndicesWithinRange(EvaluableNodeImmediateValueType value_type,
+		EvaluableNodeImmediateValue &low, EvaluableNodeImmediateValue &high, bool between_values)
+	{
+		if(value_type == ENIVT_NUMBER)
+		{
+			//ranges including nans are rare, so just assume they may include any number
+			if(FastIsNaN(low.number) || FastIsNaN(high.number))
+				return numberIndices.size();
+
+			size_t num_within_range = 0;
+			if(low.number <= high.number)
+			{
+				size_t start_index = FindLowerBoundIndexForValue(low.number);
+				size_t end_index = FindUpperBoundIndexForValue(high.number);
+				num_within_range = sortedNumberValueBuckets.CountIndicesBeforeIndex(end_index)
+					- sortedNumberValueBuckets.CountIndicesBeforeIndex(start_index);
+			}
+
+			if(between_values)
+				return num_within_range;
+			return sortedNumberValueBuckets.GetNumIndices() - num_within_range;
+		}
+
+		if(value_type == ENIVT_STRING_ID)
+			return stringIdIndices.size() / 2;
+
+		return 0;
+	}
+
+	//returns true if the column has enough string values that an edit distance index should be built for it
+	inline bool ShouldBuildStringEditDistanceIndex()
+	{
+		return !stringEditDistanceIndex && stringIdValueToIndices.size() >= minNumStringValuesForEditDistanceIndex;
+	}
+
+	//builds stringEditDistanceIndex from the current string values, after which it is kept up to date
+	void BuildStringEditDistanceIndex()
+	{
+		stringEditDistanceIndex = std::make_unique<StringEditDistanceIndex>();
+		for(auto &[string_id, _] : stringIdValueToIndices)
+			stringEditDistanceIndex->Insert(string_id);
+	}
+
 	//fills out with the num_to_find min (if findMax == false) or max (find_max == true) entities in the database
 	//note, if indices_to_consider is not nullptr, will take the intersect, ie out will be set to the num_to_find min or max elements that exist in input indices_to_consider
 	void FindMinMax(EvaluableNodeImmediateValueType value_type, size_t num_to_find, bool find_max,
@@ -655,16 +966,16 @@ public:
 		if(value_type == ENIVT_NUMBER)
 		{
 			//there are no ids for this column, so return no results
-			if(sortedNumberValueIndexPairs.size() == 0)
+			if(sortedNumberValueBuckets.size() == 0)
 				return;
 
 			//search left to right for max (bucket 0 is largest) or right to left for min
-			int64_t value_index = find_max ? sortedNumberValueIndexPairs.size() - 1 : 0;
+			int64_t value_index = find_max ? sortedNumberValueBuckets.size() - 1 : 0;
 
-			while(value_index < static_cast<int64_t>(sortedNumberValueIndexPairs.size()) && value_index >= 0)
+			while(value_index < static_cast<int64_t>(sortedNumberValueBuckets.size()) && value_index >= 0)
 			{
 				//add each index to the out indices and optionally output compute results
-				for(const auto &index : *sortedNumberValueIndexPairs[value_index].second)
+				for(const auto &index : sortedNumberValueBuckets[value_index].indices)
 				{
 					if(indices_to_consider != nullptr && !indices_to_consider->contains(index))
 						continue;
@@ -719,6 +1030,57 @@ public:
 
 protected:
 
+	//records the type and value at index into the columnar storage
+	//values that are null or do not exist are stored as NaN so that numeric columns can be read as doubles
+	__forceinline void SetColumnarValue(EvaluableNodeImmediateValueType value_type, EvaluableNodeImmediateValue &value, size_t index)
+	{
+		if(index >= valueTypes.size())
+			ResizeColumnarStorage(index + 1);
+
+		if(reducedPrecision)
+		{
+			bool was_non_number = (valueTypes[index] == ENIVT_STRING_ID || valueTypes[index] == ENIVT_CODE);
+			if(value_type == ENIVT_STRING_ID || value_type == ENIVT_CODE)
+				nonNumberValues[index] = value;
+			else if(was_non_number)
+				nonNumberValues.erase(index);
+
+			reducedNumberValues[index] = (value_type == ENIVT_NUMBER ? static_cast<float>(value.number) : std::numeric_limits<float>::quiet_NaN());
+		}
+		else
+		{
+			if(value_type == ENIVT_NULL || value_type == ENIVT_NOT_EXIST)
+				values[index].number = std::numeric_limits<double>::quiet_NaN();
+			else
+				values[index] = value;
+		}
+
+		valueTypes[index] = value_type;
+	}
+
+	//returns the exact number value of index from the bucket in sortedNumberValueBuckets that contains it,
+	// searching only the values that round to the same float as the reduced precision value of index
+	//requires that the column is using reduced precision and that the value of index is a number
+	inline double FindExactNumberValueFromReducedNumberValue(size_t index)
+	{
+		float reduced_value = reducedNumberValues[index];
+		if(FastIsNaN(reduced_value))
+			return std::numeric_limits<double>::quiet_NaN();
+
+		double upper_bound = std::nextafter(reduced_value, std::numeric_limits<float>::infinity());
+		size_t bucket_index = sortedNumberValueBuckets.FindLowerBoundIndex(
+			std::nextafter(reduced_value, -std::numeric_limits<float>::infinity()));
+		auto end_iter = sortedNumberValueBuckets.end();
+		for(auto iter = sortedNumberValueBuckets.GetIteratorAtIndex(bucket_index); iter != end_iter && iter->value <= upper_bound; ++iter)
+		{
+			if(static_cast<float>(iter->value) == reduced_value && iter->indices.contains(index))
+				return iter->value;
+		}
+
+		//only reached if the index is not in a bucket yet, in which case the reduced value is the best available
+		return reduced_value;
+	}
+
 	//updates longestStringLength and indexWithLongestString based on parameters
 	inline void UpdateLongestString(StringInternPool::StringID sid, size_t index)
 	{
@@ -746,12 +1108,30 @@ public:
 	//name of the column
 	StringInternPool::StringID stringId;
 
+	//the values of the column stored by index, so that distance computations over a column read contiguous memory
+	//type of the value for each index
+	std::vector<EvaluableNodeImmediateValueType> valueTypes;
+	//value for each index, NaN if the value is null or does not exist; only used if not reducedPrecision
+	std::vector<EvaluableNodeImmediateValue> values;
+	//number value for each index rounded to a float, NaN if the value is not a number; only used if reducedPrecision
+	std::vector<float> reducedNumberValues;
+	//string and code values by index; only used if reducedPrecision
+	CompactHashMap<size_t, EvaluableNodeImmediateValue> nonNumberValues;
+	//if true, only reducedNumberValues and nonNumberValues are stored by index instead of values
+	bool reducedPrecision;
+
 	//stores values in sorted order and the entities that have each value
-	std::vector< std::pair<double, std::unique_ptr<SortedIntegerSet>> > sortedNumberValueIndexPairs;
+	SortedNumberValueBuckets sortedNumberValueBuckets;
 
 	//maps a string id to a vector of indices that have that string
 	CompactHashMap<StringInternPool::StringID, std::unique_ptr<SortedIntegerSet>> stringIdValueToIndices;
 
+	//if not null, indexes the keys of stringIdValueToIndices by edit distance
+	std::unique_ptr<StringEditDistanceIndex> stringEditDistanceIndex;
+
+	//minimum number of unique string values before building stringEditDistanceIndex is worthwhile
+	static constexpr size_t minNumStringValuesForEditDistanceIndex = 64;
+
 	//for any value that doesn't fit into other values ( ENIVT_CODE ), maps the number of elements in the code
 	// to the indices of the same size
 	CompactHashMap<size_t, std::unique_ptr<SortedIntegerSet>> valueCodeSizeToIndices;
@@ -762,6 +1142,9 @@ public:
 	//indices of entities with a number value for this feature
 	EfficientIntegerSet numberIndices;
 
+	//running aggregates of the number values of numberIndices, including nans
+	NumberValueSummary numberValueSummary;
+
 	//indices of entities with a string id value for this feature
 	EfficientIntegerSet stringIdIndices;
 
@@ -784,4 +1167,7 @@ public:
 	size_t indexWithLargestCode;
 	//the largest code size for this label
 	size_t largestCodeSize;
+
+	//write epoch of the SeparableBoxFilterDataStore when this column was created or a single value of it was last updated
+	size_t writeEpoch;
 };
@@ -6,10 +6,17 @@ thread_local
 #endif
 SeparableBoxFilterDataStore::SBFDSParametersAndBuffers SeparableBoxFilterDataStore::parametersAndBuffers;
 
+#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+std::atomic<size_t> SeparableBoxFilterDataStore::numPotentialGoodMatchesConsidered(0);
+#else
+size_t SeparableBoxFilterDataStore::numPotentialGoodMatchesConsidered = 0;
+#endif
+
 double SeparableBoxFilterDataStore::PopulatePartialSumsWithSimilarFeatureValue(GeneralizedDistance &dist_params,
 	EvaluableNodeImmediateValue value, EvaluableNodeImmediateValueType value_type,
 	size_t num_entities_to_populate, bool expand_search_if_optimal,
-	size_t query_feature_index, size_t absolute_feature_index, BitArrayIntegerSet &enabled_indices)
+	size_t query_feature_index, size_t absolute_feature_index, BitArrayIntegerSet &enabled_indices,
+	std::vector<PartialSumCollection *> &partial_sums_collections, size_t start_index, size_t end_index)
 {
 	auto &column = columnData[absolute_feature_index];
 	auto feature_type = dist_params.featureParams[query_feature_index].featureType;
@@ -19,8 +26,8 @@ double SeparableBoxFilterDataStore::PopulatePartialSumsWithSimilarFeatureValue(G
 	if(value_is_null)
 	{
 		double unknown_unknown_term = dist_params.ComputeDistanceTermUnknownToUnknown(query_feature_index);
-		AccumulatePartialSums(column->nullIndices, query_feature_index, unknown_unknown_term);
-		AccumulatePartialSums(column->nanIndices, query_feature_index, unknown_unknown_term);
+		AccumulatePartialSums(column->nullIndices, query_feature_index, unknown_unknown_term, partial_sums_collections, start_index, end_index);
+		AccumulatePartialSums(column->nanIndices, query_feature_index, unknown_unknown_term, partial_sums_collections, start_index, end_index);
 
 		//if nominal, need to compute null matches to keep the inner loops fast
 		// if a data set is mostly nulls, it'll be slower, but this is acceptable as a more rare situation
@@ -33,7 +40,7 @@ double SeparableBoxFilterDataStore::PopulatePartialSumsWithSimilarFeatureValue(G
 			known_unknown_indices = enabled_indices;
 			column->nullIndices.EraseTo(known_unknown_indices);
 			column->nanIndices.EraseTo(known_unknown_indices);
-			AccumulatePartialSums(known_unknown_indices, query_feature_index, known_unknown_term);
+			AccumulatePartialSums(known_unknown_indices, query_feature_index, known_unknown_term, partial_sums_collections, start_index, end_index);
 		}
 
 		return known_unknown_term;
@@ -44,8 +51,8 @@ double SeparableBoxFilterDataStore::PopulatePartialSumsWithSimilarFeatureValue(G
 	if(dist_params.IsKnownToUnknownDistanceLessThanOrEqualToExactMatch(query_feature_index))
 	{
 		double known_unknown_term = dist_params.ComputeDistanceTermKnownToUnknown(query_feature_index);
-		AccumulatePartialSums(column->nullIndices, query_feature_index, known_unknown_term);
-		AccumulatePartialSums(column->nanIndices, query_feature_index, known_unknown_term);
+		AccumulatePartialSums(column->nullIndices, query_feature_index, known_unknown_term, partial_sums_collections, start_index, end_index);
+		AccumulatePartialSums(column->nanIndices, query_feature_index, known_unknown_term, partial_sums_collections, start_index, end_index);
 	}
 
 	//if nominal, only need to compute the exact match
@@ -57,7 +64,7 @@ double SeparableBoxFilterDataStore::PopulatePartialSumsWithSimilarFeatureValue(G
 			if(exact_index_found)
 			{
 				double term = dist_params.ComputeDistanceTermNominalExactMatch(query_feature_index);
-				AccumulatePartialSums(*column->sortedNumberValueIndexPairs[value_index].second, query_feature_index, term);
+				AccumulatePartialSums(column->sortedNumberValueBuckets[value_index].indices, query_feature_index, term, partial_sums_collections, start_index, end_index);
 			}
 		}
 		else if(value_type == ENIVT_STRING_ID)
@@ -66,7 +73,7 @@ double SeparableBoxFilterDataStore::PopulatePartialSumsWithSimilarFeatureValue(G
 			if(value_found != end(column->stringIdValueToIndices))
 			{
 				double term = dist_params.ComputeDistanceTermNominalExactMatch(query_feature_index);
-				AccumulatePartialSums(*(value_found->second), query_feature_index, term);
+				AccumulatePartialSums(*(value_found->second), query_feature_index, term, partial_sums_collections, start_index, end_index);
 			}
 		}
 		else if(value_type == ENIVT_CODE)
@@ -81,7 +88,7 @@ double SeparableBoxFilterDataStore::PopulatePartialSumsWithSimilarFeatureValue(G
 			{
 				auto &entity_indices = *(value_found->second);
 				ComputeAndAccumulatePartialSums(dist_params, value, value_type,
-					entity_indices, query_feature_index, absolute_feature_index);
+					entity_indices, query_feature_index, absolute_feature_index, partial_sums_collections, start_index, end_index);
 			}
 		}
 		//else value_type == ENIVT_NULL
@@ -93,11 +100,51 @@ double SeparableBoxFilterDataStore::PopulatePartialSumsWithSimilarFeatureValue(G
 	{
 		if(value_type == ENIVT_STRING_ID)
 		{
+			size_t num_entities_computed = 0;
 			auto value_found = column->stringIdValueToIndices.find(value.stringID);
 			if(value_found != end(column->stringIdValueToIndices))
 			{
 				double term = dist_params.ComputeDistanceTermNonNominalExactMatch(query_feature_index);
-				AccumulatePartialSums(*(value_found->second), query_feature_index, term);
+				num_entities_computed = AccumulatePartialSums(*(value_found->second), query_feature_index, term, partial_sums_collections, start_index, end_index);
+			}
+
+			//if there's an edit distance index, accumulate the nearest other string values too
+			if(column->stringEditDistanceIndex && num_entities_computed < num_entities_to_populate)
+			{
+				auto &value_str = string_intern_pool.GetStringFromID(value.stringID);
+				size_t max_edit_distance = column->longestStringLength + StringManipulation::GetNumUTF8Characters(value_str);
+
+				//find the nearest values, including the exact match, that are enough to cover the entities to populate
+				auto &nearby_values = parametersAndBuffers.stringValuesByEditDistance;
+				size_t search_distance = column->stringEditDistanceIndex->FindNearest(value_str, num_entities_to_populate, max_edit_distance,
+					[&column](StringInternPool::StringID string_id)
+					{	return column->stringIdValueToIndices.find(string_id)->second->size();	},
+					nearby_values);
+
+				//accumulate all values of an edit distance at a time, so every value not accumulated is at least next_distance away
+				size_t next_distance = search_distance + 1;
+				for(size_t i = 0; i < nearby_values.size(); )
+				{
+					size_t distance = nearby_values[i].first;
+					if(num_entities_computed >= num_entities_to_populate)
+					{
+						next_distance = distance;
+						break;
+					}
+
+					double term = dist_params.ComputeDistanceTermNonNominalNonNullRegular(static_cast<double>(distance), query_feature_index);
+					for(; i < nearby_values.size() && nearby_values[i].first == distance; i++)
+					{
+						//the exact match was already accumulated
+						if(distance == 0)
+							continue;
+
+						auto &entity_indices = *column->stringIdValueToIndices.find(nearby_values[i].second)->second;
+						num_entities_computed += AccumulatePartialSums(entity_indices, query_feature_index, term, partial_sums_collections, start_index, end_index);
+					}
+				}
+
+				return dist_params.ComputeDistanceTermNonNominalNonCyclicNonNullRegular(static_cast<double>(next_distance), query_feature_index);
 			}
 		}
 
@@ -116,7 +163,7 @@ double SeparableBoxFilterDataStore::PopulatePartialSumsWithSimilarFeatureValue(G
 		{
 			auto &entity_indices = *(value_found->second);
 			ComputeAndAccumulatePartialSums(dist_params, value, value_type,
-				entity_indices, query_feature_index, absolute_feature_index);
+				entity_indices, query_feature_index, absolute_feature_index, partial_sums_collections, start_index, end_index);
 		}
 
 		//next most similar code must be at least a distance of 1 edit away
@@ -125,7 +172,7 @@ double SeparableBoxFilterDataStore::PopulatePartialSumsWithSimilarFeatureValue(G
 	//else feature_type == FDT_CONTINUOUS_NUMERIC or FDT_CONTINUOUS_UNIVERSALLY_NUMERIC
 
 	//if not a number or no numbers available, then no size
-	if(value_type != ENIVT_NUMBER || column->sortedNumberValueIndexPairs.size() == 0)
+	if(value_type != ENIVT_NUMBER || column->sortedNumberValueBuckets.size() == 0)
 		return GetMaxDistanceTermFromValue(dist_params, value, value_type, query_feature_index, absolute_feature_index);
 
 	bool cyclic_feature = dist_params.IsFeatureCyclic(query_feature_index);
@@ -139,12 +186,12 @@ double SeparableBoxFilterDataStore::PopulatePartialSumsWithSimilarFeatureValue(G
 	if(exact_index_found)
 		term = dist_params.ComputeDistanceTermNonNominalExactMatch(query_feature_index);
 	else
-		term = dist_params.ComputeDistanceTermNonNominalNonNullRegular(value.number - column->sortedNumberValueIndexPairs[value_index].first, query_feature_index);
+		term = dist_params.ComputeDistanceTermNonNominalNonNullRegular(value.number - column->sortedNumberValueBuckets[value_index].value, query_feature_index);
 
-	size_t num_entities_computed = AccumulatePartialSums(*column->sortedNumberValueIndexPairs[value_index].second, query_feature_index, term);
+	size_t num_entities_computed = AccumulatePartialSums(column->sortedNumberValueBuckets[value_index].indices, query_feature_index, term, partial_sums_collections, start_index, end_index);
 
 	//the logic below assumes there are at least two entries
-	size_t num_unique_number_values = column->sortedNumberValueIndexPairs.size();
+	size_t num_unique_number_values = column->sortedNumberValueBuckets.size();
 	if(num_unique_number_values <= 1)
 		return term;
 
@@ -158,7 +205,7 @@ double SeparableBoxFilterDataStore::PopulatePartialSumsWithSimilarFeatureValue(G
 	double largest_diff_delta = 0.0;
 
 	//put a max limit to the number of cases
-	size_t max_cases_relative_to_total = std::min(static_cast<size_t>(2000), static_cast<size_t>(parametersAndBuffers.partialSums.numInstances / 8) );
+	size_t max_cases_relative_to_total = std::min(static_cast<size_t>(2000), static_cast<size_t>(partial_sums_collections.front()->numInstances / 8) );
 	size_t max_num_to_find = std::max(num_entities_to_populate, max_cases_relative_to_total);
 
 	//if one dimension or don't want to expand search, then cut off early
@@ -177,7 +224,7 @@ double SeparableBoxFilterDataStore::PopulatePartialSumsWithSimilarFeatureValue(G
 			if(lower_value_index > 0)
 			{
 				next_lower_index = lower_value_index - 1;
-				lower_diff = std::abs(value.number - column->sortedNumberValueIndexPairs[next_lower_index].first);
+				lower_diff = std::abs(value.number - column->sortedNumberValueBuckets[next_lower_index].value);
 				compute_lower = true;
 			}
 		}
@@ -193,7 +240,7 @@ double SeparableBoxFilterDataStore::PopulatePartialSumsWithSimilarFeatureValue(G
 			if(next_index != value_index)
 			{
 				next_lower_index = next_index;
-				lower_diff = GeneralizedDistance::ConstrainDifferenceToCyclicDifference(std::abs(value.number - column->sortedNumberValueIndexPairs[next_lower_index].first), cycle_length);
+				lower_diff = GeneralizedDistance::ConstrainDifferenceToCyclicDifference(std::abs(value.number - column->sortedNumberValueBuckets[next_lower_index].value), cycle_length);
 				compute_lower = true;
 			}
 		}
@@ -207,7 +254,7 @@ double SeparableBoxFilterDataStore::PopulatePartialSumsWithSimilarFeatureValue(G
 			if(upper_value_index + 1 < num_unique_number_values)
 			{
 				next_upper_index = upper_value_index + 1;
-				upper_diff = std::abs(value.number - column->sortedNumberValueIndexPairs[next_upper_index].first);
+				upper_diff = std::abs(value.number - column->sortedNumberValueBuckets[next_upper_index].value);
 				compute_upper = true;
 			}
 		}
@@ -226,7 +273,7 @@ double SeparableBoxFilterDataStore::PopulatePartialSumsWithSimilarFeatureValue(G
 				if((!compute_lower || next_index != next_lower_index))
 				{
 					next_upper_index = next_index;
-					upper_diff = GeneralizedDistance::ConstrainDifferenceToCyclicDifference(std::abs(value.number - column->sortedNumberValueIndexPairs[next_upper_index].first), cycle_length);
+					upper_diff = GeneralizedDistance::ConstrainDifferenceToCyclicDifference(std::abs(value.number - column->sortedNumberValueBuckets[next_upper_index].value), cycle_length);
 					compute_upper = true;
 				}
 				else //upper and lower have overlapped, want to exit the loop
@@ -263,7 +310,7 @@ double SeparableBoxFilterDataStore::PopulatePartialSumsWithSimilarFeatureValue(G
 			//use heuristic to decide whether to continue populating based on whether this diff will help the overall distance cutoffs
 			// look at the rate of change of the difference compared to before, and how many new entities will be populated
 			// if it is too small and doesn't fill enough (or fills too many), then stop expanding
-			size_t potential_entities = column->sortedNumberValueIndexPairs[next_closest_index].second->size();
+			size_t potential_entities = column->sortedNumberValueBuckets[next_closest_index].indices.size();
 			if(num_entities_computed + potential_entities > max_num_to_find)
 				break;
 			
@@ -288,7 +335,7 @@ double SeparableBoxFilterDataStore::PopulatePartialSumsWithSimilarFeatureValue(G
 		}
 
 		term = dist_params.ComputeDistanceTermNonNominalNonNullRegular(next_closest_diff, query_feature_index);
-		num_entities_computed += AccumulatePartialSums(*column->sortedNumberValueIndexPairs[next_closest_index].second, query_feature_index, term);
+		num_entities_computed += AccumulatePartialSums(column->sortedNumberValueBuckets[next_closest_index].indices, query_feature_index, term, partial_sums_collections, start_index, end_index);
 
 		//track the rate of change of difference
 		if(next_closest_diff - last_diff > largest_diff_delta)
@@ -311,33 +358,104 @@ double SeparableBoxFilterDataStore::PopulatePartialSumsWithSimilarFeatureValue(G
 void SeparableBoxFilterDataStore::PopulateInitialPartialSums(GeneralizedDistance &dist_params, size_t top_k, size_t num_enabled_features,
 	BitArrayIntegerSet &enabled_indices, std::vector<double> &min_unpopulated_distances, std::vector<double> &min_distance_by_unpopulated_count)
 {
-	size_t num_entities_to_populate = top_k;
-	//populate sqrt(2)^p * top_k, which will yield 2 for p=2, 1 for p=0, and about 1.2 for p=0.5
-	if(num_enabled_features > 1)
-		num_entities_to_populate = static_cast<size_t>(std::lround(FastPow(GeneralizedDistance::s_sqrt_2, dist_params.pValue) * top_k)) + 1;
-	
 	min_unpopulated_distances.resize(num_enabled_features);
+
+	//search along each feature for this query's partial sums alone
+	auto &searches = parametersAndBuffers.featureValueSearches;
+	if(searches.size() < num_enabled_features)
+		searches.resize(num_enabled_features);
+
 	for(size_t i = 0; i < num_enabled_features; i++)
 	{
-		double next_closest_distance = PopulatePartialSumsWithSimilarFeatureValue(dist_params,
-			parametersAndBuffers.targetValues[i], parametersAndBuffers.targetValueTypes[i],
-			num_entities_to_populate,
-			//expand search if using more than one dimension
-			num_enabled_features > 1 ,
-			i, parametersAndBuffers.targetColumnIndices[i], enabled_indices);
+		auto &search = searches[i];
+		search.queryFeatureIndex = i;
+		search.absoluteFeatureIndex = parametersAndBuffers.targetColumnIndices[i];
+		search.distParams = &dist_params;
+		search.value = parametersAndBuffers.targetValues[i];
+		search.valueType = parametersAndBuffers.targetValueTypes[i];
+		search.partialSums.assign(1, &parametersAndBuffers.partialSums);
+		search.nextClosestDistances.assign(1, &min_unpopulated_distances[i]);
+	}
+
+	PopulateInitialPartialSums(searches, num_enabled_features, GetNumEntitiesToPopulate(dist_params, top_k, num_enabled_features),
+		//expand search if using more than one dimension
+		num_enabled_features > 1, enabled_indices);
+
+	PopulateMinDistanceByUnpopulatedCount(min_unpopulated_distances, min_distance_by_unpopulated_count);
+}
 
-		min_unpopulated_distances[i] = next_closest_distance;
+void SeparableBoxFilterDataStore::PopulateInitialPartialSums(std::vector<FeatureValueSearch> &searches, size_t num_searches,
+	size_t num_entities_to_populate, bool expand_search_if_optimal, BitArrayIntegerSet &enabled_indices)
+{
+	if(num_searches == 0)
+		return;
+
+	//populates the partial sums of every search for the entities from start_index up to but not including end_index,
+	// accumulating the terms of each entity in feature order so the sums don't depend on how the entities are split up
+	//every range finds the same next closest distances, so only the first range needs to store them
+	auto populate_partial_sums_in_range = [this, &searches, num_searches, num_entities_to_populate, expand_search_if_optimal, &enabled_indices]
+		(size_t start_index, size_t end_index, bool store_next_closest_distances)
+		{
+			for(size_t i = 0; i < num_searches; i++)
+			{
+				auto &search = searches[i];
+				double next_closest_distance = PopulatePartialSumsWithSimilarFeatureValue(*search.distParams,
+					search.value, search.valueType, num_entities_to_populate, expand_search_if_optimal,
+					search.queryFeatureIndex, search.absoluteFeatureIndex, enabled_indices,
+					search.partialSums, start_index, end_index);
+
+				if(store_next_closest_distances)
+				{
+					for(double *next_closest_distance_location : search.nextClosestDistances)
+						*next_closest_distance_location = next_closest_distance;
+				}
+			}
+		};
+
+	size_t end_index = searches[0].partialSums[0]->numInstances;
+
+#ifdef MULTITHREAD_SUPPORT
+	//large searches are split into ranges of entities that are populated concurrently
+	if(enabled_indices.size() > 10000)
+	{
+		auto enqueue_task_lock = Concurrency::threadPool.BeginEnqueueBatchTask();
+		if(enqueue_task_lock.AreThreadsAvailable())
+		{
+			size_t num_ranges = std::max<size_t>(Concurrency::GetMaxNumThreads(), 1);
+			//keep ranges aligned to whole buckets of enabled_indices
+			size_t range_size = (end_index + num_ranges - 1) / num_ranges;
+			range_size = (range_size + 63) & ~static_cast<size_t>(63);
+
+			std::vector<std::future<void>> ranges_completed;
+			ranges_completed.reserve(num_ranges);
+
+			for(size_t start_index = 0; start_index < end_index; start_index += range_size)
+			{
+				size_t range_end_index = std::min(start_index + range_size, end_index);
+
+				ranges_completed.emplace_back(
+					Concurrency::threadPool.EnqueueBatchTask(
+						[&populate_partial_sums_in_range, start_index, range_end_index]()
+						{
+							populate_partial_sums_in_range(start_index, range_end_index, start_index == 0);
+						}
+					)
+				);
+			}
+
+			enqueue_task_lock.Unlock();
+			Concurrency::threadPool.CountCurrentThreadAsPaused();
+
+			for(auto &future : ranges_completed)
+				future.wait();
+
+			Concurrency::threadPool.CountCurrentThreadAsResumed();
+			return;
+		}
 	}
-	std::sort(begin(min_unpopulated_distances), end(min_unpopulated_distances));
-
-	//compute min distance based on the number of features that are unpopulated
-	min_distance_by_unpopulated_count.clear();
-	//need to add a 0 for when all distances are computed
-	min_distance_by_unpopulated_count.push_back(0.0);
-	//append all of the sorted distances so they can be accumulated and assigned
-	min_distance_by_unpopulated_count.insert(end(min_distance_by_unpopulated_count), begin(min_unpopulated_distances), end(min_unpopulated_distances));
-	for(size_t i = 1; i < min_distance_by_unpopulated_count.size(); i++)
-		min_distance_by_unpopulated_count[i] += min_distance_by_unpopulated_count[i - 1];
+#endif
+
+	populate_partial_sums_in_range(0, end_index, true);
 }
 
 void SeparableBoxFilterDataStore::PopulatePotentialGoodMatches(FlexiblePriorityQueue<CountDistanceReferencePair<size_t>> &potential_good_matches,
@@ -346,10 +464,98 @@ void SeparableBoxFilterDataStore::PopulatePotentialGoodMatches(FlexiblePriorityQ
 	potential_good_matches.clear();
 	potential_good_matches.Reserve(top_k);
 
+	//heuristically attempt to find some cases with the most number of features calculated (by the closest matches) and the lowest distances
+	//iterate until at least index_end / e cases are seen, but cap at a maximum number
+	size_t total_indices = enabled_indices.size();
+	size_t num_indices_to_consider = static_cast<size_t>(std::floor(total_indices * 0.3678794411714));
+	num_indices_to_consider = std::min(static_cast<size_t>(1000), num_indices_to_consider);
+
+	//find a good number of features based on the discrete logarithm of the number of features
+	size_t good_number_of_features = 0;
+	size_t num_features = partial_sums.numDimensions;
+	while(num_features >>= 1)
+		good_number_of_features++;
+
+	size_t end_index = enabled_indices.GetEndInteger();
+
+#ifdef MULTITHREAD_SUPPORT
+	//large searches are split into ranges that each consider their share of the indices and keep their own top_k
+	if(total_indices > 10000)
+	{
+		auto enqueue_task_lock = Concurrency::threadPool.BeginEnqueueBatchTask();
+		if(enqueue_task_lock.AreThreadsAvailable())
+		{
+			size_t num_ranges = std::max<size_t>(Concurrency::GetMaxNumThreads(), 1);
+			size_t range_size = (end_index + num_ranges - 1) / num_ranges;
+			size_t num_indices_to_consider_per_range = std::max<size_t>(num_indices_to_consider / num_ranges, 1);
+
+			std::vector<FlexiblePriorityQueue<CountDistanceReferencePair<size_t>>> range_matches(num_ranges);
+			std::vector<size_t> range_indices_considered(num_ranges, 0);
+
+			std::vector<std::future<void>> ranges_completed;
+			ranges_completed.reserve(num_ranges);
+
+			for(size_t range_index = 0; range_index < num_ranges; range_index++)
+			{
+				size_t start_index = range_index * range_size;
+				if(start_index >= end_index)
+					break;
+				size_t range_end_index = std::min(start_index + range_size, end_index);
+
+				ranges_completed.emplace_back(
+					Concurrency::threadPool.EnqueueBatchTask(
+						[this, &enabled_indices, &partial_sums, top_k, &range_matches, &range_indices_considered, range_index,
+						start_index, range_end_index, num_indices_to_consider_per_range, good_number_of_features]()
+						{
+							range_matches[range_index].Reserve(top_k);
+							range_indices_considered[range_index] = FindPotentialGoodMatchesInRange(range_matches[range_index],
+								enabled_indices, partial_sums, top_k, start_index, range_end_index,
+								num_indices_to_consider_per_range, good_number_of_features);
+						}
+					)
+				);
+			}
+
+			enqueue_task_lock.Unlock();
+			Concurrency::threadPool.CountCurrentThreadAsPaused();
+
+			for(auto &future : ranges_completed)
+				future.wait();
+
+			Concurrency::threadPool.CountCurrentThreadAsResumed();
+
+			//merge in range order so that the results are the same regardless of thread timing
+			size_t indices_considered = 0;
+			for(size_t range_index = 0; range_index < num_ranges; range_index++)
+			{
+				auto &matches = range_matches[range_index];
+				for(; matches.size() > 0; matches.pop())
+				{
+					potential_good_matches.push(matches.top());
+					if(potential_good_matches.size() > top_k)
+						potential_good_matches.pop();
+				}
+
+				indices_considered += range_indices_considered[range_index];
+			}
+
+			numPotentialGoodMatchesConsidered += indices_considered;
+			return;
+		}
+	}
+#endif
+
+	numPotentialGoodMatchesConsidered += FindPotentialGoodMatchesInRange(potential_good_matches,
+		enabled_indices, partial_sums, top_k, 0, end_index, num_indices_to_consider, good_number_of_features);
+}
+
+size_t SeparableBoxFilterDataStore::FindPotentialGoodMatchesInRange(FlexiblePriorityQueue<CountDistanceReferencePair<size_t>> &potential_good_matches,
+	BitArrayIntegerSet &enabled_indices, PartialSumCollection &partial_sums, size_t top_k,
+	size_t start_index, size_t end_index, size_t num_indices_to_consider, size_t good_number_of_features)
+{
 	//first, build up top_k that have at least one feature
-	size_t entity_index = 0;
+	size_t entity_index = start_index;
 	size_t indices_considered = 0;
-	size_t end_index = enabled_indices.GetEndInteger();
 	for(; entity_index < end_index; entity_index++)
 	{
 		//don't need to check maximum index, because already checked in loop
@@ -370,18 +576,6 @@ void SeparableBoxFilterDataStore::PopulatePotentialGoodMatches(FlexiblePriorityQ
 		}
 	}
 
-	//heuristically attempt to find some cases with the most number of features calculated (by the closest matches) and the lowest distances
-	//iterate until at least index_end / e cases are seen, but cap at a maximum number
-	size_t total_indices = enabled_indices.size();
-	size_t num_indices_to_consider = static_cast<size_t>(std::floor(total_indices * 0.3678794411714));
-	num_indices_to_consider = std::min(static_cast<size_t>(1000), num_indices_to_consider);
-
-	//find a good number of features based on the discrete logarithm of the number of features
-	size_t good_number_of_features = 0;
-	size_t num_features = partial_sums.numDimensions;
-	while(num_features >>= 1)
-		good_number_of_features++;
-
 	//start with requiring at least one feature matching to be considered a good match
 	size_t good_match_threshold_count = 1;
 	double good_match_threshold_value = std::numeric_limits<double>::infinity();
@@ -424,6 +618,8 @@ void SeparableBoxFilterDataStore::PopulatePotentialGoodMatches(FlexiblePriorityQ
 				break;
 		}
 	}
+
+	return indices_considered;
 }
 
 size_t SeparableBoxFilterDataStore::AddLabelsAsEmptyColumns(std::vector<size_t> &label_ids, size_t num_entities)
@@ -438,28 +634,15 @@ size_t SeparableBoxFilterDataStore::AddLabelsAsEmptyColumns(std::vector<size_t>
 		if(inserted)
 		{
 			columnData.emplace_back(std::make_unique<SBFDSColumnData>(label_id));
+			columnData.back()->SetReducedPrecision(reducedPrecisionNumbers);
+			columnData.back()->writeEpoch = ++writeEpoch;
 			num_inserted_columns++;
 		}
 	}
 	
-	//if nothing has been populated, then just create an empty matrix
-	if(matrix.size() == 0)
-	{
-		numEntities = num_entities;
-		matrix.resize(columnData.size() * numEntities);
-		return num_inserted_columns;
-	}
-
-	//expand the matrix to add the empty columns
-	std::vector<EvaluableNodeImmediateValue> old_matrix;
-	std::swap(old_matrix, matrix); //swap data pointers to free old memory
-	matrix.resize(columnData.size() * numEntities);
-
-	size_t num_columns_new = columnData.size();
-
-	//copy over existing data in blocks per entity
-	for(size_t i = 0; i < num_entities; i++)
-		memcpy((char *)&matrix[i * num_columns_new], (char *)&old_matrix[i * num_existing_columns], sizeof(EvaluableNodeImmediateValue) * num_existing_columns);
+	//fill the new columns with missing values
+	for(size_t i = num_existing_columns; i < columnData.size(); i++)
+		columnData[i]->ResizeColumnarStorage(num_entities);
 
 	//update the number of entities
 	numEntities = num_entities;
@@ -467,6 +650,36 @@ size_t SeparableBoxFilterDataStore::AddLabelsAsEmptyColumns(std::vector<size_t>
 	return num_inserted_columns;
 }
 
+void SeparableBoxFilterDataStore::AddPrebuiltLabels(std::vector<PrebuiltLabel> &labels, size_t num_entities)
+{
+	//only keep labels that are not already columns
+	labels.erase(std::remove_if(begin(labels), end(labels),
+		[this](auto &label) { return DoesHaveLabel(label.columnData->stringId); }),
+		end(labels));
+
+	if(labels.size() == 0 || num_entities == 0)
+		return;
+
+	std::vector<size_t> label_ids;
+	label_ids.reserve(labels.size());
+	for(auto &label : labels)
+		label_ids.push_back(label.columnData->stringId);
+
+	size_t num_columns_added = AddLabelsAsEmptyColumns(label_ids, num_entities);
+	size_t num_columns = columnData.size();
+	size_t num_previous_columns = num_columns - num_columns_added;
+
+	for(size_t i = 0; i < num_columns_added; i++)
+	{
+		size_t column_index = num_previous_columns + i;
+		auto &label = labels[i];
+
+		//keep the epoch at which the empty column was added
+		label.columnData->writeEpoch = columnData[column_index]->writeEpoch;
+		columnData[column_index] = std::move(label.columnData);
+	}
+}
+
 void SeparableBoxFilterDataStore::RemoveColumnIndex(size_t column_index_to_remove)
 {
 	//will replace the values at index_to_remove with the values at index_to_move
@@ -474,14 +687,9 @@ void SeparableBoxFilterDataStore::RemoveColumnIndex(size_t column_index_to_remov
 
 	size_t label_id = columnData[column_index_to_remove]->stringId;
 
-	size_t num_columns = columnData.size();
-
-	//move data from the last column to the removed column if removing the label_id isn't the last column
+	//move the last column to the removed column if removing the label_id isn't the last column
 	if(column_index_to_remove != column_index_to_move)
 	{
-		for(size_t i = 0; i < numEntities; i++)
-			matrix[i * num_columns + column_index_to_remove] = matrix[i * num_columns + column_index_to_move];
-
 		//update column lookup
 		size_t label_id_to_move = columnData[column_index_to_move]->stringId;
 		labelIdToColumnIndex[label_id_to_move] = column_index_to_remove;
@@ -490,31 +698,20 @@ void SeparableBoxFilterDataStore::RemoveColumnIndex(size_t column_index_to_remov
 		std::swap(columnData[column_index_to_remove], columnData[column_index_to_move]);
 	}
 
+	//any weighted aggregates of the column can no longer be maintained
+	weightedNumberValueSummaries.erase(std::remove_if(begin(weightedNumberValueSummaries), end(weightedNumberValueSummaries),
+		[label_id](auto &summary) { return summary.valueLabelId == label_id || summary.weightLabelId == label_id; }),
+		end(weightedNumberValueSummaries));
+
 	//remove the columnId lookup, reference, and column
 	labelIdToColumnIndex.erase(label_id);
 	columnData.pop_back();
-
-	//create new smaller container to hold the reduced data
-	std::vector<EvaluableNodeImmediateValue> old_matrix;
-	std::swap(old_matrix, matrix);
-
-	//if no columns left, then done
-	if(columnData.size() == 0)
-		return;
-
-	//move data over to new reduced copy of matrix
-	matrix.resize(columnData.size() * numEntities);
-	for(size_t i = 0; i < numEntities; i++)
-		memcpy((char *)&matrix[i * columnData.size()], (char *)&old_matrix[i * (columnData.size() + 1)], sizeof(EvaluableNodeImmediateValue) * (columnData.size()));
 }
 
 void SeparableBoxFilterDataStore::DeleteEntityIndexFromColumns(size_t index)
 {
-	for(size_t i = 0; i < columnData.size(); i++)
-	{
-		auto &feature_value = GetValue(index, i);
-		columnData[i]->DeleteIndexValue(feature_value, index);
-	}
+	for(auto &column_data : columnData)
+		column_data->DeleteIndexValue(column_data->GetIndexValue(index), index);
 }
 
 //populates distances_out with all entities and their distances that have a distance to target less than max_dist
@@ -589,15 +786,15 @@ void SeparableBoxFilterDataStore::FindEntitiesWithinDistance(GeneralizedDistance
 			//if there are fewer enabled_indices than the number of unique values for this feature, plus one for unknown values
 			// it is usually faster (less distances to compute) to just compute distance for each unique value and add to associated sums
 			// unless it happens to be that enabled_indices is very skewed
-			if(column_data->sortedNumberValueIndexPairs.size() < enabled_indices.size())
+			if(column_data->sortedNumberValueBuckets.size() < enabled_indices.size())
 			{
-				for(auto &[entity_list_value, entity_list] : column_data->sortedNumberValueIndexPairs)
+				for(auto &[entity_list_value, entity_list] : column_data->sortedNumberValueBuckets)
 				{
 					//get distance term that is applicable to each entity in this bucket
 					double distance_term = dist_params.ComputeDistanceTermRegularOneNonNull(target_value.number - entity_list_value, query_feature_index);
 
 					//for each bucket, add term to their sums
-					for(auto entity_index : *entity_list)
+					for(auto entity_index : entity_list)
 					{
 						if(!enabled_indices.contains(entity_index))
 							continue;
@@ -615,7 +812,7 @@ void SeparableBoxFilterDataStore::FindEntitiesWithinDistance(GeneralizedDistance
 				for(auto entity_index : enabled_indices)
 				{
 					//skip over number values
-					if(column_data->numberIndices.contains(entity_index))
+					if(column_data->IsIndexNumber(entity_index))
 						continue;
 
 					distances[entity_index] += unknown_dist;
@@ -629,6 +826,59 @@ void SeparableBoxFilterDataStore::FindEntitiesWithinDistance(GeneralizedDistance
 			}
 		}
 		
+		//if there's an edit distance index, only the string values near enough to be within max_dist need distances computed
+		if(target_value_type == ENIVT_STRING_ID && column_data->stringEditDistanceIndex
+			&& dist_params.featureParams[query_feature_index].featureType == FDT_CONTINUOUS_STRING
+			&& dist_params.pValue > 0 && max_dist_exponentiated < std::numeric_limits<double>::infinity())
+		{
+			auto &target_str = string_intern_pool.GetStringFromID(target_value.stringID);
+			size_t max_edit_distance = column_data->longestStringLength + StringManipulation::GetNumUTF8Characters(target_str);
+
+			//find the largest edit distance whose term alone is not beyond max_dist
+			size_t search_distance = 0;
+			while(search_distance < max_edit_distance
+					&& dist_params.ComputeDistanceTermNonNominalNonNullRegular(static_cast<double>(search_distance + 1), query_feature_index) <= max_dist_exponentiated)
+				search_distance++;
+
+			auto &string_terms = parametersAndBuffers.stringValueDistanceTerms;
+			string_terms.clear();
+			column_data->stringEditDistanceIndex->FindAllWithinDistance(target_str, search_distance,
+				[&string_terms, &dist_params, query_feature_index](StringInternPool::StringID string_id, size_t distance)
+				{
+					string_terms.emplace(string_id,
+						dist_params.ComputeDistanceTermNonNominalNonNullRegular(static_cast<double>(distance), query_feature_index));
+				});
+
+			for(auto entity_index : enabled_indices)
+			{
+				EvaluableNodeImmediateValueType value_type;
+				auto value = GetValueAndType(entity_index, absolute_feature_index, value_type);
+
+				if(value_type == ENIVT_STRING_ID)
+				{
+					//any string value not found is too far away
+					auto found = string_terms.find(value.stringID);
+					if(found == end(string_terms))
+					{
+						enabled_indices.erase(entity_index);
+						continue;
+					}
+
+					distances[entity_index] += found->second;
+				}
+				else
+				{
+					distances[entity_index] += dist_params.ComputeDistanceTermRegular(target_value, value, target_value_type, value_type, query_feature_index);
+				}
+
+				//remove entity if its distance is already greater than the max_dist
+				if(!(distances[entity_index] <= max_dist_exponentiated)) //false for NaN indices as well so they will be removed
+					enabled_indices.erase(entity_index);
+			}
+
+			continue;
+		}
+
 		//if target_value_type == ENIVT_CODE or ENIVT_STRING_ID, just compute all
 		// won't save much for code until cache equal values
 		// won't save much for string ids because it's just a lookup (though could make it a little faster by streamlining a specialized string loop)
@@ -636,8 +886,8 @@ void SeparableBoxFilterDataStore::FindEntitiesWithinDistance(GeneralizedDistance
 		//else, there are less indices to consider than possible unique values, so save computation by just considering entities that are still valid
 		for(auto entity_index : enabled_indices)
 		{
-			auto &value = GetValue(entity_index, absolute_feature_index);
-			auto value_type = column_data->GetIndexValueType(entity_index);
+			EvaluableNodeImmediateValueType value_type;
+			auto value = GetValueAndType(entity_index, absolute_feature_index, value_type);
 
 			distances[entity_index] += dist_params.ComputeDistanceTermRegular(target_value, value, target_value_type, value_type, query_feature_index);
 
@@ -679,34 +929,9 @@ void SeparableBoxFilterDataStore::FindEntitiesNearestToIndexedEntity(Generalized
 		
 	//build target
 	auto &target_column_indices = parametersAndBuffers.targetColumnIndices;
-	target_column_indices.clear();
-
 	auto &target_values = parametersAndBuffers.targetValues;
-	target_values.clear();
-
 	auto &target_value_types = parametersAndBuffers.targetValueTypes;
-	target_value_types.clear();
-
-	const size_t matrix_index_base = search_index * columnData.size();
-	for(size_t i = 0; i < position_label_ids.size(); i++)
-	{
-		auto found = labelIdToColumnIndex.find(position_label_ids[i]);
-		if(found == end(labelIdToColumnIndex))
-			continue;
-
-		if(dist_params->IsFeatureEnabled(i))
-		{
-			size_t column_index = found->second;
-
-			auto &value = matrix[matrix_index_base + column_index];
-			auto value_type = columnData[column_index]->GetIndexValueType(search_index);
-
-			PopulateNextTargetAttributes(*dist_params,
-				target_column_indices, target_values, target_value_types,
-				column_index, value, value_type,
-				dist_params->featureParams[i].featureType);
-		}
-	}
+	PopulateTargetValuesFromIndexedEntity(*dist_params, position_label_ids, search_index);
 
 	PopulateUnknownFeatureValueTerms(*dist_params);
 
@@ -859,6 +1084,52 @@ void SeparableBoxFilterDataStore::FindEntitiesNearestToIndexedEntity(Generalized
 	}
 }
 
+void SeparableBoxFilterDataStore::FindDistancesFromIndexedEntity(GeneralizedDistance &dist_params, std::vector<size_t> &position_label_ids,
+	size_t search_index, std::vector<size_t> &other_indices, std::vector<double> &distances_out)
+{
+	distances_out.clear();
+	if(other_indices.size() == 0)
+		return;
+
+	auto &dist_params_copy = parametersAndBuffers.distParams;
+	dist_params_copy = dist_params;
+
+	auto &target_column_indices = parametersAndBuffers.targetColumnIndices;
+	auto &target_values = parametersAndBuffers.targetValues;
+	auto &target_value_types = parametersAndBuffers.targetValueTypes;
+	PopulateTargetValuesFromIndexedEntity(dist_params_copy, position_label_ids, search_index);
+
+	PopulateUnknownFeatureValueTerms(dist_params_copy);
+	dist_params_copy.SetHighAccuracy(dist_params_copy.highAccuracy || dist_params_copy.recomputeAccurateDistances);
+
+	distances_out.reserve(other_indices.size());
+	for(auto other_index : other_indices)
+		distances_out.push_back(GetDistanceBetween(dist_params_copy, target_values, target_value_types, target_column_indices, other_index));
+}
+
+void SeparableBoxFilterDataStore::GetColumnDistanceStates(GeneralizedDistance &dist_params, std::vector<size_t> &position_label_ids,
+	std::vector<std::pair<size_t, double>> &column_states)
+{
+	column_states.clear();
+	column_states.reserve(position_label_ids.size());
+
+	for(size_t i = 0; i < position_label_ids.size(); i++)
+	{
+		auto found = labelIdToColumnIndex.find(position_label_ids[i]);
+		if(found == end(labelIdToColumnIndex) || !dist_params.IsFeatureEnabled(i))
+		{
+			column_states.emplace_back(std::numeric_limits<size_t>::max(), 0.0);
+			continue;
+		}
+
+		size_t column_index = found->second;
+		EvaluableNodeImmediateValue null_value;
+		double max_difference = columnData[column_index]->GetMaxDifferenceTermFromValue(
+			dist_params.featureParams[i], ENIVT_NULL, null_value);
+		column_states.emplace_back(column_index, max_difference);
+	}
+}
+
 void SeparableBoxFilterDataStore::FindNearestEntities(GeneralizedDistance &dist_params, std::vector<size_t> &position_label_ids,
 	std::vector<EvaluableNodeImmediateValue> &position_values, std::vector<EvaluableNodeImmediateValueType> &position_value_types, size_t top_k,
 	size_t ignore_entity_index, BitArrayIntegerSet &enabled_indices, std::vector<DistanceReferencePair<size_t>> &distances_out, RandomStream rand_stream)
@@ -902,6 +1173,79 @@ void SeparableBoxFilterDataStore::FindNearestEntities(GeneralizedDistance &dist_
 	auto &min_distance_by_unpopulated_count = parametersAndBuffers.minDistanceByUnpopulatedCount;
 	PopulateInitialPartialSums(dist_params, top_k, num_enabled_features, enabled_indices, min_unpopulated_distances, min_distance_by_unpopulated_count);
 
+	auto &sorted_results = parametersAndBuffers.sortedResults;
+	double worst_candidate_distance = SeedNearestEntities(dist_params, top_k, num_enabled_features, enabled_indices, rand_stream, true);
+
+	//have already gone through all records looking for top_k, if don't have top_k, then have exhausted search
+	if(sorted_results.Size() == top_k)
+	{
+		//if have removed some from the end, reduce the range
+		end_index = enabled_indices.GetEndInteger();
+
+		//pick up where left off, already have top_k in sorted_results or are out of entities
+		bool resolved_concurrently = false;
+	#ifdef MULTITHREAD_SUPPORT
+		//large searches are split into ranges that each keep their own top_k
+		if(enabled_indices.size() > 10000)
+			resolved_concurrently = ResolveRemainingDistancesConcurrently(dist_params,
+				target_column_indices, target_values, target_value_types, partial_sums, enabled_indices,
+				min_distance_by_unpopulated_count, num_enabled_features, min_unpopulated_distances,
+				top_k, worst_candidate_distance, sorted_results, rand_stream);
+	#endif
+
+		if(!resolved_concurrently)
+		{
+			#pragma omp parallel shared(worst_candidate_distance) if(end_index > 200)
+			{
+				//iterate over all indices
+				#pragma omp for schedule(static)
+				for(int64_t entity_index = 0; entity_index < static_cast<int64_t>(end_index); entity_index++)
+				{
+					//don't need to check maximum index, because already checked in loop
+					if(!enabled_indices.ContainsWithoutMaximumIndexCheck(entity_index))
+						continue;
+
+					auto [accept, distance] = ResolveDistanceToNonMatchTargetValues(dist_params,
+						target_column_indices, target_values, target_value_types, partial_sums, entity_index,
+						min_distance_by_unpopulated_count, num_enabled_features, worst_candidate_distance, min_unpopulated_distances);
+
+					if(!accept)
+						continue;
+
+				#ifdef _OPENMP
+					#pragma omp critical
+					{
+						//need to check again after going into critical section
+						if(distance <= worst_candidate_distance)
+						{
+				#endif
+							//computed the actual distance here, attempt to insert into final sorted results
+							worst_candidate_distance = sorted_results.PushAndPop(DistanceReferencePair<size_t>(distance, entity_index)).distance;
+
+				#ifdef _OPENMP
+						}
+					}
+				#endif
+		
+				} //for partialSums instances
+			}  //#pragma omp parallel
+		}
+
+	} // sorted_results.Size() == top_k
+
+	OutputNearestEntities(dist_params, distances_out);
+}
+
+double SeparableBoxFilterDataStore::SeedNearestEntities(GeneralizedDistance &dist_params, size_t top_k, size_t num_enabled_features,
+	BitArrayIntegerSet &enabled_indices, RandomStream &rand_stream, bool use_previous_nearest_neighbors)
+{
+	auto &target_column_indices = parametersAndBuffers.targetColumnIndices;
+	auto &target_values = parametersAndBuffers.targetValues;
+	auto &target_value_types = parametersAndBuffers.targetValueTypes;
+	auto &partial_sums = parametersAndBuffers.partialSums;
+	auto &min_unpopulated_distances = parametersAndBuffers.minUnpopulatedDistances;
+	auto &min_distance_by_unpopulated_count = parametersAndBuffers.minDistanceByUnpopulatedCount;
+
 	auto &potential_good_matches = parametersAndBuffers.potentialGoodMatches;
 	PopulatePotentialGoodMatches(potential_good_matches, enabled_indices, partial_sums, top_k);
 
@@ -943,99 +1287,70 @@ void SeparableBoxFilterDataStore::FindNearestEntities(GeneralizedDistance &dist_
 	auto &previous_nn_cache = parametersAndBuffers.previousQueryNearestNeighbors;
 
 	//have already gone through all records looking for top_k, if don't have top_k, then have exhausted search
-	if(sorted_results.Size() == top_k)
+	if(sorted_results.Size() < top_k)
+		return std::numeric_limits<double>::infinity();
+
+	double worst_candidate_distance = sorted_results.Top().distance;
+	if(use_previous_nearest_neighbors && num_enabled_features > 1)
 	{
-		double worst_candidate_distance = sorted_results.Top().distance;
-		if(num_enabled_features > 1)
+		for(size_t entity_index : previous_nn_cache)
 		{
-			for(size_t entity_index : previous_nn_cache)
-			{
-				//only get its distance if it is enabled,
-				//but erase to skip this entity in the next loop
-				if(!enabled_indices.EraseAndRetrieve(entity_index))
-					continue;
+			//only get its distance if it is enabled,
+			//but erase to skip this entity in the next loop
+			if(!enabled_indices.EraseAndRetrieve(entity_index))
+				continue;
 
-				auto [accept, distance] = ResolveDistanceToNonMatchTargetValues(dist_params,
-					target_column_indices, target_values, target_value_types, partial_sums, entity_index,
-					min_distance_by_unpopulated_count, num_enabled_features, worst_candidate_distance, min_unpopulated_distances);
+			auto [accept, distance] = ResolveDistanceToNonMatchTargetValues(dist_params,
+				target_column_indices, target_values, target_value_types, partial_sums, entity_index,
+				min_distance_by_unpopulated_count, num_enabled_features, worst_candidate_distance, min_unpopulated_distances);
 
-				if(accept)
-					worst_candidate_distance = sorted_results.PushAndPop(DistanceReferencePair(distance, entity_index)).distance;
-			}
+			if(accept)
+				worst_candidate_distance = sorted_results.PushAndPop(DistanceReferencePair(distance, entity_index)).distance;
 		}
+	}
 
-		//check to see if any features can have nulls quickly removed because it would push it past worst_candidate_distance
-		bool need_enabled_indices_recount = false;
-		for(size_t i = 0; i < num_enabled_features; i++)
+	//check to see if any features can have nulls quickly removed because it would push it past worst_candidate_distance
+	bool need_enabled_indices_recount = false;
+	for(size_t i = 0; i < num_enabled_features; i++)
+	{
+		//if the target_value is a null/nan, unknown-unknown differences have already been accounted for
+		//since they are partial matches
+		if(target_value_types[i] == ENIVT_NULL || (target_value_types[i] == ENIVT_NUMBER && FastIsNaN(target_values[i].number)))
+			continue;
+		
+		if(dist_params.ComputeDistanceTermKnownToUnknown(i) > worst_candidate_distance)
 		{
-			//if the target_value is a null/nan, unknown-unknown differences have already been accounted for
-			//since they are partial matches
-			if(target_value_types[i] == ENIVT_NULL || (target_value_types[i] == ENIVT_NUMBER && FastIsNaN(target_values[i].number)))
-				continue;
-			
-			if(dist_params.ComputeDistanceTermKnownToUnknown(i) > worst_candidate_distance)
+			auto &column = columnData[target_column_indices[i]];
+			auto &null_indices = column->nullIndices;
+			//make sure there's enough nulls to justify running through all of enabled_indices
+			if(null_indices.size() > 20)
 			{
-				auto &column = columnData[target_column_indices[i]];
-				auto &null_indices = column->nullIndices;
-				//make sure there's enough nulls to justify running through all of enabled_indices
-				if(null_indices.size() > 20)
-				{
-					null_indices.EraseInBatchFrom(enabled_indices);
-					need_enabled_indices_recount = true;
-				}
-
-				auto &nan_indices = column->nanIndices;
-				//make sure there's enough nulls to justify running through all of enabled_indices
-				if(nan_indices.size() > 20)
-				{
-					nan_indices.EraseInBatchFrom(enabled_indices);
-					need_enabled_indices_recount = true;
-				}
+				null_indices.EraseInBatchFrom(enabled_indices);
+				need_enabled_indices_recount = true;
 			}
-		}
-		if(need_enabled_indices_recount)
-			enabled_indices.UpdateNumElements();
 
-		//if have removed some from the end, reduce the range
-		end_index = enabled_indices.GetEndInteger();
-
-		//pick up where left off, already have top_k in sorted_results or are out of entities
-		#pragma omp parallel shared(worst_candidate_distance) if(end_index > 200)
-		{
-			//iterate over all indices
-			#pragma omp for schedule(static)
-			for(int64_t entity_index = 0; entity_index < static_cast<int64_t>(end_index); entity_index++)
+			auto &nan_indices = column->nanIndices;
+			//make sure there's enough nulls to justify running through all of enabled_indices
+			if(nan_indices.size() > 20)
 			{
-				//don't need to check maximum index, because already checked in loop
-				if(!enabled_indices.ContainsWithoutMaximumIndexCheck(entity_index))
-					continue;
-
-				auto [accept, distance] = ResolveDistanceToNonMatchTargetValues(dist_params,
-					target_column_indices, target_values, target_value_types, partial_sums, entity_index,
-					min_distance_by_unpopulated_count, num_enabled_features, worst_candidate_distance, min_unpopulated_distances);
-
-				if(!accept)
-					continue;
-
-			#ifdef _OPENMP
-				#pragma omp critical
-				{
-					//need to check again after going into critical section
-					if(distance <= worst_candidate_distance)
-					{
-			#endif
-						//computed the actual distance here, attempt to insert into final sorted results
-						worst_candidate_distance = sorted_results.PushAndPop(DistanceReferencePair<size_t>(distance, entity_index)).distance;
+				nan_indices.EraseInBatchFrom(enabled_indices);
+				need_enabled_indices_recount = true;
+			}
+		}
+	}
+	if(need_enabled_indices_recount)
+		enabled_indices.UpdateNumElements();
 
-			#ifdef _OPENMP
-					}
-				}
-			#endif
-		
-			} //for partialSums instances
-		}  //#pragma omp parallel
+	return worst_candidate_distance;
+}
 
-	} // sorted_results.Size() == top_k
+void SeparableBoxFilterDataStore::OutputNearestEntities(GeneralizedDistance &dist_params, std::vector<DistanceReferencePair<size_t>> &distances_out)
+{
+	auto &target_column_indices = parametersAndBuffers.targetColumnIndices;
+	auto &target_values = parametersAndBuffers.targetValues;
+	auto &target_value_types = parametersAndBuffers.targetValueTypes;
+	auto &sorted_results = parametersAndBuffers.sortedResults;
+	auto &previous_nn_cache = parametersAndBuffers.previousQueryNearestNeighbors;
 
 	//return and cache k nearest -- don't need to clear because the values will be clobbered
 	size_t num_results = sorted_results.Size();
@@ -1061,3 +1376,629 @@ void SeparableBoxFilterDataStore::FindNearestEntities(GeneralizedDistance &dist_
 		sorted_results.Pop();
 	}
 }
+
+void SeparableBoxFilterDataStore::FindNearestEntitiesApproximate(NearestNeighborGraph &graph, GeneralizedDistance &dist_params,
+	std::vector<size_t> &position_label_ids, std::vector<EvaluableNodeImmediateValue> &position_values,
+	std::vector<EvaluableNodeImmediateValueType> &position_value_types, size_t top_k, size_t num_candidates,
+	size_t ignore_entity_index, BitArrayIntegerSet &enabled_indices, std::vector<DistanceReferencePair<size_t>> &distances_out)
+{
+	distances_out.clear();
+	if(top_k == 0 || GetNumInsertedEntities() == 0)
+		return;
+
+	auto &target_column_indices = parametersAndBuffers.targetColumnIndices;
+	auto &target_values = parametersAndBuffers.targetValues;
+	auto &target_value_types = parametersAndBuffers.targetValueTypes;
+	PopulateTargetValuesAndLabelIndices(dist_params, position_label_ids, position_values, position_value_types);
+
+	if(target_values.size() == 0)
+		return;
+
+	PopulateUnknownFeatureValueTerms(dist_params);
+
+	enabled_indices.erase(ignore_entity_index);
+
+	graph.FindNearest(
+		[this, &dist_params, &target_values, &target_value_types, &target_column_indices](size_t entity_index)
+		{
+			return GetDistanceBetween(dist_params, target_values, target_value_types, target_column_indices, entity_index);
+		},
+		top_k, num_candidates, enabled_indices, distances_out);
+
+	//like the exact search, recompute the distances returned with high accuracy if requested
+	if(dist_params.recomputeAccurateDistances && !dist_params.highAccuracy)
+	{
+		dist_params.SetHighAccuracy(true);
+		for(auto &drp : distances_out)
+			drp.distance = GetDistanceBetween(dist_params, target_values, target_value_types, target_column_indices, drp.reference);
+	}
+}
+
+void SeparableBoxFilterDataStore::BuildNearestNeighborGraph(NearestNeighborGraph &graph)
+{
+	std::vector<size_t> column_indices;
+	if(!PopulateNearestNeighborGraphColumnIndices(graph, column_indices))
+		return;
+
+	//populate any differences for unknown values the same way as PopulateUnknownFeatureValueTerms
+	auto &dist_params = graph.nodeDistParams;
+	for(size_t i = 0; i < column_indices.size(); i++)
+	{
+		if(column_indices[i] == std::numeric_limits<size_t>::max())
+			continue;
+
+		auto &feature_params = dist_params.featureParams[i];
+		if(FastIsNaN(feature_params.knownToUnknownDifference) || FastIsNaN(feature_params.unknownToUnknownDifference))
+		{
+			EvaluableNodeImmediateValue null_value;
+			double unknown_distance_term = columnData[column_indices[i]]->GetMaxDifferenceTermFromValue(
+				feature_params, ENIVT_NULL, null_value);
+
+			if(FastIsNaN(feature_params.knownToUnknownDifference))
+				feature_params.knownToUnknownDifference = unknown_distance_term;
+			if(FastIsNaN(feature_params.unknownToUnknownDifference))
+				feature_params.unknownToUnknownDifference = unknown_distance_term;
+		}
+
+		dist_params.ComputeAndStoreUncertaintyDistanceTerms(i);
+	}
+
+	auto node_distance = GetNearestNeighborGraphNodeDistanceFunction(graph, column_indices);
+	for(size_t entity_index = 0; entity_index < numEntities; entity_index++)
+	{
+		if(DoesEntityHaveNearestNeighborGraphValues(column_indices, entity_index))
+			graph.InsertNode(entity_index, node_distance);
+	}
+}
+
+bool SeparableBoxFilterDataStore::UpdateNearestNeighborGraphNode(NearestNeighborGraph &graph, size_t entity_index)
+{
+	std::vector<size_t> column_indices;
+	if(!PopulateNearestNeighborGraphColumnIndices(graph, column_indices))
+		return false;
+
+	auto node_distance = GetNearestNeighborGraphNodeDistanceFunction(graph, column_indices);
+	graph.RemoveNode(entity_index, node_distance);
+	if(DoesEntityHaveNearestNeighborGraphValues(column_indices, entity_index))
+		graph.InsertNode(entity_index, node_distance);
+
+	return true;
+}
+
+bool SeparableBoxFilterDataStore::RemoveEntityFromNearestNeighborGraph(NearestNeighborGraph &graph,
+	size_t entity_index, size_t entity_index_to_reassign)
+{
+	std::vector<size_t> column_indices;
+	if(!PopulateNearestNeighborGraphColumnIndices(graph, column_indices))
+		return false;
+
+	graph.RemoveEntity(entity_index, entity_index_to_reassign, GetNearestNeighborGraphNodeDistanceFunction(graph, column_indices));
+	return true;
+}
+
+#ifdef MULTITHREAD_SUPPORT
+bool SeparableBoxFilterDataStore::ResolveRemainingDistancesConcurrently(GeneralizedDistance &dist_params, std::vector<size_t> &target_label_indices,
+	std::vector<EvaluableNodeImmediateValue> &target_values, std::vector<EvaluableNodeImmediateValueType> &target_value_types,
+	PartialSumCollection &partial_sums, BitArrayIntegerSet &enabled_indices,
+	std::vector<double> &min_distance_by_unpopulated_count, size_t num_features, std::vector<double> &min_unpopulated_distances,
+	size_t top_k, double worst_candidate_distance, StochasticTieBreakingPriorityQueue<DistanceReferencePair<size_t>> &sorted_results,
+	RandomStream &rand_stream)
+{
+	auto enqueue_task_lock = Concurrency::threadPool.BeginEnqueueBatchTask();
+	if(!enqueue_task_lock.AreThreadsAvailable())
+		return false;
+
+	size_t end_index = enabled_indices.GetEndInteger();
+	size_t num_ranges = std::max<size_t>(Concurrency::GetMaxNumThreads(), 1);
+	size_t range_size = (end_index + num_ranges - 1) / num_ranges;
+
+	//create the queues up front with their own streams so results don't depend on the order in which ranges complete
+	std::vector<StochasticTieBreakingPriorityQueue<DistanceReferencePair<size_t>>> range_results;
+	range_results.reserve(num_ranges);
+	for(size_t i = 0; i < num_ranges; i++)
+	{
+		range_results.emplace_back(rand_stream.CreateOtherStreamViaRand());
+		range_results.back().Reserve(top_k);
+	}
+
+	std::vector<std::future<void>> ranges_completed;
+	ranges_completed.reserve(num_ranges);
+
+	for(size_t range_index = 0; range_index < num_ranges; range_index++)
+	{
+		size_t start_index = range_index * range_size;
+		size_t range_end_index = std::min(start_index + range_size, end_index);
+
+		ranges_completed.emplace_back(
+			Concurrency::threadPool.EnqueueBatchTask(
+				[this, &dist_params, &target_label_indices, &target_values, &target_value_types, &partial_sums, &enabled_indices,
+				&min_distance_by_unpopulated_count, num_features, &min_unpopulated_distances, top_k, worst_candidate_distance,
+				&range_results, range_index, start_index, range_end_index]()
+				{
+					auto &results = range_results[range_index];
+					double reject_distance = worst_candidate_distance;
+
+					for(size_t entity_index = start_index; entity_index < range_end_index; entity_index++)
+					{
+						//don't need to check maximum index, because already checked in loop
+						if(!enabled_indices.ContainsWithoutMaximumIndexCheck(entity_index))
+							continue;
+
+						auto [accept, distance] = ResolveDistanceToNonMatchTargetValues(dist_params,
+							target_label_indices, target_values, target_value_types, partial_sums, entity_index,
+							min_distance_by_unpopulated_count, num_features, reject_distance, min_unpopulated_distances);
+
+						if(!accept)
+							continue;
+
+						//once this range has top_k of its own, only closer entities can make it into the merged results
+						results.PushAndOnlyKeepSize(DistanceReferencePair(distance, entity_index), top_k);
+						if(results.Size() == top_k)
+							reject_distance = std::min(reject_distance, results.Top().distance);
+					}
+				}
+			)
+		);
+	}
+
+	enqueue_task_lock.Unlock();
+	Concurrency::threadPool.CountCurrentThreadAsPaused();
+
+	for(auto &future : ranges_completed)
+		future.wait();
+
+	Concurrency::threadPool.CountCurrentThreadAsResumed();
+
+	//merge in range order so that the results are the same regardless of thread timing
+	for(auto &results : range_results)
+	{
+		while(results.Size() > 0)
+		{
+			auto &drp = results.Top();
+			if(drp.distance <= worst_candidate_distance)
+				worst_candidate_distance = sorted_results.PushAndPop(drp).distance;
+			results.Pop();
+		}
+	}
+
+	return true;
+}
+#endif
+
+#ifdef MULTITHREAD_SUPPORT
+void SeparableBoxFilterDataStore::FindNearestEntitiesBatch(GeneralizedDistance &dist_params, std::vector<size_t> &position_label_ids,
+	std::vector<std::vector<EvaluableNodeImmediateValue>> &batch_position_values,
+	std::vector<std::vector<EvaluableNodeImmediateValueType>> &batch_position_value_types,
+	size_t top_k, size_t ignore_entity_index, BitArrayIntegerSet &enabled_indices,
+	std::vector<std::vector<DistanceReferencePair<size_t>>> &batch_distances_out, RandomStream rand_stream, bool run_concurrently)
+#else
+void SeparableBoxFilterDataStore::FindNearestEntitiesBatch(GeneralizedDistance &dist_params, std::vector<size_t> &position_label_ids,
+	std::vector<std::vector<EvaluableNodeImmediateValue>> &batch_position_values,
+	std::vector<std::vector<EvaluableNodeImmediateValueType>> &batch_position_value_types,
+	size_t top_k, size_t ignore_entity_index, BitArrayIntegerSet &enabled_indices,
+	std::vector<std::vector<DistanceReferencePair<size_t>>> &batch_distances_out, RandomStream rand_stream)
+#endif
+{
+	size_t num_queries = batch_position_values.size();
+	batch_distances_out.resize(num_queries);
+	for(auto &distances_out : batch_distances_out)
+		distances_out.clear();
+
+	if(top_k == 0 || GetNumInsertedEntities() == 0)
+		return;
+
+	//remove cases with missing labels once for all of the queries, since every query uses the same labels
+	size_t num_enabled_features = 0;
+	for(size_t i = 0; i < position_label_ids.size(); i++)
+	{
+		auto column = labelIdToColumnIndex.find(position_label_ids[i]);
+		if(column != end(labelIdToColumnIndex) && dist_params.IsFeatureEnabled(i))
+		{
+			columnData[column->second]->invalidIndices.EraseInBatchFrom(enabled_indices);
+			num_enabled_features++;
+		}
+	}
+	enabled_indices.UpdateNumElements();
+	enabled_indices.erase(ignore_entity_index);
+
+	if(num_enabled_features == 0)
+		return;
+
+	//create the random streams up front so results don't depend on the order in which queries are run
+	std::vector<RandomStream> query_rand_streams;
+	query_rand_streams.reserve(num_queries);
+	for(size_t i = 0; i < num_queries; i++)
+		query_rand_streams.emplace_back(rand_stream.CreateOtherStreamViaRand());
+
+	//if num enabled indices < top_k, return sorted distances for each query
+	if(enabled_indices.size() <= top_k)
+	{
+		auto &query_dist_params = parametersAndBuffers.distParams;
+		for(size_t i = 0; i < num_queries; i++)
+		{
+			query_dist_params = dist_params;
+			PopulateTargetValuesAndLabelIndices(query_dist_params, position_label_ids, batch_position_values[i], batch_position_value_types[i]);
+			PopulateUnknownFeatureValueTerms(query_dist_params);
+			FindAllValidElementDistances(query_dist_params, parametersAndBuffers.targetColumnIndices,
+				parametersAndBuffers.targetValues, parametersAndBuffers.targetValueTypes, enabled_indices,
+				batch_distances_out[i], query_rand_streams[i]);
+		}
+		return;
+	}
+
+	//one past the maximum entity index to be considered
+	size_t end_index = enabled_indices.GetEndInteger();
+
+	//search the queries in groups so the partial sums of the queries of a group fit within maxBatchPartialSumsSize
+	size_t partial_sums_size = end_index * ((num_enabled_features + 63) / 64 + 1) * sizeof(uint64_t);
+	size_t group_size = std::max<size_t>(maxBatchPartialSumsSize / std::max<size_t>(partial_sums_size, 1), 1);
+	group_size = std::min(group_size, num_queries);
+
+	std::vector<NearestEntitiesBatchQuery> queries(group_size);
+	auto &searches = parametersAndBuffers.featureValueSearches;
+	FastHashMap<double, size_t> number_searches;
+	FastHashMap<StringInternPool::StringID, size_t> string_searches;
+
+	for(size_t group_start = 0; group_start < num_queries; group_start += group_size)
+	{
+		size_t num_group_queries = std::min(group_size, num_queries - group_start);
+
+		for(size_t q = 0; q < num_group_queries; q++)
+		{
+			auto &query = queries[q];
+			size_t query_index = group_start + q;
+			query.distParams = dist_params;
+			query.enabledIndices = enabled_indices;
+			query.randStream = query_rand_streams[query_index];
+
+			PopulateTargetValuesAndLabelIndices(query.distParams, position_label_ids,
+				batch_position_values[query_index], batch_position_value_types[query_index]);
+			PopulateUnknownFeatureValueTerms(query.distParams);
+
+			//keep the buffers with the query so its search can be picked up by any thread
+			SwapSearchBuffers(query);
+			query.partialSums.ResizeAndClear(num_enabled_features, end_index);
+			query.minUnpopulatedDistances.resize(num_enabled_features);
+		}
+
+		//queries with the same value for a feature share the search along that feature,
+		// and the searches are in order of feature so the partial sums are accumulated the same as a single query
+		size_t num_searches = 0;
+		for(size_t i = 0; i < num_enabled_features; i++)
+		{
+			number_searches.clear();
+			string_searches.clear();
+			size_t nan_search = std::numeric_limits<size_t>::max();
+			size_t null_search = std::numeric_limits<size_t>::max();
+
+			for(size_t q = 0; q < num_group_queries; q++)
+			{
+				auto &query = queries[q];
+				auto &value = query.targetValues[i];
+				auto value_type = query.targetValueTypes[i];
+
+				//other value types, such as code, are not shared
+				size_t *shared_search = nullptr;
+				if(value_type == ENIVT_NUMBER)
+				{
+					if(FastIsNaN(value.number))
+						shared_search = &nan_search;
+					else
+						shared_search = &number_searches.emplace(value.number, std::numeric_limits<size_t>::max()).first->second;
+				}
+				else if(value_type == ENIVT_STRING_ID)
+				{
+					shared_search = &string_searches.emplace(value.stringID, std::numeric_limits<size_t>::max()).first->second;
+				}
+				else if(value_type == ENIVT_NULL)
+				{
+					shared_search = &null_search;
+				}
+
+				if(shared_search != nullptr && *shared_search != std::numeric_limits<size_t>::max())
+				{
+					auto &search = searches[*shared_search];
+					search.partialSums.push_back(&query.partialSums);
+					search.nextClosestDistances.push_back(&query.minUnpopulatedDistances[i]);
+					continue;
+				}
+
+				if(shared_search != nullptr)
+					*shared_search = num_searches;
+
+				if(searches.size() <= num_searches)
+					searches.resize(num_searches + 1);
+
+				auto &search = searches[num_searches++];
+				search.queryFeatureIndex = i;
+				search.absoluteFeatureIndex = query.targetColumnIndices[i];
+				search.distParams = &query.distParams;
+				search.value = value;
+				search.valueType = value_type;
+				search.partialSums.assign(1, &query.partialSums);
+				search.nextClosestDistances.assign(1, &query.minUnpopulatedDistances[i]);
+			}
+		}
+
+		//every query of the group starts from the same enabled indices, so they are searched the same way
+		PopulateInitialPartialSums(searches, num_searches, GetNumEntitiesToPopulate(dist_params, top_k, num_enabled_features),
+			//expand search if using more than one dimension
+			num_enabled_features > 1, enabled_indices);
+
+		for(size_t q = 0; q < num_group_queries; q++)
+			PopulateMinDistanceByUnpopulatedCount(queries[q].minUnpopulatedDistances, queries[q].minDistanceByUnpopulatedCount);
+
+		//each query seeds its own results using the buffers of whichever thread it runs on
+		auto seed_nearest_entities = [this, &queries, top_k, num_enabled_features](size_t q)
+		{
+			auto &query = queries[q];
+			SwapSearchBuffers(query);
+			query.worstCandidateDistance = SeedNearestEntities(query.distParams, top_k, num_enabled_features,
+				query.enabledIndices, query.randStream, false);
+			SwapSearchBuffers(query);
+		};
+
+		bool seeded_concurrently = false;
+	#ifdef MULTITHREAD_SUPPORT
+		if(run_concurrently && num_group_queries > 1)
+		{
+			auto enqueue_task_lock = Concurrency::threadPool.BeginEnqueueBatchTask();
+			if(enqueue_task_lock.AreThreadsAvailable())
+			{
+				std::vector<std::future<void>> queries_seeded;
+				queries_seeded.reserve(num_group_queries);
+
+				for(size_t q = 0; q < num_group_queries; q++)
+				{
+					queries_seeded.emplace_back(
+						Concurrency::threadPool.EnqueueBatchTask([&seed_nearest_entities, q]() { seed_nearest_entities(q); })
+					);
+				}
+
+				enqueue_task_lock.Unlock();
+				Concurrency::threadPool.CountCurrentThreadAsPaused();
+
+				for(auto &future : queries_seeded)
+					future.wait();
+
+				Concurrency::threadPool.CountCurrentThreadAsResumed();
+				seeded_concurrently = true;
+			}
+		}
+	#endif
+
+		if(!seeded_concurrently)
+		{
+			for(size_t q = 0; q < num_group_queries; q++)
+				seed_nearest_entities(q);
+		}
+
+	#ifdef MULTITHREAD_SUPPORT
+		ResolveRemainingDistancesBatch(queries, num_group_queries, top_k, num_enabled_features, enabled_indices, run_concurrently);
+	#else
+		ResolveRemainingDistancesBatch(queries, num_group_queries, top_k, num_enabled_features, enabled_indices);
+	#endif
+
+		for(size_t q = 0; q < num_group_queries; q++)
+		{
+			auto &query = queries[q];
+			SwapSearchBuffers(query);
+			OutputNearestEntities(query.distParams, batch_distances_out[group_start + q]);
+			SwapSearchBuffers(query);
+		}
+	}
+}
+
+#ifdef MULTITHREAD_SUPPORT
+void SeparableBoxFilterDataStore::ResolveRemainingDistancesBatch(std::vector<NearestEntitiesBatchQuery> &queries, size_t num_queries,
+	size_t top_k, size_t num_features, BitArrayIntegerSet &enabled_indices, bool run_concurrently)
+#else
+void SeparableBoxFilterDataStore::ResolveRemainingDistancesBatch(std::vector<NearestEntitiesBatchQuery> &queries, size_t num_queries,
+	size_t top_k, size_t num_features, BitArrayIntegerSet &enabled_indices)
+#endif
+{
+	//queries without top_k have already gone through all of their entities
+	std::vector<size_t> active_queries;
+	for(size_t q = 0; q < num_queries; q++)
+	{
+		if(queries[q].sortedResults.Size() == top_k)
+			active_queries.push_back(q);
+	}
+
+	if(active_queries.size() == 0)
+		return;
+
+	size_t end_index = enabled_indices.GetEndInteger();
+
+#ifdef MULTITHREAD_SUPPORT
+	//large searches are split into ranges that each keep their own top_k for each query
+	size_t num_active_queries = active_queries.size();
+	if(run_concurrently && enabled_indices.size() * num_active_queries > 10000)
+	{
+		auto enqueue_task_lock = Concurrency::threadPool.BeginEnqueueBatchTask();
+		if(enqueue_task_lock.AreThreadsAvailable())
+		{
+			size_t num_ranges = std::max<size_t>(Concurrency::GetMaxNumThreads(), 1);
+			size_t range_size = (end_index + num_ranges - 1) / num_ranges;
+
+			//create the queues up front with their own streams so results don't depend on the order in which ranges complete
+			std::vector<StochasticTieBreakingPriorityQueue<DistanceReferencePair<size_t>>> range_results;
+			range_results.reserve(num_ranges * num_active_queries);
+			for(size_t i = 0; i < num_ranges; i++)
+			{
+				for(size_t q : active_queries)
+				{
+					range_results.emplace_back(queries[q].randStream.CreateOtherStreamViaRand());
+					range_results.back().Reserve(top_k);
+				}
+			}
+
+			std::vector<std::future<void>> ranges_completed;
+			ranges_completed.reserve(num_ranges);
+
+			for(size_t range_index = 0; range_index < num_ranges; range_index++)
+			{
+				size_t start_index = range_index * range_size;
+				size_t range_end_index = std::min(start_index + range_size, end_index);
+
+				ranges_completed.emplace_back(
+					Concurrency::threadPool.EnqueueBatchTask(
+						[this, &queries, &active_queries, num_active_queries, top_k, num_features, &enabled_indices,
+						&range_results, range_index, start_index, range_end_index]()
+						{
+							std::vector<double> reject_distances(num_active_queries);
+							for(size_t a = 0; a < num_active_queries; a++)
+								reject_distances[a] = queries[active_queries[a]].worstCandidateDistance;
+
+							for(size_t entity_index = start_index; entity_index < range_end_index; entity_index++)
+							{
+								//don't need to check maximum index, because already checked in loop
+								if(!enabled_indices.ContainsWithoutMaximumIndexCheck(entity_index))
+									continue;
+
+								for(size_t a = 0; a < num_active_queries; a++)
+								{
+									auto &query = queries[active_queries[a]];
+									if(!query.enabledIndices.contains(entity_index))
+										continue;
+
+									auto [accept, distance] = ResolveDistanceToNonMatchTargetValues(query.distParams,
+										query.targetColumnIndices, query.targetValues, query.targetValueTypes, query.partialSums, entity_index,
+										query.minDistanceByUnpopulatedCount, num_features, reject_distances[a], query.minUnpopulatedDistances);
+
+									if(!accept)
+										continue;
+
+									//once this range has top_k of its own, only closer entities can make it into the merged results
+									auto &results = range_results[range_index * num_active_queries + a];
+									results.PushAndOnlyKeepSize(DistanceReferencePair(distance, entity_index), top_k);
+									if(results.Size() == top_k)
+										reject_distances[a] = std::min(reject_distances[a], results.Top().distance);
+								}
+							}
+						}
+					)
+				);
+			}
+
+			enqueue_task_lock.Unlock();
+			Concurrency::threadPool.CountCurrentThreadAsPaused();
+
+			for(auto &future : ranges_completed)
+				future.wait();
+
+			Concurrency::threadPool.CountCurrentThreadAsResumed();
+
+			//merge in range order so that the results are the same regardless of thread timing
+			for(size_t range_index = 0; range_index < num_ranges; range_index++)
+			{
+				for(size_t a = 0; a < num_active_queries; a++)
+				{
+					auto &query = queries[active_queries[a]];
+					auto &results = range_results[range_index * num_active_queries + a];
+					while(results.Size() > 0)
+					{
+						auto &drp = results.Top();
+						if(drp.distance <= query.worstCandidateDistance)
+							query.worstCandidateDistance = query.sortedResults.PushAndPop(drp).distance;
+						results.Pop();
+					}
+				}
+			}
+
+			return;
+		}
+	}
+#endif
+
+	//visit each entity once for all of the queries
+	for(size_t entity_index = 0; entity_index < end_index; entity_index++)
+	{
+		//don't need to check maximum index, because already checked in loop
+		if(!enabled_indices.ContainsWithoutMaximumIndexCheck(entity_index))
+			continue;
+
+		for(size_t q : active_queries)
+		{
+			auto &query = queries[q];
+			if(!query.enabledIndices.contains(entity_index))
+				continue;
+
+			auto [accept, distance] = ResolveDistanceToNonMatchTargetValues(query.distParams,
+				query.targetColumnIndices, query.targetValues, query.targetValueTypes, query.partialSums, entity_index,
+				query.minDistanceByUnpopulatedCount, num_features, query.worstCandidateDistance, query.minUnpopulatedDistances);
+
+			if(accept)
+				query.worstCandidateDistance = query.sortedResults.PushAndPop(DistanceReferencePair<size_t>(distance, entity_index)).distance;
+		}
+	}
+}
+
+#ifdef MULTITHREAD_SUPPORT
+void SeparableBoxFilterDataStore::FindNearestEntitiesApproximateBatch(NearestNeighborGraph &graph, GeneralizedDistance &dist_params,
+	std::vector<size_t> &position_label_ids, std::vector<std::vector<EvaluableNodeImmediateValue>> &batch_position_values,
+	std::vector<std::vector<EvaluableNodeImmediateValueType>> &batch_position_value_types,
+	size_t top_k, size_t num_candidates, size_t ignore_entity_index, BitArrayIntegerSet &enabled_indices,
+	std::vector<std::vector<DistanceReferencePair<size_t>>> &batch_distances_out, bool run_concurrently)
+#else
+void SeparableBoxFilterDataStore::FindNearestEntitiesApproximateBatch(NearestNeighborGraph &graph, GeneralizedDistance &dist_params,
+	std::vector<size_t> &position_label_ids, std::vector<std::vector<EvaluableNodeImmediateValue>> &batch_position_values,
+	std::vector<std::vector<EvaluableNodeImmediateValueType>> &batch_position_value_types,
+	size_t top_k, size_t num_candidates, size_t ignore_entity_index, BitArrayIntegerSet &enabled_indices,
+	std::vector<std::vector<DistanceReferencePair<size_t>>> &batch_distances_out)
+#endif
+{
+	size_t num_queries = batch_position_values.size();
+	batch_distances_out.resize(num_queries);
+	for(auto &distances_out : batch_distances_out)
+		distances_out.clear();
+
+	if(top_k == 0 || GetNumInsertedEntities() == 0)
+		return;
+
+	//the graph search only reads enabled_indices, so every query can share it
+	enabled_indices.erase(ignore_entity_index);
+
+	auto find_nearest = [this, &graph, &dist_params, &position_label_ids, &batch_position_values, &batch_position_value_types,
+		top_k, num_candidates, &enabled_indices, &batch_distances_out](size_t query_index)
+	{
+		auto &query_dist_params = parametersAndBuffers.distParams;
+		query_dist_params = dist_params;
+		FindNearestEntitiesApproximate(graph, query_dist_params, position_label_ids,
+			batch_position_values[query_index], batch_position_value_types[query_index],
+			top_k, num_candidates, std::numeric_limits<size_t>::max(), enabled_indices, batch_distances_out[query_index]);
+	};
+
+#ifdef MULTITHREAD_SUPPORT
+	if(run_concurrently && num_queries > 1)
+	{
+		auto enqueue_task_lock = Concurrency::threadPool.BeginEnqueueBatchTask();
+		if(enqueue_task_lock.AreThreadsAvailable())
+		{
+			std::vector<std::future<void>> queries_completed;
+			queries_completed.reserve(num_queries);
+
+			for(size_t i = 0; i < num_queries; i++)
+			{
+				queries_completed.emplace_back(
+					Concurrency::threadPool.EnqueueBatchTask([&find_nearest, i]() { find_nearest(i); })
+				);
+			}
+
+			enqueue_task_lock.Unlock();
+			Concurrency::threadPool.CountCurrentThreadAsPaused();
+
+			for(auto &future : queries_completed)
+				future.wait();
+
+			Concurrency::threadPool.CountCurrentThreadAsResumed();
+
+			return;
+		}
+	}
+	//not running concurrently
+#endif
+
+	for(size_t i = 0; i < num_queries; i++)
+		find_nearest(i);
+}
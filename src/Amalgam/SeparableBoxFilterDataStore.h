@@ -8,16 +8,19 @@
 
 //project headers:
 #include "Concurrency.h"
+#include "DistanceKernels.h"
 #include "FastMath.h"
 #include "Entity.h"
 #include "EntityQueriesStatistics.h"
 #include "EvaluableNode.h"
 #include "IntegerSet.h"
 #include "GeneralizedDistance.h"
+#include "NearestNeighborGraph.h"
 #include "PartialSum.h"
 #include "SBFDSColumnData.h"
 
 //system headers:
+#include <atomic>
 #include <bitset>
 #include <cfloat>
 #include <cmath>
@@ -33,6 +36,24 @@ class SeparableBoxFilterDataStore
 {
 public:
 
+	//snapshots of the sorted number value buckets of columns by label id, used to build the labels without sorting
+	using NumberValueBucketsSnapshotMap = FastHashMap<StringInternPool::StringID, std::shared_ptr<SBFDSColumnData::NumberValueBucketsSnapshot>>;
+
+	//a search along one feature for a target value shared by one or more queries,
+	// which accumulates the same terms into each of their partial sums
+	struct FeatureValueSearch
+	{
+		size_t queryFeatureIndex;
+		size_t absoluteFeatureIndex;
+		//distance parameters of the first query, which are the same as the other queries' for this feature
+		GeneralizedDistance *distParams;
+		EvaluableNodeImmediateValue value;
+		EvaluableNodeImmediateValueType valueType;
+		std::vector<PartialSumCollection *> partialSums;
+		//where to store the next closest distance of each query
+		std::vector<double *> nextClosestDistances;
+	};
+
 	//contains the parameters and buffers to perform find operations on the SBFDS
 	// for multithreading, there should be one of these per thread
 	struct SBFDSParametersAndBuffers
@@ -45,6 +66,7 @@ public:
 		std::vector<double> minUnpopulatedDistances;
 		std::vector<double> minDistanceByUnpopulatedCount;
 		std::vector<double> entityDistances;
+		std::vector<size_t> entityIndices;
 
 		//when a local copy of distance params is needed
 		GeneralizedDistance distParams;
@@ -57,13 +79,41 @@ public:
 		FlexiblePriorityQueue<CountDistanceReferencePair<size_t>> potentialGoodMatches;
 		StochasticTieBreakingPriorityQueue<DistanceReferencePair<size_t>> sortedResults;
 
+		//searches along each feature to populate initial partial sums
+		std::vector<FeatureValueSearch> featureValueSearches;
+
 		//cache of nearest neighbors from previous query
 		std::vector<size_t> previousQueryNearestNeighbors;
+
+		//pairs of edit distance and string value found near a target string value
+		std::vector<std::pair<size_t, StringInternPool::StringID>> stringValuesByEditDistance;
+		//distance terms of the string values near enough a target string value to be within a distance
+		FastHashMap<StringInternPool::StringID, double> stringValueDistanceTerms;
 	};
 
 	SeparableBoxFilterDataStore()
 	{
 		numEntities = 0;
+		reducedPrecisionNumbers = false;
+		writeEpoch = 0;
+		entitiesWriteEpoch = 0;
+	}
+
+	//if reduced is true, keeps the columnar number values of every column as floats, which are used to quickly
+	// rule out entities when searching and halve the memory of number values, while the exact values used for every
+	// returned distance are recovered from the columns' sorted number value buckets
+	//if reduced is false, keeps the columnar number values at full precision
+	inline void SetReducedPrecisionNumbers(bool reduced)
+	{
+		reducedPrecisionNumbers = reduced;
+		for(auto &column_data : columnData)
+			column_data->SetReducedPrecision(reduced);
+	}
+
+	//returns true if columnar number values are kept as floats
+	constexpr bool IsUsingReducedPrecisionNumbers()
+	{
+		return reducedPrecisionNumbers;
 	}
 
 	//Gets the maximum possible distance term from value
@@ -81,16 +131,26 @@ public:
 		return dist_params.ComputeDistanceTermNonNominalNonNullRegular(max_diff, query_feature_index);
 	}
 
-	//gets the matrix cell index for the specified index
-	__forceinline const size_t GetMatrixCellIndex(size_t entity_index)
+	//returns the the element at index's value for the specified column at column_index, requires valid index
+	__forceinline EvaluableNodeImmediateValue GetValue(size_t index, size_t column_index)
 	{
-		return entity_index * columnData.size();
+		return columnData[column_index]->GetIndexValue(index);
 	}
 
-	//returns the the element at index's value for the specified column at column_index, requires valid index
-	__forceinline EvaluableNodeImmediateValue &GetValue(size_t index, size_t column_index)
+	//returns the the element at index's value for the specified column at column_index and sets value_type_out to its type
+	//requires valid index
+	__forceinline EvaluableNodeImmediateValue GetValueAndType(size_t index, size_t column_index, EvaluableNodeImmediateValueType &value_type_out)
+	{
+		auto &column_data = columnData[column_index];
+		value_type_out = column_data->GetIndexValueType(index);
+		return column_data->GetIndexValue(index);
+	}
+
+	//returns the exact number value of the element at index for the specified column at column_index, NaN if it is not a number
+	//requires valid index
+	__forceinline double GetNumberValue(size_t index, size_t column_index)
 	{
-		return matrix[index * columnData.size() + column_index];
+		return columnData[column_index]->GetIndexNumberValue(index);
 	}
 
 	//returns the column index for the label_id, or maximum value if not found
@@ -108,9 +168,86 @@ public:
 		return (labelIdToColumnIndex.count(label_id) > 0);
 	}
 
-	//populates the matrix with the label and builds column data
+	//returns the number of labels in the datastore
+	inline size_t GetNumLabels()
+	{
+		return columnData.size();
+	}
+
+	//returns the total number of entities considered as potential good matches by nearest neighbor searches
+	// of all datastores, which only increases; the difference across a search gives its number of candidates
+	static inline size_t GetNumPotentialGoodMatchesConsidered()
+	{
+		return numPotentialGoodMatchesConsidered;
+	}
+
+	//returns the current write epoch, which is increased every time an entity or any of its label values changes
+	constexpr size_t GetWriteEpoch()
+	{
+		return writeEpoch;
+	}
+
+	//returns the write epoch at which any value of label_id was last changed, including by adding or removing entities,
+	// or the maximum value if the label is not in the datastore
+	//anything computed from the label's values when the datastore was at a write epoch of at least this value is still current
+	inline size_t GetLabelWriteEpoch(size_t label_id)
+	{
+		auto column = labelIdToColumnIndex.find(label_id);
+		if(column == end(labelIdToColumnIndex))
+			return std::numeric_limits<size_t>::max();
+		return std::max(columnData[column->second]->writeEpoch, entitiesWriteEpoch);
+	}
+
+	//returns the label id of the column at column_index
+	inline StringInternPool::StringID GetColumnLabelId(size_t column_index)
+	{
+		return columnData[column_index]->stringId;
+	}
+
+	//populates snapshot_out with the sorted number value buckets of the column at column_index,
+	// which can be passed to AddLabels to rebuild the column without sorting
+	inline void GetNumberValueBucketsSnapshot(size_t column_index, SBFDSColumnData::NumberValueBucketsSnapshot &snapshot_out)
+	{
+		columnData[column_index]->GetNumberValueBucketsSnapshot(snapshot_out);
+	}
+
+	//returns true if BuildStringEditDistanceIndices would build an index for any of the continuous string features
+	// of dist_params with labels position_label_ids
+	inline bool DoStringEditDistanceIndicesNeedBuilding(GeneralizedDistance &dist_params, std::vector<StringInternPool::StringID> &position_label_ids)
+	{
+		for(size_t i = 0; i < position_label_ids.size() && i < dist_params.featureParams.size(); i++)
+		{
+			if(dist_params.featureParams[i].featureType != FDT_CONTINUOUS_STRING)
+				continue;
+
+			auto column = labelIdToColumnIndex.find(position_label_ids[i]);
+			if(column != end(labelIdToColumnIndex) && columnData[column->second]->ShouldBuildStringEditDistanceIndex())
+				return true;
+		}
+
+		return false;
+	}
+
+	//builds the edit distance index of each continuous string feature of dist_params with labels position_label_ids
+	// that has enough string values to benefit from one
+	inline void BuildStringEditDistanceIndices(GeneralizedDistance &dist_params, std::vector<StringInternPool::StringID> &position_label_ids)
+	{
+		for(size_t i = 0; i < position_label_ids.size() && i < dist_params.featureParams.size(); i++)
+		{
+			if(dist_params.featureParams[i].featureType != FDT_CONTINUOUS_STRING)
+				continue;
+
+			auto column = labelIdToColumnIndex.find(position_label_ids[i]);
+			if(column != end(labelIdToColumnIndex) && columnData[column->second]->ShouldBuildStringEditDistanceIndex())
+				columnData[column->second]->BuildStringEditDistanceIndex();
+		}
+	}
+
+	//populates the column data of the label from entities
+	// if snapshot is not nullptr and is of the number values of entities, then uses its buckets instead of sorting the number values
 	// assumes column data is empty
-	void BuildLabel(size_t column_index, const std::vector<Entity *> &entities)
+	void BuildLabel(size_t column_index, const std::vector<Entity *> &entities,
+		SBFDSColumnData::NumberValueBucketsSnapshot *snapshot = nullptr)
 	{
 		auto &column_data = columnData[column_index];
 		auto label_id = column_data->stringId;
@@ -118,7 +255,9 @@ public:
 		auto &entities_with_number_values = parametersAndBuffers.entitiesWithValues;
 		entities_with_number_values.clear();
 
-		//populate matrix and get values
+		column_data->ResizeColumnarStorage(entities.size());
+
+		//populate the values
 		// maintaining the order of insertion of the entities from smallest to largest allows for better performance of the insertions
 		// and every function called here assumes that entities are inserted in increasing order
 		for(size_t entity_index = 0; entity_index < entities.size(); entity_index++)
@@ -126,25 +265,22 @@ public:
 			EvaluableNodeImmediateValueType value_type;
 			EvaluableNodeImmediateValue value;
 			value_type = entities[entity_index]->GetValueAtLabelAsImmediateValue(label_id, value);
-			matrix[GetMatrixCellIndex(entity_index) + column_index] = value;
-
 			column_data->InsertNextIndexValueExceptNumbers(value_type, value, entity_index, entities_with_number_values);
 		}
 
-		//sort the number values for efficient insertion, but keep the entities in their order
-		std::stable_sort(begin(entities_with_number_values), end(entities_with_number_values));
-
-		column_data->AppendSortedNumberIndicesWithSortedIndices(entities_with_number_values);
+		column_data->AppendNumberIndices(entities_with_number_values, snapshot);
 	}
 
 	//expand the structure by adding a new column/label/feature and populating with data from entities
-	void AddLabels(std::vector<size_t> &label_ids, const std::vector<Entity *> &entities)
+	//if snapshots is not nullptr, any label found in it is built using its snapshot as described in BuildLabel
+	void AddLabels(std::vector<size_t> &label_ids, const std::vector<Entity *> &entities,
+		NumberValueBucketsSnapshotMap *snapshots = nullptr)
 	{
 		//make sure have data to add
 		if(label_ids.size() == 0 || entities.size() == 0)
 			return;
 
-		//resize the matrix and populate column and label_id lookups
+		//add the columns and populate column and label_id lookups
 		size_t num_columns_added = AddLabelsAsEmptyColumns(label_ids, entities.size());
 
 		size_t num_columns = columnData.size();
@@ -163,7 +299,8 @@ public:
 				for(size_t i = num_previous_columns; i < num_columns; i++)
 				{
 					columns_completed.emplace_back(
-						Concurrency::threadPool.EnqueueBatchTask([this, &entities, i]() { BuildLabel(i, entities); })
+						Concurrency::threadPool.EnqueueBatchTask([this, &entities, i, snapshots]()
+							{ BuildLabel(i, entities, FindNumberValueBucketsSnapshot(snapshots, columnData[i]->stringId)); })
 					);
 				}
 
@@ -182,9 +319,86 @@ public:
 	#endif
 
 		for(size_t i = num_previous_columns; i < num_columns; i++)
-			BuildLabel(i, entities);
+			BuildLabel(i, entities, FindNumberValueBucketsSnapshot(snapshots, columnData[i]->stringId));
 	}
 
+	//column data for a label built without modifying the datastore,
+	// so that it can be built while other threads are reading the datastore
+	struct PrebuiltLabel
+	{
+		std::unique_ptr<SBFDSColumnData> columnData;
+	};
+
+	//builds the column data and values of label_id for entities into label like BuildLabel,
+	// but without modifying the datastore
+	void PrebuildLabel(StringInternPool::StringID label_id, const std::vector<Entity *> &entities, PrebuiltLabel &label,
+		SBFDSColumnData::NumberValueBucketsSnapshot *snapshot = nullptr)
+	{
+		label.columnData = std::make_unique<SBFDSColumnData>(label_id);
+		label.columnData->SetReducedPrecision(reducedPrecisionNumbers);
+		label.columnData->ResizeColumnarStorage(entities.size());
+
+		auto &entities_with_number_values = parametersAndBuffers.entitiesWithValues;
+		entities_with_number_values.clear();
+
+		for(size_t entity_index = 0; entity_index < entities.size(); entity_index++)
+		{
+			EvaluableNodeImmediateValue value;
+			auto value_type = entities[entity_index]->GetValueAtLabelAsImmediateValue(label_id, value);
+			label.columnData->InsertNextIndexValueExceptNumbers(value_type, value, entity_index, entities_with_number_values);
+		}
+
+		label.columnData->AppendNumberIndices(entities_with_number_values, snapshot);
+	}
+
+	//builds each of label_ids for entities into the corresponding element of labels via PrebuildLabel,
+	// building the labels concurrently if possible
+	//if snapshots is not nullptr, any label found in it is built using its snapshot
+	void PrebuildLabels(std::vector<StringInternPool::StringID> &label_ids, const std::vector<Entity *> &entities,
+		std::vector<PrebuiltLabel> &labels, NumberValueBucketsSnapshotMap *snapshots = nullptr)
+	{
+		labels.clear();
+		labels.resize(label_ids.size());
+
+	#ifdef MULTITHREAD_SUPPORT
+		if(label_ids.size() > 1)
+		{
+			auto enqueue_task_lock = Concurrency::threadPool.BeginEnqueueBatchTask();
+			if(enqueue_task_lock.AreThreadsAvailable())
+			{
+				std::vector<std::future<void>> labels_completed;
+				labels_completed.reserve(label_ids.size());
+
+				for(size_t i = 0; i < label_ids.size(); i++)
+				{
+					labels_completed.emplace_back(
+						Concurrency::threadPool.EnqueueBatchTask([this, &label_ids, &entities, &labels, i, snapshots]()
+							{ PrebuildLabel(label_ids[i], entities, labels[i], FindNumberValueBucketsSnapshot(snapshots, label_ids[i])); })
+					);
+				}
+
+				enqueue_task_lock.Unlock();
+				Concurrency::threadPool.CountCurrentThreadAsPaused();
+
+				for(auto &future : labels_completed)
+					future.wait();
+
+				Concurrency::threadPool.CountCurrentThreadAsResumed();
+
+				return;
+			}
+		}
+		//not running concurrently
+	#endif
+
+		for(size_t i = 0; i < label_ids.size(); i++)
+			PrebuildLabel(label_ids[i], entities, labels[i], FindNumberValueBucketsSnapshot(snapshots, label_ids[i]));
+	}
+
+	//adds the labels built by PrebuildLabels as columns, skipping any label that already has a column
+	// the entities the labels were built from must be the entities currently in the datastore, with the same values
+	void AddPrebuiltLabels(std::vector<PrebuiltLabel> &labels, size_t num_entities);
+
 	//returns true only if none of the entities have the label
 	inline bool IsColumnIndexRemovable(size_t column_index_to_remove)
 	{
@@ -211,32 +425,30 @@ public:
 	//adds an entity to the database
 	inline void AddEntity(Entity *entity, size_t entity_index)
 	{
-		size_t starting_cell_index = GetMatrixCellIndex(entity_index);
-
-		//fill with missing values, including any empty indices
-		matrix.resize(starting_cell_index + columnData.size());
+		entitiesWriteEpoch = ++writeEpoch;
 
-		//fill in matrix cells from entity
-		size_t cell_index = starting_cell_index;
-		for(size_t column_index = 0; column_index < columnData.size(); column_index++, cell_index++)
+		//fill in the values from entity, which also fills any empty indices before it with missing values
+		for(size_t column_index = 0; column_index < columnData.size(); column_index++)
 		{
 			EvaluableNodeImmediateValueType value_type;
 			EvaluableNodeImmediateValue value;
 			value_type = entity->GetValueAtLabelAsImmediateValue(columnData[column_index]->stringId, value);
 
-			matrix[cell_index] = value;
-
 			columnData[column_index]->InsertIndexValue(value_type, value, entity_index);
 		}
 
 		//count this entity
 		if(entity_index >= numEntities)
 			numEntities = entity_index + 1;
+
+		AccumulateEntityInWeightedNumberValueSummaries(entity_index, true);
 	}
 
 	//removes an entity to the database using an incremental update scheme
 	inline void RemoveEntity(Entity *entity, size_t entity_index, size_t entity_index_to_reassign)
 	{
+		entitiesWriteEpoch = ++writeEpoch;
+
 		if(entity_index >= numEntities || columnData.size() == 0)
 			return;
 
@@ -244,6 +456,7 @@ public:
 		// simply delete from column data, delete last row, and return
 		if(entity_index + 1 == GetNumInsertedEntities() && entity_index_to_reassign >= entity_index)
 		{
+			AccumulateEntityInWeightedNumberValueSummaries(entity_index, false);
 			DeleteEntityIndexFromColumns(entity_index);
 			DeleteLastRow();
 			return;
@@ -253,36 +466,34 @@ public:
 		if(entity_index_to_reassign >= numEntities)
 			return;
 
+		AccumulateEntityInWeightedNumberValueSummaries(entity_index, false);
+
 		//if deleting a row and not replacing it, just fill as if it has no data
 		if(entity_index == entity_index_to_reassign)
 		{
 			DeleteEntityIndexFromColumns(entity_index);
-
-			//fill with missing values
-			size_t starting_cell_index = GetMatrixCellIndex(entity_index);
-			for(size_t column_index = 0; column_index < columnData.size(); column_index++)
-				matrix[starting_cell_index + column_index].number = std::numeric_limits<double>::quiet_NaN();
 			return;
 		}
 
+		//the entity being reassigned is removed from the summaries and added back at its new index
+		AccumulateEntityInWeightedNumberValueSummaries(entity_index_to_reassign, false);
+
 		//reassign index for each column
-		for(size_t column_index = 0; column_index < columnData.size(); column_index++)
+		for(auto &column_data : columnData)
 		{
-			auto &val_to_overwrite = GetValue(entity_index, column_index);
-			auto &value_of_index_to_reassign = GetValue(entity_index_to_reassign, column_index);
-			auto value_type_to_reassign = columnData[column_index]->GetIndexValueType(entity_index_to_reassign);
+			auto value_of_index_to_reassign = column_data->GetIndexValue(entity_index_to_reassign);
+			auto value_type_to_reassign = column_data->GetIndexValueType(entity_index_to_reassign);
 
 			//remove the value where it is
-			columnData[column_index]->DeleteIndexValue(value_of_index_to_reassign, entity_index_to_reassign);
+			column_data->DeleteIndexValue(value_of_index_to_reassign, entity_index_to_reassign);
 
 			//change the destination to the value
-			columnData[column_index]->ChangeIndexValue(val_to_overwrite, value_type_to_reassign, value_of_index_to_reassign, entity_index);
+			column_data->ChangeIndexValue(column_data->GetIndexValue(entity_index), value_type_to_reassign, value_of_index_to_reassign, entity_index);
 		}
 
-		//copy data from entity_index_to_reassign to entity_index
-		memcpy((char *)&(matrix[entity_index * columnData.size()]), (char *)&(matrix[entity_index_to_reassign * columnData.size()]), sizeof(EvaluableNodeImmediateValue) * columnData.size());
+		AccumulateEntityInWeightedNumberValueSummaries(entity_index, true);
 
-		//truncate matrix cache if removing the last entry, either by moving the last entity or by directly removing the last
+		//truncate the columns if removing the last entry, either by moving the last entity or by directly removing the last
 		if(entity_index_to_reassign + 1 == numEntities
 				|| (entity_index_to_reassign + 1 >= numEntities && entity_index + 1 == numEntities))
 			DeleteLastRow();
@@ -297,19 +508,21 @@ public:
 		if(entity_index >= numEntities)
 			return;
 
-		size_t matrix_index = GetMatrixCellIndex(entity_index);
-		for(size_t column_index = 0; column_index < columnData.size(); column_index++)
+		entitiesWriteEpoch = ++writeEpoch;
+
+		AccumulateEntityInWeightedNumberValueSummaries(entity_index, false);
+
+		for(auto &column_data : columnData)
 		{
 			EvaluableNodeImmediateValueType value_type;
 			EvaluableNodeImmediateValue value;
-			value_type = entity->GetValueAtLabelAsImmediateValue(columnData[column_index]->stringId, value);
-
-			columnData[column_index]->ChangeIndexValue(matrix[matrix_index], value_type, value, entity_index);
-			matrix[matrix_index] = value;
+			value_type = entity->GetValueAtLabelAsImmediateValue(column_data->stringId, value);
 
-			matrix_index++;
+			column_data->ChangeIndexValue(column_data->GetIndexValue(entity_index), value_type, value, entity_index);
 		}
 
+		AccumulateEntityInWeightedNumberValueSummaries(entity_index, true);
+
 		//clean up any labels that aren't relevant
 		RemoveAnyUnusedLabels();
 	}
@@ -320,11 +533,15 @@ public:
 		if(entity_index >= numEntities)
 			return;
 
+		//advance the epoch even if the label is not in the datastore, since the label may be in the middle of being built
+		writeEpoch++;
+
 		//find the column
 		auto column = labelIdToColumnIndex.find(label_updated);
 		if(column == end(labelIdToColumnIndex))
 			return;
 		size_t column_index = column->second;
+		columnData[column_index]->writeEpoch = writeEpoch;
 
 		//get the new value
 		EvaluableNodeImmediateValueType value_type;
@@ -332,9 +549,9 @@ public:
 		value_type = entity->GetValueAtLabelAsImmediateValue(columnData[column_index]->stringId, value);
 
 		//update the value
-		auto &matrix_value = GetValue(entity_index, column_index);
-		columnData[column_index]->ChangeIndexValue(matrix_value, value_type, value, entity_index);
-		matrix_value = value;
+		AccumulateEntityInWeightedNumberValueSummaries(entity_index, false, label_updated);
+		columnData[column_index]->ChangeIndexValue(GetValue(entity_index, column_index), value_type, value, entity_index);
+		AccumulateEntityInWeightedNumberValueSummaries(entity_index, true, label_updated);
 
 		//remove the label if no longer relevant
 		if(IsColumnIndexRemovable(column_index))
@@ -352,6 +569,88 @@ public:
 		return columnData[column_index]->numberIndices;
 	}
 
+	//returns the running aggregates of all of the number values of column_index
+	inline NumberValueSummary &GetNumberValueSummary(size_t column_index)
+	{
+		return columnData[column_index]->numberValueSummary;
+	}
+
+	//returns the running aggregates of the number values of column_index weighted by the number values of
+	// weight_column_index, or nullptr if BuildWeightedNumberValueSummary has not been called for the columns
+	inline WeightedNumberValueSummary *GetWeightedNumberValueSummary(size_t column_index, size_t weight_column_index)
+	{
+		auto value_label_id = columnData[column_index]->stringId;
+		auto weight_label_id = columnData[weight_column_index]->stringId;
+		for(auto &summary : weightedNumberValueSummaries)
+		{
+			if(summary.valueLabelId == value_label_id && summary.weightLabelId == weight_label_id)
+				return &summary.summary;
+		}
+
+		return nullptr;
+	}
+
+	//builds the running aggregates of the number values of column_index weighted by the number values of
+	// weight_column_index if not already built, after which they are kept up to date as entities change
+	void BuildWeightedNumberValueSummary(size_t column_index, size_t weight_column_index)
+	{
+		if(GetWeightedNumberValueSummary(column_index, weight_column_index) != nullptr)
+			return;
+
+		auto &summary = weightedNumberValueSummaries.emplace_back(columnData[column_index]->stringId,
+			columnData[weight_column_index]->stringId);
+		for(auto entity_index : columnData[column_index]->numberIndices)
+			summary.summary.Add(GetNumberValue(entity_index, column_index), GetWeightOfEntity(entity_index, weight_column_index));
+	}
+
+	//returns true if any of the entities in indices_to_consider, or any entity if indices_to_consider is nullptr,
+	// has a nan number value for column_index
+	inline bool DoesHaveNanNumberValues(size_t column_index, BitArrayIntegerSet *indices_to_consider)
+	{
+		auto &nan_indices = columnData[column_index]->nanIndices;
+		if(indices_to_consider == nullptr)
+			return nan_indices.size() > 0;
+
+		for(auto index : nan_indices)
+		{
+			if(indices_to_consider->contains(index))
+				return true;
+		}
+
+		return false;
+	}
+
+	//returns true if it is expected to be faster to obtain the sorted number values of num_entities entities
+	// by walking every sorted value of column_index than by sorting the entities' values
+	inline bool IsWalkingSortedNumberValuesFasterThanSorting(size_t column_index, size_t num_entities)
+	{
+		double sort_cost = num_entities * std::log2(static_cast<double>(num_entities) + 1);
+		return sort_cost >= columnData[column_index]->sortedNumberValueBuckets.GetNumIndices();
+	}
+
+	//returns the number of non-nan number values for column_index
+	inline size_t GetNumNonNanNumberValues(size_t column_index)
+	{
+		return columnData[column_index]->sortedNumberValueBuckets.GetNumIndices();
+	}
+
+	//returns the non-nan number value of column_index at rank in sorted order among all entities' values,
+	// where rank must be less than GetNumNonNanNumberValues(column_index)
+	inline double GetNumberValueAtRank(size_t column_index, size_t rank)
+	{
+		auto &buckets = columnData[column_index]->sortedNumberValueBuckets;
+		return buckets[buckets.FindBucketIndexContainingRank(rank)].value;
+	}
+
+	//calls func(value, indices) for each unique non-nan number value of column_index in sorted order,
+	// where indices are the entities that have the value
+	template<typename ValueIndicesFunction>
+	inline void IterateOverSortedNumberValues(size_t column_index, ValueIndicesFunction func)
+	{
+		for(auto &[value, indices] : columnData[column_index]->sortedNumberValueBuckets)
+			func(value, indices);
+	}
+
 	//returns a reference to the BitArrayIntegerSet corresponding to the entities with strings ids for column_index
 	inline EfficientIntegerSet &GetEntitiesWithValidStringIds(size_t column_index)
 	{
@@ -429,10 +728,10 @@ public:
 		auto column = labelIdToColumnIndex.find(feature_id);
 		if(column == labelIdToColumnIndex.end())
 			return;
-		size_t column_index = column->second;
+		auto &column_data = columnData[column->second];
 
-		columnData[column_index]->numberIndices.CopyTo(enabled_entities);
-		columnData[column_index]->nanIndices.EraseTo(enabled_entities);
+		column_data->numberIndices.CopyTo(enabled_entities);
+		column_data->nanIndices.EraseTo(enabled_entities);
 
 		//resize buffers and place each entity and value into its respective buffer
 		entities.resize(enabled_entities.size());
@@ -441,7 +740,7 @@ public:
 		for(auto entity_index : enabled_entities)
 		{
 			entities[index] = entity_index;
-			values[index] = GetValue(entity_index, column_index).number;
+			values[index] = GetNumberValue(entity_index, column->second);
 			index++;
 		}
 	}
@@ -457,10 +756,10 @@ public:
 		auto column = labelIdToColumnIndex.find(feature_id);
 		if(column == labelIdToColumnIndex.end())
 			return;
-		size_t column_index = column->second;
+		auto &column_data = columnData[column->second];
 
-		columnData[column_index]->numberIndices.IntersectTo(enabled_entities);
-		columnData[column_index]->nanIndices.EraseTo(enabled_entities);
+		column_data->numberIndices.IntersectTo(enabled_entities);
+		column_data->nanIndices.EraseTo(enabled_entities);
 
 		//resize buffers and place each entity and value into its respective buffer
 		entities.resize(enabled_entities.size());
@@ -469,7 +768,7 @@ public:
 		for(auto entity_index : enabled_entities)
 		{
 			entities[index] = entity_index;
-			values[index] = GetValue(entity_index, column_index).number;
+			values[index] = GetNumberValue(entity_index, column->second);
 			index++;
 		}
 	}
@@ -541,6 +840,49 @@ public:
 		columnData[column->second]->FindMinMax(value_type, num_to_find, is_max, enabled_indices, out);
 	}
 
+	//returns the number of entities FindAllEntitiesWithFeature would find for feature_id
+	inline size_t GetNumEntitiesWithFeature(size_t feature_id)
+	{
+		auto column = labelIdToColumnIndex.find(feature_id);
+		if(column == labelIdToColumnIndex.end())
+			return 0;
+
+		return GetNumInsertedEntities() - columnData[column->second]->invalidIndices.size();
+	}
+
+	//returns the number of entities FindAllEntitiesWithoutFeature would find for feature_id
+	inline size_t GetNumEntitiesWithoutFeature(size_t feature_id)
+	{
+		auto column = labelIdToColumnIndex.find(feature_id);
+		if(column == labelIdToColumnIndex.end())
+			return 0;
+
+		return columnData[column->second]->invalidIndices.size();
+	}
+
+	//returns the number of entities UnionAllEntitiesWithValue would insert for feature_id, value_type, and value,
+	// or for code values, the number of entities whose code would be compared
+	inline size_t GetNumEntitiesWithValue(size_t feature_id,
+		EvaluableNodeImmediateValueType value_type, EvaluableNodeImmediateValue &value)
+	{
+		auto column = labelIdToColumnIndex.find(feature_id);
+		if(column == labelIdToColumnIndex.end())
+			return 0;
+
+		return columnData[column->second]->GetNumIndicesWithValue(value_type, value);
+	}
+
+	//returns an estimate of the number of entities FindAllEntitiesWithinRange would find for the same parameters
+	inline size_t EstimateNumEntitiesWithinRange(size_t feature_id, EvaluableNodeImmediateValueType value_type,
+		EvaluableNodeImmediateValue &low, EvaluableNodeImmediateValue &high, bool between_values)
+	{
+		auto column = labelIdToColumnIndex.find(feature_id);
+		if(numEntities == 0 || column == labelIdToColumnIndex.end())
+			return 0;
+
+		return columnData[column->second]->EstimateNumIndicesWithinRange(value_type, low, high, between_values);
+	}
+
 	//returns the number of unique values for a column for the given value_type
 	size_t GetNumUniqueValuesForColumn(size_t column_index, EvaluableNodeImmediateValueType value_type)
 	{
@@ -558,16 +900,16 @@ public:
 	template<typename Iter>
 	inline std::function<bool(Iter, double &)> GetNumberValueFromEntityIteratorFunction(size_t column_index)
 	{
-		auto number_indices_ptr = &columnData[column_index]->numberIndices;
+		auto column_data_ptr = columnData[column_index].get();
 
-		return [&, number_indices_ptr, column_index]
+		return [this, column_data_ptr, column_index]
 		(Iter i, double &value)
 		{
 			size_t entity_index = *i;
-			if(!number_indices_ptr->contains(entity_index))
+			if(!column_data_ptr->IsIndexNumber(entity_index))
 				return false;
 
-			value = GetValue(entity_index, column_index).number;
+			value = GetNumberValue(entity_index, column_index);
 			return true;
 		};
 	}
@@ -580,15 +922,15 @@ public:
 		if(column_index >= columnData.size())
 			return [](size_t i, double &value) { return false; };
 
-		auto number_indices_ptr = &columnData[column_index]->numberIndices;
+		auto column_data_ptr = columnData[column_index].get();
 
-		return [&, number_indices_ptr, column_index]
+		return [this, column_data_ptr, column_index]
 			(size_t i, double &value)
 			{
-				if(!number_indices_ptr->contains(i))
+				if(!column_data_ptr->IsIndexNumber(i))
 					return false;
 
-				value = GetValue(i, column_index).number;
+				value = GetNumberValue(i, column_index);
 				return true;
 			};
 	}
@@ -626,6 +968,18 @@ public:
 		bool constant_dist_params, size_t search_index, size_t top_k, BitArrayIntegerSet &enabled_indices,
 		bool expand_to_first_nonzero_distance, std::vector<DistanceReferencePair<size_t>> &distances_out,
 		size_t ignore_index = std::numeric_limits<size_t>::max(), RandomStream rand_stream = RandomStream());
+
+	//computes the distance from the entity at search_index to each of other_indices, populating the corresponding element of distances_out
+	// at the same accuracy as the distances returned by FindEntitiesNearestToIndexedEntity
+	//will make a copy of dist_params before making any modifications
+	void FindDistancesFromIndexedEntity(GeneralizedDistance &dist_params, std::vector<size_t> &position_label_ids,
+		size_t search_index, std::vector<size_t> &other_indices, std::vector<double> &distances_out);
+
+	//populates column_states with a pair for each of position_label_ids of its column index, or the maximum size_t if not in the datastore,
+	// and the largest difference between values in the column, which is what distances with unknown values are computed from
+	//if the column states are unchanged, then distances between entities can only have changed if the values of those entities changed
+	void GetColumnDistanceStates(GeneralizedDistance &dist_params, std::vector<size_t> &position_label_ids,
+		std::vector<std::pair<size_t, double>> &column_states);
 	
 	//Finds the nearest neighbors
 	//enabled_indices is the set of entities to find from, and will be modified
@@ -634,64 +988,184 @@ public:
 		size_t top_k, size_t ignore_entity_index, BitArrayIntegerSet &enabled_indices,
 		std::vector<DistanceReferencePair<size_t>> &distances_out, RandomStream rand_stream = RandomStream());
 
+	//like FindNearestEntities, but approximates the nearest entities by searching graph, which must be for the same labels and distance parameters
+	// only entities that are nodes of graph can be found, and num_candidates is the number of candidates kept during the search,
+	// where larger values find more of the true nearest entities at the cost of more distance computations
+	void FindNearestEntitiesApproximate(NearestNeighborGraph &graph, GeneralizedDistance &dist_params, std::vector<size_t> &position_label_ids,
+		std::vector<EvaluableNodeImmediateValue> &position_values, std::vector<EvaluableNodeImmediateValueType> &position_value_types,
+		size_t top_k, size_t num_candidates, size_t ignore_entity_index, BitArrayIntegerSet &enabled_indices,
+		std::vector<DistanceReferencePair<size_t>> &distances_out);
+
+	//builds graph over every entity that has a value for each label of the graph's enabled features, where the distances
+	// between nodes use the graph's distance parameters with unknown differences populated from the current values
+	void BuildNearestNeighborGraph(NearestNeighborGraph &graph);
+
+	//inserts, updates or removes the node of entity_index in graph to match the entity's current values
+	//returns false if graph can no longer be kept up to date because one of its labels is no longer in the datastore
+	bool UpdateNearestNeighborGraphNode(NearestNeighborGraph &graph, size_t entity_index);
+
+	//removes entity_index from graph and moves entity_index_to_reassign to it, using the same conventions as RemoveEntity
+	// must be called before RemoveEntity, while the values of both entities are still stored
+	//returns false if graph can no longer be kept up to date because one of its labels is no longer in the datastore
+	bool RemoveEntityFromNearestNeighborGraph(NearestNeighborGraph &graph, size_t entity_index, size_t entity_index_to_reassign);
+
+	//like FindNearestEntities, but finds the nearest neighbors for each of the positions in batch_position_values,
+	// populating the corresponding element of batch_distances_out
+	//the filtering of enabled_indices, the searches along each feature for values shared by queries, and the pass over
+	// the remaining entities are shared across the queries, and enabled_indices will be modified
+#ifdef MULTITHREAD_SUPPORT
+	void FindNearestEntitiesBatch(GeneralizedDistance &dist_params, std::vector<size_t> &position_label_ids,
+		std::vector<std::vector<EvaluableNodeImmediateValue>> &batch_position_values,
+		std::vector<std::vector<EvaluableNodeImmediateValueType>> &batch_position_value_types,
+		size_t top_k, size_t ignore_entity_index, BitArrayIntegerSet &enabled_indices,
+		std::vector<std::vector<DistanceReferencePair<size_t>>> &batch_distances_out, RandomStream rand_stream, bool run_concurrently);
+#else
+	void FindNearestEntitiesBatch(GeneralizedDistance &dist_params, std::vector<size_t> &position_label_ids,
+		std::vector<std::vector<EvaluableNodeImmediateValue>> &batch_position_values,
+		std::vector<std::vector<EvaluableNodeImmediateValueType>> &batch_position_value_types,
+		size_t top_k, size_t ignore_entity_index, BitArrayIntegerSet &enabled_indices,
+		std::vector<std::vector<DistanceReferencePair<size_t>>> &batch_distances_out, RandomStream rand_stream);
+#endif
+
+	//like FindNearestEntitiesApproximate, but finds the nearest neighbors for each of the positions in batch_position_values,
+	// populating the corresponding element of batch_distances_out
+	//enabled_indices will be modified
+#ifdef MULTITHREAD_SUPPORT
+	void FindNearestEntitiesApproximateBatch(NearestNeighborGraph &graph, GeneralizedDistance &dist_params, std::vector<size_t> &position_label_ids,
+		std::vector<std::vector<EvaluableNodeImmediateValue>> &batch_position_values,
+		std::vector<std::vector<EvaluableNodeImmediateValueType>> &batch_position_value_types,
+		size_t top_k, size_t num_candidates, size_t ignore_entity_index, BitArrayIntegerSet &enabled_indices,
+		std::vector<std::vector<DistanceReferencePair<size_t>>> &batch_distances_out, bool run_concurrently);
+#else
+	void FindNearestEntitiesApproximateBatch(NearestNeighborGraph &graph, GeneralizedDistance &dist_params, std::vector<size_t> &position_label_ids,
+		std::vector<std::vector<EvaluableNodeImmediateValue>> &batch_position_values,
+		std::vector<std::vector<EvaluableNodeImmediateValueType>> &batch_position_value_types,
+		size_t top_k, size_t num_candidates, size_t ignore_entity_index, BitArrayIntegerSet &enabled_indices,
+		std::vector<std::vector<DistanceReferencePair<size_t>>> &batch_distances_out);
+#endif
+
 protected:
 
-	//deletes/pops off the last row in the matrix cache
+	//the buffers of one query of a batch of nearest entity searches,
+	// which are swapped with the ones of parametersAndBuffers while a thread works on the query
+	struct NearestEntitiesBatchQuery
+	{
+		GeneralizedDistance distParams;
+		BitArrayIntegerSet enabledIndices;
+		std::vector<EvaluableNodeImmediateValue> targetValues;
+		std::vector<EvaluableNodeImmediateValueType> targetValueTypes;
+		std::vector<size_t> targetColumnIndices;
+		PartialSumCollection partialSums;
+		std::vector<double> minUnpopulatedDistances;
+		std::vector<double> minDistanceByUnpopulatedCount;
+		StochasticTieBreakingPriorityQueue<DistanceReferencePair<size_t>> sortedResults;
+		RandomStream randStream;
+		//distance of the furthest entity in sortedResults once seeded
+		double worstCandidateDistance;
+	};
+
+	//maximum total size in bytes of the partial sums of the queries of a batch searched together,
+	// larger batches are searched in groups of queries
+	static constexpr size_t maxBatchPartialSumsSize = 64 * 1024 * 1024;
+
+	//deletes/pops off the last entity in the columns
 	inline void DeleteLastRow()
 	{
-		if(matrix.size() == 0)
+		if(numEntities == 0)
 			return;
 
-		//truncate matrix cache
 		numEntities--;
-		matrix.resize(matrix.size() - columnData.size());
+		for(auto &column_data : columnData)
+			column_data->ResizeColumnarStorage(numEntities);
 	}
 
 	//deletes the index and associated data
 	void DeleteEntityIndexFromColumns(size_t index);
 
+	//returns the weight of entity_index for weight_column_index, which is 1 if it does not have a number value
+	__forceinline double GetWeightOfEntity(size_t entity_index, size_t weight_column_index)
+	{
+		if(!columnData[weight_column_index]->IsIndexNumber(entity_index))
+			return 1.0;
+		return GetNumberValue(entity_index, weight_column_index);
+	}
+
+	//adds the values of entity_index to each of weightedNumberValueSummaries if add is true, removes them if false
+	//if label_id is not NOT_A_STRING_ID, only updates the summaries that involve label_id
+	//must be called to remove the values before they change and add them after
+	inline void AccumulateEntityInWeightedNumberValueSummaries(size_t entity_index, bool add,
+		StringInternPool::StringID label_id = StringInternPool::NOT_A_STRING_ID)
+	{
+		for(auto &summary : weightedNumberValueSummaries)
+		{
+			if(label_id != StringInternPool::NOT_A_STRING_ID
+					&& summary.valueLabelId != label_id && summary.weightLabelId != label_id)
+				continue;
+
+			size_t column_index = labelIdToColumnIndex[summary.valueLabelId];
+			if(!columnData[column_index]->IsIndexNumber(entity_index))
+				continue;
+
+			double value = GetNumberValue(entity_index, column_index);
+			double weight = GetWeightOfEntity(entity_index, labelIdToColumnIndex[summary.weightLabelId]);
+			if(add)
+				summary.summary.Add(value, weight);
+			else
+				summary.summary.Remove(value, weight);
+		}
+	}
+
 	//adds a new labels to the database, populating new cells with -NaN, and updating the number of entities
 	// assumes label_ids is not empty and num_entities is nonzero
 	//returns the number of new columns inserted
 	size_t AddLabelsAsEmptyColumns(std::vector<size_t> &label_ids, size_t num_entities);
 
-	//computes each partial sum and adds the term to the partial sums associated for each id in entity_indices for query_feature_index
-	//returns the number of entities indices accumulated
+	//computes each partial sum and adds the term to each of partial_sums_collections associated for each id in entity_indices
+	// for query_feature_index, only accumulating the ids from start_index up to but not including end_index
+	//returns the number of entities indices accumulated across all ids
 	size_t ComputeAndAccumulatePartialSums(GeneralizedDistance &dist_params,
 		EvaluableNodeImmediateValue value, EvaluableNodeImmediateValueType value_type,
-		SortedIntegerSet &entity_indices, size_t query_feature_index, size_t absolute_feature_index)
+		SortedIntegerSet &entity_indices, size_t query_feature_index, size_t absolute_feature_index,
+		std::vector<PartialSumCollection *> &partial_sums_collections, size_t start_index, size_t end_index)
 	{
 		size_t num_entity_indices = entity_indices.size();
 
-		auto &partial_sums = parametersAndBuffers.partialSums;
-		const auto accum_location = partial_sums.GetAccumLocation(query_feature_index);
+		const auto accum_location = PartialSumCollection::GetAccumLocation(query_feature_index);
+
+		auto &entity_indices_vector = entity_indices.GetIntegerVector();
+		size_t start_location = (start_index > 0 ? entity_indices.GetFirstIntegerVectorLocationGreaterThan(start_index - 1) : 0);
+		size_t end_location = (end_index > 0 ? entity_indices.GetFirstIntegerVectorLocationGreaterThan(end_index - 1) : 0);
 
 		//for each found element, accumulate associated partial sums
-		for(size_t entity_index : entity_indices)
+		for(size_t i = start_location; i < end_location; i++)
 		{
+			size_t entity_index = entity_indices_vector[i];
+
 			//get value
-			auto &other_value = GetValue(entity_index, absolute_feature_index);
-			auto other_value_type = columnData[absolute_feature_index]->GetIndexValueType(entity_index);
+			EvaluableNodeImmediateValueType other_value_type;
+			auto other_value = GetValueAndType(entity_index, absolute_feature_index, other_value_type);
 
 			//compute term
 			double term = dist_params.ComputeDistanceTermRegular(value, other_value, value_type, other_value_type, query_feature_index);
 
 			//accumulate
-			partial_sums.Accum(entity_index, accum_location, term);
+			for(auto partial_sums : partial_sums_collections)
+				partial_sums->Accum(entity_index, accum_location, term);
 		}
 
 		return num_entity_indices;
 	}
 
-	//adds term to the partial sums associated for each id in entity_indices for query_feature_index
-	//returns the number of entities indices accumulated
-	inline size_t AccumulatePartialSums(SortedIntegerSet &entity_indices, size_t query_feature_index, double term)
+	//adds term to each of partial_sums_collections associated for each id in entity_indices for query_feature_index
+	// only accumulating the ids from start_index up to but not including end_index
+	//returns the number of entities indices accumulated across all ids
+	inline size_t AccumulatePartialSums(SortedIntegerSet &entity_indices, size_t query_feature_index, double term,
+		std::vector<PartialSumCollection *> &partial_sums_collections, size_t start_index, size_t end_index)
 	{
 		size_t num_entity_indices = entity_indices.size();
 
-		auto &partial_sums = parametersAndBuffers.partialSums;
-		const auto accum_location = partial_sums.GetAccumLocation(query_feature_index);
-		size_t max_element = partial_sums.numInstances;
+		const auto accum_location = PartialSumCollection::GetAccumLocation(query_feature_index);
+		size_t max_element = partial_sums_collections.front()->numInstances;
 
 		auto &entity_indices_vector = entity_indices.GetIntegerVector();
 
@@ -702,78 +1176,134 @@ protected:
 		if(entity_indices.GetEndInteger() >= max_element)
 			num_entity_indices = entity_indices.GetFirstIntegerVectorLocationGreaterThan(max_element - 1);
 
+		size_t start_location = (start_index > 0 ? entity_indices.GetFirstIntegerVectorLocationGreaterThan(start_index - 1) : 0);
+		size_t end_location = num_entity_indices;
+		if(end_index < max_element)
+			end_location = (end_index > 0 ? entity_indices.GetFirstIntegerVectorLocationGreaterThan(end_index - 1) : 0);
+
 		//for each found element, accumulate associated partial sums, or if zero, just mark that it's accumulated
-		if(term != 0.0)
+		for(auto partial_sums : partial_sums_collections)
 		{
-			#pragma omp parallel for schedule(static) if(num_entity_indices > 300)
-			for(int64_t i = 0; i < static_cast<int64_t>(num_entity_indices); i++)
+			if(term != 0.0)
 			{
-				const auto entity_index = entity_indices_vector[i];
-				partial_sums.Accum(entity_index, accum_location, term);
+				#pragma omp parallel for schedule(static) if(end_location - start_location > 300)
+				for(int64_t i = static_cast<int64_t>(start_location); i < static_cast<int64_t>(end_location); i++)
+				{
+					const auto entity_index = entity_indices_vector[i];
+					partial_sums->Accum(entity_index, accum_location, term);
+				}
 			}
-		}
-		else //term == 0.0
-		{
-			#pragma omp parallel for schedule(static) if(num_entity_indices > 300)
-			for(int64_t i = 0; i < static_cast<int64_t>(num_entity_indices); i++)
+			else //term == 0.0
 			{
-				const auto entity_index = entity_indices_vector[i];
-				partial_sums.AccumZero(entity_index, accum_location);
+				#pragma omp parallel for schedule(static) if(end_location - start_location > 300)
+				for(int64_t i = static_cast<int64_t>(start_location); i < static_cast<int64_t>(end_location); i++)
+				{
+					const auto entity_index = entity_indices_vector[i];
+					partial_sums->AccumZero(entity_index, accum_location);
+				}
 			}
 		}
 
 		return num_entity_indices;
 	}
 
-	//adds term to the partial sums associated for each id in entity_indices for query_feature_index
-	//returns the number of entities indices accumulated
-	inline size_t AccumulatePartialSums(BitArrayIntegerSet &entity_indices, size_t query_feature_index, double term)
+	//adds term to each of partial_sums_collections associated for each id in entity_indices for query_feature_index
+	// only accumulating the ids from start_index up to but not including end_index
+	//returns the number of entities indices accumulated across all ids
+	inline size_t AccumulatePartialSums(BitArrayIntegerSet &entity_indices, size_t query_feature_index, double term,
+		std::vector<PartialSumCollection *> &partial_sums_collections, size_t start_index, size_t end_index)
 	{
 		size_t num_entity_indices = entity_indices.size();
 		if(num_entity_indices == 0)
 			return 0;
 
-		auto &partial_sums = parametersAndBuffers.partialSums;
-		const auto accum_location = partial_sums.GetAccumLocation(query_feature_index);
-		size_t max_element = partial_sums.numInstances;
+		const auto accum_location = PartialSumCollection::GetAccumLocation(query_feature_index);
+		size_t max_element = std::min(partial_sums_collections.front()->numInstances, end_index);
 
 		if(term != 0.0)
 		{
 			entity_indices.IterateOver(
-				[&partial_sums, &accum_location, term]
+				[&partial_sums_collections, &accum_location, term]
 				(size_t entity_index)
 				{
-					partial_sums.Accum(entity_index, accum_location, term);
+					for(auto partial_sums : partial_sums_collections)
+						partial_sums->Accum(entity_index, accum_location, term);
 				},
-				max_element);
+				max_element, start_index);
 		}
 		else
 		{
 			entity_indices.IterateOver(
-				[&partial_sums, &accum_location]
+				[&partial_sums_collections, &accum_location]
 				(size_t entity_index)
 				{
-					partial_sums.AccumZero(entity_index, accum_location);
+					for(auto partial_sums : partial_sums_collections)
+						partial_sums->AccumZero(entity_index, accum_location);
 				},
-				max_element);
+				max_element, start_index);
 		}
 
 		return entity_indices.size();
 	}
 
-	//adds term to the partial sums associated for each id in entity_indices for query_feature_index
-	//returns the number of entities indices accumulated
-	inline size_t AccumulatePartialSums(EfficientIntegerSet &entity_indices, size_t query_feature_index, double term)
+	//adds term to each of partial_sums_collections associated for each id in entity_indices for query_feature_index
+	// only accumulating the ids from start_index up to but not including end_index
+	//returns the number of entities indices accumulated across all ids
+	inline size_t AccumulatePartialSums(ChunkedIntegerSet &entity_indices, size_t query_feature_index, double term,
+		std::vector<PartialSumCollection *> &partial_sums_collections, size_t start_index, size_t end_index)
+	{
+		size_t num_entity_indices = entity_indices.size();
+		if(num_entity_indices == 0)
+			return 0;
+
+		const auto accum_location = PartialSumCollection::GetAccumLocation(query_feature_index);
+		size_t max_element = std::min(partial_sums_collections.front()->numInstances, end_index);
+
+		if(term != 0.0)
+		{
+			entity_indices.IterateOver(
+				[&partial_sums_collections, &accum_location, term]
+				(size_t entity_index)
+				{
+					for(auto partial_sums : partial_sums_collections)
+						partial_sums->Accum(entity_index, accum_location, term);
+				},
+				max_element, start_index);
+		}
+		else
+		{
+			entity_indices.IterateOver(
+				[&partial_sums_collections, &accum_location]
+				(size_t entity_index)
+				{
+					for(auto partial_sums : partial_sums_collections)
+						partial_sums->AccumZero(entity_index, accum_location);
+				},
+				max_element, start_index);
+		}
+
+		return num_entity_indices;
+	}
+
+	//adds term to each of partial_sums_collections associated for each id in entity_indices for query_feature_index
+	// only accumulating the ids from start_index up to but not including end_index
+	//returns the number of entities indices accumulated across all ids
+	inline size_t AccumulatePartialSums(EfficientIntegerSet &entity_indices, size_t query_feature_index, double term,
+		std::vector<PartialSumCollection *> &partial_sums_collections, size_t start_index, size_t end_index)
 	{
 		if(entity_indices.IsSisContainer())
-			return AccumulatePartialSums(entity_indices.GetSisContainer(), query_feature_index, term);
+			return AccumulatePartialSums(entity_indices.GetSisContainer(), query_feature_index, term, partial_sums_collections, start_index, end_index);
+		else if(entity_indices.IsCisContainer())
+			return AccumulatePartialSums(entity_indices.GetCisContainer(), query_feature_index, term, partial_sums_collections, start_index, end_index);
 		else
-			return AccumulatePartialSums(entity_indices.GetBaisContainer(), query_feature_index, term);
+			return AccumulatePartialSums(entity_indices.GetBaisContainer(), query_feature_index, term, partial_sums_collections, start_index, end_index);
 	}
 
 	//search a projection width in terms of bucket count or number of collected entities
-	//accumulates partial sums
+	//accumulates partial sums into each of partial_sums_collections, which must all be the same size,
+	// but only for entity indices from start_index up to but not including end_index
 	//searches until num_entities_to_populate are popluated or other heuristics have been reached
+	// the search only depends on the columns, so every range of entity indices will be searched the same way
 	//will only consider indices in enabled_indiced
 	// absolute_feature_index is the offset to access the feature relative to the entire data store
 	// query_feature_index is the offset to access the feature relative to the particular query data parameters
@@ -781,7 +1311,8 @@ protected:
 	double PopulatePartialSumsWithSimilarFeatureValue(GeneralizedDistance &dist_params,
 		EvaluableNodeImmediateValue value, EvaluableNodeImmediateValueType value_type,
 		size_t num_entities_to_populate, bool expand_search_if_optimal,
-		size_t query_feature_index, size_t absolute_feature_index, BitArrayIntegerSet &enabled_indices);
+		size_t query_feature_index, size_t absolute_feature_index, BitArrayIntegerSet &enabled_indices,
+		std::vector<PartialSumCollection *> &partial_sums_collections, size_t start_index, size_t end_index);
 
 	//computes a heuristically derived set of partial sums across all the enabled features from parametersAndBuffers.targetValues[i] and parametersAndBuffers.targetColumnIndices[i]
 	// if enabled_indices is not nullptr, then will only use elements in that list
@@ -791,24 +1322,108 @@ protected:
 	void PopulateInitialPartialSums(GeneralizedDistance &dist_params, size_t top_k, size_t num_enabled_features, BitArrayIntegerSet &enabled_indices,
 		std::vector<double> &min_unpopulated_distances, std::vector<double> &min_distance_by_unpopulated_count);
 
+	//runs the first num_searches of searches, each populating the partial sums of all of its queries for its feature
+	// and storing the next closest distance of each query, where the searches of each feature are in order of feature
+	// large sets of enabled_indices are split into ranges of entities populated concurrently when threads are available
+	void PopulateInitialPartialSums(std::vector<FeatureValueSearch> &searches, size_t num_searches,
+		size_t num_entities_to_populate, bool expand_search_if_optimal, BitArrayIntegerSet &enabled_indices);
+
+	//returns the number of entities PopulateInitialPartialSums should populate along each feature
+	static inline size_t GetNumEntitiesToPopulate(GeneralizedDistance &dist_params, size_t top_k, size_t num_enabled_features)
+	{
+		//populate sqrt(2)^p * top_k, which will yield 2 for p=2, 1 for p=0, and about 1.2 for p=0.5
+		if(num_enabled_features > 1)
+			return static_cast<size_t>(std::lround(FastPow(GeneralizedDistance::s_sqrt_2, dist_params.pValue) * top_k)) + 1;
+		return top_k;
+	}
+
+	//sorts min_unpopulated_distances and accumulates them into min_distance_by_unpopulated_count
+	static inline void PopulateMinDistanceByUnpopulatedCount(std::vector<double> &min_unpopulated_distances,
+		std::vector<double> &min_distance_by_unpopulated_count)
+	{
+		std::sort(begin(min_unpopulated_distances), end(min_unpopulated_distances));
+
+		//compute min distance based on the number of features that are unpopulated
+		min_distance_by_unpopulated_count.clear();
+		//need to add a 0 for when all distances are computed
+		min_distance_by_unpopulated_count.push_back(0.0);
+		//append all of the sorted distances so they can be accumulated and assigned
+		min_distance_by_unpopulated_count.insert(end(min_distance_by_unpopulated_count), begin(min_unpopulated_distances), end(min_unpopulated_distances));
+		for(size_t i = 1; i < min_distance_by_unpopulated_count.size(); i++)
+			min_distance_by_unpopulated_count[i] += min_distance_by_unpopulated_count[i - 1];
+	}
+
+	//populates potential_good_matches with up to top_k entities having the most features computed in partial_sums
+	// and the smallest partial sums, considering a heuristically limited number of enabled_indices
+	// large sets of enabled_indices are split into ranges of entities searched concurrently when threads are available
 	void PopulatePotentialGoodMatches(FlexiblePriorityQueue<CountDistanceReferencePair<size_t>> &potential_good_matches,
 		BitArrayIntegerSet &enabled_indices, PartialSumCollection &partial_sums, size_t top_k);
 
+	//like PopulatePotentialGoodMatches, but only considers up to num_indices_to_consider entities from start_index
+	// up to but not including end_index, stopping early once good_number_of_features are computed for the top_k
+	//returns the number of entities considered
+	size_t FindPotentialGoodMatchesInRange(FlexiblePriorityQueue<CountDistanceReferencePair<size_t>> &potential_good_matches,
+		BitArrayIntegerSet &enabled_indices, PartialSumCollection &partial_sums, size_t top_k,
+		size_t start_index, size_t end_index, size_t num_indices_to_consider, size_t good_number_of_features);
+
+	//after the initial partial sums of parametersAndBuffers are populated, fills parametersAndBuffers.sortedResults with top_k
+	// entities likely to be near, from the potential good matches, then random entities, then the previous query's nearest neighbors
+	// if use_previous_nearest_neighbors, removing them from enabled_indices, as well as any entities with unknown values too far to be in the top_k
+	//returns the distance of the furthest entity in sortedResults, or infinity if it doesn't have top_k
+	double SeedNearestEntities(GeneralizedDistance &dist_params, size_t top_k, size_t num_enabled_features,
+		BitArrayIntegerSet &enabled_indices, RandomStream &rand_stream, bool use_previous_nearest_neighbors);
+
+	//moves the results of parametersAndBuffers.sortedResults into distances_out in order of distance, recomputing them if requested
+	// by dist_params, and keeps them as the previous query's nearest neighbors
+	void OutputNearestEntities(GeneralizedDistance &dist_params, std::vector<DistanceReferencePair<size_t>> &distances_out);
+
+	//swaps the buffers of query with the ones of parametersAndBuffers used by searches, so the query can be worked on by any thread
+	static inline void SwapSearchBuffers(NearestEntitiesBatchQuery &query)
+	{
+		std::swap(query.targetValues, parametersAndBuffers.targetValues);
+		std::swap(query.targetValueTypes, parametersAndBuffers.targetValueTypes);
+		std::swap(query.targetColumnIndices, parametersAndBuffers.targetColumnIndices);
+		std::swap(query.partialSums, parametersAndBuffers.partialSums);
+		std::swap(query.minUnpopulatedDistances, parametersAndBuffers.minUnpopulatedDistances);
+		std::swap(query.minDistanceByUnpopulatedCount, parametersAndBuffers.minDistanceByUnpopulatedCount);
+		std::swap(query.sortedResults, parametersAndBuffers.sortedResults);
+	}
+
+	//resolves the distances of the entities of enabled_indices for the first num_queries of queries that have top_k seeded,
+	// visiting each entity once for all of the queries so that its values are read while they're in cache
+	// and each query only considers the entities of its own enabled indices
+#ifdef MULTITHREAD_SUPPORT
+	void ResolveRemainingDistancesBatch(std::vector<NearestEntitiesBatchQuery> &queries, size_t num_queries,
+		size_t top_k, size_t num_features, BitArrayIntegerSet &enabled_indices, bool run_concurrently);
+#else
+	void ResolveRemainingDistancesBatch(std::vector<NearestEntitiesBatchQuery> &queries, size_t num_queries,
+		size_t top_k, size_t num_features, BitArrayIntegerSet &enabled_indices);
+#endif
+
+#ifdef MULTITHREAD_SUPPORT
+	//resolves the distances of all of enabled_indices by splitting them into ranges searched concurrently, each keeping
+	// its own top_k starting from worst_candidate_distance, then merges the results of each range into sorted_results
+	//returns false without searching if no threads are available
+	bool ResolveRemainingDistancesConcurrently(GeneralizedDistance &dist_params, std::vector<size_t> &target_label_indices,
+		std::vector<EvaluableNodeImmediateValue> &target_values, std::vector<EvaluableNodeImmediateValueType> &target_value_types,
+		PartialSumCollection &partial_sums, BitArrayIntegerSet &enabled_indices,
+		std::vector<double> &min_distance_by_unpopulated_count, size_t num_features, std::vector<double> &min_unpopulated_distances,
+		size_t top_k, double worst_candidate_distance, StochasticTieBreakingPriorityQueue<DistanceReferencePair<size_t>> &sorted_results,
+		RandomStream &rand_stream);
+#endif
+
 	//returns the distance between two nodes while respecting the feature mask
 	inline double GetDistanceBetween(GeneralizedDistance &dist_params,
 		std::vector<EvaluableNodeImmediateValue> &target_values, std::vector<EvaluableNodeImmediateValueType> &target_value_types,
 		std::vector<size_t> &target_column_indices, size_t other_index)
 	{
-		const size_t matrix_base_position = other_index * columnData.size();
-
 		double dist_accum = 0.0;
 		for(size_t i = 0; i < target_values.size(); i++)
 		{
 			if(dist_params.IsFeatureEnabled(i))
 			{
-				size_t column_index = target_column_indices[i];
-				auto &other_value = matrix[matrix_base_position + column_index];
-				auto other_value_type = columnData[column_index]->GetIndexValueType(other_index);
+				EvaluableNodeImmediateValueType other_value_type;
+				auto other_value = GetValueAndType(other_index, target_column_indices[i], other_value_type);
 
 				dist_accum += dist_params.ComputeDistanceTermRegular(target_values[i], other_value, target_value_types[i], other_value_type, i);
 			}
@@ -833,36 +1448,65 @@ protected:
 		{
 			const size_t column_index = target_label_indices[query_feature_index];
 
+			auto &column_data = columnData[column_index];
+
 			if(feature_type == FDT_CONTINUOUS_UNIVERSALLY_NUMERIC)
 			{
-				return dist_params.ComputeDistanceTermNonNominalNonCyclicOneNonNullRegular(target_values[query_feature_index].number - GetValue(entity_index, column_index).number, query_feature_index);
+				return dist_params.ComputeDistanceTermNonNominalNonCyclicOneNonNullRegular(target_values[query_feature_index].number - GetNumberValue(entity_index, column_index), query_feature_index);
 			}
 			else if(feature_type == FDT_CONTINUOUS_NUMERIC)
 			{
-				auto &column_data = columnData[column_index];
-				if(column_data->numberIndices.contains(entity_index))
-					return dist_params.ComputeDistanceTermNonNominalNonCyclicOneNonNullRegular(target_values[query_feature_index].number - GetValue(entity_index, column_index).number, query_feature_index);
+				if(column_data->IsIndexNumber(entity_index))
+					return dist_params.ComputeDistanceTermNonNominalNonCyclicOneNonNullRegular(target_values[query_feature_index].number - GetNumberValue(entity_index, column_index), query_feature_index);
 				else
 					return dist_params.ComputeDistanceTermKnownToUnknown(query_feature_index);
 			}
 			else if(feature_type == FDT_CONTINUOUS_NUMERIC_CYCLIC)
 			{
-				auto &column_data = columnData[column_index];
-				if(column_data->numberIndices.contains(entity_index))
-					return dist_params.ComputeDistanceTermNonNominalOneNonNullRegular(target_values[query_feature_index].number - GetValue(entity_index, column_index).number, query_feature_index);
+				if(column_data->IsIndexNumber(entity_index))
+					return dist_params.ComputeDistanceTermNonNominalOneNonNullRegular(target_values[query_feature_index].number - GetNumberValue(entity_index, column_index), query_feature_index);
 				else
 					return dist_params.ComputeDistanceTermKnownToUnknown(query_feature_index);
 			}
 			else //feature_type == FDT_CONTINUOUS_CODE
 			{
-				auto &other_value = GetValue(entity_index, column_index);
-				auto other_value_type = columnData[column_index]->GetIndexValueType(entity_index);
+				EvaluableNodeImmediateValueType other_value_type;
+				auto other_value = GetValueAndType(entity_index, column_index, other_value_type);
 
 				return dist_params.ComputeDistanceTermRegular(target_values[query_feature_index], other_value, target_value_types[query_feature_index], other_value_type, query_feature_index);
 			}
 		}
 	}
 
+	//like ComputeDistanceTermNonMatch, but if the columns are at reduced precision, returns a lower bound of the term
+	// from the reduced precision value for continuous noncyclic numbers instead of reading the exact value
+	__forceinline double ComputeDistanceTermNonMatchLowerBound(GeneralizedDistance &dist_params, std::vector<size_t> &target_label_indices,
+		std::vector<EvaluableNodeImmediateValue> &target_values, std::vector<EvaluableNodeImmediateValueType> &target_value_types,
+		size_t entity_index, size_t query_feature_index)
+	{
+		auto feature_type = dist_params.featureParams[query_feature_index].featureType;
+		if(reducedPrecisionNumbers && dist_params.featureParams[query_feature_index].weight >= 0
+			&& (feature_type == FDT_CONTINUOUS_UNIVERSALLY_NUMERIC || feature_type == FDT_CONTINUOUS_NUMERIC))
+		{
+			auto &column_data = columnData[target_label_indices[query_feature_index]];
+			double target = target_values[query_feature_index].number;
+			if(column_data->IsIndexNumber(entity_index) && !FastIsNaN(target))
+			{
+				double value = column_data->GetIndexReducedNumberValue(entity_index);
+				if(std::isfinite(value))
+				{
+					//rounding to a float moves a value by at most 2^-24 of its magnitude, or the smallest denormal,
+					// and the difference term only grows with the difference, so shrinking it by more than that is a lower bound
+					double max_error = std::abs(value) * 0x1p-23 + std::numeric_limits<float>::denorm_min();
+					double diff = std::max(std::abs(target - value) - max_error, 0.0);
+					return dist_params.ComputeDistanceTermNonNominalNonCyclicOneNonNullRegular(diff, query_feature_index);
+				}
+			}
+		}
+
+		return ComputeDistanceTermNonMatch(dist_params, target_label_indices, target_values, target_value_types, entity_index, query_feature_index);
+	}
+
 	//given an estimate of distance that uses best_possible_feature_distance filled in for any features not computed,
 	// this function iterates over the partial sums indices, replacing each uncomputed feature with the actual distance for that feature
 	//returns the distance
@@ -922,7 +1566,7 @@ protected:
 			distance -= min_unpopulated_distances[--num_uncalculated_features];
 
 			const size_t query_feature_index = *it;
-			distance += ComputeDistanceTermNonMatch(dist_params, target_label_indices, target_values, target_value_types,
+			distance += ComputeDistanceTermNonMatchLowerBound(dist_params, target_label_indices, target_values, target_value_types,
 				entity_index, query_feature_index);
 
 			//break out of the loop before the iterator is incremented to save a few cycles
@@ -933,6 +1577,14 @@ protected:
 				break;
 		}
 
+		//at reduced precision the distance is only a lower bound, so compute the exact distance of the entities not ruled out
+		if(reducedPrecisionNumbers)
+		{
+			distance = ResolveDistanceToNonMatchTargetValues(dist_params, target_label_indices, target_values, target_value_types,
+				partial_sums, entity_index, num_features);
+			return std::make_pair(distance <= reject_distance, distance);
+		}
+
 		//done with computation
 		return std::make_pair(true, distance);
 	}
@@ -974,6 +1626,19 @@ protected:
 		}
 	}
 
+	//returns the snapshot in snapshots for label_id, nullptr if none
+	static inline SBFDSColumnData::NumberValueBucketsSnapshot *FindNumberValueBucketsSnapshot(
+		NumberValueBucketsSnapshotMap *snapshots, StringInternPool::StringID label_id)
+	{
+		if(snapshots == nullptr)
+			return nullptr;
+
+		auto found = snapshots->find(label_id);
+		if(found == end(*snapshots))
+			return nullptr;
+		return found->second.get();
+	}
+
 	//populates targetValues and targetColumnIndices given the selected target values for each value in corresponding position* parameters
 	inline void PopulateTargetValuesAndLabelIndices(GeneralizedDistance &dist_params,
 		std::vector<size_t> &position_label_ids, std::vector<EvaluableNodeImmediateValue> &position_values,
@@ -1005,6 +1670,40 @@ protected:
 		}
 	}
 
+	//like PopulateTargetValuesAndLabelIndices, but uses the values of the entity at search_index as the target values
+	inline void PopulateTargetValuesFromIndexedEntity(GeneralizedDistance &dist_params,
+		std::vector<size_t> &position_label_ids, size_t search_index)
+	{
+		auto &target_values = parametersAndBuffers.targetValues;
+		target_values.clear();
+
+		auto &target_value_types = parametersAndBuffers.targetValueTypes;
+		target_value_types.clear();
+
+		auto &target_column_indices = parametersAndBuffers.targetColumnIndices;
+		target_column_indices.clear();
+
+		for(size_t i = 0; i < position_label_ids.size(); i++)
+		{
+			auto found = labelIdToColumnIndex.find(position_label_ids[i]);
+			if(found == end(labelIdToColumnIndex))
+				continue;
+
+			if(dist_params.IsFeatureEnabled(i))
+			{
+				size_t column_index = found->second;
+
+				EvaluableNodeImmediateValueType value_type;
+				auto value = GetValueAndType(search_index, column_index, value_type);
+
+				PopulateNextTargetAttributes(dist_params,
+					target_column_indices, target_values, target_value_types,
+					column_index, value, value_type,
+					dist_params.featureParams[i].featureType);
+			}
+		}
+	}
+
 	//recomputes feature gaps and computes parametersAndBuffers.maxFeatureGaps
 	// returns the smallest of the maximum feature gaps among the features
 	inline void PopulateUnknownFeatureValueTerms(GeneralizedDistance &dist_params)
@@ -1037,6 +1736,64 @@ protected:
 		}
 	}
 
+	//populates column_indices with the column of each label of graph, or the maximum size_t for disabled features
+	//returns false if a label of an enabled feature is not in the datastore
+	inline bool PopulateNearestNeighborGraphColumnIndices(NearestNeighborGraph &graph, std::vector<size_t> &column_indices)
+	{
+		column_indices.clear();
+		for(size_t i = 0; i < graph.labelIds.size(); i++)
+		{
+			if(!graph.nodeDistParams.IsFeatureEnabled(i))
+			{
+				column_indices.push_back(std::numeric_limits<size_t>::max());
+				continue;
+			}
+
+			auto column = labelIdToColumnIndex.find(graph.labelIds[i]);
+			if(column == end(labelIdToColumnIndex))
+				return false;
+			column_indices.push_back(column->second);
+		}
+		return true;
+	}
+
+	//returns true if the entity at entity_index has a value for each of column_indices, which would make it a node of the graph
+	inline bool DoesEntityHaveNearestNeighborGraphValues(std::vector<size_t> &column_indices, size_t entity_index)
+	{
+		if(entity_index >= numEntities)
+			return false;
+
+		for(size_t column_index : column_indices)
+		{
+			if(column_index != std::numeric_limits<size_t>::max()
+					&& columnData[column_index]->GetIndexValueType(entity_index) == ENIVT_NOT_EXIST)
+				return false;
+		}
+		return true;
+	}
+
+	//returns a function that computes the exponentiated distance between the entities at two indices over column_indices
+	// with the node distance parameters of graph, treating unknown values the same as the exact search does
+	inline auto GetNearestNeighborGraphNodeDistanceFunction(NearestNeighborGraph &graph, std::vector<size_t> &column_indices)
+	{
+		return [this, &graph, &column_indices](size_t a, size_t b)
+		{
+			auto &dist_params = graph.nodeDistParams;
+			double distance = 0.0;
+			for(size_t i = 0; i < column_indices.size(); i++)
+			{
+				if(column_indices[i] == std::numeric_limits<size_t>::max())
+					continue;
+
+				EvaluableNodeImmediateValueType a_type, b_type;
+				auto a_value = GetValueAndType(a, column_indices[i], a_type);
+				auto b_value = GetValueAndType(b, column_indices[i], b_type);
+				distance += dist_params.ComputeDistanceTermRegular(a_value, b_value, a_type, b_type, i);
+			}
+			return distance;
+		};
+	}
+
 	//returns all elements in the database that yield valid distances along with their sorted distances to the values for entity
 	// at target_index, optionally limits results count to k
 	inline void FindAllValidElementDistances(GeneralizedDistance &dist_params, std::vector<size_t> &target_column_indices,
@@ -1049,30 +1806,110 @@ protected:
 
 		dist_params.SetHighAccuracy(dist_params.highAccuracy || dist_params.recomputeAccurateDistances);
 
+		auto &entity_indices = parametersAndBuffers.entityIndices;
+		entity_indices.clear();
+		entity_indices.reserve(valid_indices.size());
 		for(auto index : valid_indices)
+			entity_indices.push_back(index);
+
+		//accumulate one feature at a time across all of the entities so each column is read contiguously
+		// and numeric features can be computed with vector instructions
+		auto &distances = parametersAndBuffers.entityDistances;
+		distances.clear();
+		distances.resize(entity_indices.size(), 0.0);
+
+		for(size_t i = 0; i < target_values.size(); i++)
 		{
-			double distance = GetDistanceBetween(dist_params, target_values, target_value_types, target_column_indices, index);
-			distances_out.emplace_back(distance, index);
+			if(!dist_params.IsFeatureEnabled(i))
+				continue;
+
+			size_t column_index = target_column_indices[i];
+			if(!reducedPrecisionNumbers && CanUseNumericDistanceKernel(dist_params, target_values, target_value_types, i, column_index))
+			{
+				DistanceKernels::AccumulateNumericDistanceTerms(columnData[column_index]->GetNumberValuesData(),
+					entity_indices.data(), entity_indices.size(), target_values[i].number,
+					dist_params.featureParams[i].weight, dist_params.pValue == 2,
+					dist_params.ComputeDistanceTermKnownToUnknown(i), distances.data());
+				continue;
+			}
+
+			for(size_t j = 0; j < entity_indices.size(); j++)
+			{
+				EvaluableNodeImmediateValueType other_value_type;
+				auto other_value = GetValueAndType(entity_indices[j], column_index, other_value_type);
+				distances[j] += dist_params.ComputeDistanceTermRegular(target_values[i], other_value, target_value_types[i], other_value_type, i);
+			}
 		}
 
+		distances_out.reserve(distances_out.size() + entity_indices.size());
+		for(size_t j = 0; j < entity_indices.size(); j++)
+			distances_out.emplace_back(dist_params.InverseExponentiateDistance(distances[j]), entity_indices[j]);
+
 		std::sort(begin(distances_out), end(distances_out));
 	}
 
+	//returns true if the distance terms for the feature at query_feature_index can be computed
+	// by DistanceKernels::AccumulateNumericDistanceTerms, which requires every value of the column at column_index
+	// to be a number or unknown, a known target, no deviation, and a p-value whose exponentiation is exact
+	inline bool CanUseNumericDistanceKernel(GeneralizedDistance &dist_params,
+		std::vector<EvaluableNodeImmediateValue> &target_values, std::vector<EvaluableNodeImmediateValueType> &target_value_types,
+		size_t query_feature_index, size_t column_index)
+	{
+		auto &column_data = columnData[column_index];
+		return (dist_params.featureParams[query_feature_index].featureType == FDT_CONTINUOUS_UNIVERSALLY_NUMERIC
+			&& column_data->stringIdIndices.size() == 0 && column_data->codeIndices.size() == 0
+			&& (dist_params.pValue == 1 || dist_params.pValue == 2)
+			&& !dist_params.DoesFeatureHaveDeviation(query_feature_index)
+			&& target_value_types[query_feature_index] == ENIVT_NUMBER
+			&& !FastIsNaN(target_values[query_feature_index].number));
+	}
+
 	//contains entity lookups for each of the values for each of the columns
 	std::vector<std::unique_ptr<SBFDSColumnData>> columnData;
+
+	//running aggregates of the number values of the column with label valueLabelId weighted by
+	// the number values of the column with label weightLabelId
+	struct WeightedNumberValueSummaryOfLabels
+	{
+		inline WeightedNumberValueSummaryOfLabels(StringInternPool::StringID value_label_id, StringInternPool::StringID weight_label_id)
+			: valueLabelId(value_label_id), weightLabelId(weight_label_id)
+		{	}
+
+		StringInternPool::StringID valueLabelId;
+		StringInternPool::StringID weightLabelId;
+		WeightedNumberValueSummary summary;
+	};
+
+	//weighted aggregates that have been built by BuildWeightedNumberValueSummary, kept up to date as entities change
+	// and removed when either of their columns is removed
+	std::vector<WeightedNumberValueSummaryOfLabels> weightedNumberValueSummaries;
 	
 	//for multithreading, there should be one of these per thread
 #if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
 	thread_local
 #endif
 	static SBFDSParametersAndBuffers parametersAndBuffers;
+
+	//total number of entities considered by PopulatePotentialGoodMatches, only used for reporting on queries
+#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+	static std::atomic<size_t> numPotentialGoodMatchesConsidered;
+#else
+	static size_t numPotentialGoodMatchesConsidered;
+#endif
 	
-	//map from label id to column index in the matrix
+	//map from label id to column index
 	FastHashMap<StringInternPool::StringID, size_t> labelIdToColumnIndex;
 
-	//matrix of cases (rows) * features (columns)
-	std::vector<EvaluableNodeImmediateValue> matrix;
-
 	//the number of entities in the data store; all indices below this value are populated
 	size_t numEntities;
+
+	//incremented every time an entity or any of its label values changes, whether or not the label is in the datastore
+	size_t writeEpoch;
+
+	//write epoch when an entity was last added or removed or had all of its labels updated,
+	// which may change the values of every column
+	size_t entitiesWriteEpoch;
+
+	//if true, the columns also keep their number values as floats for bounding distance terms
+	bool reducedPrecisionNumbers;
 };
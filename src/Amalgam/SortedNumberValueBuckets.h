@@ -0,0 +1,386 @@
+#pragma once
+
+//project headers:
+#include "IntegerSet.h"
+
+//system headers:
+#include <algorithm>
+#include <vector>
+
+//SortedNumberValueBuckets stores unique number values in sorted order, each with a bucket of the indices that have that value
+//buckets are addressed by their position in the sorted order like a vector, but are stored in blocks of bounded size
+// so that inserting or removing a value only moves the buckets within one block rather than every bucket after it,
+// while neighboring values stay contiguous in memory for scans
+//the number of indices in each block is also tracked so that the value at a given rank among all of the indices
+// can be found without visiting every bucket; for this, indices must be added and removed via InsertIndex and EraseIndex
+class SortedNumberValueBuckets
+{
+public:
+	//a unique value and the indices that have the value
+	struct Bucket
+	{
+		inline Bucket(double _value)
+			: value(_value)
+		{	}
+
+		double value;
+		SortedIntegerSet indices;
+	};
+
+	//iterates over buckets in sorted order
+	class Iterator
+	{
+	public:
+		constexpr Iterator(std::vector<std::vector<Bucket>> *_blocks, size_t block_index, size_t offset)
+			: blocks(_blocks), blockIndex(block_index), offsetInBlock(offset)
+		{	}
+
+		__forceinline Bucket &operator *()
+		{
+			return (*blocks)[blockIndex][offsetInBlock];
+		}
+
+		__forceinline Bucket *operator ->()
+		{
+			return &(*blocks)[blockIndex][offsetInBlock];
+		}
+
+		__forceinline Iterator &operator ++()
+		{
+			offsetInBlock++;
+			if(offsetInBlock >= (*blocks)[blockIndex].size())
+			{
+				blockIndex++;
+				offsetInBlock = 0;
+			}
+			return *this;
+		}
+
+		constexpr bool operator ==(const Iterator &other)
+		{
+			return blockIndex == other.blockIndex && offsetInBlock == other.offsetInBlock;
+		}
+
+		constexpr bool operator !=(const Iterator &other)
+		{
+			return blockIndex != other.blockIndex || offsetInBlock != other.offsetInBlock;
+		}
+
+	protected:
+		std::vector<std::vector<Bucket>> *blocks;
+		size_t blockIndex;
+		size_t offsetInBlock;
+	};
+
+	inline SortedNumberValueBuckets()
+		: numBuckets(0), numIndices(0)
+	{	}
+
+	//returns the number of unique values
+	__forceinline size_t size()
+	{
+		return numBuckets;
+	}
+
+	//returns the total number of indices across all buckets
+	__forceinline size_t GetNumIndices()
+	{
+		return numIndices;
+	}
+
+	inline void clear()
+	{
+		blocks.clear();
+		blockStartIndices.clear();
+		blockFirstValues.clear();
+		blockNumIndices.clear();
+		numBuckets = 0;
+		numIndices = 0;
+	}
+
+	//returns the bucket at index in sorted order
+	__forceinline Bucket &operator [](size_t index)
+	{
+		size_t block_index = GetBlockIndexContainingIndex(index);
+		return blocks[block_index][index - blockStartIndices[block_index]];
+	}
+
+	__forceinline Bucket &front()
+	{
+		return blocks.front().front();
+	}
+
+	__forceinline Bucket &back()
+	{
+		return blocks.back().back();
+	}
+
+	//std begin (must be lowercase)
+	__forceinline Iterator begin()
+	{
+		return Iterator(&blocks, 0, 0);
+	}
+
+	//std end (must be lowercase)
+	__forceinline Iterator end()
+	{
+		return Iterator(&blocks, blocks.size(), 0);
+	}
+
+	//returns an iterator to the bucket at index, or end() if index is size()
+	inline Iterator GetIteratorAtIndex(size_t index)
+	{
+		if(index >= numBuckets)
+			return end();
+
+		size_t block_index = GetBlockIndexContainingIndex(index);
+		return Iterator(&blocks, block_index, index - blockStartIndices[block_index]);
+	}
+
+	//returns the index of the first bucket with a value not less than value
+	inline size_t FindLowerBoundIndex(double value)
+	{
+		//find the last block that starts with a value less than value, since it may contain the bound
+		auto block_iter = std::lower_bound(std::begin(blockFirstValues), std::end(blockFirstValues), value);
+		if(block_iter == std::begin(blockFirstValues))
+			return 0;
+
+		size_t block_index = std::distance(std::begin(blockFirstValues), block_iter) - 1;
+		auto &block = blocks[block_index];
+		auto bucket_iter = std::lower_bound(std::begin(block), std::end(block), value,
+			[](const Bucket &bucket, double value) { return bucket.value < value; });
+		return blockStartIndices[block_index] + std::distance(std::begin(block), bucket_iter);
+	}
+
+	//returns the index of the first bucket with a value greater than value
+	inline size_t FindUpperBoundIndex(double value)
+	{
+		auto block_iter = std::upper_bound(std::begin(blockFirstValues), std::end(blockFirstValues), value);
+		if(block_iter == std::begin(blockFirstValues))
+			return 0;
+
+		size_t block_index = std::distance(std::begin(blockFirstValues), block_iter) - 1;
+		auto &block = blocks[block_index];
+		auto bucket_iter = std::upper_bound(std::begin(block), std::end(block), value,
+			[](double value, const Bucket &bucket) { return value < bucket.value; });
+		return blockStartIndices[block_index] + std::distance(std::begin(block), bucket_iter);
+	}
+
+	//returns the index of the bucket containing the index at rank among all indices ordered by bucket value,
+	// where rank must be less than GetNumIndices()
+	inline size_t FindBucketIndexContainingRank(size_t rank)
+	{
+		size_t block_index = 0;
+		for(; block_index + 1 < blocks.size(); block_index++)
+		{
+			if(rank < blockNumIndices[block_index])
+				break;
+			rank -= blockNumIndices[block_index];
+		}
+
+		auto &block = blocks[block_index];
+		size_t offset = 0;
+		for(; offset + 1 < block.size(); offset++)
+		{
+			if(rank < block[offset].indices.size())
+				break;
+			rank -= block[offset].indices.size();
+		}
+
+		return blockStartIndices[block_index] + offset;
+	}
+
+	//returns the number of indices across all buckets before the bucket at index, where index may be size()
+	inline size_t CountIndicesBeforeIndex(size_t index)
+	{
+		if(index >= numBuckets)
+			return numIndices;
+
+		size_t block_index = GetBlockIndexContainingIndex(index);
+		size_t count = 0;
+		for(size_t i = 0; i < block_index; i++)
+			count += blockNumIndices[i];
+
+		auto &block = blocks[block_index];
+		size_t offset_end = index - blockStartIndices[block_index];
+		for(size_t offset = 0; offset < offset_end; offset++)
+			count += block[offset].indices.size();
+
+		return count;
+	}
+
+	//adds index to the bucket at bucket_index
+	inline void InsertIndex(size_t bucket_index, size_t index)
+	{
+		size_t block_index = GetBlockIndexContainingIndex(bucket_index);
+		auto &indices = blocks[block_index][bucket_index - blockStartIndices[block_index]].indices;
+		size_t prev_size = indices.size();
+		indices.insert(index);
+		blockNumIndices[block_index] += indices.size() - prev_size;
+		numIndices += indices.size() - prev_size;
+	}
+
+	//removes index from the bucket at bucket_index
+	inline void EraseIndex(size_t bucket_index, size_t index)
+	{
+		size_t block_index = GetBlockIndexContainingIndex(bucket_index);
+		auto &indices = blocks[block_index][bucket_index - blockStartIndices[block_index]].indices;
+		size_t prev_size = indices.size();
+		indices.erase(index);
+		blockNumIndices[block_index] -= prev_size - indices.size();
+		numIndices -= prev_size - indices.size();
+	}
+
+	//appends a bucket for value, which must be larger than all current values, and returns it
+	// used for building all the buckets in order
+	inline Bucket &InsertNewLargestValue(double value)
+	{
+		if(blocks.size() == 0 || blocks.back().size() >= maxBlockSize)
+		{
+			blocks.emplace_back();
+			blocks.back().reserve(maxBlockSize);
+			blockStartIndices.push_back(numBuckets);
+			blockFirstValues.push_back(value);
+			blockNumIndices.push_back(0);
+		}
+
+		numBuckets++;
+		return blocks.back().emplace_back(value);
+	}
+
+	//appends index, which must be larger than all indices in the last bucket, to the last bucket
+	// used for building all the buckets in order
+	inline void InsertNewLargestIndexInLastBucket(size_t index)
+	{
+		blocks.back().back().indices.InsertNewLargestInteger(index);
+		blockNumIndices.back()++;
+		numIndices++;
+	}
+
+	//inserts a new bucket for value at index, which must be where value belongs in the sorted order, and returns it
+	inline Bucket &Insert(size_t index, double value)
+	{
+		if(index == numBuckets)
+			return InsertNewLargestValue(value);
+
+		size_t block_index = GetBlockIndexContainingIndex(index);
+		size_t offset = index - blockStartIndices[block_index];
+		auto &block = blocks[block_index];
+		block.emplace(std::begin(block) + offset, value);
+		if(offset == 0)
+			blockFirstValues[block_index] = value;
+
+		numBuckets++;
+		for(size_t i = block_index + 1; i < blockStartIndices.size(); i++)
+			blockStartIndices[i]++;
+
+		if(block.size() <= maxBlockSize)
+			return block[offset];
+
+		//split the block in half, moving the upper half into a new block
+		size_t split_offset = block.size() / 2;
+		std::vector<Bucket> new_block;
+		new_block.reserve(maxBlockSize);
+		new_block.insert(std::end(new_block), std::make_move_iterator(std::begin(block) + split_offset),
+			std::make_move_iterator(std::end(block)));
+		block.erase(std::begin(block) + split_offset, std::end(block));
+
+		size_t new_block_num_indices = 0;
+		for(auto &bucket : new_block)
+			new_block_num_indices += bucket.indices.size();
+
+		blockStartIndices.insert(std::begin(blockStartIndices) + block_index + 1, blockStartIndices[block_index] + split_offset);
+		blockFirstValues.insert(std::begin(blockFirstValues) + block_index + 1, new_block.front().value);
+		blockNumIndices[block_index] -= new_block_num_indices;
+		blockNumIndices.insert(std::begin(blockNumIndices) + block_index + 1, new_block_num_indices);
+		blocks.insert(std::begin(blocks) + block_index + 1, std::move(new_block));
+
+		if(offset < split_offset)
+			return blocks[block_index][offset];
+		return blocks[block_index + 1][offset - split_offset];
+	}
+
+	//removes the bucket at index
+	inline void Erase(size_t index)
+	{
+		size_t block_index = GetBlockIndexContainingIndex(index);
+		size_t offset = index - blockStartIndices[block_index];
+		auto &block = blocks[block_index];
+		size_t bucket_num_indices = block[offset].indices.size();
+		blockNumIndices[block_index] -= bucket_num_indices;
+		numIndices -= bucket_num_indices;
+		block.erase(std::begin(block) + offset);
+
+		numBuckets--;
+		for(size_t i = block_index + 1; i < blockStartIndices.size(); i++)
+			blockStartIndices[i]--;
+
+		if(block.size() == 0)
+		{
+			RemoveBlock(block_index);
+			return;
+		}
+
+		if(offset == 0)
+			blockFirstValues[block_index] = block.front().value;
+
+		//merge small blocks into a neighbor so the number of blocks stays proportional to the number of buckets
+		if(block.size() < maxBlockSize / 4)
+		{
+			if(block_index + 1 < blocks.size() && block.size() + blocks[block_index + 1].size() <= maxBlockSize)
+				MergeBlockIntoPrevious(block_index + 1);
+			else if(block_index > 0 && block.size() + blocks[block_index - 1].size() <= maxBlockSize)
+				MergeBlockIntoPrevious(block_index);
+		}
+	}
+
+protected:
+
+	//returns the index of the block containing the bucket at index
+	__forceinline size_t GetBlockIndexContainingIndex(size_t index)
+	{
+		auto block_iter = std::upper_bound(std::begin(blockStartIndices), std::end(blockStartIndices), index);
+		return std::distance(std::begin(blockStartIndices), block_iter) - 1;
+	}
+
+	//moves all of the buckets in the block at block_index to the end of the block before it and removes the block
+	inline void MergeBlockIntoPrevious(size_t block_index)
+	{
+		auto &previous_block = blocks[block_index - 1];
+		auto &block = blocks[block_index];
+		previous_block.insert(std::end(previous_block), std::make_move_iterator(std::begin(block)),
+			std::make_move_iterator(std::end(block)));
+		blockNumIndices[block_index - 1] += blockNumIndices[block_index];
+		RemoveBlock(block_index);
+	}
+
+	//removes the block at block_index and its lookups
+	inline void RemoveBlock(size_t block_index)
+	{
+		blocks.erase(std::begin(blocks) + block_index);
+		blockStartIndices.erase(std::begin(blockStartIndices) + block_index);
+		blockFirstValues.erase(std::begin(blockFirstValues) + block_index);
+		blockNumIndices.erase(std::begin(blockNumIndices) + block_index);
+	}
+
+	//maximum number of buckets stored in one block before it is split
+	static constexpr size_t maxBlockSize = 256;
+
+	//blocks of buckets in sorted order
+	std::vector<std::vector<Bucket>> blocks;
+
+	//index of the first bucket of each block
+	std::vector<size_t> blockStartIndices;
+
+	//value of the first bucket of each block, kept contiguous for finding the block containing a value
+	std::vector<double> blockFirstValues;
+
+	//number of indices across all buckets of each block
+	std::vector<size_t> blockNumIndices;
+
+	//total number of buckets across all blocks
+	size_t numBuckets;
+
+	//total number of indices across all buckets
+	size_t numIndices;
+};
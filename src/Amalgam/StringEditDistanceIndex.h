@@ -0,0 +1,237 @@
+#pragma once
+
+//project headers:
+#include "EvaluableNodeTreeManipulation.h"
+#include "HashMaps.h"
+#include "StringInternPool.h"
+
+//system headers:
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+//metric index over distinct string values, stored as a BK-tree keyed on EvaluableNodeTreeManipulation::EditDistance
+//each child of a node is stored with its edit distance to the node, so that by the triangle inequality a search
+// for strings within some distance of a value only needs to visit children whose distance is close to the node's
+//removed strings are kept in the tree to route searches until enough accumulate that the tree is rebuilt
+class StringEditDistanceIndex
+{
+public:
+	inline StringEditDistanceIndex()
+		: numRemoved(0)
+	{	}
+
+	inline ~StringEditDistanceIndex()
+	{
+		for(auto &node : nodes)
+			string_intern_pool.DestroyStringReference(node.stringId);
+	}
+
+	//returns the number of strings in the index
+	inline size_t size()
+	{
+		return nodes.size() - numRemoved;
+	}
+
+	//adds string_id to the index if it is not already in it
+	inline void Insert(StringInternPool::StringID string_id)
+	{
+		auto [node_entry, inserted] = stringIdToNodeIndex.emplace(string_id, nodes.size());
+		if(!inserted)
+		{
+			auto &node = nodes[node_entry->second];
+			if(node.removed)
+			{
+				node.removed = false;
+				numRemoved--;
+			}
+			return;
+		}
+
+		//keep a reference so the string remains valid even after it is removed but still in the tree
+		string_intern_pool.CreateStringReference(string_id);
+		nodes.emplace_back(string_id);
+		if(nodes.size() == 1)
+			return;
+
+		auto &new_str = string_intern_pool.GetStringFromID(string_id);
+		size_t new_node_index = nodes.size() - 1;
+		size_t node_index = 0;
+		while(true)
+		{
+			auto &node_str = string_intern_pool.GetStringFromID(nodes[node_index].stringId);
+			size_t distance = EvaluableNodeTreeManipulation::EditDistance(new_str, node_str);
+
+			auto &children = nodes[node_index].children;
+			auto found = std::find_if(begin(children), end(children),
+				[distance](auto &child) { return child.first == distance; });
+			if(found == end(children))
+			{
+				children.emplace_back(distance, new_node_index);
+				return;
+			}
+
+			node_index = found->second;
+		}
+	}
+
+	//removes string_id from the index if it is in it
+	inline void Remove(StringInternPool::StringID string_id)
+	{
+		auto node_entry = stringIdToNodeIndex.find(string_id);
+		if(node_entry == end(stringIdToNodeIndex))
+			return;
+
+		auto &node = nodes[node_entry->second];
+		if(node.removed)
+			return;
+
+		node.removed = true;
+		numRemoved++;
+
+		//rebuild once most of the tree is only routing
+		if(numRemoved > nodes.size() / 2)
+			Rebuild();
+	}
+
+	//calls func(string_id, distance) for each string in the index whose edit distance to value is at most max_distance
+	template<typename StringFunction>
+	inline void FindAllWithinDistance(const std::string &value, size_t max_distance, StringFunction func)
+	{
+		if(nodes.size() == 0)
+			return;
+
+		std::vector<size_t> nodes_to_visit;
+		nodes_to_visit.push_back(0);
+		while(nodes_to_visit.size() > 0)
+		{
+			auto &node = nodes[nodes_to_visit.back()];
+			nodes_to_visit.pop_back();
+
+			auto &node_str = string_intern_pool.GetStringFromID(node.stringId);
+			size_t distance = EvaluableNodeTreeManipulation::EditDistance(value, node_str);
+			if(distance <= max_distance && !node.removed)
+				func(node.stringId, distance);
+
+			//only children with a distance to the node within max_distance of distance can contain matches
+			for(auto &[child_distance, child_node_index] : node.children)
+			{
+				if(child_distance + max_distance >= distance && child_distance <= distance + max_distance)
+					nodes_to_visit.push_back(child_node_index);
+			}
+		}
+	}
+
+	//finds the strings nearest to value, such that the sum of get_count(string_id) over the strings found is at least min_count
+	// if possible, including all strings tied at the largest distance found, searching no farther than max_distance
+	//populates nearest_out with pairs of edit distance and string id sorted by distance, and returns the largest distance
+	// that was searched, so every string not in nearest_out has a distance greater than the value returned
+	template<typename CountFunction>
+	size_t FindNearest(const std::string &value, size_t min_count, size_t max_distance, CountFunction get_count,
+		std::vector<std::pair<size_t, StringInternPool::StringID>> &nearest_out)
+	{
+		nearest_out.clear();
+		if(nodes.size() == 0)
+			return max_distance;
+
+		//total count of strings found at each distance, used to shrink the search radius as closer strings are found
+		std::vector<size_t> count_by_distance(max_distance + 1, 0);
+		size_t radius = max_distance;
+
+		//pairs of node index and the smallest distance any string in its subtree can be from value
+		std::vector<std::pair<size_t, size_t>> nodes_to_visit;
+		nodes_to_visit.emplace_back(0, 0);
+		std::vector<std::pair<size_t, size_t>> children_to_visit;
+		while(nodes_to_visit.size() > 0)
+		{
+			auto [node_index, min_distance] = nodes_to_visit.back();
+			nodes_to_visit.pop_back();
+			if(min_distance > radius)
+				continue;
+
+			auto &node = nodes[node_index];
+			auto &node_str = string_intern_pool.GetStringFromID(node.stringId);
+			size_t distance = EvaluableNodeTreeManipulation::EditDistance(value, node_str);
+			if(distance <= radius && !node.removed)
+			{
+				nearest_out.emplace_back(distance, node.stringId);
+				count_by_distance[distance] += get_count(node.stringId);
+
+				//shrink the radius to the smallest that still contains min_count
+				size_t total_count = 0;
+				for(size_t d = 0; d <= radius; d++)
+				{
+					total_count += count_by_distance[d];
+					if(total_count >= min_count)
+					{
+						radius = d;
+						break;
+					}
+				}
+			}
+
+			//visit the children that could be closest first, so the radius shrinks as quickly as possible
+			children_to_visit.clear();
+			for(auto &[child_distance, child_node_index] : node.children)
+			{
+				size_t child_min_distance = (child_distance > distance ? child_distance - distance : distance - child_distance);
+				if(child_min_distance <= radius)
+					children_to_visit.emplace_back(child_min_distance, child_node_index);
+			}
+			std::sort(begin(children_to_visit), end(children_to_visit), std::greater<>());
+			for(auto &[child_min_distance, child_node_index] : children_to_visit)
+				nodes_to_visit.emplace_back(child_node_index, child_min_distance);
+		}
+
+		//remove any strings that were found before the radius shrank below them
+		nearest_out.erase(std::remove_if(begin(nearest_out), end(nearest_out),
+			[radius](auto &entry) { return entry.first > radius; }), end(nearest_out));
+		std::sort(begin(nearest_out), end(nearest_out));
+		return radius;
+	}
+
+protected:
+	//rebuilds the tree from only the strings that have not been removed
+	void Rebuild()
+	{
+		std::vector<StringInternPool::StringID> string_ids;
+		string_ids.reserve(nodes.size() - numRemoved);
+		for(auto &node : nodes)
+		{
+			if(!node.removed)
+				string_ids.push_back(node.stringId);
+		}
+
+		//the previous nodes' references are released after inserting so that none of the strings can be freed in between
+		auto prev_nodes = std::move(nodes);
+		nodes.clear();
+		stringIdToNodeIndex.clear();
+		numRemoved = 0;
+		for(auto string_id : string_ids)
+			Insert(string_id);
+
+		for(auto &node : prev_nodes)
+			string_intern_pool.DestroyStringReference(node.stringId);
+	}
+
+	struct Node
+	{
+		inline Node(StringInternPool::StringID string_id)
+			: stringId(string_id), removed(false)
+		{	}
+
+		StringInternPool::StringID stringId;
+		bool removed;
+		//pairs of edit distance to this node and the index of the child node
+		std::vector<std::pair<size_t, size_t>> children;
+	};
+
+	//nodes of the tree, where the first is the root
+	std::vector<Node> nodes;
+
+	//index of the node of each string
+	FastHashMap<StringInternPool::StringID, size_t> stringIdToNodeIndex;
+
+	//number of nodes whose strings have been removed
+	size_t numRemoved;
+};
@@ -6,6 +6,7 @@
 #include "EvaluableNodeTreeFunctions.h"
 
 bool _enable_SBF_datastore = true;
+bool _enable_SBF_datastore_reduced_precision = false;
 
 #ifdef MULTITHREAD_SUPPORT
 Concurrency::ReadWriteMutex EntityQueryManager::queryCacheMutex;
@@ -15,6 +16,13 @@ FastHashMap<Entity *, std::unique_ptr<EntityQueryCaches>> EntityQueryManager::qu
 
 size_t EntityQueryManager::maxEntitiesBruteForceSearch = 10;
 
+bool EntityQueryManager::explainQueries = false;
+
+#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+thread_local
+#endif
+EntityQueryExplanation EntityQueryManager::queryExplanation;
+
 bool EntityQueryCondition::DoesEntityMatchCondition(Entity *e)
 {
 	if(e == nullptr)
@@ -823,6 +831,78 @@ static bool CanUseQueryCaches(std::vector<EntityQueryCondition> &conditions)
 	return true;
 }
 
+//returns true if cond keeps exactly the entities matching a criterion independent of the other conditions,
+// such that it can be evaluated anywhere among consecutive conditions for which this is also true
+static bool IsReorderableFilterCondition(EntityQueryCondition &cond)
+{
+	switch(cond.queryType)
+	{
+	//without labels, the condition matches nothing when first but keeps everything otherwise
+	case ENT_QUERY_EXISTS:
+	case ENT_QUERY_NOT_EXISTS:
+		return (cond.existLabels.size() > 0);
+
+	case ENT_QUERY_EQUALS:
+		return (cond.singleLabels.size() > 0);
+
+	case ENT_QUERY_BETWEEN:
+	case ENT_QUERY_NOT_BETWEEN:
+		return (cond.pairedLabels.size() > 0);
+
+	case ENT_QUERY_AMONG:
+	case ENT_QUERY_NOT_AMONG:
+		return true;
+
+	//ENT_QUERY_NOT_EQUALS only requires the label to exist when it is the first condition
+	default:
+		return false;
+	}
+}
+
+void EntityQueryManager::OrderConditionsBySelectivity(EntityQueryCaches *entity_caches,
+	std::vector<EntityQueryCondition> &conditions, bool return_query_value)
+{
+	size_t num_movable_conditions = conditions.size();
+	if(return_query_value && num_movable_conditions > 0)
+		num_movable_conditions--;
+
+	size_t run_start = 0;
+	while(run_start < num_movable_conditions)
+	{
+		if(!IsReorderableFilterCondition(conditions[run_start]))
+		{
+			run_start++;
+			continue;
+		}
+
+		size_t run_end = run_start + 1;
+		while(run_end < num_movable_conditions && IsReorderableFilterCondition(conditions[run_end]))
+			run_end++;
+
+		if(run_end - run_start > 1)
+		{
+			//estimated number of matching entities and index of each condition of the run
+			std::vector<std::pair<size_t, size_t>> estimates;
+			estimates.reserve(run_end - run_start);
+			for(size_t cond_index = run_start; cond_index < run_end; cond_index++)
+				estimates.emplace_back(entity_caches->EstimateNumMatchingEntities(&conditions[cond_index]), cond_index);
+
+			//keep the given order among conditions with the same estimate
+			std::stable_sort(begin(estimates), end(estimates),
+				[](auto &a, auto &b) { return a.first < b.first; });
+
+			std::vector<EntityQueryCondition> ordered_conditions;
+			ordered_conditions.reserve(estimates.size());
+			for(auto &[_, cond_index] : estimates)
+				ordered_conditions.emplace_back(std::move(conditions[cond_index]));
+
+			std::move(begin(ordered_conditions), end(ordered_conditions), begin(conditions) + run_start);
+		}
+
+		run_start = run_end;
+	}
+}
+
 EntityQueryCaches *EntityQueryManager::GetQueryCachesForContainer(Entity *container)
 {
 #ifdef MULTITHREAD_SUPPORT
@@ -858,6 +938,9 @@ EvaluableNodeReference EntityQueryManager::GetMatchingEntitiesFromQueryCaches(En
 	// use the first condition as an heuristic for building it if it doesn't exist
 	EntityQueryCaches *entity_caches = GetQueryCachesForContainer(container);
 
+	//evaluate the most selective filters first so the set of matching entities shrinks as early as possible
+	OrderConditionsBySelectivity(entity_caches, conditions, return_query_value);
+
 	//starting collection of matching entities, initialized to all entities with the requested labels
 	// reuse existing buffer
 	BitArrayIntegerSet &matching_ents = entity_caches->buffers.currentMatchingEntities;
@@ -869,10 +952,26 @@ EvaluableNodeReference EntityQueryManager::GetMatchingEntitiesFromQueryCaches(En
 	auto &indices_with_duplicates = entity_caches->buffers.entityIndicesWithDuplicates;
 	indices_with_duplicates.clear();
 
+	//if the leading filter conditions have been queried since their labels were last written,
+	// start with their result instead of computing them
+	auto &query_result_key = entity_caches->buffers.queryResultKey;
+	auto &query_result_label_ids = entity_caches->buffers.queryResultLabelIds;
+	size_t num_cached_conditions = EntityQueryResultCache::BuildKey(conditions, query_result_key, query_result_label_ids);
+	size_t query_result_write_epoch = 0;
+	size_t first_cond_index = 0;
+	if(num_cached_conditions > 0
+			&& entity_caches->GetQueryResult(query_result_key, matching_ents, query_result_write_epoch))
+	{
+		first_cond_index = num_cached_conditions;
+
+		for(size_t cond_index = 0; cond_index < num_cached_conditions; cond_index++)
+			queryExplanation.AddCachedCondition(conditions[cond_index].queryType, matching_ents.size());
+	}
+
 	//execute each query
 	// for the first condition, matching_ents is empty and must be populated
 	// for each subsequent loop, matching_ents will have the currently selected entities to query from
-	for(size_t cond_index = 0; cond_index < conditions.size(); cond_index++)
+	for(size_t cond_index = first_cond_index; cond_index < conditions.size(); cond_index++)
 	{
 		auto &cond = conditions[cond_index];
 		bool is_first = (cond_index == 0);
@@ -881,6 +980,8 @@ EvaluableNodeReference EntityQueryManager::GetMatchingEntitiesFromQueryCaches(En
 		//start each condition with cleared compute results as to not reuse the results from a previous computation
 		compute_results.clear();
 
+		queryExplanation.BeginCondition(cond.queryType, EntityQueryExplanation::EvaluationPath::QUERY_CACHES);
+
 		//if query_none, return results as empty list
 		if(cond.queryType == ENT_NULL)
 			return EvaluableNodeReference(enm->AllocNode(ENT_LIST), true);
@@ -944,6 +1045,37 @@ EvaluableNodeReference EntityQueryManager::GetMatchingEntitiesFromQueryCaches(En
 					cond.exclusionLabel = std::numeric_limits<size_t>::max();
 				else
 					cond.exclusionLabel = container->GetContainedEntityIndex(cond.exclusionLabel);
+
+				//batches are only computed here when they are the last condition, so return the list of results for each position
+				if(cond.batchValuesToCompare.size() > 0)
+				{
+					auto &batch_compute_results = entity_caches->buffers.batchComputeResultsIdToValue;
+					entity_caches->GetMatchingEntitiesBatch(&cond, matching_ents, batch_compute_results, is_first);
+
+					auto &contained_entities = container->GetContainedEntities();
+					EvaluableNodeReference query_return(enm->AllocNode(ENT_LIST), true);
+					query_return->ReserveOrderedChildNodes(batch_compute_results.size());
+					for(auto &results : batch_compute_results)
+					{
+						EvaluableNodeReference result;
+						if(return_query_value)
+						{
+							result = EntityQueryManager::ConvertResultsToEvaluableNodes<size_t>(results,
+								enm, cond.returnSortedList, cond.additionalSortedListLabel,
+								[&contained_entities](auto entity_index) { return contained_entities[entity_index]; });
+						}
+						else
+						{
+							result = CreateListOfStringsIdsFromIteratorAndFunction(results, enm,
+								[&contained_entities](auto &drp) { return contained_entities[drp.reference]->GetIdStringId(); });
+						}
+
+						query_return->AppendOrderedChildNode(result);
+						query_return.UpdatePropertiesBasedOnAttachedNode(result);
+					}
+
+					return query_return;
+				}
 				//fall through to cases below
 			}
 
@@ -1157,6 +1289,11 @@ EvaluableNodeReference EntityQueryManager::GetMatchingEntitiesFromQueryCaches(En
 			default:
 				break;
 		}
+
+		queryExplanation.EndCondition(matching_ents.size());
+
+		if(cond_index + 1 == num_cached_conditions)
+			entity_caches->StoreQueryResult(query_result_key, query_result_label_ids, query_result_write_epoch, matching_ents);
 	}
 
 	//---Return Query Results---//
@@ -1237,6 +1374,20 @@ EvaluableNodeReference EntityQueryManager::GetMatchingEntitiesFromQueryCaches(En
 
 EvaluableNodeReference EntityQueryManager::GetEntitiesMatchingQuery(Entity *container, std::vector<EntityQueryCondition> &conditions, EvaluableNodeManager *enm, bool return_query_value)
 {
+	for(size_t cond_index = 0; cond_index < conditions.size(); cond_index++)
+	{
+		auto &cond = conditions[cond_index];
+		if(cond.batchValuesToCompare.size() == 0)
+			continue;
+
+		//a batch in the last condition can share its work across all of the positions when using the query caches
+		if(cond_index + 1 == conditions.size() && cond.positionLabels.size() > 0
+				&& _enable_SBF_datastore && CanUseQueryCaches(conditions))
+			return GetMatchingEntitiesFromQueryCaches(container, conditions, enm, return_query_value);
+
+		return GetEntitiesMatchingBatchQueryIndividually(container, conditions, cond_index, enm, return_query_value);
+	}
+
 	if(_enable_SBF_datastore && CanUseQueryCaches(conditions))
 		return GetMatchingEntitiesFromQueryCaches(container, conditions, enm, return_query_value);
 
@@ -1266,7 +1417,9 @@ EvaluableNodeReference EntityQueryManager::GetEntitiesMatchingQuery(Entity *cont
 				return EvaluableNodeReference::Null();
 		}
 		
+		queryExplanation.BeginCondition(conditions[cond_index].queryType, EntityQueryExplanation::EvaluationPath::BRUTE_FORCE);
 		query_return_value = conditions[cond_index].GetMatchingEntities(container, matching_entities, first_condition, (return_query_value && last_condition) ? enm : nullptr);
+		queryExplanation.EndCondition(matching_entities.size());
 	}
 
 	//if need to return something specific, then do so, otherwise return list of matching entities
@@ -1276,3 +1429,31 @@ EvaluableNodeReference EntityQueryManager::GetEntitiesMatchingQuery(Entity *cont
 	SortEntitiesByID(matching_entities);
 	return CreateListOfStringsIdsFromIteratorAndFunction(matching_entities, enm, [](Entity *e) { return e->GetIdStringId(); });
 }
+
+EvaluableNodeReference EntityQueryManager::GetEntitiesMatchingBatchQueryIndividually(Entity *container, std::vector<EntityQueryCondition> &conditions,
+	size_t batch_cond_index, EvaluableNodeManager *enm, bool return_query_value)
+{
+	auto &batch_cond = conditions[batch_cond_index];
+	size_t num_queries = batch_cond.batchValuesToCompare.size();
+
+	EvaluableNodeReference query_return(enm->AllocNode(ENT_LIST), true);
+	query_return->ReserveOrderedChildNodes(num_queries);
+
+	std::vector<EntityQueryCondition> single_conditions;
+	for(size_t i = 0; i < num_queries; i++)
+	{
+		single_conditions = conditions;
+		auto &single_cond = single_conditions[batch_cond_index];
+		single_cond.valueToCompare = std::move(single_cond.batchValuesToCompare[i]);
+		single_cond.valueTypes = std::move(single_cond.batchValueTypes[i]);
+		single_cond.batchValuesToCompare.clear();
+		single_cond.batchValueTypes.clear();
+		single_cond.randomStream = batch_cond.randomStream.CreateOtherStreamViaRand();
+
+		EvaluableNodeReference result = GetEntitiesMatchingQuery(container, single_conditions, enm, return_query_value);
+		query_return->AppendOrderedChildNode(result);
+		query_return.UpdatePropertiesBasedOnAttachedNode(result);
+	}
+
+	return query_return;
+}
@@ -16,6 +16,9 @@
 //if set to false, will not allow use of the SBF datastore
 extern bool _enable_SBF_datastore;
 
+//if set to true, SBF datastores created will keep their columnar number values as floats
+extern bool _enable_SBF_datastore_reduced_precision;
+
 class EntityQueryCondition
 {
 public:
@@ -51,6 +54,11 @@ public:
 	std::vector<StringInternPool::StringID> positionLabels;	//the labels that comprise each dimension of the position
 	std::vector<EvaluableNodeImmediateValue> valueToCompare;//sometimes used for position values in conjunction with positionLabels
 
+	//for ENT_QUERY_NEAREST_GENERALIZED_DISTANCE, if not empty, each element is a separate position with corresponding types
+	// to find the nearest entities to, and the results are returned as a list with one entry per position
+	std::vector<std::vector<EvaluableNodeImmediateValue>> batchValuesToCompare;
+	std::vector<std::vector<EvaluableNodeImmediateValueType>> batchValueTypes;
+
 	GeneralizedDistance distParams;
 
 	//a single standalone label in the query
@@ -107,6 +115,9 @@ public:
 	//for ENT_QUERY_NEAREST_GENERALIZED_DISTANCE and ENT_QUERY_WITHIN_GENERALIZED_DISTANCE, if returnSortedList is true, additionally return this label if valid
 	StringInternPool::StringID additionalSortedListLabel;
 
+	//for ENT_QUERY_NEAREST_GENERALIZED_DISTANCE, if between 0 and 1, the fraction of the true nearest entities an approximate search should aim to find
+	double approximateRecall;
+
 	//if conviction_of_removal is true, then it will compute the conviction as if the entities were removed, if false, will compute added or included
 	bool convictionOfRemoval;
 
@@ -315,13 +315,26 @@ public:
 			}
 		}
 
+		//sorts on .first - value, not weight
+		std::sort(std::begin(value_weights), std::end(value_weights));
+
+		return QuantileOfSortedValues(value_weights, total_weight, eq_or_no_weights, q_percentage);
+	}
+
+	//computes the quantile of value_weights, which are pairs of value and weight sorted as by std::sort
+	//total_weight is the sum of the weights, and eq_or_no_weights is true if all the weights are the same
+	//q_percentage is the quantile percentage to calculate
+	static double QuantileOfSortedValues(std::vector<std::pair<double, double>> &value_weights,
+		double total_weight, bool eq_or_no_weights, double q_percentage)
+	{
+		//invalid range of quantile percentage
+		if(FastIsNaN(q_percentage) || q_percentage < 0.0 || q_percentage > 1.0)
+			return std::numeric_limits<double>::quiet_NaN();
+
 		//make sure have valid values and weights
 		if(value_weights.size() == 0 || total_weight == 0.0)
 			return std::numeric_limits<double>::quiet_NaN();
 
-		//sorts on .first - value, not weight
-		std::sort(std::begin(value_weights), std::end(value_weights));
-
 		//early outs for edge cases
 		if(value_weights.size() == 1 || q_percentage == 0.0)
 			return value_weights.front().first;
@@ -385,6 +398,58 @@ public:
 		return value_weights.back().first;
 	}
 
+	//computes the same quantile as QuantileOfSortedValues for num_values unweighted values, but only obtains the values
+	// adjacent to the quantile, by calling get_value_at_rank(rank) for the value at rank in sorted order
+	template<typename RankValueFunction>
+	static double QuantileOfRankedValues(size_t num_values, RankValueFunction get_value_at_rank, double q_percentage)
+	{
+		//invalid range of quantile percentage
+		if(FastIsNaN(q_percentage) || q_percentage < 0.0 || q_percentage > 1.0)
+			return std::numeric_limits<double>::quiet_NaN();
+
+		if(num_values == 0)
+			return std::numeric_limits<double>::quiet_NaN();
+
+		//early outs for edge cases
+		if(num_values == 1 || q_percentage == 0.0)
+			return get_value_at_rank(0);
+		else if(q_percentage == 1.0)
+			return get_value_at_rank(num_values - 1);
+
+		//with equal weights, the cdf term of rank i, normalized by the first and last cdf terms, is i / (num_values - 1)
+		// computed the same way as QuantileOfSortedValues so that the results are identical
+		const double last_cdf_term = static_cast<double>(num_values) - 0.5 - 0.5;
+		auto cdf_term = [last_cdf_term](size_t i)
+		{
+			return (static_cast<double>(i + 1) - 0.5 - 0.5) / last_cdf_term;
+		};
+
+		//find the first rank whose cdf term is not less than q_percentage
+		size_t rank = static_cast<size_t>(std::ceil(q_percentage * last_cdf_term));
+		rank = std::min(std::max(rank, static_cast<size_t>(1)), num_values - 1);
+		while(rank > 1 && cdf_term(rank - 1) >= q_percentage)
+			rank--;
+		while(rank < num_values - 1 && cdf_term(rank) < q_percentage)
+			rank++;
+
+		double cdf_term_prev = cdf_term(rank - 1);
+		double cdf_term_curr = cdf_term(rank);
+		if(q_percentage == cdf_term_prev)
+			return get_value_at_rank(rank - 1);
+		else if(q_percentage == cdf_term_curr)
+			return get_value_at_rank(rank);
+		else if(cdf_term_prev < q_percentage && q_percentage < cdf_term_curr)
+		{
+			double prev_value = get_value_at_rank(rank - 1);
+			double curr_value = get_value_at_rank(rank);
+
+			//linearly interpolate
+			return prev_value + (curr_value - prev_value) * (q_percentage - cdf_term_prev) / (cdf_term_curr - cdf_term_prev);
+		}
+
+		return get_value_at_rank(num_values - 1);
+	}
+
 	//computes the generalized mean of the values where p_value is the parameter for the generalized mean
 	//center is the center the calculation is around, default is 0.0
 	//if calculate_moment is true, the final calculation will not be raised to 1/p for p>=1
@@ -650,6 +715,15 @@ public:
 			}
 		}
 
+		std::sort(begin(values), end(values));
+
+		return ExtremeDifferenceOfSortedValues(values, select_min_value, max_distance, include_zero_distances);
+	}
+
+	//like ExtremeDifference, but for values that are already sorted and contain no nans
+	static double ExtremeDifferenceOfSortedValues(std::vector<double> &values,
+		bool select_min_value, double max_distance, bool include_zero_distances)
+	{
 		//deal with edge cases
 		//if no values, then don't have any gaps
 		if(values.size() == 0)
@@ -664,8 +738,6 @@ public:
 				return max_distance;
 		}
 
-		std::sort(begin(values), end(values));
-
 		double extreme_distance;
 		if(select_min_value)
 		{
@@ -182,6 +182,56 @@ namespace EntityQueryBuilder
 	}
 
 
+	//if position is a list of positions rather than a single position, populates the batch positions of condition
+	// so that the nearest entities are found for each; a list of lists is only treated as a batch if none of the features
+	// are code, because otherwise each list could be the value of a single position
+	inline void PopulateBatchPositions(EntityQueryCondition &condition, EvaluableNode *position)
+	{
+		if(!EvaluableNode::IsOrderedArray(position))
+			return;
+
+		auto &position_ocn = position->GetOrderedChildNodesReference();
+		if(position_ocn.size() == 0)
+			return;
+
+		for(auto &pos_en : position_ocn)
+		{
+			if(!EvaluableNode::IsOrderedArray(pos_en))
+				return;
+		}
+
+		for(auto &feature_params : condition.distParams.featureParams)
+		{
+			if(feature_params.featureType == FDT_CONTINUOUS_CODE)
+				return;
+		}
+
+		size_t num_elements = condition.positionLabels.size();
+		condition.batchValuesToCompare.resize(position_ocn.size());
+		condition.batchValueTypes.resize(position_ocn.size());
+		for(size_t i = 0; i < position_ocn.size(); i++)
+		{
+			auto &values = condition.batchValuesToCompare[i];
+			auto &value_types = condition.batchValueTypes[i];
+			values.resize(num_elements);
+			value_types.resize(num_elements, ENIVT_NULL);
+
+			//positions that don't match the labels default to nulls for each label, same as a single position
+			auto &values_ocn = position_ocn[i]->GetOrderedChildNodesReference();
+			if(values_ocn.size() != num_elements)
+				continue;
+
+			for(size_t j = 0; j < num_elements; j++)
+				value_types[j] = values[j].CopyValueFromEvaluableNode(values_ocn[j]);
+		}
+
+		//the single position is not used, but keep it consistent with the labels
+		condition.valueToCompare.clear();
+		condition.valueToCompare.resize(num_elements);
+		condition.valueTypes.clear();
+		condition.valueTypes.resize(num_elements, ENIVT_NULL);
+	}
+
 	//interpret evaluable node as a distance query
 	inline void BuildDistanceCondition(EvaluableNode *cn, EvaluableNodeType condition_type, std::vector<EntityQueryCondition> &conditions)
 	{
@@ -309,6 +359,9 @@ namespace EntityQueryBuilder
 		PopulateDistanceFeatureParameters(dist_params, num_elements, cur_condition->positionLabels,
 			weights_node, distance_types_node, attributes_node, deviations_node);
 
+		if(condition_type == ENT_QUERY_NEAREST_GENERALIZED_DISTANCE)
+			PopulateBatchPositions(*cur_condition, ocn[POSITION]);
+
 		//set minkowski parameter; default to 2.0 for Euclidian distance
 		double p_value = 2.0;
 		if(ocn.size() > MINKOWSKI_PARAMETER)
@@ -373,6 +426,7 @@ namespace EntityQueryBuilder
 		
 		cur_condition->returnSortedList = false;
 		cur_condition->additionalSortedListLabel = string_intern_pool.NOT_A_STRING_ID;
+		cur_condition->approximateRecall = 1.0;
 		if(condition_type == ENT_QUERY_WITHIN_GENERALIZED_DISTANCE || condition_type == ENT_QUERY_NEAREST_GENERALIZED_DISTANCE || condition_type == ENT_COMPUTE_ENTITY_DISTANCE_CONTRIBUTIONS)
 		{
 			if(ocn.size() > NUM_MINKOWSKI_DISTANCE_QUERY_PARAMETERS + 0)
@@ -382,6 +436,9 @@ namespace EntityQueryBuilder
 				if(!EvaluableNode::IsEmptyNode(list_param) && list_param->GetType() != ENT_TRUE && list_param->GetType() != ENT_FALSE)
 					cur_condition->additionalSortedListLabel = EvaluableNode::ToStringIDIfExists(list_param);
 			}
+
+			if(condition_type == ENT_QUERY_NEAREST_GENERALIZED_DISTANCE && ocn.size() > NUM_MINKOWSKI_DISTANCE_QUERY_PARAMETERS + 1)
+				cur_condition->approximateRecall = EvaluableNode::ToNumber(ocn[NUM_MINKOWSKI_DISTANCE_QUERY_PARAMETERS + 1], 1.0);
 		}
 		else if(condition_type == ENT_COMPUTE_ENTITY_CONVICTIONS || condition_type == ENT_COMPUTE_ENTITY_GROUP_KL_DIVERGENCE || condition_type == ENT_COMPUTE_ENTITY_KL_DIVERGENCES)
 		{
@@ -456,6 +513,11 @@ namespace EntityQueryBuilder
 						exists_condition->existLabels.push_back(cur_condition->positionLabels[i]);
 						cur_condition->valueToCompare.erase(cur_condition->valueToCompare.begin() + i);
 						cur_condition->valueTypes.erase(cur_condition->valueTypes.begin() + i);
+
+						for(auto &values : cur_condition->batchValuesToCompare)
+							values.erase(values.begin() + i);
+						for(auto &value_types : cur_condition->batchValueTypes)
+							value_types.erase(value_types.begin() + i);
 					}
 
 					cur_condition->positionLabels.erase(cur_condition->positionLabels.begin() + i);
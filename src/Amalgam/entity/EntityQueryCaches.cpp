@@ -129,7 +129,471 @@ void EntityQueryCaches::EnsureLabelsAreCached(EntityQueryCondition *cond)
 	//need to double-check to make sure that another thread didn't already rebuild
 	if(labels_to_add.size() > 0)
 #endif
-		sbfds.AddLabels(labels_to_add, container->GetContainedEntities());
+	{
+		sbfds.AddLabels(labels_to_add, container->GetContainedEntities(), &snapshotNumberValueBuckets);
+
+		//the snapshot of a label is no longer needed once it has been built
+		for(auto label_id : labels_to_add)
+			snapshotNumberValueBuckets.erase(label_id);
+	}
+
+#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+	//release write lock and reacquire read lock
+	write_lock.unlock();
+	lock.lock();
+#endif
+}
+
+void EntityQueryCaches::PrewarmLabels(std::vector<StringInternPool::StringID> &label_ids)
+{
+	std::vector<StringInternPool::StringID> labels_to_add;
+	SeparableBoxFilterDataStore::NumberValueBucketsSnapshotMap snapshots;
+	size_t write_epoch = 0;
+
+	{
+	#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+		Concurrency::ReadLock lock(mutex);
+	#endif
+
+		for(auto label_id : label_ids)
+		{
+			if(label_id != StringInternPool::NOT_A_STRING_ID && !DoesHaveLabel(label_id)
+					&& std::find(begin(labels_to_add), end(labels_to_add), label_id) == end(labels_to_add))
+				labels_to_add.push_back(label_id);
+		}
+
+		write_epoch = sbfds.GetWriteEpoch();
+
+		//keep any snapshots of the labels, as they may be removed from the cache while the labels are built
+		for(auto label_id : labels_to_add)
+		{
+			auto found = snapshotNumberValueBuckets.find(label_id);
+			if(found != end(snapshotNumberValueBuckets))
+				snapshots.emplace(label_id, found->second);
+		}
+	}
+
+	if(labels_to_add.size() == 0)
+		return;
+
+	//build the labels without holding any lock on the cache
+	auto &entities = container->GetContainedEntities();
+	std::vector<SeparableBoxFilterDataStore::PrebuiltLabel> prebuilt_labels;
+	sbfds.PrebuildLabels(labels_to_add, entities, prebuilt_labels, &snapshots);
+
+#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+	Concurrency::WriteLock write_lock(mutex);
+#endif
+
+	//if any entity changed while the labels were being built, they may be out of date,
+	// so build the labels from the entities as they are now
+	if(sbfds.GetWriteEpoch() != write_epoch)
+	{
+		labels_to_add.erase(std::remove_if(begin(labels_to_add), end(labels_to_add),
+			[this](auto sid) { return DoesHaveLabel(sid); }),
+			end(labels_to_add));
+
+		sbfds.AddLabels(labels_to_add, container->GetContainedEntities(), &snapshotNumberValueBuckets);
+	}
+	else
+	{
+		sbfds.AddPrebuiltLabels(prebuilt_labels, entities.size());
+	}
+
+	//the snapshot of a label is no longer needed once it has been built
+	for(auto label_id : labels_to_add)
+		snapshotNumberValueBuckets.erase(label_id);
+}
+
+void EntityQueryCaches::WriteSnapshot(BinaryData &snapshot_out)
+{
+#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+	Concurrency::ReadLock lock(mutex);
+#endif
+
+	snapshot_out.clear();
+	size_t num_labels = sbfds.GetNumLabels();
+	if(num_labels == 0)
+		return;
+
+	//entities are stored by id so that they can be found regardless of the order they are loaded in
+	auto &entities = container->GetContainedEntities();
+	CompactHashMap<std::string, size_t> string_map;
+	for(size_t i = 0; i < entities.size(); i++)
+		string_map.emplace(entities[i]->GetId(), i);
+
+	//labels may have the same string as an entity id
+	std::vector<size_t> label_string_indices;
+	label_string_indices.reserve(num_labels);
+	for(size_t column_index = 0; column_index < num_labels; column_index++)
+	{
+		auto [string_entry, inserted] = string_map.emplace(
+			string_intern_pool.GetStringFromID(sbfds.GetColumnLabelId(column_index)), string_map.size());
+		label_string_indices.push_back(string_entry->second);
+	}
+
+	UnparseIndexToCompactIndexAndAppend(snapshot_out, snapshotFormatVersion);
+	UnparseIndexToCompactIndexAndAppend(snapshot_out, entities.size());
+	UnparseIndexToCompactIndexAndAppend(snapshot_out, num_labels);
+
+	BinaryData compressed_strings = CompressStrings(string_map);
+	snapshot_out.insert(end(snapshot_out), begin(compressed_strings), end(compressed_strings));
+
+	SBFDSColumnData::NumberValueBucketsSnapshot buckets;
+	for(size_t column_index = 0; column_index < num_labels; column_index++)
+	{
+		UnparseIndexToCompactIndexAndAppend(snapshot_out, label_string_indices[column_index]);
+
+		sbfds.GetNumberValueBucketsSnapshot(column_index, buckets);
+		UnparseIndexToCompactIndexAndAppend(snapshot_out, buckets.numberValuesHash);
+		UnparseIndexToCompactIndexAndAppend(snapshot_out, buckets.bucketValues.size());
+
+		size_t bucket_indices_offset = 0;
+		for(size_t bucket_index = 0; bucket_index < buckets.bucketValues.size(); bucket_index++)
+		{
+			UnparseIndexToCompactIndexAndAppend(snapshot_out, bit_cast<uint64_t, double>(buckets.bucketValues[bucket_index]));
+			UnparseIndexToCompactIndexAndAppend(snapshot_out, buckets.bucketSizes[bucket_index]);
+			for(size_t i = 0; i < buckets.bucketSizes[bucket_index]; i++)
+				UnparseIndexToCompactIndexAndAppend(snapshot_out, buckets.bucketIndices[bucket_indices_offset++]);
+		}
+	}
+}
+
+bool EntityQueryCaches::ReadSnapshot(BinaryData &snapshot)
+{
+#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+	Concurrency::WriteLock lock(mutex);
+#endif
+
+	snapshotNumberValueBuckets.clear();
+
+	OffsetIndex offset = 0;
+	if(ParseCompactIndexToIndexAndAdvance(snapshot, offset) != snapshotFormatVersion)
+		return false;
+
+	auto &entities = container->GetContainedEntities();
+	size_t num_entities = ParseCompactIndexToIndexAndAdvance(snapshot, offset);
+	size_t num_labels = ParseCompactIndexToIndexAndAdvance(snapshot, offset);
+	if(num_entities != entities.size())
+		return false;
+
+	std::vector<std::string> strings = DecompressStrings(snapshot, offset);
+	if(strings.size() < num_entities)
+		return false;
+
+	//find the current index of each entity in the snapshot, and the snapshot index of each current index
+	std::vector<size_t> entity_indices(num_entities);
+	auto snapshot_indices = std::make_shared<std::vector<size_t>>(num_entities, num_entities);
+	for(size_t i = 0; i < num_entities; i++)
+	{
+		entity_indices[i] = container->GetContainedEntityIndex(string_intern_pool.GetIDFromString(strings[i]));
+		if(entity_indices[i] >= num_entities || (*snapshot_indices)[entity_indices[i]] != num_entities)
+			return false;
+		(*snapshot_indices)[entity_indices[i]] = i;
+	}
+
+	for(size_t label_num = 0; label_num < num_labels; label_num++)
+	{
+		size_t label_string_index = ParseCompactIndexToIndexAndAdvance(snapshot, offset);
+		auto buckets = std::make_shared<SBFDSColumnData::NumberValueBucketsSnapshot>();
+		buckets->numberValuesHash = ParseCompactIndexToIndexAndAdvance(snapshot, offset);
+		size_t num_buckets = ParseCompactIndexToIndexAndAdvance(snapshot, offset);
+		if(label_string_index >= strings.size() || num_buckets > num_entities)
+		{
+			snapshotNumberValueBuckets.clear();
+			return false;
+		}
+
+		//validate the buckets as they are read, as well as that they have the hash that was stored with them,
+		// so that if the hash matches the values of the entities, the buckets are of those values
+		buckets->bucketValues.reserve(num_buckets);
+		buckets->bucketSizes.reserve(num_buckets);
+		uint64_t number_values_hash = 0;
+		bool valid = true;
+		for(size_t bucket_index = 0; bucket_index < num_buckets && valid; bucket_index++)
+		{
+			double value = bit_cast<double, uint64_t>(ParseCompactIndexToIndexAndAdvance(snapshot, offset));
+			size_t bucket_size = ParseCompactIndexToIndexAndAdvance(snapshot, offset);
+			if(FastIsNaN(value) || (bucket_index > 0 && !(value > buckets->bucketValues.back()))
+					|| bucket_size == 0 || buckets->bucketIndices.size() + bucket_size > num_entities)
+			{
+				valid = false;
+				break;
+			}
+
+			buckets->bucketValues.push_back(value);
+			buckets->bucketSizes.push_back(bucket_size);
+
+			size_t bucket_start = buckets->bucketIndices.size();
+			for(size_t i = 0; i < bucket_size; i++)
+			{
+				size_t snapshot_index = ParseCompactIndexToIndexAndAdvance(snapshot, offset);
+				if(snapshot_index >= num_entities)
+				{
+					valid = false;
+					break;
+				}
+
+				number_values_hash += SBFDSColumnData::HashNumberValue(snapshot_index, value);
+				buckets->bucketIndices.push_back(entity_indices[snapshot_index]);
+			}
+
+			//the indices in each bucket must be in order and not repeated
+			if(valid)
+			{
+				auto bucket_begin = begin(buckets->bucketIndices) + bucket_start;
+				std::sort(bucket_begin, end(buckets->bucketIndices));
+				valid = (std::adjacent_find(bucket_begin, end(buckets->bucketIndices)) == end(buckets->bucketIndices));
+			}
+		}
+
+		if(!valid || number_values_hash != buckets->numberValuesHash)
+		{
+			snapshotNumberValueBuckets.clear();
+			return false;
+		}
+
+		//if no entity has the label, then there is nothing to build
+		auto label_id = string_intern_pool.GetIDFromString(strings[label_string_index]);
+		if(label_id == StringInternPool::NOT_A_STRING_ID || sbfds.DoesHaveLabel(label_id))
+			continue;
+
+		buckets->snapshotIndices = snapshot_indices;
+		snapshotNumberValueBuckets.emplace(label_id, std::move(buckets));
+	}
+
+	return true;
+}
+
+bool EntityQueryCaches::CanUseApproximateIndex(EntityQueryCondition *cond)
+{
+	if(cond->queryType != ENT_QUERY_NEAREST_GENERALIZED_DISTANCE
+			|| !(cond->approximateRecall > 0.0 && cond->approximateRecall < 1.0))
+		return false;
+
+	if(cond->positionLabels.size() == 0 || cond->valueToCompare.size() != cond->positionLabels.size())
+		return false;
+
+	//the graph is only navigable over continuous numeric features and a numeric or null position,
+	// so anything else falls back to the exact search
+	for(size_t i = 0; i < cond->positionLabels.size(); i++)
+	{
+		auto feature_type = cond->distParams.featureParams[i].featureType;
+		if(feature_type != FDT_CONTINUOUS_NUMERIC && feature_type != FDT_CONTINUOUS_UNIVERSALLY_NUMERIC)
+			return false;
+	}
+
+	auto is_position_navigable = [](std::vector<EvaluableNodeImmediateValueType> &value_types)
+	{
+		for(auto value_type : value_types)
+		{
+			if(value_type != ENIVT_NUMBER && value_type != ENIVT_NULL)
+				return false;
+		}
+		return true;
+	};
+
+	//a batch needs every one of its positions to be navigable
+	if(cond->batchValueTypes.size() > 0)
+	{
+		for(auto &value_types : cond->batchValueTypes)
+		{
+			if(!is_position_navigable(value_types))
+				return false;
+		}
+		return true;
+	}
+
+	return is_position_navigable(cond->valueTypes);
+}
+
+#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+void EntityQueryCaches::EnsureApproximateIndexIsBuilt(EntityQueryCondition *cond, Concurrency::ReadLock &lock)
+#else
+void EntityQueryCaches::EnsureApproximateIndexIsBuilt(EntityQueryCondition *cond)
+#endif
+{
+	if(!CanUseApproximateIndex(cond) || FindApproximateIndex(cond) != nullptr)
+		return;
+
+#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+	lock.unlock();
+	Concurrency::WriteLock write_lock(mutex);
+
+	//need to double-check to make sure that another thread didn't already build it
+	if(FindApproximateIndex(cond) == nullptr)
+#endif
+	{
+		if(approximateIndices.size() >= maxNumApproximateIndices)
+			approximateIndices.erase(begin(approximateIndices));
+
+		approximateIndices.emplace_back(std::make_unique<NearestNeighborGraph>(cond->positionLabels, cond->distParams));
+		sbfds.BuildNearestNeighborGraph(*approximateIndices.back());
+	}
+
+#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+	//release write lock and reacquire read lock
+	write_lock.unlock();
+	lock.lock();
+#endif
+}
+
+#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+void EntityQueryCaches::EnsureStringEditDistanceIndicesAreBuilt(EntityQueryCondition *cond, Concurrency::ReadLock &lock)
+#else
+void EntityQueryCaches::EnsureStringEditDistanceIndicesAreBuilt(EntityQueryCondition *cond)
+#endif
+{
+	switch(cond->queryType)
+	{
+		case ENT_QUERY_NEAREST_GENERALIZED_DISTANCE:
+		case ENT_QUERY_WITHIN_GENERALIZED_DISTANCE:
+		case ENT_COMPUTE_ENTITY_DISTANCE_CONTRIBUTIONS:
+		case ENT_COMPUTE_ENTITY_CONVICTIONS:
+		case ENT_COMPUTE_ENTITY_KL_DIVERGENCES:
+		case ENT_COMPUTE_ENTITY_GROUP_KL_DIVERGENCE:
+			break;
+
+		default:
+			return;
+	}
+
+	if(!sbfds.DoStringEditDistanceIndicesNeedBuilding(cond->distParams, cond->positionLabels))
+		return;
+
+#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+	lock.unlock();
+	Concurrency::WriteLock write_lock(mutex);
+#endif
+
+	//builds only those that another thread didn't already build
+	sbfds.BuildStringEditDistanceIndices(cond->distParams, cond->positionLabels);
+
+#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+	//release write lock and reacquire read lock
+	write_lock.unlock();
+	lock.lock();
+#endif
+}
+
+bool EntityQueryCaches::CanUseNumberValueSummary(EntityQueryCondition *cond, bool is_first)
+{
+	//the summaries are of all entities
+	if(!is_first)
+		return false;
+
+	if(cond->queryType == ENT_QUERY_SUM)
+		return true;
+
+	if(cond->queryType != ENT_QUERY_GENERALIZED_MEAN)
+		return false;
+
+	double p_value = cond->distParams.pValue;
+	return ((p_value == 1.0 || p_value == 2.0) && cond->center == 0.0);
+}
+
+#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+void EntityQueryCaches::EnsureWeightedNumberValueSummaryIsBuilt(EntityQueryCondition *cond, bool is_first, Concurrency::ReadLock &lock)
+#else
+void EntityQueryCaches::EnsureWeightedNumberValueSummaryIsBuilt(EntityQueryCondition *cond, bool is_first)
+#endif
+{
+	if(cond->weightLabel == StringInternPool::NOT_A_STRING_ID || !CanUseNumberValueSummary(cond, is_first))
+		return;
+
+	size_t column_index = sbfds.GetColumnIndexFromLabelId(cond->singleLabel);
+	size_t weight_column_index = sbfds.GetColumnIndexFromLabelId(cond->weightLabel);
+	if(column_index == std::numeric_limits<size_t>::max() || weight_column_index == std::numeric_limits<size_t>::max())
+		return;
+
+	if(sbfds.GetWeightedNumberValueSummary(column_index, weight_column_index) != nullptr)
+		return;
+
+#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+	lock.unlock();
+	Concurrency::WriteLock write_lock(mutex);
+
+	//the columns may have changed while the lock was released
+	column_index = sbfds.GetColumnIndexFromLabelId(cond->singleLabel);
+	weight_column_index = sbfds.GetColumnIndexFromLabelId(cond->weightLabel);
+#endif
+
+	//builds only if another thread didn't already build it
+	if(column_index != std::numeric_limits<size_t>::max() && weight_column_index != std::numeric_limits<size_t>::max())
+		sbfds.BuildWeightedNumberValueSummary(column_index, weight_column_index);
+
+#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+	//release write lock and reacquire read lock
+	write_lock.unlock();
+	lock.lock();
+#endif
+}
+
+#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+void EntityQueryCaches::EnsureWeightedSampleTableIsBuilt(EntityQueryCondition *cond, bool is_first, Concurrency::ReadLock &lock)
+#else
+void EntityQueryCaches::EnsureWeightedSampleTableIsBuilt(EntityQueryCondition *cond, bool is_first)
+#endif
+{
+	if(!is_first)
+		return;
+
+	bool need_alias_table = (static_cast<size_t>(cond->maxToRetrieve) >= minNumSamplesForAliasTable);
+
+	auto found = weightedSampleTables.find(cond->singleLabel);
+	if(found != end(weightedSampleTables)
+			&& (!need_alias_table || found->second.entityIndices.size() == 0 || found->second.aliasTable.IsInitialized()))
+		return;
+
+#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+	lock.unlock();
+	Concurrency::WriteLock write_lock(mutex);
+#endif
+
+	//builds only if another thread didn't already build it
+	auto [table_entry, inserted] = weightedSampleTables.emplace(cond->singleLabel, WeightedSampleTable());
+	auto &table = table_entry->second;
+	if(inserted)
+	{
+		BitArrayIntegerSet entities_with_weights;
+		sbfds.FindAllEntitiesWithValidNumbers(cond->singleLabel, entities_with_weights, table.entityIndices, table.probabilities);
+		NormalizeProbabilities(table.probabilities);
+
+		//accumulate the same way as WeightedDiscreteRandomSample so the same entities are selected
+		table.cumulativeProbabilities.resize(table.probabilities.size());
+		bool nondecreasing = true;
+		double probability_mass = 0.0;
+		for(size_t i = 0; i < table.probabilities.size(); i++)
+		{
+			double prev_probability_mass = probability_mass;
+			probability_mass += table.probabilities[i];
+			table.cumulativeProbabilities[i] = probability_mass;
+
+			//also catches nans
+			if(!(probability_mass >= prev_probability_mass))
+				nondecreasing = false;
+		}
+
+		if(nondecreasing)
+			table.probabilities.clear();
+	}
+
+	if(need_alias_table && table.entityIndices.size() > 0 && !table.aliasTable.IsInitialized())
+	{
+		//probabilities are modified by the alias table, so rederive them if they were not kept
+		std::vector<double> probabilities = table.probabilities;
+		if(probabilities.size() == 0)
+		{
+			probabilities.resize(table.cumulativeProbabilities.size());
+			BitArrayIntegerSet entities_with_weights;
+			std::vector<size_t> entity_indices;
+			sbfds.FindAllEntitiesWithValidNumbers(cond->singleLabel, entities_with_weights, entity_indices, probabilities);
+			NormalizeProbabilities(probabilities);
+		}
+
+		table.aliasTable = WeightedDiscreteRandomStreamTransform<size_t, CompactHashMap<size_t, double>>(
+			table.entityIndices, probabilities, false);
+	}
 
 #if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
 	//release write lock and reacquire read lock
@@ -144,8 +608,14 @@ void EntityQueryCaches::GetMatchingEntities(EntityQueryCondition *cond, BitArray
 #if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
 	Concurrency::ReadLock lock(mutex);
 	EnsureLabelsAreCached(cond, lock);
+	EnsureApproximateIndexIsBuilt(cond, lock);
+	EnsureStringEditDistanceIndicesAreBuilt(cond, lock);
+	EnsureWeightedNumberValueSummaryIsBuilt(cond, is_first, lock);
 #else
 	EnsureLabelsAreCached(cond);
+	EnsureApproximateIndexIsBuilt(cond);
+	EnsureStringEditDistanceIndicesAreBuilt(cond);
+	EnsureWeightedNumberValueSummaryIsBuilt(cond, is_first);
 #endif
 
 	switch(cond->queryType)
@@ -234,9 +704,28 @@ void EntityQueryCaches::GetMatchingEntities(EntityQueryCondition *cond, BitArray
 				}
 				else if(cond->queryType == ENT_QUERY_NEAREST_GENERALIZED_DISTANCE)
 				{
-					sbfds.FindNearestEntities(cond->distParams, cond->positionLabels, cond->valueToCompare, cond->valueTypes,
-						static_cast<size_t>(cond->maxToRetrieve), cond->exclusionLabel, matching_entities,
-						compute_results, cond->randomStream.CreateOtherStreamViaRand());
+					//keep enough candidates that the expected fraction of misses is 1 - approximateRecall
+					size_t top_k = static_cast<size_t>(cond->maxToRetrieve);
+					size_t num_candidates = top_k;
+					if(cond->approximateRecall > 0.0 && cond->approximateRecall < 1.0)
+						num_candidates = static_cast<size_t>(std::ceil(top_k / (1.0 - cond->approximateRecall)));
+
+					//only search approximately when it would consider fewer entities than an exact search
+					// and most of the graph is enabled, otherwise the search would rarely land on enabled entities
+					NearestNeighborGraph *approximate_index = (CanUseApproximateIndex(cond) ? FindApproximateIndex(cond) : nullptr);
+					if(approximate_index != nullptr
+						&& num_candidates < matching_entities.size() && 2 * matching_entities.size() >= approximate_index->GetNumNodes())
+					{
+						sbfds.FindNearestEntitiesApproximate(*approximate_index, cond->distParams, cond->positionLabels,
+							cond->valueToCompare, cond->valueTypes, top_k, num_candidates, cond->exclusionLabel,
+							matching_entities, compute_results);
+					}
+					else
+					{
+						sbfds.FindNearestEntities(cond->distParams, cond->positionLabels, cond->valueToCompare, cond->valueTypes,
+							top_k, cond->exclusionLabel, matching_entities,
+							compute_results, cond->randomStream.CreateOtherStreamViaRand());
+					}
 				}
 				else //ENT_QUERY_WITHIN_GENERALIZED_DISTANCE
 				{
@@ -305,14 +794,32 @@ void EntityQueryCaches::GetMatchingEntities(EntityQueryCondition *cond, BitArray
 				for(auto i : cond->positionLabels)
 					sbfds.IntersectEntitiesWithFeature(i, *ents_to_compute_ptr);
 
+				//use the persistent knn cache unless another thread is using it, in which case start from a clean one
+			#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+				Concurrency::SingleLock knn_cache_lock(knnCacheMutex, std::try_to_lock);
+				bool use_persistent_knn_cache = knn_cache_lock.owns_lock();
+			#else
+				bool use_persistent_knn_cache = true;
+			#endif
+				KnnNonZeroDistanceQuerySBFCache &knn_cache = (use_persistent_knn_cache ? knnCache : buffers.knnCache);
+
 			#ifdef MULTITHREAD_SUPPORT
 				ConvictionProcessor<KnnNonZeroDistanceQuerySBFCache, size_t, BitArrayIntegerSet> conviction_processor(buffers.convictionBuffers,
-					buffers.knnCache, distance_transform, top_k, cond->useConcurrency);
+					knn_cache, distance_transform, top_k, cond->useConcurrency);
 			#else
 				ConvictionProcessor<KnnNonZeroDistanceQuerySBFCache, size_t, BitArrayIntegerSet> conviction_processor(buffers.convictionBuffers,
-					buffers.knnCache, distance_transform, top_k);
+					knn_cache, distance_transform, top_k);
 			#endif
-				buffers.knnCache.ResetCache(sbfds, matching_entities, cond->distParams, cond->positionLabels);
+				if(use_persistent_knn_cache)
+				{
+				#ifdef MULTITHREAD_SUPPORT
+					knn_cache.UpdateCache(sbfds, matching_entities, cond->distParams, cond->positionLabels, top_k, cond->useConcurrency);
+				#else
+					knn_cache.UpdateCache(sbfds, matching_entities, cond->distParams, cond->positionLabels, top_k);
+				#endif
+				}
+				else
+					knn_cache.ResetCache(sbfds, matching_entities, cond->distParams, cond->positionLabels);
 
 				auto &results_buffer = buffers.doubleVector;
 				results_buffer.clear();
@@ -539,6 +1046,33 @@ void EntityQueryCaches::GetMatchingEntities(EntityQueryCondition *cond, BitArray
 			else //just use a valid column
 				weight_column_index = 0;
 
+			//sums and means of all entities can be read from the running aggregates of the column
+			if(CanUseNumberValueSummary(cond, is_first))
+			{
+				double result = 0.0;
+				if(ComputeAggregateFromNumberValueSummary(cond, column_index, has_weight, weight_column_index, result))
+				{
+					compute_results.emplace_back(result, 0);
+					return;
+				}
+			}
+
+			//order statistics can be computed from the column's values that are already sorted, rather than sorting,
+			// as long as there are no nans that would need to be included
+			if(cond->queryType != ENT_QUERY_SUM && cond->queryType != ENT_QUERY_GENERALIZED_MEAN)
+			{
+				BitArrayIntegerSet *indices_to_consider = (is_first ? nullptr : &matching_entities);
+				bool nans_relevant = (cond->queryType == ENT_QUERY_QUANTILE || cond->queryType == ENT_QUERY_MODE);
+				if((is_first || sbfds.IsWalkingSortedNumberValuesFasterThanSorting(column_index, matching_entities.size()))
+					&& !(nans_relevant && sbfds.DoesHaveNanNumberValues(column_index, indices_to_consider)))
+				{
+					double result = ComputeOrderStatisticFromSortedNumberValues(cond, column_index,
+						has_weight, weight_column_index, indices_to_consider);
+					compute_results.emplace_back(result, 0);
+					return;
+				}
+			}
+
 			double result = 0.0;
 
 			if(is_first)
@@ -632,6 +1166,244 @@ void EntityQueryCaches::GetMatchingEntities(EntityQueryCondition *cond, BitArray
 	}
 }
 
+bool EntityQueryCaches::ComputeAggregateFromNumberValueSummary(EntityQueryCondition *cond, size_t column_index,
+	bool has_weight, size_t weight_column_index, double &result)
+{
+	bool is_sum = (cond->queryType == ENT_QUERY_SUM);
+	bool is_mean_of_squares = (!is_sum && cond->distParams.pValue == 2.0);
+
+	if(!has_weight)
+	{
+		//absolute values are only taken when unweighted, and the aggregates don't include them
+		if(!is_sum && !is_mean_of_squares && cond->absoluteValue)
+			return false;
+
+		auto &summary = sbfds.GetNumberValueSummary(column_index);
+		if(is_sum)
+			result = summary.sum.GetSum();
+		else if(!is_mean_of_squares)
+			result = summary.sum.GetSum() / summary.numValues;
+		else
+			result = summary.sumOfSquares.GetSum() / summary.numValues;
+	}
+	else
+	{
+		auto summary = sbfds.GetWeightedNumberValueSummary(column_index, weight_column_index);
+		if(summary == nullptr)
+			return false;
+
+		if(is_sum)
+			result = summary->weightedSum.GetSum();
+		else if(!is_mean_of_squares)
+			result = summary->weightedSum.GetSum() / summary->weightSum.GetSum();
+		else
+			result = summary->weightedSumOfSquares.GetSum() / summary->weightSum.GetSum();
+	}
+
+	if(is_mean_of_squares && !cond->calculateMoment)
+		result = std::sqrt(result);
+
+	return true;
+}
+
+double EntityQueryCaches::ComputeOrderStatisticFromSortedNumberValues(EntityQueryCondition *cond, size_t column_index,
+	bool has_weight, size_t weight_column_index, BitArrayIntegerSet *indices_to_consider)
+{
+	auto get_weight = sbfds.GetNumberValueFromEntityIndexFunction(weight_column_index);
+
+	switch(cond->queryType)
+	{
+	case ENT_QUERY_QUANTILE:
+	{
+		//without weights, only the values adjacent to the quantile are needed
+		if(indices_to_consider == nullptr && !has_weight)
+			return EntityQueriesStatistics::QuantileOfRankedValues(sbfds.GetNumNonNanNumberValues(column_index),
+				[this, column_index](size_t rank) { return sbfds.GetNumberValueAtRank(column_index, rank); },
+				cond->qPercentage);
+
+		auto &value_weights = buffers.pairDoubleVector;
+		value_weights.clear();
+		double total_weight = 0.0;
+		bool eq_or_no_weights = true;
+		double weight_check = std::numeric_limits<double>::quiet_NaN();
+
+		sbfds.IterateOverSortedNumberValues(column_index,
+			[&](double value, SortedIntegerSet &indices)
+			{
+				size_t value_start = value_weights.size();
+				for(auto index : indices)
+				{
+					if(indices_to_consider != nullptr && !indices_to_consider->contains(index))
+						continue;
+
+					double weight_value = 1.0;
+					if(has_weight)
+					{
+						get_weight(index, weight_value);
+						if(FastIsNaN(weight_value))
+							continue;
+
+						//check to see if weights are different
+						if(FastIsNaN(weight_check))
+							weight_check = weight_value;
+						else if(weight_check != weight_value)
+							eq_or_no_weights = false;
+					}
+
+					value_weights.emplace_back(value, weight_value);
+					total_weight += weight_value;
+				}
+
+				//order equal values by weight, the same as sorting all of the pairs would
+				if(has_weight)
+					std::sort(begin(value_weights) + value_start, end(value_weights));
+			});
+
+		return EntityQueriesStatistics::QuantileOfSortedValues(value_weights, total_weight, eq_or_no_weights, cond->qPercentage);
+	}
+
+	case ENT_QUERY_MODE:
+	{
+		double mode = std::numeric_limits<double>::quiet_NaN();
+		double mode_weight = 0.0;
+
+		sbfds.IterateOverSortedNumberValues(column_index,
+			[&](double value, SortedIntegerSet &indices)
+			{
+				double value_weight = 0.0;
+				if(indices_to_consider == nullptr && !has_weight)
+				{
+					value_weight = static_cast<double>(indices.size());
+				}
+				else
+				{
+					for(auto index : indices)
+					{
+						if(indices_to_consider != nullptr && !indices_to_consider->contains(index))
+							continue;
+
+						double weight_value = 1.0;
+						if(has_weight)
+							get_weight(index, weight_value);
+						value_weight += weight_value;
+					}
+				}
+
+				if(value_weight > mode_weight)
+				{
+					mode = value;
+					mode_weight = value_weight;
+				}
+			});
+
+		return mode;
+	}
+
+	case ENT_QUERY_MIN_DIFFERENCE:
+	case ENT_QUERY_MAX_DIFFERENCE:
+	{
+		//only the differences between adjacent values matter, so two of each value
+		// are enough to include a difference of zero for values that repeat
+		auto &values = buffers.doubleVector;
+		values.clear();
+
+		sbfds.IterateOverSortedNumberValues(column_index,
+			[&](double value, SortedIntegerSet &indices)
+			{
+				size_t num_with_value = 0;
+				if(indices_to_consider == nullptr)
+				{
+					num_with_value = indices.size();
+				}
+				else
+				{
+					for(auto index : indices)
+					{
+						if(indices_to_consider->contains(index) && ++num_with_value == 2)
+							break;
+					}
+				}
+
+				values.insert(end(values), std::min<size_t>(num_with_value, 2), value);
+			});
+
+		return EntityQueriesStatistics::ExtremeDifferenceOfSortedValues(values, cond->queryType == ENT_QUERY_MIN_DIFFERENCE,
+			cond->maxDistance, cond->includeZeroDifferences);
+	}
+
+	default:
+		return std::numeric_limits<double>::quiet_NaN();
+	}
+}
+
+void EntityQueryCaches::GetMatchingEntitiesBatch(EntityQueryCondition *cond, BitArrayIntegerSet &matching_entities,
+	std::vector<std::vector<DistanceReferencePair<size_t>>> &batch_compute_results, bool is_first)
+{
+#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+	Concurrency::ReadLock lock(mutex);
+	EnsureLabelsAreCached(cond, lock);
+	EnsureApproximateIndexIsBuilt(cond, lock);
+	EnsureStringEditDistanceIndicesAreBuilt(cond, lock);
+#else
+	EnsureLabelsAreCached(cond);
+	EnsureApproximateIndexIsBuilt(cond);
+	EnsureStringEditDistanceIndicesAreBuilt(cond);
+#endif
+
+	//if first, need to populate with all entities
+	if(is_first)
+	{
+		matching_entities.clear();
+		matching_entities.SetAllIds(sbfds.GetNumInsertedEntities());
+	}
+
+	//get entity (case) weighting if applicable
+	bool use_entity_weights = (cond->weightLabel != StringInternPool::NOT_A_STRING_ID);
+	size_t weight_column = std::numeric_limits<size_t>::max();
+	if(use_entity_weights)
+		weight_column = sbfds.GetColumnIndexFromLabelId(cond->weightLabel);
+
+	auto get_weight = sbfds.GetNumberValueFromEntityIndexFunction(weight_column);
+	EntityQueriesStatistics::DistanceTransform<size_t> distance_transform(cond->transformSuprisalToProb,
+		cond->distanceWeightExponent, use_entity_weights, get_weight);
+
+	//keep enough candidates that the expected fraction of misses is 1 - approximateRecall, the same as a single position
+	size_t top_k = static_cast<size_t>(cond->maxToRetrieve);
+	size_t num_candidates = top_k;
+	if(cond->approximateRecall > 0.0 && cond->approximateRecall < 1.0)
+		num_candidates = static_cast<size_t>(std::ceil(top_k / (1.0 - cond->approximateRecall)));
+
+	NearestNeighborGraph *approximate_index = (CanUseApproximateIndex(cond) ? FindApproximateIndex(cond) : nullptr);
+	if(approximate_index != nullptr
+		&& num_candidates < matching_entities.size() && 2 * matching_entities.size() >= approximate_index->GetNumNodes())
+	{
+	#ifdef MULTITHREAD_SUPPORT
+		sbfds.FindNearestEntitiesApproximateBatch(*approximate_index, cond->distParams, cond->positionLabels,
+			cond->batchValuesToCompare, cond->batchValueTypes, top_k, num_candidates, cond->exclusionLabel,
+			matching_entities, batch_compute_results, cond->useConcurrency);
+	#else
+		sbfds.FindNearestEntitiesApproximateBatch(*approximate_index, cond->distParams, cond->positionLabels,
+			cond->batchValuesToCompare, cond->batchValueTypes, top_k, num_candidates, cond->exclusionLabel,
+			matching_entities, batch_compute_results);
+	#endif
+	}
+	else
+	{
+	#ifdef MULTITHREAD_SUPPORT
+		sbfds.FindNearestEntitiesBatch(cond->distParams, cond->positionLabels, cond->batchValuesToCompare, cond->batchValueTypes,
+			top_k, cond->exclusionLabel, matching_entities,
+			batch_compute_results, cond->randomStream.CreateOtherStreamViaRand(), cond->useConcurrency);
+	#else
+		sbfds.FindNearestEntitiesBatch(cond->distParams, cond->positionLabels, cond->batchValuesToCompare, cond->batchValueTypes,
+			top_k, cond->exclusionLabel, matching_entities,
+			batch_compute_results, cond->randomStream.CreateOtherStreamViaRand());
+	#endif
+	}
+
+	for(auto &compute_results : batch_compute_results)
+		distance_transform.TransformDistances(compute_results, cond->returnSortedList);
+}
+
 bool EntityQueryCaches::ComputeValueFromMatchingEntities(EntityQueryCondition *cond, BitArrayIntegerSet &matching_entities,
 	StringInternPool::StringID &compute_result, bool is_first)
 {
@@ -785,17 +1557,140 @@ void EntityQueryCaches::ComputeValuesFromMatchingEntities(EntityQueryCondition *
 	}
 }
 
+size_t EntityQueryCaches::EstimateNumMatchingEntities(EntityQueryCondition *cond)
+{
+#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+	Concurrency::ReadLock lock(mutex);
+	EnsureLabelsAreCached(cond, lock);
+#else
+	EnsureLabelsAreCached(cond);
+#endif
+
+	//each label of a condition further restricts the entities, so use the most restrictive label
+	size_t estimate = sbfds.GetNumInsertedEntities();
+
+	switch(cond->queryType)
+	{
+	case ENT_QUERY_EXISTS:
+		for(auto label_id : cond->existLabels)
+			estimate = std::min(estimate, sbfds.GetNumEntitiesWithFeature(label_id));
+		break;
+
+	case ENT_QUERY_NOT_EXISTS:
+		for(auto label_id : cond->existLabels)
+			estimate = std::min(estimate, sbfds.GetNumEntitiesWithoutFeature(label_id));
+		break;
+
+	case ENT_QUERY_EQUALS:
+		for(size_t i = 0; i < cond->singleLabels.size(); i++)
+		{
+			auto &[label_id, value] = cond->singleLabels[i];
+			estimate = std::min(estimate, sbfds.GetNumEntitiesWithValue(label_id, cond->valueTypes[i], value));
+		}
+		break;
+
+	case ENT_QUERY_BETWEEN:
+	case ENT_QUERY_NOT_BETWEEN:
+		for(size_t i = 0; i < cond->pairedLabels.size(); i++)
+		{
+			auto &[label_id, range] = cond->pairedLabels[i];
+			estimate = std::min(estimate, sbfds.EstimateNumEntitiesWithinRange(label_id, cond->valueTypes[i],
+				range.first, range.second, cond->queryType == ENT_QUERY_BETWEEN));
+		}
+		break;
+
+	case ENT_QUERY_AMONG:
+	case ENT_QUERY_NOT_AMONG:
+	{
+		size_t num_among = 0;
+		for(size_t i = 0; i < cond->valueToCompare.size(); i++)
+			num_among += sbfds.GetNumEntitiesWithValue(cond->singleLabel, cond->valueTypes[i], cond->valueToCompare[i]);
+
+		if(cond->queryType == ENT_QUERY_AMONG)
+		{
+			estimate = std::min(estimate, num_among);
+		}
+		else
+		{
+			size_t num_with_label = sbfds.GetNumEntitiesWithFeature(cond->singleLabel);
+			estimate = (num_among < num_with_label ? num_with_label - num_among : 0);
+		}
+		break;
+	}
+
+	default:
+		break;
+	}
+
+	return estimate;
+}
+
+bool EntityQueryCaches::GetQueryResult(const std::string &key, BitArrayIntegerSet &matching_entities, size_t &write_epoch)
+{
+#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+	Concurrency::ReadLock lock(mutex);
+	Concurrency::SingleLock result_cache_lock(queryResultCacheMutex);
+#endif
+
+	write_epoch = sbfds.GetWriteEpoch();
+	return queryResultCache.GetResult(key, sbfds, matching_entities);
+}
+
+void EntityQueryCaches::StoreQueryResult(const std::string &key, std::vector<StringInternPool::StringID> &label_ids,
+	size_t write_epoch, BitArrayIntegerSet &matching_entities)
+{
+#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+	Concurrency::SingleLock result_cache_lock(queryResultCacheMutex);
+#endif
+
+	queryResultCache.StoreResult(key, label_ids, write_epoch, matching_entities);
+}
+
 void EntityQueryCaches::GetMatchingEntitiesViaSamplingWithReplacement(EntityQueryCondition *cond, BitArrayIntegerSet &matching_entities, std::vector<size_t> &entity_indices_sampled, bool is_first, bool update_matching_entities)
 {
 #if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
 	Concurrency::ReadLock lock(mutex);
 	EnsureLabelsAreCached(cond, lock);
+	EnsureWeightedSampleTableIsBuilt(cond, is_first, lock);
 #else
 	EnsureLabelsAreCached(cond);
+	EnsureWeightedSampleTableIsBuilt(cond, is_first);
 #endif
 
 	size_t num_to_sample = static_cast<size_t>(cond->maxToRetrieve);
 
+	//if not filtered, draw from the weight label's table rather than rebuilding the distribution,
+	// unless the table was removed by another thread's write after it was built
+	auto found_table = (is_first ? weightedSampleTables.find(cond->singleLabel) : end(weightedSampleTables));
+	if(found_table != end(weightedSampleTables) && (num_to_sample < minNumSamplesForAliasTable
+			|| found_table->second.entityIndices.size() == 0 || found_table->second.aliasTable.IsInitialized()))
+	{
+		auto &table = found_table->second;
+		if(update_matching_entities)
+			matching_entities.clear();
+
+		if(table.entityIndices.size() == 0)
+			return;
+
+		for(size_t i = 0; i < num_to_sample; i++)
+		{
+			size_t eid;
+			if(num_to_sample >= minNumSamplesForAliasTable)
+				eid = table.aliasTable.WeightedDiscreteRand(cond->randomStream);
+			else if(table.probabilities.size() > 0)
+				eid = table.entityIndices[WeightedDiscreteRandomSample(table.probabilities, cond->randomStream)];
+			else
+				eid = table.entityIndices[WeightedDiscreteRandomSampleFromCumulativeProbabilities(table.cumulativeProbabilities, cond->randomStream)];
+
+			if(update_matching_entities)
+				matching_entities.insert(eid);
+			else
+				entity_indices_sampled.push_back(eid);
+		}
+
+		return;
+	}
+
 	auto &probabilities = EntityQueryCaches::buffers.doubleVector;
 	auto &entity_indices = EntityQueryCaches::buffers.entityIndices;
 
@@ -814,7 +1709,7 @@ void EntityQueryCaches::GetMatchingEntitiesViaSamplingWithReplacement(EntityQuer
 	NormalizeProbabilities(probabilities);
 
 	//if not sampling many, then brute force it
-	if(num_to_sample < 10)
+	if(num_to_sample < minNumSamplesForAliasTable)
 	{
 		//sample the entities
 		for(size_t i = 0; i < num_to_sample; i++)
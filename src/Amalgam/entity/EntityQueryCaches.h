@@ -1,11 +1,15 @@
 #pragma once
 
 //project headers:
+#include "BinaryPacking.h"
 #include "Conviction.h"
 #include "Entity.h"
+#include "EntityQueries.h"
+#include "EntityQueryResultCache.h"
 #include "HashMaps.h"
 #include "IntegerSet.h"
 #include "KnnCache.h"
+#include "NearestNeighborGraph.h"
 #include "SeparableBoxFilterDataStore.h"
 #include "StringInternPool.h"
 #include "WeightedDiscreteRandomStream.h"
@@ -21,7 +25,9 @@ class EntityQueryCaches
 public:
 
 	EntityQueryCaches(Entity *_container) : container(_container)
-	{	}
+	{
+		sbfds.SetReducedPrecisionNumbers(_enable_SBF_datastore_reduced_precision);
+	}
 
 	//adds the entity to the cache
 	// container should contain entity
@@ -36,6 +42,10 @@ public:
 	#endif
 
 		sbfds.AddEntity(e, entity_index);
+		UpdateApproximateIndices(entity_index, [](NearestNeighborGraph &) { return true; });
+		knnCache.EntityChanged(entity_index);
+		snapshotNumberValueBuckets.clear();
+		weightedSampleTables.clear();
 	}
 
 	//like AddEntity, but removes the entity from the cache and reassigns entity_index_to_reassign to use the old
@@ -50,7 +60,20 @@ public:
 			write_lock.lock();
 	#endif
 
+		//the graphs read the values of both entities from sbfds, so they must be updated first
+		for(size_t i = 0; i < approximateIndices.size(); )
+		{
+			if(!sbfds.RemoveEntityFromNearestNeighborGraph(*approximateIndices[i], entity_index, entity_index_to_reassign))
+				approximateIndices.erase(begin(approximateIndices) + i);
+			else
+				i++;
+		}
+
 		sbfds.RemoveEntity(e, entity_index, entity_index_to_reassign);
+		knnCache.EntityChanged(entity_index);
+		knnCache.EntityChanged(entity_index_to_reassign);
+		snapshotNumberValueBuckets.clear();
+		weightedSampleTables.clear();
 	}
 
 	//updates all of the label values for entity e with index entity_index
@@ -61,6 +84,9 @@ public:
 	#endif
 
 		sbfds.UpdateAllEntityLabels(entity, entity_index);
+		UpdateApproximateIndices(entity_index, [](NearestNeighborGraph &) { return true; });
+		knnCache.EntityChanged(entity_index);
+		weightedSampleTables.clear();
 	}
 
 	//like UpdateAllEntityLabels, but only updates labels for the keys of labels_updated
@@ -71,7 +97,18 @@ public:
 	#endif
 
 		for(auto &[label_id, _] : labels_updated)
+		{
 			sbfds.UpdateEntityLabel(entity, entity_index, label_id);
+			knnCache.EntityLabelChanged(entity_index, label_id);
+			weightedSampleTables.erase(label_id);
+		}
+
+		UpdateApproximateIndices(entity_index,
+			[&labels_updated](NearestNeighborGraph &graph)
+			{
+				return std::any_of(begin(labels_updated), end(labels_updated),
+					[&graph](auto &label) { return graph.HasLabel(label.first); });
+			});
 	}
 
 	//like UpdateEntityLabels, but only updates labels for the keys of labels_updated that are not in labels_previous
@@ -89,8 +126,23 @@ public:
 
 			//if not found or different, need to update the label
 			if(prev_entry == end(labels_previous) || prev_entry->second != label)
+			{
 				sbfds.UpdateEntityLabel(entity, entity_index, label_id);
+				knnCache.EntityLabelChanged(entity_index, label_id);
+				weightedSampleTables.erase(label_id);
+			}
 		}
+
+		UpdateApproximateIndices(entity_index,
+			[&labels_previous, &labels_updated](NearestNeighborGraph &graph)
+			{
+				return std::any_of(begin(labels_updated), end(labels_updated),
+					[&graph, &labels_previous](auto &label)
+					{
+						auto prev_entry = labels_previous.find(label.first);
+						return (prev_entry == end(labels_previous) || prev_entry->second != label.second) && graph.HasLabel(label.first);
+					});
+			});
 	}
 
 	//like UpdateAllEntityLabels, but only updates labels for label_updated
@@ -101,6 +153,10 @@ public:
 	#endif
 
 		sbfds.UpdateEntityLabel(entity, entity_index, label_updated);
+		UpdateApproximateIndices(entity_index,
+			[label_updated](NearestNeighborGraph &graph) { return graph.HasLabel(label_updated); });
+		knnCache.EntityLabelChanged(entity_index, label_updated);
+		weightedSampleTables.erase(label_updated);
 	}
 
 	//specifies that this cache can be used for the input condition
@@ -119,10 +175,96 @@ public:
 	void EnsureLabelsAreCached(EntityQueryCondition *cond);
 #endif
 
+	//makes sure each of label_ids is in the cache, building the labels that are not while other threads can still
+	// read the cache, and only requiring exclusive access to add them once built
+	//the caller must keep the contained entities of the container from being added or removed until it returns
+	void PrewarmLabels(std::vector<StringInternPool::StringID> &label_ids);
+
+	//populates snapshot_out with a snapshot of the labels cached, to be stored alongside the container
+	// and read back with ReadSnapshot to build the labels faster than building them from the entities alone
+	//leaves snapshot_out empty if no labels are cached
+	void WriteSnapshot(BinaryData &snapshot_out);
+
+	//reads a snapshot created by WriteSnapshot, which will be used when building any of its labels
+	// as each label is built, the hash of the number values of the entities is checked against the hash stored with the label's buckets,
+	// and the buckets are not used if it does not match
+	//returns false if the snapshot could not be read or is not of the container's current entities
+	bool ReadSnapshot(BinaryData &snapshot);
+
+	//returns true if cond can be answered by an approximate search of one of approximateIndices
+	static bool CanUseApproximateIndex(EntityQueryCondition *cond);
+
+	//returns the approximate index for the labels and distance parameters of cond, nullptr if none has been built
+	inline NearestNeighborGraph *FindApproximateIndex(EntityQueryCondition *cond)
+	{
+		for(auto &graph : approximateIndices)
+		{
+			if(graph->IsForQuery(cond->positionLabels, cond->distParams))
+				return graph.get();
+		}
+		return nullptr;
+	}
+
+	//if cond can use an approximate index, makes sure one is built for its labels and distance parameters
+#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+	void EnsureApproximateIndexIsBuilt(EntityQueryCondition *cond, Concurrency::ReadLock &lock);
+#else
+	void EnsureApproximateIndexIsBuilt(EntityQueryCondition *cond);
+#endif
+
+	//if cond is a distance query, makes sure the edit distance indices are built for any of its continuous string features
+	// that have enough values to benefit from one
+#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+	void EnsureStringEditDistanceIndicesAreBuilt(EntityQueryCondition *cond, Concurrency::ReadLock &lock);
+#else
+	void EnsureStringEditDistanceIndicesAreBuilt(EntityQueryCondition *cond);
+#endif
+
+	//returns true if cond can be computed from running aggregates of its label's values
+	// when is_first is the value that will be passed to GetMatchingEntities
+	static bool CanUseNumberValueSummary(EntityQueryCondition *cond, bool is_first);
+
+	//if cond can be computed from running aggregates of its label's values weighted by its weight label,
+	// makes sure the aggregates are built
+#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+	void EnsureWeightedNumberValueSummaryIsBuilt(EntityQueryCondition *cond, bool is_first, Concurrency::ReadLock &lock);
+#else
+	void EnsureWeightedNumberValueSummaryIsBuilt(EntityQueryCondition *cond, bool is_first);
+#endif
+
+	//if cond is an ENT_QUERY_WEIGHTED_SAMPLE that is not filtered by a previous condition,
+	// makes sure weightedSampleTables has a table for its weight label that can produce cond's number of samples
+#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+	void EnsureWeightedSampleTableIsBuilt(EntityQueryCondition *cond, bool is_first, Concurrency::ReadLock &lock);
+#else
+	void EnsureWeightedSampleTableIsBuilt(EntityQueryCondition *cond, bool is_first);
+#endif
+
+	//returns an estimate of the number of entities that match cond when it is the first condition,
+	// where cond is an exists, not exists, equals, between, not between, among, or not among condition
+	size_t EstimateNumMatchingEntities(EntityQueryCondition *cond);
+
 	//returns the set matching_entities of entity ids in the cache that match the provided query condition cond, will fill compute_results with numeric results if KNN query
 	//if is_first is true, optimizes to skip unioning results with matching_entities (just overwrites instead).
 	void GetMatchingEntities(EntityQueryCondition *cond, BitArrayIntegerSet &matching_entities, std::vector<DistanceReferencePair<size_t>> &compute_results, bool is_first, bool update_matching_entities);
 
+	//computes the ENT_QUERY_SUM or ENT_QUERY_GENERALIZED_MEAN of cond, for which CanUseNumberValueSummary must be true,
+	// into result from the running aggregates of column_index, weighted by weight_column_index if has_weight
+	//returns false if the weighted aggregates have not been built
+	bool ComputeAggregateFromNumberValueSummary(EntityQueryCondition *cond, size_t column_index,
+		bool has_weight, size_t weight_column_index, double &result);
+
+	//computes the ENT_QUERY_QUANTILE, ENT_QUERY_MODE, ENT_QUERY_MIN_DIFFERENCE, or ENT_QUERY_MAX_DIFFERENCE of cond
+	// from the sorted number values of column_index, for the entities in indices_to_consider or all entities if nullptr
+	//the entities must not have any nan values unless cond is a difference query, since the sorted values exclude nans
+	double ComputeOrderStatisticFromSortedNumberValues(EntityQueryCondition *cond, size_t column_index,
+		bool has_weight, size_t weight_column_index, BitArrayIntegerSet *indices_to_consider);
+
+	//like GetMatchingEntities, but for a batched ENT_QUERY_NEAREST_GENERALIZED_DISTANCE condition, populating
+	// batch_compute_results with the results for each of the positions in cond->batchValuesToCompare
+	void GetMatchingEntitiesBatch(EntityQueryCondition *cond, BitArrayIntegerSet &matching_entities,
+		std::vector<std::vector<DistanceReferencePair<size_t>>> &batch_compute_results, bool is_first);
+
 	//like GetMatchingEntities, but returns a string id
 	bool ComputeValueFromMatchingEntities(EntityQueryCondition *cond, BitArrayIntegerSet &matching_entities, StringInternPool::StringID &compute_result, bool is_first);
 
@@ -133,20 +275,105 @@ public:
 	//returns true if value was computed, false if not valid
 	void ComputeValuesFromMatchingEntities(EntityQueryCondition *cond, BitArrayIntegerSet &matching_entities, FastHashMap<StringInternPool::StringID, double> &compute_results, bool is_first);
 
+	//if the leading filter conditions with the key and labels from EntityQueryResultCache::BuildKey have a current result,
+	// copies it into matching_entities and returns true
+	//write_epoch is set to the write epoch of the datastore before the lookup, to be passed to StoreQueryResult
+	// if the conditions are computed instead
+	bool GetQueryResult(const std::string &key, BitArrayIntegerSet &matching_entities, size_t &write_epoch);
+
+	//stores matching_entities as the result of the leading filter conditions with the key and labels from
+	// EntityQueryResultCache::BuildKey, computed after the datastore was at write_epoch
+	void StoreQueryResult(const std::string &key, std::vector<StringInternPool::StringID> &label_ids,
+		size_t write_epoch, BitArrayIntegerSet &matching_entities);
+
 	//like GetMatchingEntities, but returns entity_indices_sampled
 	void GetMatchingEntitiesViaSamplingWithReplacement(EntityQueryCondition *cond, BitArrayIntegerSet &matching_entities, std::vector<size_t> &entity_indices_sampled, bool is_first, bool update_matching_entities);
 
+	//version of the format written by WriteSnapshot
+	static constexpr OffsetIndex snapshotFormatVersion = 2;
+
+	//number of samples to draw at or above which weighted samples are drawn via an alias table
+	static constexpr size_t minNumSamplesForAliasTable = 10;
+
+	//the distribution of all entities with a number value for a weight label, to draw weighted samples from
+	struct WeightedSampleTable
+	{
+		//entity indices with a valid number value for the label
+		std::vector<size_t> entityIndices;
+
+		//running sums of the normalized weights of entityIndices, for drawing a few samples via binary search
+		std::vector<double> cumulativeProbabilities;
+
+		//normalized weights of entityIndices, only populated if cumulativeProbabilities is not nondecreasing,
+		// such as when there are negative weights, in which case samples must be drawn via a linear scan
+		std::vector<double> probabilities;
+
+		//alias table for drawing many samples, only initialized once a query needs at least minNumSamplesForAliasTable samples
+		WeightedDiscreteRandomStreamTransform<size_t, CompactHashMap<size_t, double>> aliasTable;
+	};
+
 	//the container this is a cache for
 	Entity *container;
 
 	SeparableBoxFilterDataStore sbfds;
 
+	//updates the node of entity_index in each of approximateIndices for which has_updated_label(graph) is true,
+	// removing any graph that can no longer be kept up to date
+	template<typename LabelPredicate>
+	inline void UpdateApproximateIndices(size_t entity_index, LabelPredicate has_updated_label)
+	{
+		for(size_t i = 0; i < approximateIndices.size(); )
+		{
+			auto &graph = *approximateIndices[i];
+			if(has_updated_label(graph) && !sbfds.UpdateNearestNeighborGraphNode(graph, entity_index))
+				approximateIndices.erase(begin(approximateIndices) + i);
+			else
+				i++;
+		}
+	}
+
+	//maximum number of approximate indices kept, after which the oldest is removed to build a new one
+	static constexpr size_t maxNumApproximateIndices = 4;
+
+	//approximate nearest neighbor indices, one for each combination of labels and distance parameters of approximate searches,
+	// each built the first time an approximate search with them is requested and kept up to date with entity changes thereafter
+	std::vector<std::unique_ptr<NearestNeighborGraph>> approximateIndices;
+
+	//for each label of a snapshot read by ReadSnapshot that has not been built yet, its sorted number value buckets
+	// cleared when entities are added or removed, since the indices would no longer match
+	SeparableBoxFilterDataStore::NumberValueBucketsSnapshotMap snapshotNumberValueBuckets;
+
+	//for each weight label, the table to draw unfiltered weighted samples from, kept across queries
+	// and removed whenever any value of its label may have changed
+	FastHashMap<StringInternPool::StringID, WeightedSampleTable> weightedSampleTables;
+
+	//nearest neighbors cache for conviction and related computations, kept across queries
+	// and only updated where entity changes could affect the cached neighbors
+	KnnNonZeroDistanceQuerySBFCache knnCache;
+
+#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+	//mutex for exclusive use of knnCache, since queries only hold a read lock on the query cache
+	Concurrency::SingleMutex knnCacheMutex;
+#endif
+
+	//entities matched by recently queried chains of filter conditions, kept across queries
+	// and only used while the labels of their conditions have not been written
+	EntityQueryResultCache queryResultCache;
+
+#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+	//mutex for exclusive use of queryResultCache, since queries only hold a read lock on the query cache
+	Concurrency::SingleMutex queryResultCacheMutex;
+#endif
+
 	//buffers to be reused for less memory churn
 	struct QueryCachesBuffers
 	{
 		//for storting compute results
 		std::vector<DistanceReferencePair<size_t>> computeResultsIdToValue;
 
+		//for storing compute results of batched queries
+		std::vector<std::vector<DistanceReferencePair<size_t>>> batchComputeResultsIdToValue;
+
 		//buffer to keep track of which entities are currently matching
 		BitArrayIntegerSet currentMatchingEntities;
 
@@ -156,6 +383,12 @@ public:
 		//buffer for entity indices
 		std::vector<size_t> entityIndices;
 
+		//key of the leading filter conditions of the current query for the query result cache
+		std::string queryResultKey;
+
+		//labels the result of the leading filter conditions of the current query depends on
+		std::vector<StringInternPool::StringID> queryResultLabelIds;
+
 		//buffer for sampled entity indices with replacement / duplicates
 		std::vector<size_t> entityIndicesWithDuplicates;
 
@@ -165,7 +398,7 @@ public:
 		//buffer for doubles pairs
 		std::vector<std::pair<double,double>> pairDoubleVector;
 
-		//nearest neighbors cache
+		//nearest neighbors cache for when the persistent knnCache is in use by another thread
 		KnnNonZeroDistanceQuerySBFCache knnCache;
 
 		//for conviction calculations
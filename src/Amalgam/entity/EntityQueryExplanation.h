@@ -0,0 +1,192 @@
+#pragma once
+
+//project headers:
+#include "EvaluableNodeManagement.h"
+#include "Opcodes.h"
+#include "PerformanceProfiler.h"
+#include "SeparableBoxFilterDataStore.h"
+
+//system headers:
+#include <string>
+#include <vector>
+
+//records how each condition of a query was evaluated, how long it took, and how many entities it left,
+// so that the cost of a query can be attributed to its conditions
+//recording only happens between Begin and End, so that queries that are not being explained do no extra work
+class EntityQueryExplanation
+{
+public:
+	//the means by which a condition was evaluated
+	enum class EvaluationPath
+	{
+		QUERY_CACHES,
+		QUERY_RESULT_CACHE,
+		BRUTE_FORCE
+	};
+
+	//explanation of the evaluation of a single condition
+	struct ConditionExplanation
+	{
+		EvaluableNodeType queryType;
+		EvaluationPath path;
+		//time spent evaluating the condition in seconds
+		double seconds;
+		//number of entities matching after the condition was evaluated
+		size_t numMatchingEntities;
+		//number of entities considered as potential nearest neighbors
+		size_t numKnnCandidates;
+	};
+
+	EntityQueryExplanation()
+		: isRecording(false), startTime(0.0), totalSeconds(0.0), numEntities(0), numResults(0),
+		conditionStartTime(0.0), conditionStartNumKnnCandidates(0), isConditionOpen(false)
+	{	}
+
+	//starts a new explanation for a query of a container with num_entities contained entities
+	inline void Begin(size_t num_entities)
+	{
+		isRecording = true;
+		numEntities = num_entities;
+		numResults = 0;
+		totalSeconds = 0.0;
+		isConditionOpen = false;
+		conditions.clear();
+		startTime = PerformanceProfiler::GetCurTime();
+	}
+
+	//starts timing a condition of type query_type evaluated via path
+	inline void BeginCondition(EvaluableNodeType query_type, EvaluationPath path)
+	{
+		if(!isRecording)
+			return;
+
+		conditions.push_back({ query_type, path, 0.0, 0, 0 });
+		isConditionOpen = true;
+		conditionStartNumKnnCandidates = SeparableBoxFilterDataStore::GetNumPotentialGoodMatchesConsidered();
+		conditionStartTime = PerformanceProfiler::GetCurTime();
+	}
+
+	//finishes the condition started by the most recent call to BeginCondition,
+	// leaving num_matching_entities entities matching
+	inline void EndCondition(size_t num_matching_entities)
+	{
+		if(!isRecording || !isConditionOpen)
+			return;
+
+		auto &cond = conditions.back();
+		cond.seconds = PerformanceProfiler::GetCurTime() - conditionStartTime;
+		cond.numMatchingEntities = num_matching_entities;
+		cond.numKnnCandidates = SeparableBoxFilterDataStore::GetNumPotentialGoodMatchesConsidered() - conditionStartNumKnnCandidates;
+		isConditionOpen = false;
+	}
+
+	//records a condition of type query_type whose matching entities were retrieved from a cached result
+	inline void AddCachedCondition(EvaluableNodeType query_type, size_t num_matching_entities)
+	{
+		if(!isRecording)
+			return;
+
+		conditions.push_back({ query_type, EvaluationPath::QUERY_RESULT_CACHE, 0.0, num_matching_entities, 0 });
+	}
+
+	//finishes the explanation given the result of the query,
+	// finishing any condition that returned the result directly
+	inline void End(EvaluableNode *result)
+	{
+		if(!isRecording)
+			return;
+
+		numResults = 0;
+		if(result != nullptr)
+		{
+			if(result->IsAssociativeArray())
+				numResults = result->GetMappedChildNodesReference().size();
+			else if(result->IsOrderedArray())
+				numResults = result->GetOrderedChildNodesReference().size();
+			else
+				numResults = 1;
+		}
+
+		EndCondition(numResults);
+		totalSeconds = PerformanceProfiler::GetCurTime() - startTime;
+		isRecording = false;
+	}
+
+	//returns true if an explanation has been recorded since the last call to Clear
+	constexpr bool HasExplanation()
+	{
+		return !isRecording && startTime != 0.0;
+	}
+
+	//clears the recorded explanation
+	inline void Clear()
+	{
+		isRecording = false;
+		startTime = 0.0;
+		conditions.clear();
+	}
+
+	//returns an assoc describing the explanation, allocated from enm
+	EvaluableNodeReference ToEvaluableNode(EvaluableNodeManager *enm)
+	{
+		EvaluableNode *explanation = enm->AllocNode(ENT_ASSOC);
+		explanation->SetMappedChildNode("seconds", enm->AllocNode(totalSeconds));
+		explanation->SetMappedChildNode("num_entities", enm->AllocNode(static_cast<double>(numEntities)));
+		explanation->SetMappedChildNode("num_results", enm->AllocNode(static_cast<double>(numResults)));
+
+		EvaluableNode *conditions_list = enm->AllocNode(ENT_LIST);
+		conditions_list->ReserveOrderedChildNodes(conditions.size());
+		explanation->SetMappedChildNode("conditions", conditions_list);
+
+		for(auto &cond : conditions)
+		{
+			EvaluableNode *cond_explanation = enm->AllocNode(ENT_ASSOC);
+			cond_explanation->SetMappedChildNode("type", enm->AllocNode(ENT_STRING, GetStringFromEvaluableNodeType(cond.queryType, true)));
+			cond_explanation->SetMappedChildNode("path", enm->AllocNode(ENT_STRING, GetEvaluationPathString(cond.path)));
+			cond_explanation->SetMappedChildNode("seconds", enm->AllocNode(cond.seconds));
+			cond_explanation->SetMappedChildNode("num_matching_entities", enm->AllocNode(static_cast<double>(cond.numMatchingEntities)));
+			cond_explanation->SetMappedChildNode("knn_candidates", enm->AllocNode(static_cast<double>(cond.numKnnCandidates)));
+			conditions_list->AppendOrderedChildNode(cond_explanation);
+		}
+
+		return EvaluableNodeReference(explanation, true);
+	}
+
+	//returns the string used to describe path
+	static inline std::string GetEvaluationPathString(EvaluationPath path)
+	{
+		switch(path)
+		{
+		case EvaluationPath::QUERY_CACHES:			return "query_caches";
+		case EvaluationPath::QUERY_RESULT_CACHE:	return "query_result_cache";
+		case EvaluationPath::BRUTE_FORCE:			return "brute_force";
+		default:									return "";
+		}
+	}
+
+protected:
+	//true between Begin and End
+	bool isRecording;
+
+	//time the query started
+	double startTime;
+
+	//total time of the query in seconds
+	double totalSeconds;
+
+	//number of entities in the container queried
+	size_t numEntities;
+
+	//number of results returned by the query
+	size_t numResults;
+
+	//time and number of knn candidates when the most recent condition began
+	double conditionStartTime;
+	size_t conditionStartNumKnnCandidates;
+
+	//true if the most recent condition has begun but not ended
+	bool isConditionOpen;
+
+	//explanation of each condition in the order evaluated
+	std::vector<ConditionExplanation> conditions;
+};
@@ -2,6 +2,7 @@
 
 //project headers:
 #include "EntityQueryCaches.h"
+#include "EntityQueryExplanation.h"
 #include "IntegerSet.h"
 
 //system headers:
@@ -20,9 +21,57 @@ public:
 	// uses efficient querying methods with a query database, one database per container
 	static EvaluableNodeReference GetMatchingEntitiesFromQueryCaches(Entity *container, std::vector<EntityQueryCondition> &conditions, EvaluableNodeManager *enm, bool return_query_value);
 
+	//reorders each run of consecutive filter conditions whose results do not depend on their order,
+	// so that the conditions estimated by entity_caches to match the fewest entities are evaluated first
+	//conditions that depend on the entities matched before them, such as samples, nearest, and min or max, are not moved,
+	// nor is the last condition if return_query_value is true, since its labels determine the values returned
+	static void OrderConditionsBySelectivity(EntityQueryCaches *entity_caches, std::vector<EntityQueryCondition> &conditions, bool return_query_value);
+
+	//like GetEntitiesMatchingQuery, but where the condition at batch_cond_index has multiple positions,
+	// runs the query separately for each position and returns a list of the results
+	static EvaluableNodeReference GetEntitiesMatchingBatchQueryIndividually(Entity *container, std::vector<EntityQueryCondition> &conditions,
+		size_t batch_cond_index, EvaluableNodeManager *enm, bool return_query_value);
+
 	//returns the numeric query cache associated with the specified container, creates one if one does not already exist
 	static EntityQueryCaches *GetQueryCachesForContainer(Entity *container);
 
+	//makes sure the query caches of container have each of label_ids, building any missing labels
+	// without blocking other queries of container until the labels are ready to be added
+	inline static void PrewarmLabels(Entity *container, std::vector<StringInternPool::StringID> &label_ids)
+	{
+		if(container == nullptr || label_ids.size() == 0)
+			return;
+
+		GetQueryCachesForContainer(container)->PrewarmLabels(label_ids);
+	}
+
+	//populates snapshot_out with a snapshot of the query caches of container to be stored alongside it
+	// leaves snapshot_out empty if container does not have any query caches
+	inline static void WriteQueryCachesSnapshot(Entity *container, BinaryData &snapshot_out)
+	{
+		snapshot_out.clear();
+		if(container == nullptr)
+			return;
+
+	#ifdef MULTITHREAD_SUPPORT
+		Concurrency::ReadLock lock(queryCacheMutex);
+	#endif
+
+		auto found_cache = queryCaches.find(container);
+		if(found_cache != end(queryCaches))
+			found_cache->second->WriteSnapshot(snapshot_out);
+	}
+
+	//reads a snapshot created by WriteQueryCachesSnapshot into the query caches of container, creating them if needed
+	// returns true if the snapshot could be read
+	inline static bool ReadQueryCachesSnapshot(Entity *container, BinaryData &snapshot)
+	{
+		if(container == nullptr)
+			return false;
+
+		return GetQueryCachesForContainer(container)->ReadSnapshot(snapshot);
+	}
+
 	//updates when entity contents have changed
 	// container should contain entity
 	// entity_index is the index that the entity should be stored as
@@ -194,6 +243,15 @@ public:
 		}
 	}
 
+	//if true, each query records how it was evaluated into queryExplanation
+	static bool explainQueries;
+
+	//explanation of the most recent query evaluated on this thread while explainQueries was true
+#if defined(MULTITHREAD_SUPPORT) || defined(MULTITHREAD_INTERFACE)
+	thread_local
+#endif
+	static EntityQueryExplanation queryExplanation;
+
 protected:
 
 #ifdef MULTITHREAD_SUPPORT
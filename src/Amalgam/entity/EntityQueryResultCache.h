@@ -0,0 +1,244 @@
+#pragma once
+
+//project headers:
+#include "EntityQueries.h"
+#include "HashMaps.h"
+#include "IntegerSet.h"
+#include "SeparableBoxFilterDataStore.h"
+#include "StringInternPool.h"
+
+//system headers:
+#include <algorithm>
+#include <cstring>
+#include <list>
+#include <string>
+#include <vector>
+
+//bounded least recently used cache of the entities matched by chains of leading filter conditions,
+// so that a query repeated between writes can start after the conditions whose result is cached
+//each result is keyed by a canonical representation of its conditions and is only used while none of the labels
+// its conditions depend on have been written since the result was computed
+class EntityQueryResultCache
+{
+public:
+	//maximum number of results kept, after which the least recently used result is replaced
+	static constexpr size_t maxNumResults = 16;
+
+	//populates key with a canonical representation of the longest chain of leading filter conditions
+	// whose result can be cached, and label_ids with the labels the result depends on
+	//returns the number of conditions in the chain, or 0 if the result is not worth caching
+	static size_t BuildKey(std::vector<EntityQueryCondition> &conditions,
+		std::string &key, std::vector<StringInternPool::StringID> &label_ids)
+	{
+		key.clear();
+		label_ids.clear();
+
+		size_t num_conditions = 0;
+		for(; num_conditions < conditions.size(); num_conditions++)
+		{
+			if(!AppendConditionToKey(conditions[num_conditions], key, label_ids))
+				break;
+		}
+
+		//a lone exists condition is already just a copy of the entities of its labels
+		if(num_conditions == 1 && conditions[0].queryType == ENT_QUERY_EXISTS)
+			num_conditions = 0;
+
+		if(num_conditions == 0)
+		{
+			key.clear();
+			label_ids.clear();
+			return 0;
+		}
+
+		std::sort(begin(label_ids), end(label_ids));
+		label_ids.erase(std::unique(begin(label_ids), end(label_ids)), end(label_ids));
+		return num_conditions;
+	}
+
+	//if there is a result for key that is still current in sbfds, copies it into matching_entities and returns true
+	bool GetResult(const std::string &key, SeparableBoxFilterDataStore &sbfds, BitArrayIntegerSet &matching_entities)
+	{
+		auto found = resultsByKey.find(key);
+		if(found == end(resultsByKey))
+			return false;
+
+		auto result = found->second;
+		for(auto label_id : result->labelIds)
+		{
+			if(sbfds.GetLabelWriteEpoch(label_id) > result->writeEpoch)
+			{
+				resultsByKey.erase(found);
+				results.erase(result);
+				return false;
+			}
+		}
+
+		//mark as most recently used
+		results.splice(begin(results), results, result);
+		matching_entities = result->matchingEntities;
+		return true;
+	}
+
+	//stores matching_entities as the result for key, which depends on label_ids and was computed
+	// entirely after the datastore was at write_epoch
+	void StoreResult(const std::string &key, std::vector<StringInternPool::StringID> &label_ids,
+		size_t write_epoch, BitArrayIntegerSet &matching_entities)
+	{
+		auto found = resultsByKey.find(key);
+		if(found != end(resultsByKey))
+		{
+			results.erase(found->second);
+			resultsByKey.erase(found);
+		}
+		else if(results.size() >= maxNumResults)
+		{
+			resultsByKey.erase(results.back().key);
+			results.pop_back();
+		}
+
+		results.emplace_front();
+		auto &result = results.front();
+		result.key = key;
+		result.labelIds = label_ids;
+		result.writeEpoch = write_epoch;
+		result.matchingEntities = matching_entities;
+		resultsByKey.emplace(key, begin(results));
+	}
+
+protected:
+
+	//appends the bytes of value to key
+	template<typename ValueType>
+	static inline void AppendToKey(std::string &key, ValueType value)
+	{
+		char bytes[sizeof(ValueType)];
+		std::memcpy(&bytes[0], &value, sizeof(ValueType));
+		key.append(&bytes[0], sizeof(ValueType));
+	}
+
+	//appends value of value_type to key
+	//returns false if the value cannot be compared by its immediate value alone
+	static inline bool AppendValueToKey(std::string &key, EvaluableNodeImmediateValueType value_type, EvaluableNodeImmediateValue &value)
+	{
+		AppendToKey(key, value_type);
+		if(value_type == ENIVT_NUMBER)
+			AppendToKey(key, value.number);
+		else if(value_type == ENIVT_STRING_ID)
+			AppendToKey(key, value.stringID);
+		else if(value_type == ENIVT_CODE)
+			return false;
+		return true;
+	}
+
+	//appends the canonical representation of cond to key and the labels it depends on to label_ids
+	//returns false if the result of cond cannot be cached, in which case key and label_ids may be partially appended
+	static bool AppendConditionToKey(EntityQueryCondition &cond, std::string &key, std::vector<StringInternPool::StringID> &label_ids)
+	{
+		AppendToKey(key, cond.queryType);
+
+		switch(cond.queryType)
+		{
+			case ENT_QUERY_EXISTS:
+			case ENT_QUERY_NOT_EXISTS:
+			{
+				if(cond.existLabels.size() == 0)
+					return false;
+
+				//the order of the labels does not change the result
+				size_t first_label_index = label_ids.size();
+				label_ids.insert(end(label_ids), begin(cond.existLabels), end(cond.existLabels));
+				std::sort(begin(label_ids) + first_label_index, end(label_ids));
+
+				AppendToKey(key, cond.existLabels.size());
+				for(size_t i = first_label_index; i < label_ids.size(); i++)
+					AppendToKey(key, label_ids[i]);
+				return true;
+			}
+
+			case ENT_QUERY_EQUALS:
+			case ENT_QUERY_NOT_EQUALS:
+			{
+				if(cond.singleLabels.size() == 0)
+					return false;
+
+				AppendToKey(key, cond.singleLabels.size());
+				for(size_t i = 0; i < cond.singleLabels.size(); i++)
+				{
+					auto &[label_id, value] = cond.singleLabels[i];
+					label_ids.push_back(label_id);
+					AppendToKey(key, label_id);
+					if(!AppendValueToKey(key, cond.valueTypes[i], value))
+						return false;
+				}
+				return true;
+			}
+
+			case ENT_QUERY_BETWEEN:
+			case ENT_QUERY_NOT_BETWEEN:
+			{
+				if(cond.pairedLabels.size() == 0)
+					return false;
+
+				AppendToKey(key, cond.pairedLabels.size());
+				for(size_t i = 0; i < cond.pairedLabels.size(); i++)
+				{
+					auto &[label_id, range] = cond.pairedLabels[i];
+					label_ids.push_back(label_id);
+					AppendToKey(key, label_id);
+					if(!AppendValueToKey(key, cond.valueTypes[i], range.first)
+							|| !AppendValueToKey(key, cond.valueTypes[i], range.second))
+						return false;
+				}
+				return true;
+			}
+
+			case ENT_QUERY_AMONG:
+			case ENT_QUERY_NOT_AMONG:
+			{
+				label_ids.push_back(cond.singleLabel);
+				AppendToKey(key, cond.singleLabel);
+				AppendToKey(key, cond.valueToCompare.size());
+				for(size_t i = 0; i < cond.valueToCompare.size(); i++)
+				{
+					if(!AppendValueToKey(key, cond.valueTypes[i], cond.valueToCompare[i]))
+						return false;
+				}
+				return true;
+			}
+
+			case ENT_QUERY_MIN:
+			case ENT_QUERY_MAX:
+			{
+				label_ids.push_back(cond.singleLabel);
+				AppendToKey(key, cond.singleLabel);
+				AppendToKey(key, cond.singleLabelType);
+				AppendToKey(key, cond.maxToRetrieve);
+				return true;
+			}
+
+			default:
+				return false;
+		}
+	}
+
+	//a result and what is needed to determine whether it is current
+	struct CachedResult
+	{
+		std::string key;
+
+		//labels whose values the result depends on
+		std::vector<StringInternPool::StringID> labelIds;
+
+		//write epoch of the datastore before the result was computed
+		size_t writeEpoch;
+
+		BitArrayIntegerSet matchingEntities;
+	};
+
+	//results ordered from most to least recently used
+	std::list<CachedResult> results;
+
+	//lookup from key to the entry of results
+	FastHashMap<std::string, std::list<CachedResult>::iterator> resultsByKey;
+};
@@ -10,6 +10,7 @@
 
 //system headers:
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstdint>
 #include <cstdlib>
@@ -583,6 +584,32 @@ public:
 		attributes.individualAttribs.garbageCollectionIteration = gc_collect_iteration;
 	}
 
+#ifdef MULTITHREAD_SUPPORT
+	//like SetGarbageCollectionIteration, but safe for multiple threads to call on the same node concurrently,
+	// provided no other attributes are being modified at the same time
+	//returns true if this call set the iteration, false if it was already gc_collect_iteration
+	inline bool SetGarbageCollectionIterationAtomic(uint8_t gc_collect_iteration)
+	{
+		static_assert(sizeof(std::atomic<uint8_t>) == sizeof(uint8_t), "Attributes must be usable as an atomic");
+		auto &atomic_attributes = *reinterpret_cast<std::atomic<uint8_t> *>(&attributes.allAttributes);
+
+		EvaluableNodeAttributesType cur_attributes;
+		cur_attributes.allAttributes = atomic_attributes.load(std::memory_order_relaxed);
+		EvaluableNodeAttributesType new_attributes;
+		do
+		{
+			if(cur_attributes.individualAttribs.garbageCollectionIteration == gc_collect_iteration)
+				return false;
+
+			new_attributes.allAttributes = cur_attributes.allAttributes;
+			new_attributes.individualAttribs.garbageCollectionIteration = gc_collect_iteration;
+		} while(!atomic_attributes.compare_exchange_weak(cur_attributes.allAttributes, new_attributes.allAttributes,
+			std::memory_order_relaxed));
+
+		return true;
+	}
+#endif
+
 	//returns the number of child nodes regardless of mapped or ordered
 	size_t GetNumChildNodes();
 
@@ -910,7 +937,8 @@ protected:
 // concrete values can be stored for the EvaluableNode.  It is intended to
 // group types into the highest specificity that it is worth using to
 // compare two values based on their collective types
-enum EvaluableNodeImmediateValueType
+//uses a single byte so that it can be stored compactly per value
+enum EvaluableNodeImmediateValueType : uint8_t
 {
 	ENIVT_NOT_EXIST,	//there is nothing to even hold the data
 	ENIVT_NULL,			//no data being held
@@ -1,29 +1,45 @@
 //project headers:
 #include "EvaluableNodeManagement.h"
+#include "PerformanceProfiler.h"
 
 //system headers:
 #include <limits>
+#include <new>
 #include <string>
 #include <vector>
 #include <utility>
 
 const double EvaluableNodeManager::allocExpansionFactor = 1.5;
+const size_t EvaluableNodeManager::minNodeSlabSize = 256;
 const ExecutionCycleCountCompactDelta EvaluableNodeManager::minCycleCountBetweenGarbageCollects = 150000;
+double EvaluableNodeManager::garbageCollectionPauseBudget = 0.0;
+#ifdef MULTITHREAD_SUPPORT
+const size_t EvaluableNodeManager::minNumNodesForConcurrentGarbageCollection = 100000;
+const size_t EvaluableNodeManager::threadLocalAllocationBufferSize = 64;
+thread_local EvaluableNodeManager::ThreadLocalAllocationBufferCache EvaluableNodeManager::threadLocalAllocationBufferCache;
+Concurrency::SingleMutex EvaluableNodeManager::threadLocalAllocationBufferLifetimeMutex;
+#endif
 
 EvaluableNodeManager::EvaluableNodeManager()
 {
 	firstUnusedNodeIndex = 0;
+	numNodesPendingInvalidation = 0;
 	executionCyclesSinceLastGarbageCollection = 0;
 }
 
 EvaluableNodeManager::~EvaluableNodeManager()
 {
 #ifdef MULTITHREAD_SUPPORT
+	ClearThreadLocalAllocationBuffers(true);
 	Concurrency::WriteLock lock(managerAttributesMutex);
 #endif
 
-	for(auto &n : nodes)
-		delete n;
+	//only nodes below firstUnusedNodeIndex can hold resources; the slabs free the storage
+	for(size_t i = 0; i < firstUnusedNodeIndex; i++)
+		nodes[i]->Invalidate();
+
+	for(auto n : nodesPendingInvalidation)
+		n->Invalidate();
 }
 
 EvaluableNode *EvaluableNodeManager::AllocNode(EvaluableNode *original, EvaluableNodeMetadataModifier metadata_modifier)
@@ -92,13 +108,8 @@ EvaluableNode *EvaluableNodeManager::AllocListNodeWithOrderedChildNodes(Evaluabl
 			size_t allocated_index = firstUnusedNodeIndex++;
 			if(allocated_index < nodes.size())
 			{
-				if(nodes[allocated_index] != nullptr)
-				{
-					//before releasing the lock, make sure it has an allocated type, otherwise it could get grabbed by another thread
-					nodes[allocated_index]->InitializeType(cur_type);
-				}
-				else //allocate if nullptr
-					nodes[allocated_index] = new EvaluableNode(cur_type);
+				//before releasing the lock, make sure it has an allocated type, otherwise it could get grabbed by another thread
+				nodes[allocated_index]->InitializeType(cur_type);
 
 				//if first node, populate the parent node
 				if(num_allocated == 0)
@@ -148,9 +159,7 @@ EvaluableNode *EvaluableNodeManager::AllocListNodeWithOrderedChildNodes(Evaluabl
 		if(num_nodes_needed > num_nodes)
 		{
 			size_t nodes_to_allocate = static_cast<size_t>(allocExpansionFactor * num_nodes_needed) + 1;
-
-			//fill new EvaluableNode slots with nullptr
-			nodes.resize(num_nodes + nodes_to_allocate, nullptr);
+			AddNodes(nodes_to_allocate);
 		}
 	}
 
@@ -165,6 +174,10 @@ bool EvaluableNodeManager::RecommendGarbageCollection()
 	return true;
 #endif
 
+	//continue freeing nodes from the previous collection
+	if(numNodesPendingInvalidation > 0)
+		return true;
+
 #ifdef MULTITHREAD_SUPPORT
 	if(executionCyclesSinceLastGarbageCollection > minCycleCountBetweenGarbageCollects * static_cast<ExecutionCycleCount>(Concurrency::threadPool.GetNumActiveThreads()))
 #else
@@ -224,8 +237,11 @@ void EvaluableNodeManager::CollectGarbage()
 	}
 #endif
 
-	//perform garbage collection
-	FreeAllNodesExceptReferencedNodes();
+	//perform garbage collection, or continue it if some collected nodes have not been freed yet
+	if(numNodesPendingInvalidation > 0)
+		InvalidatePendingNodes(PerformanceProfiler::GetCurTime(), garbageCollectionPauseBudget);
+	else
+		FreeAllNodesExceptReferencedNodes();
 
 #ifdef MULTITHREAD_SUPPORT
 	//free the unique lock and reacquire the shared lock
@@ -237,6 +253,13 @@ void EvaluableNodeManager::CollectGarbage()
 
 void EvaluableNodeManager::FreeAllNodes()
 {
+	if(numNodesPendingInvalidation > 0)
+		InvalidatePendingNodes(0.0, 0.0);
+
+#ifdef MULTITHREAD_SUPPORT
+	ClearThreadLocalAllocationBuffers(false);
+#endif
+
 	//get rid of any extra memory
 	for(size_t i = 0; i < firstUnusedNodeIndex; i++)
 		nodes[i]->Invalidate();
@@ -254,6 +277,20 @@ void EvaluableNodeManager::FreeAllNodes()
 EvaluableNode *EvaluableNodeManager::AllocUninitializedNode()
 {
 #ifdef MULTITHREAD_SUPPORT
+	//allocate from the nodes this thread has reserved if possible, which needs no synchronization
+	// only reserve nodes when other threads may be allocating, otherwise there is no contention to avoid
+	auto &cache = threadLocalAllocationBufferCache;
+	ThreadLocalAllocationBuffer *buffer = &cache.buffers[cache.lastUsedBufferIndex];
+	if(buffer->enm.load(std::memory_order_relaxed) != this || buffer->nodes.size() == 0)
+		buffer = (Concurrency::threadPool.GetNumActiveThreads() > 1 ? RefillThreadLocalAllocationBuffer() : nullptr);
+
+	if(buffer != nullptr)
+	{
+		EvaluableNode *n = buffer->nodes.back();
+		buffer->nodes.pop_back();
+		return n;
+	}
+
 	//attempt to allocate using an atomic without write locking
 	Concurrency::ReadLock lock(managerAttributesMutex);
 	
@@ -261,14 +298,8 @@ EvaluableNode *EvaluableNodeManager::AllocUninitializedNode()
 	size_t allocated_index = firstUnusedNodeIndex++;
 	if(allocated_index < nodes.size())
 	{
-		if(nodes[allocated_index] != nullptr)
-		{
-			//before releasing the lock, make sure it has an allocated type, otherwise it could get grabbed by another thread
-			nodes[allocated_index]->InitializeUnallocated();
-		}
-		else //allocate if nullptr
-			nodes[allocated_index] = new EvaluableNode();
-
+		//before releasing the lock, make sure it has an allocated type, otherwise it could get grabbed by another thread
+		nodes[allocated_index]->InitializeUnallocated();
 		return nodes[allocated_index];
 	}
 	//the node wasn't valid; put it back and do a write lock to allocate more
@@ -283,29 +314,279 @@ EvaluableNode *EvaluableNodeManager::AllocUninitializedNode()
 #endif
 
 	size_t num_nodes = nodes.size();
-	if(num_nodes > firstUnusedNodeIndex)
+	if(num_nodes <= firstUnusedNodeIndex)
 	{
-		if(nodes[firstUnusedNodeIndex] != nullptr)
+		//ran out, so need another node; add enough that it won't need to be expanded often and slow down garbage collection
+		size_t nodes_to_allocate = static_cast<size_t>(allocExpansionFactor * num_nodes) + 1; //preallocate additional resources, plus current node
+		AddNodes(nodes_to_allocate);
+	}
+
+	//make sure it has an allocated type, otherwise it could be treated as ENT_DEALLOCATED
+	nodes[firstUnusedNodeIndex]->InitializeUnallocated();
+	return nodes[firstUnusedNodeIndex++];
+}
+
+#ifdef MULTITHREAD_SUPPORT
+EvaluableNodeManager::ThreadLocalAllocationBufferCache::~ThreadLocalAllocationBufferCache()
+{
+	for(auto &buffer : buffers)
+		ReleaseThreadLocalAllocationBuffer(buffer);
+}
+
+void EvaluableNodeManager::ReturnThreadLocalAllocationBuffer()
+{
+	for(auto &buffer : threadLocalAllocationBufferCache.buffers)
+	{
+		if(buffer.enm.load(std::memory_order_relaxed) != this)
+			continue;
+
+		if(buffer.nodes.size() == 0)
+			return;
+
+		for(auto n : buffer.nodes)
+			n->Invalidate();
+		buffer.nodes.clear();
+
+		ReclaimFreedNodesAtEnd();
+		return;
+	}
+}
+
+EvaluableNodeManager::ThreadLocalAllocationBuffer *EvaluableNodeManager::RefillThreadLocalAllocationBuffer()
+{
+	auto &cache = threadLocalAllocationBufferCache;
+	auto &buffers = cache.buffers;
+
+	size_t buffer_index = buffers.size();
+	for(size_t i = 0; i < buffers.size(); i++)
+	{
+		if(buffers[i].enm.load(std::memory_order_relaxed) == this)
 		{
-		#ifdef MULTITHREAD_SUPPORT
-			//before releasing the lock, make sure it has an allocated type, otherwise it could get grabbed by another thread
-			nodes[firstUnusedNodeIndex]->InitializeUnallocated();
-		#endif	
+			buffer_index = i;
+			break;
 		}
-		else //allocate if nullptr
-			nodes[firstUnusedNodeIndex] = new EvaluableNode();
+	}
 
-		return nodes[firstUnusedNodeIndex++];
+	if(buffer_index == buffers.size())
+	{
+		//use a buffer that isn't reserved from any manager if there is one, otherwise release the next in turn
+		for(size_t i = 0; i < buffers.size(); i++)
+		{
+			if(buffers[i].enm.load(std::memory_order_relaxed) == nullptr)
+			{
+				buffer_index = i;
+				break;
+			}
+		}
+
+		if(buffer_index == buffers.size())
+		{
+			buffer_index = cache.nextBufferToReplace;
+			cache.nextBufferToReplace = (cache.nextBufferToReplace + 1) % buffers.size();
+			ReleaseThreadLocalAllocationBuffer(buffers[buffer_index]);
+		}
+
+		auto &buffer = buffers[buffer_index];
+		{
+			Concurrency::SingleLock lock(threadLocalAllocationBuffersMutex);
+			buffer.registrationIndex = threadLocalAllocationBuffers.size();
+			threadLocalAllocationBuffers.push_back(&buffer);
+			buffer.enm = this;
+		}
+
+		//wait until the thread has allocated a buffer's worth of nodes from this manager before reserving any,
+		// so that threads that allocate only a few nodes from each of many managers don't leave many reserved
+		buffer.numNodesUntilReserving = threadLocalAllocationBufferSize;
 	}
 
-	//ran out, so need another node; push a bunch on the heap so don't need to reallocate as often and slow down garbage collection
-	size_t nodes_to_allocate = static_cast<size_t>(allocExpansionFactor * num_nodes) + 1; //preallocate additional resources, plus current node
-	
-	//fill new EvaluableNode slots with nullptr
-	nodes.resize(num_nodes + nodes_to_allocate, nullptr);
+	cache.lastUsedBufferIndex = buffer_index;
+	auto &buffer = buffers[buffer_index];
 
-	nodes[firstUnusedNodeIndex] = new EvaluableNode();
-	return nodes[firstUnusedNodeIndex++];
+	if(buffer.numNodesUntilReserving > 0)
+	{
+		buffer.numNodesUntilReserving--;
+		return nullptr;
+	}
+
+	Concurrency::ReadLock lock(managerAttributesMutex);
+
+	size_t first_index = firstUnusedNodeIndex.fetch_add(threadLocalAllocationBufferSize);
+	if(first_index + threadLocalAllocationBufferSize > nodes.size())
+	{
+		//not enough nodes; put them back so they can be allocated after the nodes are expanded
+		firstUnusedNodeIndex -= threadLocalAllocationBufferSize;
+		return nullptr;
+	}
+
+	//reserve in reverse so that nodes are allocated in the order they are in nodes
+	buffer.nodes.resize(threadLocalAllocationBufferSize);
+	for(size_t i = 0; i < threadLocalAllocationBufferSize; i++)
+	{
+		EvaluableNode *n = nodes[first_index + i];
+		n->InitializeType(ENT_NULL);
+		buffer.nodes[threadLocalAllocationBufferSize - 1 - i] = n;
+	}
+
+	return &buffer;
+}
+
+void EvaluableNodeManager::ReleaseThreadLocalAllocationBuffer(ThreadLocalAllocationBuffer &buffer)
+{
+	//the manager may be in use by other threads or being destroyed, so hold the lifetime lock while accessing it
+	Concurrency::SingleLock lifetime_lock(threadLocalAllocationBufferLifetimeMutex);
+	EvaluableNodeManager *enm = buffer.enm;
+	if(enm == nullptr)
+		return;
+
+	Concurrency::SingleLock lock(enm->threadLocalAllocationBuffersMutex);
+
+	//return the nodes so they can be reused without waiting for garbage collection;
+	// the nodes are unreferenced, but hold a read lock so nodes aren't compacted while they're being freed
+	if(buffer.nodes.size() > 0)
+	{
+		Concurrency::ReadLock attributes_lock(enm->managerAttributesMutex);
+		for(auto n : buffer.nodes)
+			n->Invalidate();
+		buffer.nodes.clear();
+	}
+
+	auto &registered_buffers = enm->threadLocalAllocationBuffers;
+	size_t index = buffer.registrationIndex;
+	registered_buffers[index] = registered_buffers.back();
+	registered_buffers[index]->registrationIndex = index;
+	registered_buffers.pop_back();
+
+	buffer.enm = nullptr;
+}
+
+void EvaluableNodeManager::ClearThreadLocalAllocationBuffers(bool detach)
+{
+	//detaching needs to wait for any other thread releasing its buffer from this manager
+	Concurrency::SingleLock lifetime_lock(threadLocalAllocationBufferLifetimeMutex, std::defer_lock);
+	if(detach)
+		lifetime_lock.lock();
+
+	Concurrency::SingleLock lock(threadLocalAllocationBuffersMutex);
+	for(auto buffer : threadLocalAllocationBuffers)
+	{
+		buffer->nodes.clear();
+		if(detach)
+			buffer->enm = nullptr;
+	}
+
+	if(detach)
+		threadLocalAllocationBuffers.clear();
+}
+#endif
+
+void EvaluableNodeManager::InvalidatePendingNodes(double start_time, double time_budget)
+{
+	{
+	#ifdef MULTITHREAD_SUPPORT
+		Concurrency::WriteLock lock(managerAttributesMutex);
+	#endif
+
+		//only check the time after each batch of nodes, as checking the time costs more than invalidating a node
+		const size_t num_nodes_per_batch = 256;
+		while(nodesPendingInvalidation.size() > 0)
+		{
+			size_t num_nodes_in_batch = std::min(num_nodes_per_batch, nodesPendingInvalidation.size());
+			for(size_t i = 0; i < num_nodes_in_batch; i++)
+			{
+				EvaluableNode *n = nodesPendingInvalidation.back();
+				nodesPendingInvalidation.pop_back();
+				n->Invalidate();
+				nodes.push_back(n);
+			}
+
+			if(time_budget > 0.0 && PerformanceProfiler::GetCurTime() - start_time >= time_budget)
+				break;
+		}
+
+		numNodesPendingInvalidation = nodesPendingInvalidation.size();
+	}
+
+	if(numNodesPendingInvalidation == 0)
+		ReleaseEmptyNodeSlabs();
+}
+
+void EvaluableNodeManager::AddNodes(size_t num_new_nodes)
+{
+	size_t num_nodes = nodes.size();
+	nodes.resize(num_nodes + num_new_nodes);
+
+	while(num_new_nodes > 0)
+	{
+		if(nodeSlabs.size() == 0 || nodeSlabs.back().numNodesConstructed == nodeSlabs.back().numNodes)
+		{
+			//the storage is left unconstructed, so the platform can defer committing memory until nodes are first used
+			size_t slab_size = std::max(num_new_nodes, minNodeSlabSize);
+			nodeSlabs.push_back({ std::unique_ptr<EvaluableNodeStorage[]>(new EvaluableNodeStorage[slab_size]), slab_size, 0, 0 });
+		}
+
+		auto &slab = nodeSlabs.back();
+		size_t num_to_construct = std::min(num_new_nodes, slab.numNodes - slab.numNodesConstructed);
+		for(size_t i = 0; i < num_to_construct; i++)
+			nodes[num_nodes++] = new (&slab.storage[slab.numNodesConstructed++]) EvaluableNode();
+
+		num_new_nodes -= num_to_construct;
+	}
+}
+
+void EvaluableNodeManager::ReleaseEmptyNodeSlabs()
+{
+#ifdef MULTITHREAD_SUPPORT
+	Concurrency::WriteLock lock(managerAttributesMutex);
+#endif
+
+	//nodes pending invalidation are not in nodes, so their slabs cannot be checked until they are invalidated
+	if(numNodesPendingInvalidation > 0)
+		return;
+
+	//a slab can only be empty if there are at least as many unused nodes as it has constructed
+	size_t num_unused_nodes = nodes.size() - firstUnusedNodeIndex;
+	if(std::none_of(begin(nodeSlabs), end(nodeSlabs),
+			[num_unused_nodes](auto &slab) { return slab.numNodesConstructed <= num_unused_nodes; }))
+		return;
+
+	//order the slabs by address so the slab of each node can be found by binary search
+	std::vector<EvaluableNodeSlab *> slabs_by_address;
+	slabs_by_address.reserve(nodeSlabs.size());
+	for(auto &slab : nodeSlabs)
+	{
+		slab.numNodesInUse = 0;
+		slabs_by_address.push_back(&slab);
+	}
+	std::sort(begin(slabs_by_address), end(slabs_by_address),
+		[](EvaluableNodeSlab *a, EvaluableNodeSlab *b) { return a->storage.get() < b->storage.get(); });
+
+	auto find_slab = [&slabs_by_address](EvaluableNode *n)
+	{
+		auto storage = reinterpret_cast<EvaluableNodeStorage *>(n);
+		auto next_slab = std::upper_bound(begin(slabs_by_address), end(slabs_by_address), storage,
+			[](EvaluableNodeStorage *s, EvaluableNodeSlab *slab) { return s < slab->storage.get(); });
+		return *std::prev(next_slab);
+	};
+
+	for(size_t i = 0; i < firstUnusedNodeIndex; i++)
+		find_slab(nodes[i])->numNodesInUse++;
+
+	if(std::all_of(begin(nodeSlabs), end(nodeSlabs), [](auto &slab) { return slab.numNodesInUse > 0; }))
+		return;
+
+	//remove the slots of the empty slabs, which are all unused and hold no resources
+	auto new_end = std::remove_if(begin(nodes) + firstUnusedNodeIndex, end(nodes),
+		[&find_slab](EvaluableNode *n) { return find_slab(n)->numNodesInUse == 0; });
+	nodes.erase(new_end, end(nodes));
+
+	//keep the slabs in the order they were added
+	size_t num_slabs_kept = 0;
+	for(size_t i = 0; i < nodeSlabs.size(); i++)
+	{
+		if(nodeSlabs[i].numNodesInUse > 0)
+			std::swap(nodeSlabs[num_slabs_kept++], nodeSlabs[i]);
+	}
+	nodeSlabs.resize(num_slabs_kept);
 }
 
 void EvaluableNodeManager::FreeAllNodesExceptReferencedNodes()
@@ -313,6 +594,16 @@ void EvaluableNodeManager::FreeAllNodesExceptReferencedNodes()
 	if(nodes.size() == 0)
 		return;
 
+#ifdef MULTITHREAD_SUPPORT
+	//nodes reserved by threads are not referenced, so they will be collected
+	ClearThreadLocalAllocationBuffers(false);
+#endif
+
+	double start_time = 0.0;
+	bool defer_invalidation = (garbageCollectionPauseBudget > 0.0);
+	if(defer_invalidation)
+		start_time = PerformanceProfiler::GetCurTime();
+
 	uint8_t cur_gc_collect_iteration = 1;
 
 	//set to contain everything that is referenced
@@ -320,11 +611,19 @@ void EvaluableNodeManager::FreeAllNodesExceptReferencedNodes()
 
 	//start with a clean slate, and swap everything in use into the in-use region
 	size_t lowest_known_unused_index = firstUnusedNodeIndex;	//will store any unused nodes up here; start at what was previously known to be the max, as those above don't need to be rechecked
+	size_t prev_first_unused_node_index = lowest_known_unused_index;
 	//clear firstUnusedNodeIndex to signal to other threads that they won't need to do garbage collection
 	firstUnusedNodeIndex = 0;
 
 	//create a temporary variable for multithreading as to not use the atomic variable to slow things down
 	size_t first_unused_node_index_temp = 0;
+
+#ifdef MULTITHREAD_SUPPORT
+	if(PartitionNodesByGCCollectIterationConcurrent(lowest_known_unused_index, cur_gc_collect_iteration,
+			!defer_invalidation, first_unused_node_index_temp))
+		lowest_known_unused_index = first_unused_node_index_temp;
+#endif
+
 	while(first_unused_node_index_temp < lowest_known_unused_index)
 	{
 		//nodes can't be nullptr below firstUnusedNodeIndex
@@ -338,7 +637,7 @@ void EvaluableNodeManager::FreeAllNodesExceptReferencedNodes()
 		else //collect the node
 		{
 			//free any extra memory used, since this node is no longer needed
-			if(cur_node_ptr->GetType() != ENT_DEALLOCATED)
+			if(!defer_invalidation && cur_node_ptr->GetType() != ENT_DEALLOCATED)
 				cur_node_ptr->Invalidate();
 
 			//see if out of things to free; if so exit early
@@ -353,11 +652,38 @@ void EvaluableNodeManager::FreeAllNodesExceptReferencedNodes()
 	//assign back to the atomic variable
 	firstUnusedNodeIndex = first_unused_node_index_temp;
 
+	if(defer_invalidation)
+	{
+	#ifdef MULTITHREAD_SUPPORT
+		Concurrency::WriteLock lock(managerAttributesMutex);
+	#endif
+
+		//move the collected nodes that still need to be invalidated out of nodes so they cannot be allocated,
+		// iterating downward so the slot at the end of nodes has always been checked already
+		for(size_t i = prev_first_unused_node_index; i > first_unused_node_index_temp; i--)
+		{
+			EvaluableNode *n = nodes[i - 1];
+			if(n->GetType() == ENT_DEALLOCATED)
+				continue;
+
+			nodesPendingInvalidation.push_back(n);
+			nodes[i - 1] = nodes.back();
+			nodes.pop_back();
+		}
+		numNodesPendingInvalidation = nodesPendingInvalidation.size();
+	}
+
 	//reset garbage collection iteration as it has been counted as referenced
 	//set to contain everything that is referenced, which could be borrowed nodes from outside of the entity
 	// which is why it can't just iterate over nodes
 	SetAllReferencedNodesGCCollectIteration(0);
 
+	//free as many of the collected nodes as the budget allows
+	if(numNodesPendingInvalidation > 0)
+		InvalidatePendingNodes(start_time, garbageCollectionPauseBudget);
+	else
+		ReleaseEmptyNodeSlabs();
+
 	//update details since last garbage collection
 	executionCyclesSinceLastGarbageCollection = 0;
 }
@@ -489,12 +815,13 @@ void EvaluableNodeManager::KeepNodeReference(EvaluableNode *en)
 	if(en == nullptr)
 		return;
 
+	auto &shard = GetNodeReferenceShard(en);
 #ifdef MULTITHREAD_SUPPORT
-	Concurrency::WriteLock lock(managerAttributesMutex);
+	Concurrency::SingleLock lock(shard.mutex);
 #endif
 
 	//attempt to put in value 1 for the reference
-	auto [inserted_entry, inserted] = nodesCurrentlyReferenced.insert(std::make_pair(en, 1));
+	auto [inserted_entry, inserted] = shard.nodesReferenced.insert(std::make_pair(en, 1));
 
 	//if couldn't insert because already referenced, then increment
 	if(!inserted)
@@ -506,22 +833,23 @@ void EvaluableNodeManager::FreeNodeReference(EvaluableNode *en)
 	if(en == nullptr)
 		return;
 
+	auto &shard = GetNodeReferenceShard(en);
 #ifdef MULTITHREAD_SUPPORT
-	Concurrency::WriteLock lock(managerAttributesMutex);
+	Concurrency::SingleLock lock(shard.mutex);
 #endif
 
 	//get reference count
-	auto node = nodesCurrentlyReferenced.find(en);
+	auto node = shard.nodesReferenced.find(en);
 
 	//don't do anything if not counted
-	if(node == nodesCurrentlyReferenced.end())
+	if(node == shard.nodesReferenced.end())
 		return;
 
 	//if it has sufficient refcount, then just decrement
 	if(node->second > 1)
 		node->second--;
 	else //otherwise remove reference
-		nodesCurrentlyReferenced.erase(node);
+		shard.nodesReferenced.erase(node);
 }
 
 void EvaluableNodeManager::CompactAllocatedNodes()
@@ -541,7 +869,7 @@ void EvaluableNodeManager::CompactAllocatedNodes()
 
 	while(firstUnusedNodeIndex < lowest_known_unused_index)
 	{
-		if(nodes[firstUnusedNodeIndex] != nullptr && nodes[firstUnusedNodeIndex]->GetType() != ENT_DEALLOCATED)
+		if(nodes[firstUnusedNodeIndex]->GetType() != ENT_DEALLOCATED)
 			firstUnusedNodeIndex++;
 		else
 		{
@@ -562,10 +890,14 @@ size_t EvaluableNodeManager::GetEstimatedTotalReservedSizeInBytes()
 	Concurrency::ReadLock lock(managerAttributesMutex);
 #endif
 
-	size_t total_size = 0;
-	for(auto &a : nodes)
-		total_size += EvaluableNode::GetEstimatedNodeSizeInBytes(a);
-	
+	//nodes that are not in use hold no additional memory beyond their storage
+	size_t total_size = (nodes.size() - firstUnusedNodeIndex) * sizeof(EvaluableNode);
+	for(size_t i = 0; i < firstUnusedNodeIndex; i++)
+		total_size += EvaluableNode::GetEstimatedNodeSizeInBytes(nodes[i]);
+
+	for(auto n : nodesPendingInvalidation)
+		total_size += EvaluableNode::GetEstimatedNodeSizeInBytes(n);
+
 	return total_size;
 }
 
@@ -865,6 +1197,182 @@ void EvaluableNodeManager::SetAllReferencedNodesGCCollectIterationRecurse(Evalua
 	}	
 }
 
+#ifdef MULTITHREAD_SUPPORT
+bool EvaluableNodeManager::SetAllReferencedNodesGCCollectIterationConcurrent(uint8_t gc_collect_iteration)
+{
+	if(firstUnusedNodeIndex < minNumNodesForConcurrentGarbageCollection)
+		return false;
+
+	auto enqueue_task_lock = Concurrency::threadPool.BeginEnqueueBatchTask();
+	if(!enqueue_task_lock.AreThreadsAvailable())
+		return false;
+
+	//the referenced nodes are usually few but large, such as the root of an entity,
+	// so expand them breadth first until there are enough subtrees to balance across the threads
+	size_t num_tasks = std::max<size_t>(Concurrency::GetMaxNumThreads(), 1);
+	size_t min_num_subtrees = 64 * num_tasks;
+
+	std::vector<EvaluableNode *> subtrees;
+	IterateNodesReferenced([&subtrees, gc_collect_iteration](EvaluableNode *t, size_t count)
+		{
+			if(t == nullptr || t->GetGarbageCollectionIteration() == gc_collect_iteration)
+				return;
+
+			t->SetGarbageCollectionIteration(gc_collect_iteration);
+			subtrees.push_back(t);
+		});
+
+	std::vector<EvaluableNode *> child_subtrees;
+	while(subtrees.size() > 0 && subtrees.size() < min_num_subtrees)
+	{
+		child_subtrees.clear();
+		for(auto tree : subtrees)
+		{
+			auto mark_child = [&child_subtrees, gc_collect_iteration](EvaluableNode *e)
+			{
+				if(e == nullptr || e->GetGarbageCollectionIteration() == gc_collect_iteration)
+					return;
+
+				e->SetGarbageCollectionIteration(gc_collect_iteration);
+				child_subtrees.push_back(e);
+			};
+
+			if(tree->IsAssociativeArray())
+			{
+				for(auto &[_, e] : tree->GetMappedChildNodesReference())
+					mark_child(e);
+			}
+			else if(!tree->IsImmediate())
+			{
+				for(auto &e : tree->GetOrderedChildNodesReference())
+					mark_child(e);
+			}
+		}
+		std::swap(subtrees, child_subtrees);
+	}
+
+	size_t num_subtrees_per_task = (subtrees.size() + num_tasks - 1) / num_tasks;
+
+	std::vector<std::future<void>> tasks_completed;
+	tasks_completed.reserve(num_tasks);
+	for(size_t start_index = 0; start_index < subtrees.size(); start_index += num_subtrees_per_task)
+	{
+		size_t end_index = std::min(start_index + num_subtrees_per_task, subtrees.size());
+		tasks_completed.emplace_back(
+			Concurrency::threadPool.EnqueueBatchTask([&subtrees, start_index, end_index, gc_collect_iteration]()
+				{
+					for(size_t i = start_index; i < end_index; i++)
+						SetAllReferencedNodesGCCollectIterationConcurrentRecurse(subtrees[i], gc_collect_iteration);
+				})
+		);
+	}
+
+	enqueue_task_lock.Unlock();
+	Concurrency::threadPool.CountCurrentThreadAsPaused();
+
+	for(auto &future : tasks_completed)
+		future.wait();
+
+	Concurrency::threadPool.CountCurrentThreadAsResumed();
+
+	return true;
+}
+
+void EvaluableNodeManager::SetAllReferencedNodesGCCollectIterationConcurrentRecurse(EvaluableNode *tree, uint8_t gc_collect_iteration)
+{
+	//only the thread that sets a node's iteration traverses it
+	if(tree->IsAssociativeArray())
+	{
+		for(auto &[_, e] : tree->GetMappedChildNodesReference())
+		{
+			if(e != nullptr && e->SetGarbageCollectionIterationAtomic(gc_collect_iteration))
+				SetAllReferencedNodesGCCollectIterationConcurrentRecurse(e, gc_collect_iteration);
+		}
+	}
+	else if(!tree->IsImmediate())
+	{
+		for(auto &e : tree->GetOrderedChildNodesReference())
+		{
+			if(e != nullptr && e->SetGarbageCollectionIterationAtomic(gc_collect_iteration))
+				SetAllReferencedNodesGCCollectIterationConcurrentRecurse(e, gc_collect_iteration);
+		}
+	}
+}
+
+bool EvaluableNodeManager::PartitionNodesByGCCollectIterationConcurrent(size_t num_nodes, uint8_t gc_collect_iteration,
+	bool invalidate_unreferenced, size_t &num_referenced)
+{
+	if(num_nodes < minNumNodesForConcurrentGarbageCollection)
+		return false;
+
+	auto enqueue_task_lock = Concurrency::threadPool.BeginEnqueueBatchTask();
+	if(!enqueue_task_lock.AreThreadsAvailable())
+		return false;
+
+	size_t num_ranges = std::max<size_t>(Concurrency::GetMaxNumThreads(), 1);
+	size_t range_size = (num_nodes + num_ranges - 1) / num_ranges;
+
+	//partition each range in place, keeping the number of referenced nodes at the start of each range
+	std::vector<size_t> num_referenced_by_range(num_ranges, 0);
+	std::vector<std::future<void>> ranges_completed;
+	ranges_completed.reserve(num_ranges);
+
+	for(size_t range_index = 0; range_index < num_ranges; range_index++)
+	{
+		size_t start_index = std::min(range_index * range_size, num_nodes);
+		size_t end_index = std::min(start_index + range_size, num_nodes);
+
+		ranges_completed.emplace_back(
+			Concurrency::threadPool.EnqueueBatchTask(
+				[this, &num_referenced_by_range, range_index, start_index, end_index, gc_collect_iteration, invalidate_unreferenced]()
+				{
+					size_t first_unreferenced_index = start_index;
+					size_t lowest_known_unreferenced_index = end_index;
+					while(first_unreferenced_index < lowest_known_unreferenced_index)
+					{
+						auto &cur_node_ptr = nodes[first_unreferenced_index];
+						if(cur_node_ptr->GetGarbageCollectionIteration() == gc_collect_iteration)
+						{
+							first_unreferenced_index++;
+						}
+						else
+						{
+							if(invalidate_unreferenced && cur_node_ptr->GetType() != ENT_DEALLOCATED)
+								cur_node_ptr->Invalidate();
+
+							std::swap(cur_node_ptr, nodes[--lowest_known_unreferenced_index]);
+						}
+					}
+
+					num_referenced_by_range[range_index] = first_unreferenced_index - start_index;
+				}
+			)
+		);
+	}
+
+	enqueue_task_lock.Unlock();
+	Concurrency::threadPool.CountCurrentThreadAsPaused();
+
+	for(auto &future : ranges_completed)
+		future.wait();
+
+	Concurrency::threadPool.CountCurrentThreadAsResumed();
+
+	//pull the referenced nodes of each range down to follow those of the previous ranges;
+	// every slot between num_referenced and the current index holds an unreferenced node
+	num_referenced = num_referenced_by_range[0];
+	for(size_t range_index = 1; range_index < num_ranges; range_index++)
+	{
+		size_t start_index = std::min(range_index * range_size, num_nodes);
+		size_t end_index = start_index + num_referenced_by_range[range_index];
+		for(size_t i = start_index; i < end_index; i++)
+			std::swap(nodes[num_referenced++], nodes[i]);
+	}
+
+	return true;
+}
+#endif
+
 void EvaluableNodeManager::ValidateEvaluableNodeTreeMemoryIntegrityRecurse(EvaluableNode *en, EvaluableNode::ReferenceSetType &checked)
 {
 	auto [_, inserted] = checked.insert(en);
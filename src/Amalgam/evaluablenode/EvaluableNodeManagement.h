@@ -4,6 +4,10 @@
 #include "Concurrency.h"
 #include "EvaluableNode.h"
 
+//system headers:
+#include <array>
+#include <memory>
+
 typedef int64_t ExecutionCycleCount;
 typedef int32_t ExecutionCycleCountCompactDelta;
 
@@ -376,66 +380,40 @@ public:
 	//if no nodes are referenced, then will free all
 	inline void ClearAllNodesIfNoneReferenced()
 	{
-		if(nodesCurrentlyReferenced.size() == 0)
+		if(GetNumberOfNodesReferenced() == 0)
 			FreeAllNodes();
 	}
 
-	//adds the node to nodesCurrentlyReferenced
+	//adds the node to the references kept in nodeReferenceShards
 	void KeepNodeReference(EvaluableNode *en);
 
 	//like KeepNodeReference but iterates over a collection
 	template<typename EvaluableNodeCollection>
 	inline void KeepNodeReferences(EvaluableNodeCollection &node_collection)
 	{
-	#ifdef MULTITHREAD_SUPPORT
-		Concurrency::WriteLock lock(managerAttributesMutex);
-	#endif
-
 		for(auto en : node_collection)
-		{
-			if(en == nullptr)
-				continue;
-
-			//attempt to put in value 1 for the reference
-			auto [inserted_result, inserted] = nodesCurrentlyReferenced.insert(std::make_pair(en, 1));
-
-			//if couldn't insert because already referenced, then increment
-			if(!inserted)
-				inserted_result->second++;
-		}
+			KeepNodeReference(en);
 	}
 
-	//removes the node from nodesCurrentlyReferenced
+	//removes the node from the references kept in nodeReferenceShards
 	void FreeNodeReference(EvaluableNode *en);
 
 	//like FreeNodeReference but iterates over a collection
 	template<typename EvaluableNodeCollection>
 	inline void FreeNodeReferences(EvaluableNodeCollection &node_collection)
 	{
-	#ifdef MULTITHREAD_SUPPORT
-		Concurrency::WriteLock lock(managerAttributesMutex);
-	#endif
-
 		for(auto en : node_collection)
-		{
-			if(en == nullptr)
-				continue;
-
-			//get reference count
-			auto node = nodesCurrentlyReferenced.find(en);
-
-			//don't do anything if not counted
-			if(node == nodesCurrentlyReferenced.end())
-				continue;
-
-			//if it has sufficient refcount, then just decrement
-			if(node->second > 1)
-				node->second--;
-			else //otherwise remove reference
-				nodesCurrentlyReferenced.erase(node);
-		}
+			FreeNodeReference(en);
 	}
 
+#ifdef MULTITHREAD_SUPPORT
+	//frees the nodes the current thread has reserved from this manager but not yet allocated
+	// so that they can be reused without waiting for garbage collection
+	//should be called when a thread is done allocating from this manager, such as at the end of a task,
+	// while it still holds a lock on memoryModificationMutex
+	void ReturnThreadLocalAllocationBuffer();
+#endif
+
 	//compacts allocated nodes so that the node pool can be used more efficiently
 	// and can improve reuse without calling the more expensive FreeAllNodesExceptReferencedNodes
 	void CompactAllocatedNodes();
@@ -455,7 +433,7 @@ public:
 	#endif
 
 		//if any group of nodes on the top are ready to be cleaned up cheaply, do so
-		while(firstUnusedNodeIndex > 0 && nodes[firstUnusedNodeIndex - 1] != nullptr && nodes[firstUnusedNodeIndex - 1]->GetType() == ENT_DEALLOCATED)
+		while(firstUnusedNodeIndex > 0 && nodes[firstUnusedNodeIndex - 1]->GetType() == ENT_DEALLOCATED)
 			firstUnusedNodeIndex--;
 	}
 
@@ -466,9 +444,17 @@ public:
 	__forceinline size_t GetNumberOfUnusedNodes()
 	{	return nodes.size() - firstUnusedNodeIndex;		}
 
-	__forceinline size_t GetNumberOfNodesReferenced()
+	inline size_t GetNumberOfNodesReferenced()
 	{
-		return nodesCurrentlyReferenced.size();
+		size_t num_nodes_referenced = 0;
+		for(auto &shard : nodeReferenceShards)
+		{
+		#ifdef MULTITHREAD_SUPPORT
+			Concurrency::SingleLock lock(shard.mutex);
+		#endif
+			num_nodes_referenced += shard.nodesReferenced.size();
+		}
+		return num_nodes_referenced;
 	}
 
 	//returns the root node, implicitly defined as the first node in memory
@@ -504,9 +490,12 @@ public:
 	}
 
 	//returns a copy of the nodes referenced; should be used only for debugging
-	inline EvaluableNode::ReferenceCountType &GetNodesReferenced()
+	inline EvaluableNode::ReferenceCountType GetNodesReferenced()
 	{
-		return nodesCurrentlyReferenced;
+		EvaluableNode::ReferenceCountType nodes_referenced;
+		IterateNodesReferenced([&nodes_referenced](EvaluableNode *en, size_t count)
+			{	nodes_referenced.emplace(en, count);	});
+		return nodes_referenced;
 	}
 
 	//returns true if any node is referenced other than root, which is an indication if there are
@@ -517,7 +506,7 @@ public:
 		Concurrency::ReadLock lock(managerAttributesMutex);
 	#endif
 
-		size_t num_nodes_currently_referenced = nodesCurrentlyReferenced.size();
+		size_t num_nodes_currently_referenced = GetNumberOfNodesReferenced();
 		if(num_nodes_currently_referenced > 1)
 			return true;
 
@@ -531,7 +520,11 @@ public:
 		//in theory this should always find the root node being referenced and thus return false
 		// but if there is any sort of unusual situation where the root node isn't referenced, it'll catch it
 		// and report that there is something else being referenced
-		return (nodesCurrentlyReferenced.find(nodes[0]) == end(nodesCurrentlyReferenced));		
+		auto &shard = GetNodeReferenceShard(nodes[0]);
+	#ifdef MULTITHREAD_SUPPORT
+		Concurrency::SingleLock shard_lock(shard.mutex);
+	#endif
+		return (shard.nodesReferenced.find(nodes[0]) == end(shard.nodesReferenced));
 	}
 
 	//Returns all nodes still in use.  For debugging purposes
@@ -556,14 +549,82 @@ public:
 	ExecutionCycleCount executionCyclesSinceLastGarbageCollection;
 #endif
 
+	//maximum number of seconds each garbage collection pause should spend freeing the memory of unreferenced nodes
+	// if positive, unreferenced nodes are set aside when collected and freed a slice at a time by subsequent calls to CollectGarbage
+	// if zero, all unreferenced nodes are freed during the collection
+	static double garbageCollectionPauseBudget;
+
 protected:
 	//allocates an EvaluableNode of the respective memory type in the appropriate way
 	// returns an uninitialized EvaluableNode -- care must be taken to set fields properly
 	EvaluableNode *AllocUninitializedNode();
 
-	//frees everything execpt those nodes referenced by nodesCurrentlyReferenced
+	//frees everything execpt those nodes referenced by nodeReferenceShards
 	void FreeAllNodesExceptReferencedNodes();
 
+#ifdef MULTITHREAD_SUPPORT
+	//nodes a thread has reserved from a manager so that it can allocate them without any synchronization
+	//the reserved nodes are initialized as ENT_NULL so they are valid and counted as in use by the manager,
+	// and are returned to the manager when the buffer is released
+	struct ThreadLocalAllocationBuffer
+	{
+		//the manager the nodes were reserved from, nullptr if none
+		// atomic because a manager that is destroyed detaches the buffers of other threads
+		std::atomic<EvaluableNodeManager *> enm { nullptr };
+
+		//reserved nodes, where the next node to allocate is at the back
+		std::vector<EvaluableNode *> nodes;
+
+		//number of nodes to allocate from enm without the buffer before reserving nodes
+		size_t numNodesUntilReserving = 0;
+
+		//index of this buffer in enm->threadLocalAllocationBuffers
+		size_t registrationIndex = 0;
+	};
+
+	//allocation buffers of a thread for the few managers it most recently reserved nodes from,
+	// so that a thread alternating between managers keeps the nodes it reserved from each
+	struct ThreadLocalAllocationBufferCache
+	{
+		//releases every buffer when the thread exits
+		~ThreadLocalAllocationBufferCache();
+
+		std::array<ThreadLocalAllocationBuffer, 4> buffers;
+
+		//index of the buffer most recently allocated from, which is checked first
+		size_t lastUsedBufferIndex = 0;
+
+		//index of the buffer to release next when a buffer is needed for another manager
+		size_t nextBufferToReplace = 0;
+	};
+
+	//returns the current thread's allocation buffer for this manager with reserved nodes, reserving more if needed,
+	// taking over one of the thread's buffers if it doesn't have one for this manager
+	//returns nullptr if no nodes were reserved, either because the thread has not yet allocated enough from this manager
+	// or because there are not enough unused nodes, in which case more need to be allocated
+	ThreadLocalAllocationBuffer *RefillThreadLocalAllocationBuffer();
+
+	//returns the unused nodes of buffer to the manager it reserved them from and unregisters it from that manager
+	static void ReleaseThreadLocalAllocationBuffer(ThreadLocalAllocationBuffer &buffer);
+
+	//clears the allocation buffers of all threads that reserved nodes from this manager,
+	// leaving the nodes to be collected; if detach is true, the buffers are also detached from this manager
+	//assumes no thread is allocating from this manager
+	void ClearThreadLocalAllocationBuffers(bool detach);
+#endif
+
+	//frees nodesPendingInvalidation, returning their slots to nodes,
+	// stopping once time_budget seconds have elapsed since start_time if time_budget is positive
+	void InvalidatePendingNodes(double start_time, double time_budget);
+
+	//adds num_new_nodes slots to the end of nodes, constructing the nodes from the remaining storage of the last slab
+	// and allocating a new slab when that runs out
+	void AddNodes(size_t num_new_nodes);
+
+	//releases any slabs that contain no nodes in use, removing their slots from nodes
+	//assumes that no nodes are being allocated concurrently
+	void ReleaseEmptyNodeSlabs();
+
 	//support for FreeNodeTree, but requires that tree not be nullptr
 	void FreeNodeTreeRecurse(EvaluableNode *tree);
 
@@ -599,14 +660,19 @@ protected:
 	//sets all referenced nodes' garbage collection iteration to gc_collect_iteration
 	inline void SetAllReferencedNodesGCCollectIteration(uint8_t gc_collect_iteration)
 	{
+	#ifdef MULTITHREAD_SUPPORT
+		if(SetAllReferencedNodesGCCollectIterationConcurrent(gc_collect_iteration))
+			return;
+	#endif
+
 		//check for null or insertion before calling recursion to minimize number of branches (slight performance improvement)
-		for(auto &[t, _] : nodesCurrentlyReferenced)
-		{
-			if(t == nullptr || t->GetGarbageCollectionIteration() == gc_collect_iteration)
-				continue;
+		IterateNodesReferenced([this, gc_collect_iteration](EvaluableNode *t, size_t count)
+			{
+				if(t == nullptr || t->GetGarbageCollectionIteration() == gc_collect_iteration)
+					return;
 
-			SetAllReferencedNodesGCCollectIterationRecurse(t, gc_collect_iteration);
-		}
+				SetAllReferencedNodesGCCollectIterationRecurse(t, gc_collect_iteration);
+			});
 	}
 
 	//computes whether the code is cycle free and idempotent and updates all nodes appropriately
@@ -618,6 +684,23 @@ protected:
 	//note that tree cannot be nullptr and it should already be inserted into the references prior to calling
 	static void SetAllReferencedNodesGCCollectIterationRecurse(EvaluableNode *tree, uint8_t gc_collect_iteration);
 
+#ifdef MULTITHREAD_SUPPORT
+	//like SetAllReferencedNodesGCCollectIteration, but divides the referenced nodes among threads of the thread pool
+	//returns false without doing anything if there are too few nodes or no threads available
+	bool SetAllReferencedNodesGCCollectIterationConcurrent(uint8_t gc_collect_iteration);
+
+	//like SetAllReferencedNodesGCCollectIterationRecurse, but can be run on multiple threads concurrently
+	// tree must already have been set to gc_collect_iteration by the calling thread
+	static void SetAllReferencedNodesGCCollectIterationConcurrentRecurse(EvaluableNode *tree, uint8_t gc_collect_iteration);
+
+	//moves the nodes below num_nodes that are not set to gc_collect_iteration to the end of that range,
+	// invalidating them if invalidate_unreferenced is true, dividing the range among threads of the thread pool
+	//returns true and sets num_referenced to the number of nodes remaining at the start of the range,
+	// or returns false without doing anything if there are too few nodes or no threads available
+	bool PartitionNodesByGCCollectIterationConcurrent(size_t num_nodes, uint8_t gc_collect_iteration,
+		bool invalidate_unreferenced, size_t &num_referenced);
+#endif
+
 	static void ValidateEvaluableNodeTreeMemoryIntegrityRecurse(EvaluableNode *en, EvaluableNode::ReferenceSetType &checked);
 
 #ifdef MULTITHREAD_SUPPORT
@@ -636,14 +719,111 @@ public:
 protected:
 #endif
 
+	//number of shards the node references are split across, so that threads keeping and freeing
+	// references to different nodes rarely contend on the same lock
+#ifdef MULTITHREAD_SUPPORT
+	static constexpr size_t numNodeReferenceShards = 16;
+#else
+	static constexpr size_t numNodeReferenceShards = 1;
+#endif
+
+	//reference counts for the subset of referenced nodes whose address hashes to the shard
+	// aligned to a cache line so that threads working on different shards don't share one
+	struct alignas(64) NodeReferenceShard
+	{
+	#ifdef MULTITHREAD_SUPPORT
+		Concurrency::SingleMutex mutex;
+	#endif
+		EvaluableNode::ReferenceCountType nodesReferenced;
+	};
+
+	//returns the shard that keeps the reference count for en
+	inline NodeReferenceShard &GetNodeReferenceShard(EvaluableNode *en)
+	{
+		if constexpr(numNodeReferenceShards == 1)
+			return nodeReferenceShards[0];
+
+		//nodes are aligned, so drop the low bits and mix the rest so neighboring nodes land in different shards
+		uint64_t hash = (static_cast<uint64_t>(reinterpret_cast<uintptr_t>(en)) >> 3) * 0x9E3779B97F4A7C15ull;
+		return nodeReferenceShards[(hash >> 32) % numNodeReferenceShards];
+	}
+
+	//calls func(en, reference_count) for every node currently referenced, merging all of the shards
+	// each shard is locked while it is being iterated
+	template<typename NodeReferenceFunction>
+	inline void IterateNodesReferenced(NodeReferenceFunction func)
+	{
+		for(auto &shard : nodeReferenceShards)
+		{
+		#ifdef MULTITHREAD_SUPPORT
+			Concurrency::SingleLock lock(shard.mutex);
+		#endif
+			for(auto &[en, count] : shard.nodesReferenced)
+				func(en, count);
+		}
+	}
+
 	//keeps track of all of the nodes currently referenced by any resource or interpreter
-	EvaluableNode::ReferenceCountType nodesCurrentlyReferenced;
+	std::array<NodeReferenceShard, numNodeReferenceShards> nodeReferenceShards;
 
 	//nodes that have been allocated and may be in use
 	// all nodes in use are below firstUnusedNodeIndex, such that all above that index are free for use
-	// nodes cannot be nullptr for lower indices than firstUnusedNodeIndex
+	//every slot points to a constructed node in one of the slabs in nodeSlabs; nodes at or above firstUnusedNodeIndex
+	// are either ENT_DEALLOCATED or ENT_UNINITIALIZED, so they hold no resources
 	std::vector<EvaluableNode *> nodes;
 
+	//storage for a single node, which is only constructed when the node is first needed
+	struct alignas(EvaluableNode) EvaluableNodeStorage
+	{
+		uint8_t data[sizeof(EvaluableNode)];
+	};
+
+	//contiguous block of storage for nodes, so that nodes allocated together are near each other in memory
+	// and the platform allocator is called once per slab rather than once per node
+	struct EvaluableNodeSlab
+	{
+		std::unique_ptr<EvaluableNodeStorage[]> storage;
+		size_t numNodes;
+
+		//number of nodes at the start of storage that have been constructed and given slots in nodes
+		size_t numNodesConstructed;
+
+		//number of nodes of the slab that were in use when the slabs were last checked after garbage collection
+		size_t numNodesInUse;
+	};
+
+	//slabs backing every slot in nodes, in the order they were added, so only the last can have unconstructed storage
+	std::vector<EvaluableNodeSlab> nodeSlabs;
+
+	//unreferenced nodes that have been collected but not yet invalidated; they have been removed from nodes
+	// so they cannot be allocated, and their slots are returned to nodes once they are invalidated
+	std::vector<EvaluableNode *> nodesPendingInvalidation;
+
+	//number of nodes in nodesPendingInvalidation, so it can be checked without a lock
+#ifdef MULTITHREAD_SUPPORT
+	std::atomic<size_t> numNodesPendingInvalidation;
+#else
+	size_t numNodesPendingInvalidation;
+#endif
+
+#ifdef MULTITHREAD_SUPPORT
+	//allocation buffers of the current thread
+	thread_local static ThreadLocalAllocationBufferCache threadLocalAllocationBufferCache;
+
+	//allocation buffers of all threads that currently have nodes reserved from this manager
+	std::vector<ThreadLocalAllocationBuffer *> threadLocalAllocationBuffers;
+
+	//mutex for threadLocalAllocationBuffers and the nodes of the buffers in it
+	Concurrency::SingleMutex threadLocalAllocationBuffersMutex;
+
+	//mutex held while a buffer is released from or detached by a manager other than the one the thread is allocating from,
+	// so that the manager cannot be destroyed while it is in use
+	static Concurrency::SingleMutex threadLocalAllocationBufferLifetimeMutex;
+
+	//number of nodes a thread reserves at a time
+	static const size_t threadLocalAllocationBufferSize;
+#endif
+
 #ifdef MULTITHREAD_SUPPORT
 	std::atomic<size_t> firstUnusedNodeIndex;
 #else
@@ -653,6 +833,14 @@ protected:
 	//extra space to allocate when allocating
 	static const double allocExpansionFactor;
 
+	//minimum number of nodes of storage to allocate at once, so that small managers don't allocate many tiny slabs
+	static const size_t minNodeSlabSize;
+
 	//minimum number of cycles between collects as to not spend too much time garbage collecting
 	static const ExecutionCycleCountCompactDelta minCycleCountBetweenGarbageCollects;
+
+#ifdef MULTITHREAD_SUPPORT
+	//minimum number of nodes in use for garbage collection to be divided among threads
+	static const size_t minNumNodesForConcurrentGarbageCollection;
+#endif
 };
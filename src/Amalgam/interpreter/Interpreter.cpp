@@ -851,6 +851,7 @@ bool Interpreter::InterpretEvaluableNodesConcurrently(EvaluableNode *parent_node
 						concurrency_manager.GetCallStackWriteMutex());
 
 					evaluableNodeManager->KeepNodeReference(result);
+					evaluableNodeManager->ReturnThreadLocalAllocationBuffer();
 					interpreter.memoryModificationLock.unlock();
 					return result;
 				}
@@ -389,6 +389,8 @@ protected:
 
 						enm->KeepNodeReference(result);
 
+						//return any nodes reserved by this thread while the lock still prevents garbage collection
+						enm->ReturnThreadLocalAllocationBuffer();
 						interpreter->memoryModificationLock.unlock();
 						return result;
 					}
@@ -172,6 +172,68 @@ EvaluableNodeReference Interpreter::InterpretNode_ENT_SYSTEM(EvaluableNode *en)
 
 		return EvaluableNodeReference(evaluableNodeManager->AllocNode(ENT_STRING, GetEntityMemorySizeDiagnostics(curEntity)), true);
 	}
+	else if(command == "gc_pause_budget")
+	{
+		//if a parameter is specified, set the budget, otherwise return the current budget
+		if(ocn.size() > 1)
+		{
+			double budget = InterpretNodeIntoNumberValue(ocn[1]);
+			if(FastIsNaN(budget) || budget < 0.0)
+				budget = 0.0;
+			EvaluableNodeManager::garbageCollectionPauseBudget = budget;
+			return EvaluableNodeReference::Null();
+		}
+
+		return EvaluableNodeReference(evaluableNodeManager->AllocNode(EvaluableNodeManager::garbageCollectionPauseBudget), true);
+	}
+	else if(command == "explain_queries")
+	{
+		//if a parameter is specified, enable or disable recording explanations
+		if(ocn.size() > 1)
+		{
+			EntityQueryManager::explainQueries = InterpretNodeIntoBoolValue(ocn[1]);
+			EntityQueryManager::queryExplanation.Clear();
+			return EvaluableNodeReference::Null();
+		}
+
+		//return the explanation of the most recent query on this thread
+		auto &explanation = EntityQueryManager::queryExplanation;
+		if(!explanation.HasExplanation())
+			return EvaluableNodeReference::Null();
+
+		return explanation.ToEvaluableNode(evaluableNodeManager);
+	}
+	else if(command == "prewarm_query_labels" && ocn.size() > 2)
+	{
+		EvaluableNodeReference id_path = InterpretNodeForImmediateUse(ocn[1]);
+		EntityReadReference container;
+		if(id_path == nullptr)
+			container = EntityReadReference(curEntity);
+		else
+			container = TraverseToExistingEntityReadReferenceViaEvaluableNodeIDPath(curEntity, id_path);
+		evaluableNodeManager->FreeNodeTreeIfPossible(id_path);
+
+		if(container == nullptr)
+			return EvaluableNodeReference::Null();
+
+		std::vector<StringInternPool::StringID> label_ids;
+		EvaluableNodeReference labels = InterpretNodeForImmediateUse(ocn[2]);
+		if(labels != nullptr)
+		{
+			for(auto &label : labels->GetOrderedChildNodes())
+			{
+				//labels that are not interned strings cannot be on any entity, so there is nothing to build
+				auto label_id = EvaluableNode::ToStringIDIfExists(label);
+				if(label_id != string_intern_pool.NOT_A_STRING_ID)
+					label_ids.push_back(label_id);
+			}
+		}
+		evaluableNodeManager->FreeNodeTreeIfPossible(labels);
+
+		//the read reference keeps the contained entities from being added or removed while the labels are built
+		EntityQueryManager::PrewarmLabels(container, label_ids);
+		return EvaluableNodeReference::Null();
+	}
 	else if(command == "rand" && ocn.size() > 1)
 	{
 		double num_bytes_raw = InterpretNodeIntoNumberValue(ocn[1]);
@@ -370,6 +432,7 @@ EvaluableNodeReference Interpreter::InterpretNode_ENT_PARALLEL(EvaluableNode *en
 							interpreter.evaluableNodeManager->FreeNodeTreeIfPossible(result);
 							result.reference = EvaluableNodeReference::Null();
 
+							interpreter.evaluableNodeManager->ReturnThreadLocalAllocationBuffer();
 							interpreter.memoryModificationLock.unlock();
 							return result;
 						}
@@ -1863,7 +1926,7 @@ void Interpreter::ValidateEvaluableNodeIntegrity()
 	if(curEntity != nullptr)
 		EvaluableNodeManager::ValidateEvaluableNodeTreeMemoryIntegrity(curEntity->GetRoot());
 
-	auto &nodes_referenced = evaluableNodeManager->GetNodesReferenced();
+	auto nodes_referenced = evaluableNodeManager->GetNodesReferenced();
 	for(auto &[en, _] : nodes_referenced)
 		EvaluableNodeManager::ValidateEvaluableNodeTreeMemoryIntegrity(en);
 
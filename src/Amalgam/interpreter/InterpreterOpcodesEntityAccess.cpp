@@ -148,7 +148,14 @@ EvaluableNodeReference Interpreter::InterpretNode_ENT_CONTAINED_ENTITIES_and_COM
 		return EvaluableNodeReference::Null();
 
 	//perform query
-	return EntityQueryManager::GetEntitiesMatchingQuery(source_entity, conditionsBuffer, evaluableNodeManager, return_query_value);
+	if(!EntityQueryManager::explainQueries)
+		return EntityQueryManager::GetEntitiesMatchingQuery(source_entity, conditionsBuffer, evaluableNodeManager, return_query_value);
+
+	auto &explanation = EntityQueryManager::queryExplanation;
+	explanation.Begin(source_entity->GetNumContainedEntities());
+	EvaluableNodeReference result = EntityQueryManager::GetEntitiesMatchingQuery(source_entity, conditionsBuffer, evaluableNodeManager, return_query_value);
+	explanation.End(result);
+	return result;
 }
 
 EvaluableNodeReference Interpreter::InterpretNode_ENT_QUERY_and_COMPUTE_opcodes(EvaluableNode *en)
@@ -4,6 +4,7 @@
 #include "RandomStream.h"
 
 //system headers:
+#include <algorithm>
 #include <limits>
 #include <map>
 #include <vector>
@@ -99,6 +100,22 @@ size_t WeightedDiscreteRandomSample(ContainerType &probabilities, RandomStream &
 	return selected_element - 1;
 }
 
+//like WeightedDiscreteRandomSample, but takes the running sums of the normalized probabilities, which must be nondecreasing,
+// and finds the index with a binary search instead of a linear scan, returning the same index for the same random value
+// requires that cumulative_probabilities be non-empty
+template<typename ContainerType>
+size_t WeightedDiscreteRandomSampleFromCumulativeProbabilities(ContainerType &cumulative_probabilities, RandomStream &rs)
+{
+	double r = rs.Rand();
+	auto found = std::lower_bound(std::begin(cumulative_probabilities), std::end(cumulative_probabilities), r);
+
+	//should only make it here when the numerical precision is off (i.e., didn't add up to 1 exactly)
+	if(found == std::end(cumulative_probabilities))
+		return cumulative_probabilities.size() - 1;
+
+	return static_cast<size_t>(found - std::begin(cumulative_probabilities));
+}
+
 //Will return a random index, weighted by the values in probabilities based on the specified RandomStream
 // if normalize is true, then it will normalize the probabilities in place
 // requires that probabilities_map be non-empty